@@ -12,12 +12,15 @@
 // CONDITIONS OF ANY KIND, either express or implied. See the License for the
 // specific language governing permissions and limitations under the License.
 
+#include <algorithm>
 #include <float.h>
+#include <math.h>
 #include <stdio.h>
 #include <string.h>
+#include <string>
+#include <vector>
 
 #ifdef _WIN32
-#include <algorithm>
 #include <windows.h> // Sleep()
 #else
 #include <unistd.h> // sleep()
@@ -50,9 +53,34 @@ public:
 static int g_warmup_loop_count = 8;
 static int g_loop_count = 4;
 static bool g_enable_cooling_down = true;
+static int g_instances = 1;
+
+// 0=text 1=json 2=csv
+static int g_output_format = 0;
+static int g_output_count = 0;
+
+// per model results recorded or compared against, one file holds all configs
+struct baseline_entry
+{
+    std::string name;
+    std::string config;
+    int loop_count;
+    double time_avg;
+    double time_stddev;
+};
+
+static const char* g_baseline_path = 0;
+static char g_baseline_config[256];
+static float g_regression_threshold = 0.05f;
+static std::vector<baseline_entry> g_baseline_entries;
+static bool g_baseline_dirty = false;
+static int g_regression_count = 0;
 
 static ncnn::UnlockedPoolAllocator g_blob_pool_allocator;
+static ncnn::PoolAllocator g_blob_locked_pool_allocator;
 static ncnn::PoolAllocator g_workspace_pool_allocator;
+static ncnn::ThreadLocalPoolAllocator g_workspace_thread_local_pool_allocator;
+static bool g_thread_local_workspace = false;
 
 #if NCNN_VULKAN
 static ncnn::VulkanDevice* g_vkdev = 0;
@@ -60,12 +88,319 @@ static ncnn::VkAllocator* g_blob_vkallocator = 0;
 static ncnn::VkAllocator* g_staging_vkallocator = 0;
 #endif // NCNN_VULKAN
 
+struct benchmark_result
+{
+    double time_min;
+    double time_max;
+    double time_avg;
+    double time_p50;
+    double time_p90;
+    double time_p99;
+    double time_p999;
+    double time_stddev;
+
+    // concurrent instances on the shared net, zero if not measured
+    double throughput;
+    double efficiency;
+};
+
+// nearest-rank percentile of sorted times
+static double percentile(const std::vector<double>& sorted_times, double p)
+{
+    int n = (int)sorted_times.size();
+    int i = (int)ceil(p * n) - 1;
+    i = std::min(std::max(i, 0), n - 1);
+    return sorted_times[i];
+}
+
+static void print_result(const char* comment, const benchmark_result& r)
+{
+    if (g_output_format == 1)
+    {
+        fprintf(stdout, "%s\n  {\"name\": \"%s\", \"loop_count\": %d, \"min\": %.3f, \"max\": %.3f, \"avg\": %.3f, \"p50\": %.3f, \"p90\": %.3f, \"p99\": %.3f, \"p999\": %.3f, \"instances\": %d, \"throughput\": %.3f, \"efficiency\": %.3f}",
+                g_output_count == 0 ? "[" : ",", comment, g_loop_count, r.time_min, r.time_max, r.time_avg, r.time_p50, r.time_p90, r.time_p99, r.time_p999, g_instances, r.throughput, r.efficiency);
+    }
+    else if (g_output_format == 2)
+    {
+        if (g_output_count == 0)
+        {
+            fprintf(stdout, "name,loop_count,min,max,avg,p50,p90,p99,p999,instances,throughput,efficiency\n");
+        }
+        fprintf(stdout, "%s,%d,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,%d,%.3f,%.3f\n",
+                comment, g_loop_count, r.time_min, r.time_max, r.time_avg, r.time_p50, r.time_p90, r.time_p99, r.time_p999, g_instances, r.throughput, r.efficiency);
+    }
+    else if (g_instances > 1)
+    {
+        fprintf(stderr, "%20s  min = %7.2f  max = %7.2f  avg = %7.2f  p50 = %7.2f  p90 = %7.2f  p99 = %7.2f  p999 = %7.2f  fps = %7.2f  efficiency = %5.2f\n",
+                comment, r.time_min, r.time_max, r.time_avg, r.time_p50, r.time_p90, r.time_p99, r.time_p999, r.throughput, r.efficiency);
+    }
+    else
+    {
+        fprintf(stderr, "%20s  min = %7.2f  max = %7.2f  avg = %7.2f  p50 = %7.2f  p90 = %7.2f  p99 = %7.2f  p999 = %7.2f\n",
+                comment, r.time_min, r.time_max, r.time_avg, r.time_p50, r.time_p90, r.time_p99, r.time_p999);
+    }
+
+    fflush(stdout);
+
+    g_output_count++;
+}
+
+static int load_baseline(const char* path)
+{
+    FILE* fp = fopen(path, "rb");
+    if (!fp)
+        return -1;
+
+    // name<TAB>config<TAB>loop_count avg stddev
+    char line[1024];
+    while (fgets(line, sizeof(line), fp))
+    {
+        char* tab0 = strchr(line, '\t');
+        char* tab1 = tab0 ? strchr(tab0 + 1, '\t') : 0;
+        if (!tab1)
+            continue;
+
+        *tab0 = '\0';
+        *tab1 = '\0';
+
+        baseline_entry e;
+        e.name = line;
+        e.config = tab0 + 1;
+        if (sscanf(tab1 + 1, "%d %lf %lf", &e.loop_count, &e.time_avg, &e.time_stddev) != 3)
+            continue;
+
+        g_baseline_entries.push_back(e);
+    }
+
+    fclose(fp);
+
+    return 0;
+}
+
+static int save_baseline(const char* path)
+{
+    FILE* fp = fopen(path, "wb");
+    if (!fp)
+    {
+        fprintf(stderr, "fopen %s failed\n", path);
+        return -1;
+    }
+
+    for (size_t i = 0; i < g_baseline_entries.size(); i++)
+    {
+        const baseline_entry& e = g_baseline_entries[i];
+        fprintf(fp, "%s\t%s\t%d %.6f %.6f\n", e.name.c_str(), e.config.c_str(), e.loop_count, e.time_avg, e.time_stddev);
+    }
+
+    fclose(fp);
+
+    return 0;
+}
+
+// one-sided 95% critical value of student t
+static double t_critical(double df)
+{
+    static const double table[30] = {
+        6.314, 2.920, 2.353, 2.132, 2.015, 1.943, 1.895, 1.860, 1.833, 1.812,
+        1.796, 1.782, 1.771, 1.761, 1.753, 1.746, 1.740, 1.734, 1.729, 1.725,
+        1.721, 1.717, 1.714, 1.711, 1.708, 1.706, 1.703, 1.701, 1.699, 1.697
+    };
+
+    int i = (int)df;
+    if (i < 1)
+        return table[0];
+    if (i > 30)
+        return 1.645;
+    return table[i - 1];
+}
+
+// welch t-test of the mean latency against the baseline
+static void compare_baseline(const char* comment, const benchmark_result& r)
+{
+    for (size_t i = 0; i < g_baseline_entries.size(); i++)
+    {
+        const baseline_entry& e = g_baseline_entries[i];
+        if (e.name != comment || e.config != g_baseline_config)
+            continue;
+
+        const double v0 = e.time_stddev * e.time_stddev / e.loop_count;
+        const double v1 = r.time_stddev * r.time_stddev / g_loop_count;
+        const double diff = r.time_avg - e.time_avg;
+        const double change = diff / e.time_avg;
+
+        // no variance at all makes any difference significant
+        bool significant = diff > 0;
+        double t = 0;
+        if (v0 + v1 > 0)
+        {
+            t = diff / sqrt(v0 + v1);
+
+            // welch-satterthwaite degrees of freedom
+            double df = 1;
+            if (e.loop_count > 1 && g_loop_count > 1)
+                df = (v0 + v1) * (v0 + v1) / (v0 * v0 / (e.loop_count - 1) + v1 * v1 / (g_loop_count - 1));
+
+            significant = t > t_critical(df);
+        }
+
+        const bool regression = significant && change > g_regression_threshold;
+        if (regression)
+            g_regression_count++;
+
+        fprintf(stderr, "%20s  baseline = %7.2f  change = %+6.1f%%  t = %6.2f  %s\n", comment, e.time_avg, change * 100, t, regression ? "REGRESSION" : "ok");
+        return;
+    }
+
+    // first run of this model and config
+    baseline_entry e;
+    e.name = comment;
+    e.config = g_baseline_config;
+    e.loop_count = g_loop_count;
+    e.time_avg = r.time_avg;
+    e.time_stddev = r.time_stddev;
+    g_baseline_entries.push_back(e);
+    g_baseline_dirty = true;
+
+    fprintf(stderr, "%20s  baseline recorded\n", comment);
+}
+
+#if NCNN_THREADS
+struct instance_context
+{
+    const ncnn::Net* net;
+    const ncnn::Mat* in;
+    int num_threads;
+    bool branch_parallel;
+
+    // all instances start timing together after their warmup
+    ncnn::Mutex* lock;
+    ncnn::ConditionVariable* condition;
+    int* ready_count;
+
+    double start;
+    double end;
+};
+
+static void* instance_worker(void* args)
+{
+    instance_context* ctx = (instance_context*)args;
+
+    const ncnn::Net& net = *ctx->net;
+    const char* input_name = net.input_names()[0];
+    const char* output_name = net.output_names()[0];
+
+    // every instance owns its allocators
+    ncnn::UnlockedPoolAllocator blob_pool_allocator;
+    ncnn::PoolAllocator blob_locked_pool_allocator;
+    ncnn::PoolAllocator workspace_pool_allocator;
+    ncnn::ThreadLocalPoolAllocator workspace_thread_local_pool_allocator;
+    blob_pool_allocator.set_size_compare_ratio(0.0f);
+    blob_locked_pool_allocator.set_size_compare_ratio(0.0f);
+    workspace_pool_allocator.set_size_compare_ratio(0.5f);
+    workspace_thread_local_pool_allocator.set_size_compare_ratio(0.5f);
+
+    ncnn::Allocator* blob_allocator = ctx->branch_parallel ? (ncnn::Allocator*)&blob_locked_pool_allocator : (ncnn::Allocator*)&blob_pool_allocator;
+    ncnn::Allocator* workspace_allocator = g_thread_local_workspace ? (ncnn::Allocator*)&workspace_thread_local_pool_allocator : (ncnn::Allocator*)&workspace_pool_allocator;
+
+#if NCNN_VULKAN
+    ncnn::VkAllocator* blob_vkallocator = 0;
+    ncnn::VkAllocator* staging_vkallocator = 0;
+    if (net.opt.use_vulkan_compute)
+    {
+        blob_vkallocator = new ncnn::VkBlobAllocator(g_vkdev);
+        staging_vkallocator = new ncnn::VkStagingAllocator(g_vkdev);
+    }
+#endif // NCNN_VULKAN
+
+    ncnn::Mat out;
+    for (int i = 0; i < g_warmup_loop_count + g_loop_count; i++)
+    {
+        if (i == g_warmup_loop_count)
+        {
+            ctx->lock->lock();
+            (*ctx->ready_count)--;
+            if (*ctx->ready_count == 0)
+                ctx->condition->broadcast();
+            while (*ctx->ready_count != 0)
+                ctx->condition->wait(*ctx->lock);
+            ctx->lock->unlock();
+
+            ctx->start = ncnn::get_current_time();
+        }
+
+        ncnn::Extractor ex = net.create_extractor();
+        ex.set_num_threads(ctx->num_threads);
+        ex.set_blob_allocator(blob_allocator);
+        ex.set_workspace_allocator(workspace_allocator);
+#if NCNN_VULKAN
+        if (net.opt.use_vulkan_compute)
+        {
+            ex.set_blob_vkallocator(blob_vkallocator);
+            ex.set_workspace_vkallocator(blob_vkallocator);
+            ex.set_staging_vkallocator(staging_vkallocator);
+        }
+#endif // NCNN_VULKAN
+        ex.input(input_name, *ctx->in);
+        ex.extract(output_name, out);
+    }
+
+    ctx->end = ncnn::get_current_time();
+
+#if NCNN_VULKAN
+    delete blob_vkallocator;
+    delete staging_vkallocator;
+#endif // NCNN_VULKAN
+
+    return 0;
+}
+
+// run g_instances extractors concurrently, return inferences per second
+static double benchmark_instances(const ncnn::Net& net, const ncnn::Mat& in, const ncnn::Option& opt)
+{
+    ncnn::Mutex lock;
+    ncnn::ConditionVariable condition;
+    int ready_count = g_instances;
+
+    std::vector<instance_context> contexts(g_instances);
+    std::vector<ncnn::Thread*> threads(g_instances);
+    for (int i = 0; i < g_instances; i++)
+    {
+        instance_context& ctx = contexts[i];
+        ctx.net = &net;
+        ctx.in = &in;
+        ctx.num_threads = opt.num_threads;
+        ctx.branch_parallel = opt.use_branch_parallel;
+        ctx.lock = &lock;
+        ctx.condition = &condition;
+        ctx.ready_count = &ready_count;
+        ctx.start = 0;
+        ctx.end = 0;
+
+        threads[i] = new ncnn::Thread(instance_worker, (void*)&ctx);
+    }
+
+    double start = DBL_MAX;
+    double end = -DBL_MAX;
+    for (int i = 0; i < g_instances; i++)
+    {
+        threads[i]->join();
+        delete threads[i];
+
+        start = std::min(start, contexts[i].start);
+        end = std::max(end, contexts[i].end);
+    }
+
+    return g_instances * g_loop_count * 1000.0 / (end - start);
+}
+#endif // NCNN_THREADS
+
 void benchmark(const char* comment, const ncnn::Mat& _in, const ncnn::Option& opt)
 {
     ncnn::Mat in = _in;
     in.fill(0.01f);
 
     g_blob_pool_allocator.clear();
+    g_blob_locked_pool_allocator.clear();
     g_workspace_pool_allocator.clear();
 
 #if NCNN_VULKAN
@@ -130,9 +465,7 @@ void benchmark(const char* comment, const ncnn::Mat& _in, const ncnn::Option& op
         ex.extract(output_names[0], out);
     }
 
-    double time_min = DBL_MAX;
-    double time_max = -DBL_MAX;
-    double time_avg = 0;
+    std::vector<double> times(g_loop_count);
 
     for (int i = 0; i < g_loop_count; i++)
     {
@@ -146,16 +479,50 @@ void benchmark(const char* comment, const ncnn::Mat& _in, const ncnn::Option& op
 
         double end = ncnn::get_current_time();
 
-        double time = end - start;
+        times[i] = end - start;
+    }
 
-        time_min = std::min(time_min, time);
-        time_max = std::max(time_max, time);
-        time_avg += time;
+    benchmark_result r;
+    r.time_avg = 0;
+    for (int i = 0; i < g_loop_count; i++)
+    {
+        r.time_avg += times[i];
     }
+    r.time_avg /= g_loop_count;
 
-    time_avg /= g_loop_count;
+    // sample standard deviation
+    r.time_stddev = 0;
+    for (int i = 0; i < g_loop_count; i++)
+    {
+        r.time_stddev += (times[i] - r.time_avg) * (times[i] - r.time_avg);
+    }
+    r.time_stddev = g_loop_count > 1 ? sqrt(r.time_stddev / (g_loop_count - 1)) : 0;
+
+    std::sort(times.begin(), times.end());
+    r.time_min = times[0];
+    r.time_max = times[g_loop_count - 1];
+    r.time_p50 = percentile(times, 0.5);
+    r.time_p90 = percentile(times, 0.9);
+    r.time_p99 = percentile(times, 0.99);
+    r.time_p999 = percentile(times, 0.999);
+
+    r.throughput = 0;
+    r.efficiency = 0;
+#if NCNN_THREADS
+    if (g_instances > 1)
+    {
+        // ideal scaling keeps every instance at the single instance latency
+        r.throughput = benchmark_instances(net, in, opt);
+        r.efficiency = r.throughput / (g_instances * 1000.0 / r.time_avg);
+    }
+#endif // NCNN_THREADS
+
+    print_result(comment, r);
 
-    fprintf(stderr, "%20s  min = %7.2f  max = %7.2f  avg = %7.2f\n", comment, time_min, time_max, time_avg);
+    if (g_baseline_path)
+    {
+        compare_baseline(comment, r);
+    }
 }
 
 int main(int argc, char** argv)
@@ -165,6 +532,12 @@ int main(int argc, char** argv)
     int powersave = 0;
     int gpu_device = -1;
     int cooling_down = 1;
+    int branch_parallel = 0;
+    int instances = 1;
+    const char* output_format = "text";
+    const char* baseline = "-";
+    float regression_threshold = 5.f;
+    int thread_local_workspace = 0;
 
     if (argc >= 2)
     {
@@ -186,6 +559,56 @@ int main(int argc, char** argv)
     {
         cooling_down = atoi(argv[5]);
     }
+    if (argc >= 7)
+    {
+        branch_parallel = atoi(argv[6]);
+    }
+    if (argc >= 8)
+    {
+        instances = atoi(argv[7]);
+    }
+    if (argc >= 9)
+    {
+        output_format = argv[8];
+    }
+    if (argc >= 10)
+    {
+        baseline = argv[9];
+    }
+    if (argc >= 11)
+    {
+        regression_threshold = (float)atof(argv[10]);
+    }
+    if (argc >= 12)
+    {
+        thread_local_workspace = atoi(argv[11]);
+    }
+
+    if (strcmp(output_format, "text") == 0)
+    {
+        g_output_format = 0;
+    }
+    else if (strcmp(output_format, "json") == 0)
+    {
+        g_output_format = 1;
+    }
+    else if (strcmp(output_format, "csv") == 0)
+    {
+        g_output_format = 2;
+    }
+    else
+    {
+        fprintf(stderr, "unknown output format %s, expect text json or csv\n", output_format);
+        return -1;
+    }
+
+#if !NCNN_THREADS
+    if (instances > 1)
+    {
+        fprintf(stderr, "concurrent instances need NCNN_THREADS, fallback to 1\n");
+        instances = 1;
+    }
+#endif
 
 #ifdef __EMSCRIPTEN__
     EM_ASM(
@@ -197,10 +620,16 @@ int main(int argc, char** argv)
 
     g_enable_cooling_down = cooling_down != 0;
 
-    g_loop_count = loop_count;
+    g_loop_count = std::max(loop_count, 1);
+
+    g_instances = std::max(instances, 1);
+
+    g_thread_local_workspace = thread_local_workspace != 0;
 
     g_blob_pool_allocator.set_size_compare_ratio(0.0f);
+    g_blob_locked_pool_allocator.set_size_compare_ratio(0.0f);
     g_workspace_pool_allocator.set_size_compare_ratio(0.5f);
+    g_workspace_thread_local_pool_allocator.set_size_compare_ratio(0.5f);
 
 #if NCNN_VULKAN
     if (use_vulkan_compute)
@@ -218,8 +647,9 @@ int main(int argc, char** argv)
     ncnn::Option opt;
     opt.lightmode = true;
     opt.num_threads = num_threads;
-    opt.blob_allocator = &g_blob_pool_allocator;
-    opt.workspace_allocator = &g_workspace_pool_allocator;
+    // concurrent branches share the blob allocator
+    opt.blob_allocator = branch_parallel ? (ncnn::Allocator*)&g_blob_locked_pool_allocator : (ncnn::Allocator*)&g_blob_pool_allocator;
+    opt.workspace_allocator = g_thread_local_workspace ? (ncnn::Allocator*)&g_workspace_thread_local_pool_allocator : (ncnn::Allocator*)&g_workspace_pool_allocator;
 #if NCNN_VULKAN
     opt.blob_vkallocator = g_blob_vkallocator;
     opt.workspace_vkallocator = g_blob_vkallocator;
@@ -237,6 +667,7 @@ int main(int argc, char** argv)
     opt.use_packing_layout = true;
     opt.use_shader_pack8 = false;
     opt.use_image_storage = false;
+    opt.use_branch_parallel = branch_parallel != 0;
 
     ncnn::set_cpu_powersave(powersave);
 
@@ -248,6 +679,28 @@ int main(int argc, char** argv)
     fprintf(stderr, "powersave = %d\n", ncnn::get_cpu_powersave());
     fprintf(stderr, "gpu_device = %d\n", gpu_device);
     fprintf(stderr, "cooling_down = %d\n", (int)g_enable_cooling_down);
+    fprintf(stderr, "branch_parallel = %d\n", branch_parallel);
+    fprintf(stderr, "instances = %d\n", g_instances);
+    fprintf(stderr, "thread_local_workspace = %d\n", (int)g_thread_local_workspace);
+
+    if (strcmp(baseline, "-") != 0)
+    {
+        g_baseline_path = baseline;
+        g_regression_threshold = regression_threshold / 100.f;
+
+        // results are only comparable under the same settings
+        sprintf(g_baseline_config, "threads=%d powersave=%d gpu=%d branch_parallel=%d instances=%d", num_threads, ncnn::get_cpu_powersave(), gpu_device, branch_parallel, g_instances);
+        if (g_thread_local_workspace)
+        {
+            // keep the settings of baselines recorded with the default pool unchanged
+            strcat(g_baseline_config, " thread_local_workspace=1");
+        }
+
+        load_baseline(g_baseline_path);
+
+        fprintf(stderr, "baseline = %s\n", g_baseline_path);
+        fprintf(stderr, "regression_threshold = %.1f%%\n", regression_threshold);
+    }
 
     // run
     benchmark("squeezenet", ncnn::Mat(227, 227, 3), opt);
@@ -321,10 +774,26 @@ int main(int argc, char** argv)
     benchmark("vision_transformer", ncnn::Mat(384, 384, 3), opt);
 
     benchmark("FastestDet", ncnn::Mat(352, 352, 3), opt);
+
+    if (g_output_format == 1 && g_output_count > 0)
+    {
+        fprintf(stdout, "\n]\n");
+    }
+
+    if (g_baseline_path)
+    {
+        if (g_baseline_dirty)
+        {
+            save_baseline(g_baseline_path);
+        }
+
+        fprintf(stderr, "%d regressions beyond %.1f%%\n", g_regression_count, regression_threshold);
+    }
+
 #if NCNN_VULKAN
     delete g_blob_vkallocator;
     delete g_staging_vkallocator;
 #endif // NCNN_VULKAN
 
-    return 0;
+    return g_regression_count > 0 ? 1 : 0;
 }
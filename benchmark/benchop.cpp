@@ -0,0 +1,624 @@
+// Tencent is pleased to support the open source community by making ncnn available.
+//
+// Copyright (C) 2023 THL A29 Limited, a Tencent company. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this file except
+// in compliance with the License. You may obtain a copy of the License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software distributed
+// under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+// CONDITIONS OF ANY KIND, either express or implied. See the License for the
+// specific language governing permissions and limitations under the License.
+
+// time every distinct (layer type, params, input shape) of the benchmark models in isolation
+
+#include <algorithm>
+#include <float.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include "benchmark.h"
+#include "cpu.h"
+#include "datareader.h"
+#include "layer.h"
+#include "net.h"
+
+class DataReaderFromEmpty : public ncnn::DataReader
+{
+public:
+    virtual int scan(const char* format, void* p) const
+    {
+        return 0;
+    }
+    virtual size_t read(void* buf, size_t size) const
+    {
+        memset(buf, 0, size);
+        return size;
+    }
+};
+
+struct blob_shape
+{
+    std::string name;
+    int dims;
+    int w;
+    int h;
+    int c;
+};
+
+// one distinct operator found in the models
+struct op_entry
+{
+    std::string type;
+    std::string params;
+    std::vector<blob_shape> bottom_shapes;
+    int top_count;
+
+    // occurrences over all models
+    int count;
+    std::string model;
+};
+
+struct option_variant
+{
+    const char* name;
+    bool use_packing_layout;
+    bool use_sgemm_convolution;
+    bool use_winograd_convolution;
+    bool use_winograd23_convolution;
+    bool use_winograd43_convolution;
+    bool use_winograd63_convolution;
+    bool use_int8_inference;
+    bool use_bf16_storage;
+
+    // 0=all layers 1=convolution only 2=layers quantized to int8
+    int applies_to;
+};
+
+static const option_variant g_variants[] = {
+    {"default", true, true, true, true, true, true, true, false, 0},
+    {"nopack", false, true, true, true, true, true, true, false, 0},
+    {"bf16", true, true, true, true, true, true, true, true, 0},
+    {"noint8", true, true, true, true, true, true, false, false, 2},
+    {"direct", true, false, false, true, true, true, true, false, 1},
+    {"sgemm", true, true, false, true, true, true, true, false, 1},
+    {"winograd23", true, true, true, true, false, false, true, false, 1},
+    {"winograd43", true, true, true, false, true, false, true, false, 1},
+    {"winograd63", true, true, true, false, false, true, true, false, 1},
+};
+
+static int g_warmup_loop_count = 4;
+static int g_loop_count = 8;
+
+static const blob_shape* find_blob_shape(const std::vector<blob_shape>& shapes, const char* name)
+{
+    for (size_t i = 0; i < shapes.size(); i++)
+    {
+        if (shapes[i].name == name)
+            return &shapes[i];
+    }
+
+    return 0;
+}
+
+// top shapes from the -23330 hint, return the number of shapes
+static int parse_shape_hints(const char* params, const std::vector<std::string>& tops, std::vector<blob_shape>& shapes)
+{
+    const char* p = strstr(params, "-23330=");
+    if (!p)
+        return 0;
+
+    p += 7;
+
+    int count = 0;
+    int nconsumed = 0;
+    if (sscanf(p, "%d%n", &count, &nconsumed) != 1)
+        return 0;
+    p += nconsumed;
+
+    std::vector<int> values;
+    for (int i = 0; i < count; i++)
+    {
+        int v = 0;
+        if (sscanf(p, ",%d%n", &v, &nconsumed) != 1)
+            return 0;
+        p += nconsumed;
+        values.push_back(v);
+    }
+
+    int shape_count = std::min((int)tops.size(), count / 4);
+    for (int i = 0; i < shape_count; i++)
+    {
+        blob_shape s;
+        s.name = tops[i];
+        s.dims = values[i * 4];
+        s.w = values[i * 4 + 1];
+        s.h = values[i * 4 + 2];
+        s.c = values[i * 4 + 3];
+        shapes.push_back(s);
+    }
+
+    return shape_count;
+}
+
+static std::string shape_string(const std::vector<blob_shape>& shapes)
+{
+    std::string str;
+    for (size_t i = 0; i < shapes.size(); i++)
+    {
+        const blob_shape& s = shapes[i];
+
+        char buf[64];
+        if (s.dims == 1) sprintf(buf, "%s[%d]", i == 0 ? "" : ",", s.w);
+        if (s.dims == 2) sprintf(buf, "%s[%d,%d]", i == 0 ? "" : ",", s.w, s.h);
+        if (s.dims == 3) sprintf(buf, "%s[%d,%d,%d]", i == 0 ? "" : ",", s.w, s.h, s.c);
+        str += buf;
+    }
+
+    return str;
+}
+
+// bottom shapes of every layer from one profiled run, for models without shape hints
+static int run_shapes(const char* parampath, int w, int h, int c, std::vector<std::vector<blob_shape> >& layer_bottom_shapes)
+{
+    ncnn::Net net;
+    net.opt.use_vulkan_compute = false;
+
+    // storage shape is the logical shape without packing
+    net.opt.use_packing_layout = false;
+    net.opt.use_fp16_storage = false;
+    net.opt.use_bf16_storage = false;
+
+    if (net.load_param(parampath) != 0)
+        return -1;
+
+    DataReaderFromEmpty dr;
+    if (net.load_model(dr) != 0)
+        return -1;
+
+    ncnn::Mat in(w, h, c);
+    in.fill(0.01f);
+
+    ncnn::Extractor ex = net.create_extractor();
+    ex.set_profiling(true);
+    ex.input(net.input_indexes()[0], in);
+
+    ncnn::Mat out;
+    if (ex.extract(net.output_indexes()[0], out) != 0)
+        return -1;
+
+    layer_bottom_shapes.resize(net.layers().size());
+
+    const std::vector<ncnn::LayerProfile>& records = ex.profile_records();
+    for (size_t i = 0; i < records.size(); i++)
+    {
+        const ncnn::LayerProfile& record = records[i];
+
+        std::vector<blob_shape>& shapes = layer_bottom_shapes[record.layer_index];
+        shapes.resize(record.bottom_shapes.size());
+        for (size_t j = 0; j < record.bottom_shapes.size(); j++)
+        {
+            const ncnn::Mat& m = record.bottom_shapes[j];
+            shapes[j].dims = m.dims;
+            shapes[j].w = m.w;
+            shapes[j].h = m.h;
+            shapes[j].c = m.c;
+        }
+    }
+
+    return 0;
+}
+
+// collect distinct operators with known input shapes from one param file
+// input shapes come from the -23330 hints, or from a run with the given input when w is not zero
+static int collect_ops(const char* parampath, int w, int h, int c, const char* type_filter, std::vector<op_entry>& ops)
+{
+    std::vector<std::vector<blob_shape> > layer_bottom_shapes;
+    if (w != 0 && run_shapes(parampath, w, h, c, layer_bottom_shapes) != 0)
+    {
+        fprintf(stderr, "run %s failed\n", parampath);
+        return -1;
+    }
+
+    FILE* fp = fopen(parampath, "rb");
+    if (!fp)
+    {
+        fprintf(stderr, "fopen %s failed\n", parampath);
+        return -1;
+    }
+
+    char line[16384];
+
+    // magic and counts
+    if (!fgets(line, sizeof(line), fp) || !fgets(line, sizeof(line), fp))
+    {
+        fclose(fp);
+        return -1;
+    }
+
+    std::vector<blob_shape> shapes;
+
+    for (int layer_index = 0; fgets(line, sizeof(line), fp); layer_index++)
+    {
+        line[strcspn(line, "\r\n")] = '\0';
+
+        char type[256];
+        char name[256];
+        int bottom_count = 0;
+        int top_count = 0;
+        int nconsumed = 0;
+        if (sscanf(line, "%255s %255s %d %d%n", type, name, &bottom_count, &top_count, &nconsumed) != 4)
+            continue;
+
+        const char* p = line + nconsumed;
+
+        std::vector<std::string> bottoms;
+        std::vector<std::string> tops;
+        for (int i = 0; i < bottom_count + top_count; i++)
+        {
+            char blob[256];
+            if (sscanf(p, "%255s%n", blob, &nconsumed) != 1)
+                break;
+            p += nconsumed;
+
+            if (i < bottom_count)
+                bottoms.push_back(blob);
+            else
+                tops.push_back(blob);
+        }
+
+        while (*p == ' ')
+            p++;
+
+        parse_shape_hints(p, tops, shapes);
+
+        // nothing to compute
+        if (bottom_count == 0 || strcmp(type, "Split") == 0)
+            continue;
+
+        if (strcmp(type_filter, "all") != 0 && strcmp(type_filter, type) != 0)
+            continue;
+
+        std::vector<blob_shape> bottom_shapes;
+        if (w != 0)
+        {
+            // layers not on the path to the first output have no record
+            if (layer_index < (int)layer_bottom_shapes.size())
+                bottom_shapes = layer_bottom_shapes[layer_index];
+        }
+        else
+        {
+            for (int i = 0; i < bottom_count; i++)
+            {
+                const blob_shape* s = find_blob_shape(shapes, bottoms[i].c_str());
+                if (!s)
+                    break;
+
+                bottom_shapes.push_back(*s);
+            }
+        }
+
+        // operators need the input shapes from the hints
+        if ((int)bottom_shapes.size() != bottom_count)
+            continue;
+
+        const std::string shape = shape_string(bottom_shapes);
+
+        bool found = false;
+        for (size_t i = 0; i < ops.size(); i++)
+        {
+            op_entry& op = ops[i];
+            if (op.type == type && op.params == p && shape_string(op.bottom_shapes) == shape)
+            {
+                op.count++;
+                found = true;
+                break;
+            }
+        }
+
+        if (!found)
+        {
+            op_entry op;
+            op.type = type;
+            op.params = p;
+            op.bottom_shapes = bottom_shapes;
+            op.top_count = top_count;
+            op.count = 1;
+            op.model = parampath;
+            ops.push_back(op);
+        }
+    }
+
+    fclose(fp);
+
+    return 0;
+}
+
+// same input layout conversion as Net does before the layer
+static void convert_layout(ncnn::Mat& m, const ncnn::Layer* layer, const ncnn::Option& opt)
+{
+#if NCNN_BF16
+    if (opt.use_bf16_storage && layer->support_bf16_storage)
+    {
+        ncnn::Mat m_bf16;
+        ncnn::cast_float32_to_bfloat16(m, m_bf16, opt);
+        m = m_bf16;
+    }
+#endif // NCNN_BF16
+
+    if (!opt.use_packing_layout || !layer->support_packing)
+        return;
+
+    int elemcount = 0;
+    if (m.dims == 1) elemcount = m.elempack * m.w;
+    if (m.dims == 2) elemcount = m.elempack * m.h;
+    if (m.dims == 3 || m.dims == 4) elemcount = m.elempack * m.c;
+
+    int dst_elempack = 1;
+    if (m.elembits() == 32)
+    {
+#if NCNN_AVX512
+        if (elemcount % 16 == 0 && ncnn::cpu_support_x86_avx512())
+            dst_elempack = 16;
+        else if (elemcount % 8 == 0 && ncnn::cpu_support_x86_avx())
+            dst_elempack = 8;
+        else if (elemcount % 4 == 0)
+            dst_elempack = 4;
+#elif NCNN_AVX
+        if (elemcount % 8 == 0 && ncnn::cpu_support_x86_avx())
+            dst_elempack = 8;
+        else if (elemcount % 4 == 0)
+            dst_elempack = 4;
+#elif NCNN_RVV
+        const int packn = ncnn::cpu_riscv_vlenb() / 4;
+        if (elemcount % packn == 0)
+            dst_elempack = packn;
+#else
+        if (elemcount % 4 == 0)
+            dst_elempack = 4;
+#endif
+    }
+    if (m.elembits() == 16)
+    {
+#if NCNN_RVV
+        const int packn = ncnn::cpu_riscv_vlenb() / 2;
+        if (elemcount % packn == 0)
+            dst_elempack = packn;
+#else
+        if (elemcount % 4 == 0)
+            dst_elempack = 4;
+#endif
+    }
+
+    if (m.elempack != dst_elempack)
+    {
+        ncnn::Mat m_packed;
+        ncnn::convert_packing(m, m_packed, dst_elempack, opt);
+        m = m_packed;
+    }
+}
+
+// time one operator under one option variant, return 0 if success
+static int benchmark_op(const op_entry& op, const option_variant& v, int num_threads, double& time_min, double& time_avg)
+{
+    const int bottom_count = (int)op.bottom_shapes.size();
+
+    // inputs followed by the operator, input shape hints reach the operator bottom_shapes
+    std::string param = "7767517\n";
+    {
+        char buf[256];
+        sprintf(buf, "%d %d\n", bottom_count + 1, bottom_count + op.top_count);
+        param += buf;
+
+        for (int i = 0; i < bottom_count; i++)
+        {
+            const blob_shape& s = op.bottom_shapes[i];
+            sprintf(buf, "Input in%d 0 1 in%d 0=%d 1=%d 2=%d -23330=4,%d,%d,%d,%d\n", i, i, s.w, s.h, s.c, s.dims, s.w, s.h, s.c);
+            param += buf;
+        }
+
+        sprintf(buf, "%s op %d %d", op.type.c_str(), bottom_count, op.top_count);
+        param += buf;
+        for (int i = 0; i < bottom_count; i++)
+        {
+            sprintf(buf, " in%d", i);
+            param += buf;
+        }
+        for (int i = 0; i < op.top_count; i++)
+        {
+            sprintf(buf, " out%d", i);
+            param += buf;
+        }
+        param += " ";
+        param += op.params;
+        param += "\n";
+    }
+
+    ncnn::UnlockedPoolAllocator blob_pool_allocator;
+    ncnn::PoolAllocator workspace_pool_allocator;
+    blob_pool_allocator.set_size_compare_ratio(0.f);
+    workspace_pool_allocator.set_size_compare_ratio(0.5f);
+
+    ncnn::Net net;
+    net.opt.lightmode = true;
+    net.opt.num_threads = num_threads;
+    net.opt.blob_allocator = &blob_pool_allocator;
+    net.opt.workspace_allocator = &workspace_pool_allocator;
+    net.opt.use_vulkan_compute = false;
+    net.opt.use_packing_layout = v.use_packing_layout;
+    net.opt.use_sgemm_convolution = v.use_sgemm_convolution;
+    net.opt.use_winograd_convolution = v.use_winograd_convolution;
+    net.opt.use_winograd23_convolution = v.use_winograd23_convolution;
+    net.opt.use_winograd43_convolution = v.use_winograd43_convolution;
+    net.opt.use_winograd63_convolution = v.use_winograd63_convolution;
+    net.opt.use_int8_inference = v.use_int8_inference;
+    net.opt.use_int8_storage = v.use_int8_inference;
+    net.opt.use_int8_arithmetic = v.use_int8_inference;
+    net.opt.use_bf16_storage = v.use_bf16_storage;
+    net.opt.use_fp16_packed = false;
+    net.opt.use_fp16_storage = false;
+    net.opt.use_fp16_arithmetic = false;
+
+    if (net.load_param_mem(param.c_str()) != 0)
+        return -1;
+
+    DataReaderFromEmpty dr;
+    if (net.load_model(dr) != 0)
+        return -1;
+
+    const ncnn::Layer* layer = net.layers()[bottom_count];
+
+    const ncnn::Option& opt = net.opt;
+
+    std::vector<ncnn::Mat> bottom_blobs(bottom_count);
+    for (int i = 0; i < bottom_count; i++)
+    {
+        const blob_shape& s = op.bottom_shapes[i];
+        if (s.dims == 1) bottom_blobs[i].create(s.w);
+        if (s.dims == 2) bottom_blobs[i].create(s.w, s.h);
+        if (s.dims == 3) bottom_blobs[i].create(s.w, s.h, s.c);
+        if (bottom_blobs[i].empty())
+            return -1;
+
+        bottom_blobs[i].fill(0.01f);
+
+        convert_layout(bottom_blobs[i], layer, opt);
+    }
+
+    if (layer->one_blob_only && bottom_count != 1)
+        return -1;
+
+    time_min = DBL_MAX;
+    time_avg = 0;
+    for (int i = 0; i < g_warmup_loop_count + g_loop_count; i++)
+    {
+        // inplace operators consume a fresh copy, the copy is not timed
+        std::vector<ncnn::Mat> blobs(bottom_count);
+        for (int j = 0; j < bottom_count; j++)
+        {
+            blobs[j] = layer->support_inplace ? bottom_blobs[j].clone(opt.blob_allocator) : bottom_blobs[j];
+        }
+
+        std::vector<ncnn::Mat> top_blobs(op.top_count);
+
+        double start = ncnn::get_current_time();
+
+        int ret = 0;
+        if (layer->one_blob_only && layer->support_inplace)
+            ret = layer->forward_inplace(blobs[0], opt);
+        else if (layer->one_blob_only)
+            ret = layer->forward(blobs[0], top_blobs[0], opt);
+        else if (layer->support_inplace)
+            ret = layer->forward_inplace(blobs, opt);
+        else
+            ret = layer->forward(blobs, top_blobs, opt);
+
+        double end = ncnn::get_current_time();
+
+        if (ret != 0)
+            return -1;
+
+        if (i < g_warmup_loop_count)
+            continue;
+
+        time_min = std::min(time_min, end - start);
+        time_avg += end - start;
+    }
+
+    time_avg /= g_loop_count;
+
+    return 0;
+}
+
+static bool variant_applies(const option_variant& v, const op_entry& op)
+{
+    if (v.applies_to == 1)
+        return op.type == "Convolution";
+
+    // int8_scale_term is param 8 of these layers
+    if (v.applies_to == 2)
+        return (op.type == "Convolution" || op.type == "ConvolutionDepthWise" || op.type == "InnerProduct") && (op.params.find(" 8=") != std::string::npos || op.params.find("8=") == 0);
+
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 5)
+    {
+        fprintf(stderr, "usage: %s [loop count] [max threads] [layer type] [ncnnparam[:w,h,c]]...\n", argv[0]);
+        fprintf(stderr, "  layer type - all or one type such as Convolution\n");
+        fprintf(stderr, "  w,h,c      - input shape, required for models without -23330 shape hints\n");
+        return -1;
+    }
+
+    g_loop_count = std::max(atoi(argv[1]), 1);
+    const int max_threads = std::max(atoi(argv[2]), 1);
+    const char* type_filter = argv[3];
+
+    std::vector<op_entry> ops;
+    for (int i = 4; i < argc; i++)
+    {
+        char parampath[256];
+        int w = 0;
+        int h = 0;
+        int c = 0;
+        if (sscanf(argv[i], "%255[^:]:%d,%d,%d", parampath, &w, &h, &c) < 1)
+            continue;
+
+        collect_ops(parampath, w, h, c, type_filter, ops);
+    }
+
+    // 1 2 4 ... and max threads
+    std::vector<int> thread_counts;
+    for (int t = 1; t < max_threads; t *= 2)
+    {
+        thread_counts.push_back(t);
+    }
+    thread_counts.push_back(max_threads);
+
+    ncnn::set_omp_dynamic(0);
+
+    fprintf(stderr, "loop_count = %d\n", g_loop_count);
+    fprintf(stderr, "max_threads = %d\n", max_threads);
+    fprintf(stderr, "%d distinct operators\n", (int)ops.size());
+
+    fprintf(stdout, "type,params,input,count,model,variant,threads,min,avg\n");
+
+    for (size_t i = 0; i < ops.size(); i++)
+    {
+        const op_entry& op = ops[i];
+        const std::string shape = shape_string(op.bottom_shapes);
+
+        for (size_t j = 0; j < sizeof(g_variants) / sizeof(g_variants[0]); j++)
+        {
+            const option_variant& v = g_variants[j];
+            if (!variant_applies(v, op))
+                continue;
+
+            for (size_t k = 0; k < thread_counts.size(); k++)
+            {
+                const int num_threads = thread_counts[k];
+                ncnn::set_omp_num_threads(num_threads);
+
+                double time_min = 0;
+                double time_avg = 0;
+                if (benchmark_op(op, v, num_threads, time_min, time_avg) != 0)
+                {
+                    fprintf(stderr, "%s %s %s failed\n", op.type.c_str(), shape.c_str(), v.name);
+                    break;
+                }
+
+                fprintf(stdout, "%s,\"%s\",\"%s\",%d,%s,%s,%d,%.4f,%.4f\n", op.type.c_str(), op.params.c_str(), shape.c_str(), op.count, op.model.c_str(), v.name, num_threads, time_min, time_avg);
+                fflush(stdout);
+            }
+        }
+    }
+
+    return 0;
+}
@@ -21,43 +21,476 @@
 #include <android/hardware_buffer.h>
 #endif // __ANDROID_API__ >= 26
 
+#if defined __linux__
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#endif
+
 namespace ncnn {
 
 Allocator::~Allocator()
 {
 }
 
-class PoolAllocatorPrivate
+void* fastMalloc_hugepage(size_t size)
+{
+#if defined __linux__ && defined MADV_HUGEPAGE && _POSIX_C_SOURCE >= 200112L
+    if (size < NCNN_HUGEPAGE_SIZE)
+        return fastMalloc(size);
+
+    void* ptr = 0;
+    if (posix_memalign(&ptr, NCNN_HUGEPAGE_SIZE, size + NCNN_MALLOC_OVERREAD))
+        return 0;
+
+    // the tail shorter than one huge page stays on regular pages
+    madvise(ptr, size & ~(size_t)(NCNN_HUGEPAGE_SIZE - 1), MADV_HUGEPAGE);
+
+    return ptr;
+#else
+    return fastMalloc(size);
+#endif
+}
+
+static ThreadLocalStorage tls_hugepage_allocation;
+
+void set_thread_hugepage_allocation(bool enabled)
+{
+    tls_hugepage_allocation.set(enabled ? (void*)1 : 0);
+}
+
+bool get_thread_hugepage_allocation()
+{
+    return tls_hugepage_allocation.get() != 0;
+}
+
+size_t get_hugepage_usage()
+{
+#if defined __linux__
+    // smaps_rollup needs linux 4.14, sum up smaps otherwise
+    FILE* fp = fopen("/proc/self/smaps_rollup", "rb");
+    if (!fp)
+        fp = fopen("/proc/self/smaps", "rb");
+    if (!fp)
+        return 0;
+
+    size_t usage_kb = 0;
+
+    char line[256];
+    while (fgets(line, 256, fp))
+    {
+        // AnonHugePages Shared_Hugetlb Private_Hugetlb
+        unsigned long kb = 0;
+        if (sscanf(line, "AnonHugePages: %lu kB", &kb) == 1
+                || sscanf(line, "Shared_Hugetlb: %lu kB", &kb) == 1
+                || sscanf(line, "Private_Hugetlb: %lu kB", &kb) == 1)
+        {
+            usage_kb += kb;
+        }
+    }
+
+    fclose(fp);
+
+    return usage_kb * 1024;
+#else
+    return 0;
+#endif
+}
+
+// every pool block starts with this header in front of the returned pointer
+struct pool_block_header
+{
+    size_t size;
+    pool_block_header* next;
+    const void* owner;
+    size_t magic;
+
+    // mapped length for hugetlbfs blocks, 0 for fastMalloc blocks
+    size_t hugetlb_size;
+
+    // bytes allocated from hugetlbfs or advised to transparent huge pages
+    size_t hugepage_size;
+
+#if NCNN_STDIO
+    // every block of the pool, walked for the blocks still in use at destruction
+    pool_block_header* all_prev;
+    pool_block_header* all_next;
+#endif
+};
+
+// hugetlbfs pages are reserved by the administrator, use them unless rounding up wastes more than 1/8
+static pool_block_header* pool_block_malloc(size_t size, bool use_hugepage)
+{
+    pool_block_header* block = 0;
+    size_t hugetlb_size = 0;
+    size_t hugepage_size = 0;
+
+    if (use_hugepage && size >= NCNN_HUGEPAGE_SIZE)
+    {
+#if defined __linux__ && defined MAP_HUGETLB
+        hugetlb_size = alignSize(size + NCNN_MALLOC_OVERREAD, NCNN_HUGEPAGE_SIZE);
+        if (hugetlb_size - size <= size / 8)
+        {
+            void* ptr = mmap(0, hugetlb_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+            if (ptr != MAP_FAILED)
+                block = (pool_block_header*)ptr;
+        }
+#endif
+
+        if (block)
+        {
+            hugepage_size = hugetlb_size;
+        }
+        else
+        {
+            hugetlb_size = 0;
+            block = (pool_block_header*)fastMalloc_hugepage(size);
+#if defined __linux__ && defined MADV_HUGEPAGE
+            hugepage_size = size & ~(size_t)(NCNN_HUGEPAGE_SIZE - 1);
+#endif
+        }
+    }
+    else
+    {
+        block = (pool_block_header*)fastMalloc(size);
+    }
+
+    if (!block)
+        return 0;
+
+    block->hugetlb_size = hugetlb_size;
+    block->hugepage_size = hugepage_size;
+    return block;
+}
+
+static void pool_block_free(pool_block_header* block)
+{
+    block->magic = 0;
+
+#if defined __linux__ && defined MAP_HUGETLB
+    if (block->hugetlb_size)
+    {
+        munmap(block, block->hugetlb_size);
+        return;
+    }
+#endif
+
+    ncnn::fastFree(block);
+}
+
+static const size_t POOL_BLOCK_MAGIC = 0x4e434e4e; // NCNN
+static const int POOL_BLOCK_HEADER_SIZE = (int)((sizeof(pool_block_header) + NCNN_MALLOC_ALIGN - 1) & -NCNN_MALLOC_ALIGN);
+
+// four size classes per power of two, blocks below 256 bytes share class 0
+#define POOL_BIN_COUNT 224
+
+// bins are peeked without their lock to skip empty classes, and only written under it
+static NCNN_FORCEINLINE pool_block_header* pool_bin_load(pool_block_header* const* bin)
+{
+#if defined __GNUC__
+    return __atomic_load_n(bin, __ATOMIC_RELAXED);
+#else
+    return *(pool_block_header* const volatile*)bin;
+#endif
+}
+
+static NCNN_FORCEINLINE void pool_bin_store(pool_block_header** bin, pool_block_header* block)
+{
+#if defined __GNUC__
+    __atomic_store_n(bin, block, __ATOMIC_RELAXED);
+#else
+    *(pool_block_header* volatile*)bin = block;
+#endif
+}
+
+static int pool_size_class(size_t size)
+{
+    if (size < 256)
+        return 0;
+
+    int log2 = 0;
+    while ((size >> log2) > 1)
+        log2++;
+
+    const int sub = (int)((size >> (log2 - 2)) & 3);
+
+    const int c = (log2 - 8) * 4 + sub;
+
+    return c < POOL_BIN_COUNT ? c : POOL_BIN_COUNT - 1;
+}
+
+// budgets binned by size class, each bin is a free list with its own lock
+// payouts are found in O(1) through the block header
+class PoolAllocatorBins
 {
 public:
-    Mutex budgets_lock;
-    Mutex payouts_lock;
+    PoolAllocatorBins(bool locked);
+    ~PoolAllocatorBins();
+
+    void* fastMalloc(size_t size);
+
+    // return 0 if ptr was handed out by this pool
+    int fastFree(void* ptr);
+
+    void clear();
+
+    void get_statistics(PoolAllocatorStatistics& stat) const;
+
+    // print the blocks still handed out, call after clear
+    void log_payouts() const;
+
     unsigned int size_compare_ratio; // 0~256
-    std::list<std::pair<size_t, void*> > budgets;
-    std::list<std::pair<size_t, void*> > payouts;
+
+    bool use_hugepage;
+
+    int payout_count;
+
+private:
+    void lock(int i) const;
+    void unlock(int i) const;
+
+    pool_block_header* bins[POOL_BIN_COUNT];
+
+    // null for the unlocked pool
+    Mutex* bin_locks;
+
+#if NCNN_STDIO
+    // all blocks, guarded by all_blocks_lock for the locked pool
+    pool_block_header* all_blocks;
+    Mutex all_blocks_lock;
+#endif
+
+    int hit_count;
+    int miss_count;
+
+    // in KB
+    int hugepage_kb;
 };
 
-PoolAllocator::PoolAllocator()
-    : Allocator(), d(new PoolAllocatorPrivate)
+PoolAllocatorBins::PoolAllocatorBins(bool locked)
 {
-    d->size_compare_ratio = 192; // 0.75f * 256
+    size_compare_ratio = 192; // 0.75f * 256
+    use_hugepage = false;
+    payout_count = 0;
+    hit_count = 0;
+    miss_count = 0;
+    hugepage_kb = 0;
+
+    for (int i = 0; i < POOL_BIN_COUNT; i++)
+    {
+        bins[i] = 0;
+    }
+
+    bin_locks = locked ? new Mutex[POOL_BIN_COUNT] : 0;
+
+#if NCNN_STDIO
+    all_blocks = 0;
+#endif
 }
 
-PoolAllocator::~PoolAllocator()
+PoolAllocatorBins::~PoolAllocatorBins()
 {
     clear();
 
-    if (!d->payouts.empty())
+    delete[] bin_locks;
+}
+
+void PoolAllocatorBins::lock(int i) const
+{
+    if (bin_locks)
+        bin_locks[i].lock();
+}
+
+void PoolAllocatorBins::unlock(int i) const
+{
+    if (bin_locks)
+        bin_locks[i].unlock();
+}
+
+void* PoolAllocatorBins::fastMalloc(size_t size)
+{
+    // budgets between size and size / size_compare_ratio are reusable
+    const int class_begin = pool_size_class(size);
+    int class_end = POOL_BIN_COUNT - 1;
+    if (size_compare_ratio != 0 && size <= (size_t)-1 / 256)
     {
-        NCNN_LOGE("FATAL ERROR! pool allocator destroyed too early");
+        class_end = pool_size_class(size * 256 / size_compare_ratio);
+    }
+
+    for (int i = class_begin; i <= class_end; i++)
+    {
+        if (!pool_bin_load(&bins[i]))
+            continue;
+
+        lock(i);
+
+        pool_block_header* prev = 0;
+        pool_block_header* block = bins[i];
+        for (; block; prev = block, block = block->next)
+        {
+            size_t bs = block->size;
+
+            // size_compare_ratio ~ 100%
+            if (bs >= size && ((bs * size_compare_ratio) >> 8) <= size)
+                break;
+        }
+
+        if (block)
+        {
+            if (prev)
+                prev->next = block->next;
+            else
+                pool_bin_store(&bins[i], block->next);
+        }
+
+        unlock(i);
+
+        if (block)
+        {
+            block->next = 0;
+            NCNN_XADD(&hit_count, 1);
+            NCNN_XADD(&payout_count, 1);
+            return (unsigned char*)block + POOL_BLOCK_HEADER_SIZE;
+        }
+    }
+
+    // new
+    pool_block_header* block = pool_block_malloc(size + POOL_BLOCK_HEADER_SIZE, use_hugepage);
+    if (!block)
+        return 0;
+
+    NCNN_XADD(&hugepage_kb, (int)(block->hugepage_size / 1024));
+
+    block->size = size;
+    block->next = 0;
+    block->owner = this;
+    block->magic = POOL_BLOCK_MAGIC;
+
 #if NCNN_STDIO
-        std::list<std::pair<size_t, void*> >::iterator it = d->payouts.begin();
-        for (; it != d->payouts.end(); ++it)
+    if (bin_locks)
+        all_blocks_lock.lock();
+    block->all_prev = 0;
+    block->all_next = all_blocks;
+    if (all_blocks)
+        all_blocks->all_prev = block;
+    all_blocks = block;
+    if (bin_locks)
+        all_blocks_lock.unlock();
+#endif
+
+    NCNN_XADD(&miss_count, 1);
+    NCNN_XADD(&payout_count, 1);
+    return (unsigned char*)block + POOL_BLOCK_HEADER_SIZE;
+}
+
+int PoolAllocatorBins::fastFree(void* ptr)
+{
+    pool_block_header* block = (pool_block_header*)((unsigned char*)ptr - POOL_BLOCK_HEADER_SIZE);
+    if (block->owner != this || block->magic != POOL_BLOCK_MAGIC)
+        return -1;
+
+    // return to budgets, the latest freed block is reused first
+    const int i = pool_size_class(block->size);
+
+    lock(i);
+    block->next = bins[i];
+    pool_bin_store(&bins[i], block);
+    unlock(i);
+
+    NCNN_XADD(&payout_count, -1);
+    return 0;
+}
+
+void PoolAllocatorBins::clear()
+{
+    for (int i = 0; i < POOL_BIN_COUNT; i++)
+    {
+        lock(i);
+        pool_block_header* block = bins[i];
+        pool_bin_store(&bins[i], 0);
+        unlock(i);
+
+        while (block)
+        {
+            pool_block_header* next = block->next;
+            NCNN_XADD(&hugepage_kb, -(int)(block->hugepage_size / 1024));
+
+#if NCNN_STDIO
+            if (bin_locks)
+                all_blocks_lock.lock();
+            if (block->all_prev)
+                block->all_prev->all_next = block->all_next;
+            else
+                all_blocks = block->all_next;
+            if (block->all_next)
+                block->all_next->all_prev = block->all_prev;
+            if (bin_locks)
+                all_blocks_lock.unlock();
+#endif
+
+            pool_block_free(block);
+            block = next;
+        }
+    }
+}
+
+void PoolAllocatorBins::get_statistics(PoolAllocatorStatistics& stat) const
+{
+    stat.hit_count = hit_count;
+    stat.miss_count = miss_count;
+    stat.payout_count = payout_count;
+    stat.budget_count = 0;
+    stat.budget_size = 0;
+    stat.hugepage_size = (size_t)hugepage_kb * 1024;
+
+    for (int i = 0; i < POOL_BIN_COUNT; i++)
+    {
+        if (!pool_bin_load(&bins[i]))
+            continue;
+
+        lock(i);
+        for (const pool_block_header* block = bins[i]; block; block = block->next)
         {
-            void* ptr = it->second;
-            NCNN_LOGE("%p still in use", ptr);
+            stat.budget_count++;
+            stat.budget_size += block->size;
         }
+        unlock(i);
+    }
+}
+
+void PoolAllocatorBins::log_payouts() const
+{
+#if NCNN_STDIO
+    // no budget is left after clear, the remaining blocks are payouts
+    for (const pool_block_header* block = all_blocks; block; block = block->all_next)
+    {
+        NCNN_LOGE("%p still in use", (const unsigned char*)block + POOL_BLOCK_HEADER_SIZE);
+    }
 #endif
+}
+
+class PoolAllocatorPrivate : public PoolAllocatorBins
+{
+public:
+    PoolAllocatorPrivate()
+        : PoolAllocatorBins(true)
+    {
+    }
+};
+
+PoolAllocator::PoolAllocator()
+    : Allocator(), d(new PoolAllocatorPrivate)
+{
+}
+
+PoolAllocator::~PoolAllocator()
+{
+    clear();
+
+    if (d->payout_count != 0)
+    {
+        NCNN_LOGE("FATAL ERROR! pool allocator destroyed too early, %d blocks still in use", d->payout_count);
+        d->log_payouts();
     }
 
     delete d;
@@ -75,17 +508,7 @@ PoolAllocator& PoolAllocator::operator=(const PoolAllocator&)
 
 void PoolAllocator::clear()
 {
-    d->budgets_lock.lock();
-
-    std::list<std::pair<size_t, void*> >::iterator it = d->budgets.begin();
-    for (; it != d->budgets.end(); ++it)
-    {
-        void* ptr = it->second;
-        ncnn::fastFree(ptr);
-    }
-    d->budgets.clear();
-
-    d->budgets_lock.unlock();
+    d->clear();
 }
 
 void PoolAllocator::set_size_compare_ratio(float scr)
@@ -99,137 +522,259 @@ void PoolAllocator::set_size_compare_ratio(float scr)
     d->size_compare_ratio = (unsigned int)(scr * 256);
 }
 
+void PoolAllocator::set_use_hugepage(bool use_hugepage)
+{
+    d->use_hugepage = use_hugepage;
+}
+
+void PoolAllocator::get_statistics(PoolAllocatorStatistics& stat) const
+{
+    d->get_statistics(stat);
+}
+
 void* PoolAllocator::fastMalloc(size_t size)
 {
-    d->budgets_lock.lock();
+    return d->fastMalloc(size);
+}
 
-    // find free budget
-    std::list<std::pair<size_t, void*> >::iterator it = d->budgets.begin();
-    for (; it != d->budgets.end(); ++it)
+void PoolAllocator::fastFree(void* ptr)
+{
+    if (!ptr)
+        return;
+
+    if (d->fastFree(ptr) != 0)
     {
-        size_t bs = it->first;
+        NCNN_LOGE("FATAL ERROR! pool allocator get wild %p", ptr);
+        ncnn::fastFree(ptr);
+    }
+}
 
-        // size_compare_ratio ~ 100%
-        if (bs >= size && ((bs * d->size_compare_ratio) >> 8) <= size)
-        {
-            void* ptr = it->second;
+class UnlockedPoolAllocatorPrivate : public PoolAllocatorBins
+{
+public:
+    UnlockedPoolAllocatorPrivate()
+        : PoolAllocatorBins(false)
+    {
+    }
+};
 
-            d->budgets.erase(it);
+UnlockedPoolAllocator::UnlockedPoolAllocator()
+    : Allocator(), d(new UnlockedPoolAllocatorPrivate)
+{
+}
 
-            d->budgets_lock.unlock();
+UnlockedPoolAllocator::~UnlockedPoolAllocator()
+{
+    clear();
 
-            d->payouts_lock.lock();
+    if (d->payout_count != 0)
+    {
+        NCNN_LOGE("FATAL ERROR! unlocked pool allocator destroyed too early, %d blocks still in use", d->payout_count);
+        d->log_payouts();
+    }
 
-            d->payouts.push_back(std::make_pair(bs, ptr));
+    delete d;
+}
 
-            d->payouts_lock.unlock();
+UnlockedPoolAllocator::UnlockedPoolAllocator(const UnlockedPoolAllocator&)
+    : d(0)
+{
+}
 
-            return ptr;
-        }
+UnlockedPoolAllocator& UnlockedPoolAllocator::operator=(const UnlockedPoolAllocator&)
+{
+    return *this;
+}
+
+void UnlockedPoolAllocator::clear()
+{
+    d->clear();
+}
+
+void UnlockedPoolAllocator::set_size_compare_ratio(float scr)
+{
+    if (scr < 0.f || scr > 1.f)
+    {
+        NCNN_LOGE("invalid size compare ratio %f", scr);
+        return;
     }
 
-    d->budgets_lock.unlock();
+    d->size_compare_ratio = (unsigned int)(scr * 256);
+}
 
-    // new
-    void* ptr = ncnn::fastMalloc(size);
+void UnlockedPoolAllocator::set_use_hugepage(bool use_hugepage)
+{
+    d->use_hugepage = use_hugepage;
+}
 
-    d->payouts_lock.lock();
+void UnlockedPoolAllocator::get_statistics(PoolAllocatorStatistics& stat) const
+{
+    d->get_statistics(stat);
+}
 
-    d->payouts.push_back(std::make_pair(size, ptr));
+void* UnlockedPoolAllocator::fastMalloc(size_t size)
+{
+    return d->fastMalloc(size);
+}
 
-    d->payouts_lock.unlock();
+void UnlockedPoolAllocator::fastFree(void* ptr)
+{
+    if (!ptr)
+        return;
 
-    return ptr;
+    if (d->fastFree(ptr) != 0)
+    {
+        NCNN_LOGE("FATAL ERROR! unlocked pool allocator get wild %p", ptr);
+        ncnn::fastFree(ptr);
+    }
 }
 
-void PoolAllocator::fastFree(void* ptr)
+// blocks and bytes kept per thread before falling back to the shared pool
+// larger blocks always go back to the shared pool
+#define POOL_THREAD_CACHE_SIZE 8
+#define POOL_THREAD_CACHE_BYTES (4 * 1024 * 1024)
+
+class ThreadLocalPoolAllocatorPrivate;
+
+// only touched by its own thread except in clear, get_statistics and at thread exit
+struct pool_thread_cache
 {
-    d->payouts_lock.lock();
+    ThreadLocalPoolAllocatorPrivate* owner;
+    pool_block_header* blocks[POOL_THREAD_CACHE_SIZE];
+    int count;
+    size_t bytes;
+    int hit_count;
+};
+
+static void pool_thread_cache_exit(void* ptr);
 
-    // return to budgets
-    std::list<std::pair<size_t, void*> >::iterator it = d->payouts.begin();
-    for (; it != d->payouts.end(); ++it)
+class ThreadLocalPoolAllocatorPrivate
+{
+public:
+    ThreadLocalPoolAllocatorPrivate()
+        : bins(true), tls(pool_thread_cache_exit)
     {
-        if (it->second == ptr)
-        {
-            size_t size = it->first;
+        retired_hit_count = 0;
+    }
 
-            d->payouts.erase(it);
+    pool_thread_cache* get_thread_cache();
 
-            d->payouts_lock.unlock();
+    // move the blocks of cache into the shared pool, caches_lock held
+    void flush_thread_cache(pool_thread_cache* cache);
 
-            d->budgets_lock.lock();
+    PoolAllocatorBins bins;
 
-            d->budgets.push_back(std::make_pair(size, ptr));
+    ThreadLocalStorage tls;
 
-            d->budgets_lock.unlock();
+    Mutex caches_lock;
+    std::vector<pool_thread_cache*> caches;
 
-            return;
-        }
-    }
+    // cache hits of exited threads
+    int retired_hit_count;
+};
 
-    d->payouts_lock.unlock();
+pool_thread_cache* ThreadLocalPoolAllocatorPrivate::get_thread_cache()
+{
+    pool_thread_cache* cache = (pool_thread_cache*)tls.get();
+    if (cache)
+        return cache;
+
+    // out of tls keys, every thread goes to the shared pool
+    if (!tls.is_valid())
+        return 0;
 
-    NCNN_LOGE("FATAL ERROR! pool allocator get wild %p", ptr);
-    ncnn::fastFree(ptr);
+    cache = new pool_thread_cache;
+    cache->owner = this;
+    cache->count = 0;
+    cache->bytes = 0;
+    cache->hit_count = 0;
+
+    caches_lock.lock();
+    caches.push_back(cache);
+    caches_lock.unlock();
+
+    tls.set(cache);
+    return cache;
 }
 
-class UnlockedPoolAllocatorPrivate
+void ThreadLocalPoolAllocatorPrivate::flush_thread_cache(pool_thread_cache* cache)
 {
-public:
-    unsigned int size_compare_ratio; // 0~256
-    std::list<std::pair<size_t, void*> > budgets;
-    std::list<std::pair<size_t, void*> > payouts;
-};
+    for (int j = 0; j < cache->count; j++)
+    {
+        bins.fastFree((unsigned char*)cache->blocks[j] + POOL_BLOCK_HEADER_SIZE);
+    }
+    cache->count = 0;
+    cache->bytes = 0;
+}
 
-UnlockedPoolAllocator::UnlockedPoolAllocator()
-    : Allocator(), d(new UnlockedPoolAllocatorPrivate)
+// a thread exits, its blocks go back to the shared pool for the other threads
+static void pool_thread_cache_exit(void* ptr)
 {
-    d->size_compare_ratio = 192; // 0.75f * 256
+    pool_thread_cache* cache = (pool_thread_cache*)ptr;
+    ThreadLocalPoolAllocatorPrivate* d = cache->owner;
+
+    d->caches_lock.lock();
+    d->flush_thread_cache(cache);
+    d->retired_hit_count += cache->hit_count;
+    for (size_t i = 0; i < d->caches.size(); i++)
+    {
+        if (d->caches[i] == cache)
+        {
+            d->caches.erase(d->caches.begin() + i);
+            break;
+        }
+    }
+    d->caches_lock.unlock();
+
+    delete cache;
 }
 
-UnlockedPoolAllocator::~UnlockedPoolAllocator()
+ThreadLocalPoolAllocator::ThreadLocalPoolAllocator()
+    : Allocator(), d(new ThreadLocalPoolAllocatorPrivate)
+{
+}
+
+ThreadLocalPoolAllocator::~ThreadLocalPoolAllocator()
 {
     clear();
 
-    if (!d->payouts.empty())
+    if (d->bins.payout_count != 0)
     {
-        NCNN_LOGE("FATAL ERROR! unlocked pool allocator destroyed too early");
-#if NCNN_STDIO
-        std::list<std::pair<size_t, void*> >::iterator it = d->payouts.begin();
-        for (; it != d->payouts.end(); ++it)
-        {
-            void* ptr = it->second;
-            NCNN_LOGE("%p still in use", ptr);
-        }
-#endif
+        NCNN_LOGE("FATAL ERROR! thread local pool allocator destroyed too early, %d blocks still in use", d->bins.payout_count);
+        d->bins.log_payouts();
+    }
+
+    for (size_t i = 0; i < d->caches.size(); i++)
+    {
+        delete d->caches[i];
     }
 
     delete d;
 }
 
-UnlockedPoolAllocator::UnlockedPoolAllocator(const UnlockedPoolAllocator&)
+ThreadLocalPoolAllocator::ThreadLocalPoolAllocator(const ThreadLocalPoolAllocator&)
     : d(0)
 {
 }
 
-UnlockedPoolAllocator& UnlockedPoolAllocator::operator=(const UnlockedPoolAllocator&)
+ThreadLocalPoolAllocator& ThreadLocalPoolAllocator::operator=(const ThreadLocalPoolAllocator&)
 {
     return *this;
 }
 
-void UnlockedPoolAllocator::clear()
+void ThreadLocalPoolAllocator::clear()
 {
-    std::list<std::pair<size_t, void*> >::iterator it = d->budgets.begin();
-    for (; it != d->budgets.end(); ++it)
+    d->caches_lock.lock();
+    for (size_t i = 0; i < d->caches.size(); i++)
     {
-        void* ptr = it->second;
-        ncnn::fastFree(ptr);
+        d->flush_thread_cache(d->caches[i]);
     }
-    d->budgets.clear();
+    d->caches_lock.unlock();
+
+    d->bins.clear();
 }
 
-void UnlockedPoolAllocator::set_size_compare_ratio(float scr)
+void ThreadLocalPoolAllocator::set_size_compare_ratio(float scr)
 {
     if (scr < 0.f || scr > 1.f)
     {
@@ -237,58 +782,114 @@ void UnlockedPoolAllocator::set_size_compare_ratio(float scr)
         return;
     }
 
-    d->size_compare_ratio = (unsigned int)(scr * 256);
+    d->bins.size_compare_ratio = (unsigned int)(scr * 256);
 }
 
-void* UnlockedPoolAllocator::fastMalloc(size_t size)
+void ThreadLocalPoolAllocator::set_use_hugepage(bool use_hugepage)
 {
-    // find free budget
-    std::list<std::pair<size_t, void*> >::iterator it = d->budgets.begin();
-    for (; it != d->budgets.end(); ++it)
-    {
-        size_t bs = it->first;
+    d->bins.use_hugepage = use_hugepage;
+}
 
-        // size_compare_ratio ~ 100%
-        if (bs >= size && ((bs * d->size_compare_ratio) >> 8) <= size)
+void ThreadLocalPoolAllocator::get_statistics(PoolAllocatorStatistics& stat) const
+{
+    d->bins.get_statistics(stat);
+
+    // blocks in thread caches are budgets, not payouts
+    d->caches_lock.lock();
+    for (size_t i = 0; i < d->caches.size(); i++)
+    {
+        const pool_thread_cache* cache = d->caches[i];
+        for (int j = 0; j < cache->count; j++)
         {
-            void* ptr = it->second;
+            stat.budget_size += cache->blocks[j]->size;
+        }
+        stat.budget_count += cache->count;
+        stat.payout_count -= cache->count;
+        stat.hit_count += cache->hit_count;
+    }
+    stat.hit_count += d->retired_hit_count;
+    d->caches_lock.unlock();
+}
 
-            d->budgets.erase(it);
+void* ThreadLocalPoolAllocator::fastMalloc(size_t size)
+{
+    pool_thread_cache* cache = d->get_thread_cache();
+    if (!cache)
+        return d->bins.fastMalloc(size);
 
-            d->payouts.push_back(std::make_pair(bs, ptr));
+    const unsigned int size_compare_ratio = d->bins.size_compare_ratio;
 
-            return ptr;
+    // the smallest fit, newest first among equals
+    int best = -1;
+    for (int i = cache->count - 1; i >= 0; i--)
+    {
+        size_t bs = cache->blocks[i]->size;
+
+        // size_compare_ratio ~ 100%
+        if (bs >= size && ((bs * size_compare_ratio) >> 8) <= size)
+        {
+            if (best == -1 || bs < cache->blocks[best]->size)
+                best = i;
         }
     }
 
-    // new
-    void* ptr = ncnn::fastMalloc(size);
+    if (best == -1)
+        return d->bins.fastMalloc(size);
 
-    d->payouts.push_back(std::make_pair(size, ptr));
+    pool_block_header* block = cache->blocks[best];
+    for (int j = best + 1; j < cache->count; j++)
+    {
+        cache->blocks[j - 1] = cache->blocks[j];
+    }
+    cache->count--;
+    cache->bytes -= block->size;
+    cache->hit_count++;
 
-    return ptr;
+    return (unsigned char*)block + POOL_BLOCK_HEADER_SIZE;
 }
 
-void UnlockedPoolAllocator::fastFree(void* ptr)
+void ThreadLocalPoolAllocator::fastFree(void* ptr)
 {
-    // return to budgets
-    std::list<std::pair<size_t, void*> >::iterator it = d->payouts.begin();
-    for (; it != d->payouts.end(); ++it)
+    if (!ptr)
+        return;
+
+    pool_block_header* block = (pool_block_header*)((unsigned char*)ptr - POOL_BLOCK_HEADER_SIZE);
+    if (block->owner != &d->bins || block->magic != POOL_BLOCK_MAGIC)
     {
-        if (it->second == ptr)
-        {
-            size_t size = it->first;
+        NCNN_LOGE("FATAL ERROR! thread local pool allocator get wild %p", ptr);
+        ncnn::fastFree(ptr);
+        return;
+    }
 
-            d->payouts.erase(it);
+    if (block->size > POOL_THREAD_CACHE_BYTES)
+    {
+        d->bins.fastFree(ptr);
+        return;
+    }
 
-            d->budgets.push_back(std::make_pair(size, ptr));
+    pool_thread_cache* cache = d->get_thread_cache();
+    if (!cache)
+    {
+        d->bins.fastFree(ptr);
+        return;
+    }
 
-            return;
+    while (cache->count == POOL_THREAD_CACHE_SIZE || cache->bytes + block->size > POOL_THREAD_CACHE_BYTES)
+    {
+        // the oldest block goes back to the shared pool
+        pool_block_header* oldest = cache->blocks[0];
+        d->bins.fastFree((unsigned char*)oldest + POOL_BLOCK_HEADER_SIZE);
+
+        for (int j = 1; j < cache->count; j++)
+        {
+            cache->blocks[j - 1] = cache->blocks[j];
         }
+        cache->count--;
+        cache->bytes -= oldest->size;
     }
 
-    NCNN_LOGE("FATAL ERROR! unlocked pool allocator get wild %p", ptr);
-    ncnn::fastFree(ptr);
+    cache->blocks[cache->count++] = block;
+    cache->bytes += block->size;
 }
 
 #if NCNN_VULKAN
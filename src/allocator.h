@@ -106,6 +106,20 @@ static NCNN_FORCEINLINE void fastFree(void* ptr)
     }
 }
 
+// the huge page size assumed for x86 and arm64 linux
+#define NCNN_HUGEPAGE_SIZE (2 * 1024 * 1024)
+
+// like fastMalloc, the 2M aligned part is advised to transparent huge pages on linux
+// release with fastFree
+NCNN_EXPORT void* fastMalloc_hugepage(size_t size);
+
+// large mats created with the default allocator on the calling thread use fastMalloc_hugepage while enabled
+NCNN_EXPORT void set_thread_hugepage_allocation(bool enabled);
+NCNN_EXPORT bool get_thread_hugepage_allocation();
+
+// bytes of this process backed by transparent or hugetlbfs huge pages, 0 if unknown
+NCNN_EXPORT size_t get_hugepage_usage();
+
 #if NCNN_THREADS
 // exchange-add operation for atomic operations on reference counters
 #if defined __riscv && !defined __riscv_atomic
@@ -162,6 +176,24 @@ public:
     virtual void fastFree(void* ptr) = 0;
 };
 
+// reuse counters of a pool allocator
+struct NCNN_EXPORT PoolAllocatorStatistics
+{
+    // fastMalloc served from a budget or by a new allocation
+    int hit_count;
+    int miss_count;
+
+    // blocks handed out and not freed yet
+    int payout_count;
+
+    // blocks and bytes kept for reuse
+    int budget_count;
+    size_t budget_size;
+
+    // bytes allocated from hugetlbfs or advised to transparent huge pages
+    size_t hugepage_size;
+};
+
 class PoolAllocatorPrivate;
 class NCNN_EXPORT PoolAllocator : public Allocator
 {
@@ -176,6 +208,14 @@ public:
     // release all budgets immediately
     void clear();
 
+    // allocate blocks of at least NCNN_HUGEPAGE_SIZE from huge pages
+    // hugetlbfs pages first, then transparent huge pages, then regular pages
+    // default off
+    void set_use_hugepage(bool use_hugepage);
+
+    // counters since construction, budgets at the moment
+    void get_statistics(PoolAllocatorStatistics& stat) const;
+
     virtual void* fastMalloc(size_t size);
     virtual void fastFree(void* ptr);
 
@@ -201,6 +241,14 @@ public:
     // release all budgets immediately
     void clear();
 
+    // allocate blocks of at least NCNN_HUGEPAGE_SIZE from huge pages
+    // hugetlbfs pages first, then transparent huge pages, then regular pages
+    // default off
+    void set_use_hugepage(bool use_hugepage);
+
+    // counters since construction, budgets at the moment
+    void get_statistics(PoolAllocatorStatistics& stat) const;
+
     virtual void* fastMalloc(size_t size);
     virtual void fastFree(void* ptr);
 
@@ -212,6 +260,47 @@ private:
     UnlockedPoolAllocatorPrivate* const d;
 };
 
+// pool allocator with a small block cache per thread in front of a shared locked pool
+// suited for workspace allocations made inside parallel regions
+// blocks may be freed on another thread than the one allocated them
+// the cache of an exiting thread goes back to the shared pool on pthread platforms only,
+// on windows it stays until clear() or destruction, prefer long-lived threads there
+// every instance takes one tls key, without a free key it works as a plain locked pool
+class ThreadLocalPoolAllocatorPrivate;
+class NCNN_EXPORT ThreadLocalPoolAllocator : public Allocator
+{
+public:
+    ThreadLocalPoolAllocator();
+    ~ThreadLocalPoolAllocator();
+
+    // ratio range 0 ~ 1
+    // default cr = 0.75
+    void set_size_compare_ratio(float scr);
+
+    // release all budgets and thread caches immediately
+    // must not run concurrently with fastMalloc or fastFree
+    void clear();
+
+    // allocate blocks of at least NCNN_HUGEPAGE_SIZE from huge pages
+    // hugetlbfs pages first, then transparent huge pages, then regular pages
+    // default off
+    void set_use_hugepage(bool use_hugepage);
+
+    // counters since construction, budgets at the moment
+    // hit_count includes the thread cache hits
+    void get_statistics(PoolAllocatorStatistics& stat) const;
+
+    virtual void* fastMalloc(size_t size);
+    virtual void fastFree(void* ptr);
+
+private:
+    ThreadLocalPoolAllocator(const ThreadLocalPoolAllocator&);
+    ThreadLocalPoolAllocator& operator=(const ThreadLocalPoolAllocator&);
+
+private:
+    ThreadLocalPoolAllocatorPrivate* const d;
+};
+
 #if NCNN_VULKAN
 
 class VulkanDevice;
@@ -0,0 +1,559 @@
+// Tencent is pleased to support the open source community by making ncnn available.
+//
+// Copyright (C) 2024 THL A29 Limited, a Tencent company. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this file except
+// in compliance with the License. You may obtain a copy of the License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software distributed
+// under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+// CONDITIONS OF ANY KIND, either express or implied. See the License for the
+// specific language governing permissions and limitations under the License.
+
+#include "net.h"
+
+#include "benchmark.h"
+#include "cpu.h"
+
+namespace ncnn {
+
+class AsyncExtractRequest
+{
+public:
+    int id;
+    std::vector<int> input_indexes;
+    std::vector<Mat> inputs;
+    std::vector<int> output_indexes;
+    std::vector<Mat> outputs;
+    async_extract_callback_func callback;
+    void* userdata;
+    int ret;
+};
+
+class AsyncExtractWorker
+{
+public:
+    AsyncExtractorPrivate* d;
+    int index;
+    Allocator* blob_allocator;
+    Allocator* workspace_allocator;
+    Thread* thread;
+
+    // affinity_generation applied to this worker thread
+    int affinity_generation;
+    // core count of the cpu partition, 0 if not partitioned
+    int max_threads;
+};
+
+class AsyncExtractorPrivate
+{
+public:
+    // run one request on the calling thread with the worker allocators
+    int run(AsyncExtractRequest* request, const AsyncExtractWorker* worker) const;
+
+    // run requests sharing input and output blobs as one batched forward
+    int run_batch(std::vector<AsyncExtractRequest*>& batch, const AsyncExtractWorker* worker) const;
+
+    // move queued requests that can join batch, up to max_batch in total
+    void collect_batch(std::vector<AsyncExtractRequest*>& batch);
+
+    // hand over a finished request to its callback or to wait()
+    void finish(AsyncExtractRequest* request);
+
+    const Net* net;
+    int num_threads;
+    int max_inflight;
+    bool max_inflight_auto;
+
+    // dynamic batching
+    int max_batch;
+    int max_delay_us;
+    std::vector<int> batch_histogram;
+
+    // bumped on set_cpu_partitioning, workers rebind before their next request
+    bool cpu_partitioning;
+    int affinity_generation;
+
+    Mutex lock;
+    // signaled when a request is queued or workers should stop
+    ConditionVariable request_condition;
+    // signaled when a request finished
+    ConditionVariable finish_condition;
+
+    std::list<AsyncExtractRequest*> queue;
+    // finished requests without callback, taken by wait()
+    std::vector<AsyncExtractRequest*> finished;
+    // request ids that wait() may still take
+    std::vector<int> waitable_ids;
+
+    // queued and running requests
+    int inflight;
+    int next_id;
+    bool stop;
+
+    std::vector<AsyncExtractWorker> workers;
+};
+
+int AsyncExtractorPrivate::run(AsyncExtractRequest* request, const AsyncExtractWorker* worker) const
+{
+    Extractor ex = net->create_extractor();
+    ex.set_num_threads(worker->max_threads > 0 ? std::min(num_threads, worker->max_threads) : num_threads);
+    ex.set_blob_allocator(worker->blob_allocator);
+    ex.set_workspace_allocator(worker->workspace_allocator);
+
+    for (size_t i = 0; i < request->input_indexes.size(); i++)
+    {
+        int ret = ex.input(request->input_indexes[i], request->inputs[i]);
+        if (ret != 0)
+            return ret;
+    }
+
+    // inputs are owned by the extractor from now on
+    request->inputs.clear();
+
+    request->outputs.resize(request->output_indexes.size());
+    for (size_t i = 0; i < request->output_indexes.size(); i++)
+    {
+        Mat out;
+        int ret = ex.extract(request->output_indexes[i], out);
+        if (ret != 0)
+            return ret;
+
+        // detach from the worker pool allocator, which is not shared across threads
+        request->outputs[i] = out.clone();
+    }
+
+    return 0;
+}
+
+int AsyncExtractorPrivate::run_batch(std::vector<AsyncExtractRequest*>& batch, const AsyncExtractWorker* worker) const
+{
+    const AsyncExtractRequest* first = batch[0];
+    const int batch_size = (int)batch.size();
+
+    Extractor ex = net->create_extractor();
+    ex.set_num_threads(worker->max_threads > 0 ? std::min(num_threads, worker->max_threads) : num_threads);
+    ex.set_blob_allocator(worker->blob_allocator);
+    ex.set_workspace_allocator(worker->workspace_allocator);
+
+    std::vector<Mat> mats(batch_size);
+    for (size_t i = 0; i < first->input_indexes.size(); i++)
+    {
+        for (int b = 0; b < batch_size; b++)
+        {
+            mats[b] = batch[b]->inputs[i];
+        }
+
+        int ret = ex.input(first->input_indexes[i], mats);
+        if (ret != 0)
+            return ret;
+    }
+
+    for (int b = 0; b < batch_size; b++)
+    {
+        batch[b]->inputs.clear();
+        batch[b]->outputs.resize(first->output_indexes.size());
+    }
+
+    for (size_t i = 0; i < first->output_indexes.size(); i++)
+    {
+        int ret = ex.extract(first->output_indexes[i], mats);
+        if (ret != 0)
+            return ret;
+
+        // scatter and detach from the worker pool allocator
+        for (int b = 0; b < batch_size; b++)
+        {
+            batch[b]->outputs[i] = mats[b].clone();
+        }
+    }
+
+    return 0;
+}
+
+static bool same_blob_indexes(const std::vector<int>& a, const std::vector<int>& b)
+{
+    if (a.size() != b.size())
+        return false;
+
+    for (size_t i = 0; i < a.size(); i++)
+    {
+        if (a[i] != b[i])
+            return false;
+    }
+
+    return true;
+}
+
+void AsyncExtractorPrivate::collect_batch(std::vector<AsyncExtractRequest*>& batch)
+{
+    const AsyncExtractRequest* first = batch[0];
+
+    std::list<AsyncExtractRequest*>::iterator it = queue.begin();
+    while (it != queue.end() && (int)batch.size() < max_batch)
+    {
+        AsyncExtractRequest* request = *it;
+        if (same_blob_indexes(request->input_indexes, first->input_indexes) && same_blob_indexes(request->output_indexes, first->output_indexes))
+        {
+            batch.push_back(request);
+            it = queue.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+}
+
+void AsyncExtractorPrivate::finish(AsyncExtractRequest* request)
+{
+    if (request->callback)
+    {
+        request->callback(request->ret, request->outputs, request->userdata);
+        delete request;
+
+        lock.lock();
+        inflight--;
+        finish_condition.broadcast();
+        lock.unlock();
+        return;
+    }
+
+    lock.lock();
+    finished.push_back(request);
+    inflight--;
+    finish_condition.broadcast();
+    lock.unlock();
+}
+
+static void* async_extract_worker(void* args)
+{
+    AsyncExtractWorker* worker = (AsyncExtractWorker*)args;
+    AsyncExtractorPrivate* d = worker->d;
+
+    for (;;)
+    {
+        d->lock.lock();
+        while (d->queue.empty() && !d->stop)
+        {
+            d->request_condition.wait(d->lock);
+        }
+
+        if (d->queue.empty())
+        {
+            d->lock.unlock();
+            break;
+        }
+
+        std::vector<AsyncExtractRequest*> batch(1, *d->queue.begin());
+        d->queue.pop_front();
+
+        if (d->max_batch > 1)
+        {
+            // gather more requests until the batch is full or the delay expires
+            const double deadline = get_current_time() + d->max_delay_us / 1000.0;
+            for (;;)
+            {
+                d->collect_batch(batch);
+                if ((int)batch.size() >= d->max_batch || d->stop)
+                    break;
+
+                // the deadline follows the wall clock, never wait longer than the delay after a jump
+                int remaining_us = std::min((int)((deadline - get_current_time()) * 1000), d->max_delay_us);
+                if (remaining_us <= 0)
+                    break;
+
+                d->request_condition.timed_wait(d->lock, remaining_us);
+            }
+        }
+
+        d->batch_histogram[batch.size()]++;
+
+        const bool rebind = worker->affinity_generation != d->affinity_generation;
+        const bool cpu_partitioning = d->cpu_partitioning;
+        worker->affinity_generation = d->affinity_generation;
+
+        d->lock.unlock();
+
+        if (rebind)
+        {
+            // this thread and its openmp threads stay on the partition across requests
+            // the simpleomp pool threads are shared by all workers, only this thread is bound then
+            // partition 0 of 1 spans all cores when partitioning is turned off again
+            const int powersave = get_cpu_powersave();
+            CpuSet mask;
+            if (cpu_partitioning)
+                mask = get_cpu_partition(worker->index, (int)d->workers.size());
+            else if (powersave == 0)
+                mask = get_cpu_partition(0, 1);
+            else
+                mask = get_cpu_thread_affinity_mask(powersave);
+#if NCNN_SIMPLEOMP
+            set_cpu_current_thread_affinity(mask);
+#else
+            set_cpu_thread_affinity(mask);
+#endif
+            worker->max_threads = cpu_partitioning ? mask.num_enabled() : 0;
+        }
+
+        if (batch.size() == 1)
+        {
+            batch[0]->ret = d->run(batch[0], worker);
+        }
+        else
+        {
+            int ret = d->run_batch(batch, worker);
+            for (size_t i = 0; i < batch.size(); i++)
+            {
+                batch[i]->ret = ret;
+            }
+        }
+
+        for (size_t i = 0; i < batch.size(); i++)
+        {
+            d->finish(batch[i]);
+        }
+    }
+
+    return 0;
+}
+
+AsyncExtractor::AsyncExtractor(const Net* net, int worker_count, int max_inflight)
+    : d(new AsyncExtractorPrivate)
+{
+    worker_count = std::max(worker_count, 1);
+
+    d->net = net;
+    d->num_threads = std::max(net->opt.num_threads / worker_count, 1);
+    d->max_inflight = max_inflight > 0 ? max_inflight : worker_count * 2;
+    d->max_inflight_auto = max_inflight <= 0;
+    d->max_batch = 1;
+    d->max_delay_us = 0;
+    d->batch_histogram.resize(2, 0);
+    d->cpu_partitioning = false;
+    d->affinity_generation = 0;
+    d->inflight = 0;
+    d->next_id = 0;
+    d->stop = false;
+
+    d->workers.resize(worker_count);
+    for (int i = 0; i < worker_count; i++)
+    {
+        AsyncExtractWorker& worker = d->workers[i];
+        worker.d = d;
+        worker.index = i;
+        worker.affinity_generation = 0;
+        worker.max_threads = 0;
+
+        if (net->opt.use_branch_parallel)
+        {
+            // branch parallel layers share the allocators across threads
+            worker.blob_allocator = new PoolAllocator;
+            worker.workspace_allocator = new PoolAllocator;
+        }
+        else
+        {
+            worker.blob_allocator = new UnlockedPoolAllocator;
+            worker.workspace_allocator = new UnlockedPoolAllocator;
+        }
+
+#if NCNN_THREADS
+        worker.thread = new Thread(async_extract_worker, (void*)&worker);
+#else
+        worker.thread = 0;
+#endif // NCNN_THREADS
+    }
+}
+
+AsyncExtractor::~AsyncExtractor()
+{
+    d->lock.lock();
+    d->stop = true;
+    d->request_condition.broadcast();
+    d->lock.unlock();
+
+    // workers drain the queue before leaving
+    for (size_t i = 0; i < d->workers.size(); i++)
+    {
+        AsyncExtractWorker& worker = d->workers[i];
+        if (worker.thread)
+        {
+            worker.thread->join();
+            delete worker.thread;
+        }
+
+        delete worker.blob_allocator;
+        delete worker.workspace_allocator;
+    }
+
+    for (size_t i = 0; i < d->finished.size(); i++)
+    {
+        delete d->finished[i];
+    }
+
+    delete d;
+}
+
+AsyncExtractor::AsyncExtractor(const AsyncExtractor&)
+    : d(0)
+{
+}
+
+AsyncExtractor& AsyncExtractor::operator=(const AsyncExtractor&)
+{
+    return *this;
+}
+
+void AsyncExtractor::set_num_threads(int num_threads)
+{
+    d->lock.lock();
+    d->num_threads = num_threads;
+    d->lock.unlock();
+}
+
+void AsyncExtractor::set_dynamic_batching(int max_batch, int max_delay_us)
+{
+    d->lock.lock();
+    d->max_batch = std::max(max_batch, 1);
+    d->max_delay_us = std::max(max_delay_us, 0);
+    if ((int)d->batch_histogram.size() < d->max_batch + 1)
+    {
+        d->batch_histogram.resize(d->max_batch + 1, 0);
+    }
+    if (d->max_inflight_auto)
+    {
+        // leave room for every worker to fill a batch
+        d->max_inflight = (int)d->workers.size() * d->max_batch * 2;
+    }
+    d->lock.unlock();
+}
+
+void AsyncExtractor::set_cpu_partitioning(bool enable)
+{
+    d->lock.lock();
+    d->cpu_partitioning = enable;
+    d->affinity_generation++;
+    d->lock.unlock();
+}
+
+void AsyncExtractor::get_batch_histogram(std::vector<int>& histogram) const
+{
+    d->lock.lock();
+    histogram = d->batch_histogram;
+    d->lock.unlock();
+}
+
+int AsyncExtractor::submit(const std::vector<int>& input_indexes, const std::vector<Mat>& inputs, const std::vector<int>& output_indexes, async_extract_callback_func callback, void* userdata)
+{
+    if (input_indexes.size() != inputs.size())
+    {
+        NCNN_LOGE("async extract input count %d mismatch, expect %d", (int)inputs.size(), (int)input_indexes.size());
+        return -1;
+    }
+
+    AsyncExtractRequest* request = new AsyncExtractRequest;
+    request->input_indexes = input_indexes;
+    request->inputs = inputs;
+    request->output_indexes = output_indexes;
+    request->callback = callback;
+    request->userdata = userdata;
+    request->ret = 0;
+
+    d->lock.lock();
+
+    // back-pressure
+    while (d->inflight >= d->max_inflight)
+    {
+        d->finish_condition.wait(d->lock);
+    }
+
+    const int request_id = d->next_id++;
+    request->id = request_id;
+
+    if (!callback)
+    {
+        d->waitable_ids.push_back(request_id);
+    }
+
+    d->inflight++;
+
+#if NCNN_THREADS
+    d->queue.push_back(request);
+    d->request_condition.signal();
+    d->lock.unlock();
+#else
+    d->lock.unlock();
+
+    // no worker thread, run it right away
+    d->batch_histogram[1]++;
+    AsyncExtractWorker& worker = d->workers[0];
+    request->ret = d->run(request, &worker);
+    d->finish(request);
+#endif // NCNN_THREADS
+
+    return request_id;
+}
+
+int AsyncExtractor::submit(int input_index, const Mat& in, int output_index, async_extract_callback_func callback, void* userdata)
+{
+    std::vector<int> input_indexes(1, input_index);
+    std::vector<Mat> inputs(1, in);
+    std::vector<int> output_indexes(1, output_index);
+
+    return submit(input_indexes, inputs, output_indexes, callback, userdata);
+}
+
+int AsyncExtractor::wait(int request_id, std::vector<Mat>& outputs)
+{
+    MutexLockGuard guard(d->lock);
+
+    bool waitable = false;
+    for (size_t i = 0; i < d->waitable_ids.size(); i++)
+    {
+        if (d->waitable_ids[i] == request_id)
+        {
+            d->waitable_ids.erase(d->waitable_ids.begin() + i);
+            waitable = true;
+            break;
+        }
+    }
+
+    if (!waitable)
+    {
+        NCNN_LOGE("async extract request %d is not waitable", request_id);
+        return -1;
+    }
+
+    for (;;)
+    {
+        for (size_t i = 0; i < d->finished.size(); i++)
+        {
+            AsyncExtractRequest* request = d->finished[i];
+            if (request->id != request_id)
+                continue;
+
+            d->finished.erase(d->finished.begin() + i);
+
+            outputs = request->outputs;
+            int ret = request->ret;
+            delete request;
+            return ret;
+        }
+
+        d->finish_condition.wait(d->lock);
+    }
+}
+
+void AsyncExtractor::wait_all()
+{
+    d->lock.lock();
+    while (d->inflight > 0)
+    {
+        d->finish_condition.wait(d->lock);
+    }
+    d->lock.unlock();
+}
+
+} // namespace ncnn
@@ -21,12 +21,35 @@
 
 #include "benchmark.h"
 
-#if NCNN_BENCHMARK
+#if NCNN_STDIO
+#include <stdio.h>
+#endif // NCNN_STDIO
+
+#include "layer_type.h"
+
 #include "layer/convolution.h"
+#include "layer/convolution1d.h"
+#include "layer/convolution3d.h"
 #include "layer/convolutiondepthwise.h"
+#include "layer/convolutiondepthwise1d.h"
+#include "layer/convolutiondepthwise3d.h"
 #include "layer/deconvolution.h"
+#include "layer/deconvolution1d.h"
+#include "layer/deconvolution3d.h"
 #include "layer/deconvolutiondepthwise.h"
+#include "layer/deconvolutiondepthwise1d.h"
+#include "layer/deconvolutiondepthwise3d.h"
+#include "layer/gemm.h"
+#include "layer/gru.h"
+#include "layer/innerproduct.h"
+#include "layer/lstm.h"
+#include "layer/multiheadattention.h"
+#include "layer/pooling.h"
+#include "layer/pooling1d.h"
+#include "layer/pooling3d.h"
+#include "layer/rnn.h"
 
+#if NCNN_BENCHMARK
 #include <stdio.h>
 #endif // NCNN_BENCHMARK
 
@@ -49,6 +72,439 @@ double get_current_time()
 #endif // _WIN32
 }
 
+struct trace_record
+{
+    const char* category;
+    std::string name;
+    std::string detail;
+    double start;
+    double end;
+};
+
+// events of one thread, appended without contention
+class TraceThreadBuffer
+{
+public:
+    int tid;
+    Mutex lock;
+    std::vector<trace_record> records;
+};
+
+static volatile int g_trace_enabled = 0;
+static double g_trace_start_time = 0;
+static Mutex g_trace_lock;
+static std::vector<TraceThreadBuffer*> g_trace_buffers;
+static ThreadLocalStorage g_trace_thread_buffer;
+
+void start_trace()
+{
+    MutexLockGuard guard(g_trace_lock);
+
+    for (size_t i = 0; i < g_trace_buffers.size(); i++)
+    {
+        TraceThreadBuffer* buffer = g_trace_buffers[i];
+        MutexLockGuard buffer_guard(buffer->lock);
+        buffer->records.clear();
+    }
+
+    g_trace_start_time = get_current_time();
+    g_trace_enabled = 1;
+}
+
+bool trace_enabled()
+{
+    return g_trace_enabled != 0;
+}
+
+void trace_event(const char* category, const char* name, const char* detail, double start, double end)
+{
+    if (!g_trace_enabled)
+        return;
+
+    TraceThreadBuffer* buffer = (TraceThreadBuffer*)g_trace_thread_buffer.get();
+    if (!buffer)
+    {
+        // buffers outlive their threads, so the tracks of finished threads survive until written
+        buffer = new TraceThreadBuffer;
+
+        MutexLockGuard guard(g_trace_lock);
+        buffer->tid = (int)g_trace_buffers.size();
+        g_trace_buffers.push_back(buffer);
+
+        g_trace_thread_buffer.set(buffer);
+    }
+
+    trace_record record;
+    record.category = category;
+    record.name = name;
+    record.detail = detail ? detail : "";
+    record.start = start;
+    record.end = end;
+
+    MutexLockGuard guard(buffer->lock);
+    buffer->records.push_back(record);
+}
+
+#if NCNN_STDIO
+static void write_trace_string(FILE* fp, const std::string& str)
+{
+    fputc('"', fp);
+    for (size_t i = 0; i < str.size(); i++)
+    {
+        char c = str[i];
+        if (c == '"' || c == '\\')
+            fputc('\\', fp);
+        if ((unsigned char)c >= 0x20)
+            fputc(c, fp);
+    }
+    fputc('"', fp);
+}
+
+int stop_trace(const char* path)
+{
+    MutexLockGuard guard(g_trace_lock);
+
+    g_trace_enabled = 0;
+
+    FILE* fp = fopen(path, "wb");
+    if (!fp)
+    {
+        NCNN_LOGE("fopen %s failed", path);
+        return -1;
+    }
+
+    fprintf(fp, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+
+    bool first = true;
+    for (size_t i = 0; i < g_trace_buffers.size(); i++)
+    {
+        TraceThreadBuffer* buffer = g_trace_buffers[i];
+        MutexLockGuard buffer_guard(buffer->lock);
+
+        if (buffer->records.empty())
+            continue;
+
+        fprintf(fp, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%d,\"args\":{\"name\":\"thread %d\"}}", first ? "" : ",\n", buffer->tid, buffer->tid);
+        first = false;
+
+        for (size_t j = 0; j < buffer->records.size(); j++)
+        {
+            const trace_record& record = buffer->records[j];
+
+            // timestamps in microseconds since start_trace
+            fprintf(fp, ",\n{\"name\":");
+            write_trace_string(fp, record.name);
+            fprintf(fp, ",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":0,\"tid\":%d", record.category, (record.start - g_trace_start_time) * 1000, (record.end - record.start) * 1000, buffer->tid);
+            if (!record.detail.empty())
+            {
+                fprintf(fp, ",\"args\":{\"detail\":");
+                write_trace_string(fp, record.detail);
+                fprintf(fp, "}");
+            }
+            fprintf(fp, "}");
+        }
+
+        buffer->records.clear();
+    }
+
+    fprintf(fp, "\n]}\n");
+
+    fclose(fp);
+
+    return 0;
+}
+#endif // NCNN_STDIO
+
+static uint64_t blob_elemcount(const Mat& m)
+{
+    if (m.dims == 0)
+        return 0;
+
+    return (uint64_t)m.w * m.h * m.d * m.c * m.elempack;
+}
+
+static uint64_t blob_bytes(const Mat& m)
+{
+    if (m.dims == 0)
+        return 0;
+
+    return (uint64_t)m.w * m.h * m.d * m.c * m.elemsize;
+}
+
+// rows of a 2-dim blob, the sequence length of recurrent and attention layers
+static uint64_t blob_rows(const Mat& m)
+{
+    return (uint64_t)m.h * m.elempack;
+}
+
+static uint64_t conv_macs(uint64_t top_elemcount, uint64_t weight_data_size, int num_output)
+{
+    return num_output ? top_elemcount * weight_data_size / num_output : 0;
+}
+
+LayerWorkload estimate_layer_workload(const Layer* layer, const std::vector<Mat>& bottom_blobs, const std::vector<Mat>& top_blobs)
+{
+    LayerWorkload workload;
+    workload.macs = 0;
+    workload.bytes_read = 0;
+    workload.bytes_written = 0;
+
+    for (size_t i = 0; i < bottom_blobs.size(); i++)
+    {
+        workload.bytes_read += blob_bytes(bottom_blobs[i]);
+    }
+    for (size_t i = 0; i < top_blobs.size(); i++)
+    {
+        workload.bytes_written += blob_bytes(top_blobs[i]);
+    }
+
+    if (bottom_blobs.empty() || top_blobs.empty())
+        return workload;
+
+    const uint64_t bottom_elemcount = blob_elemcount(bottom_blobs[0]);
+    const uint64_t top_elemcount = blob_elemcount(top_blobs[0]);
+
+    // fp32 weights, int8 once quantized
+    uint64_t weight_count = 0;
+    size_t weight_elemsize = 4u;
+
+    switch (layer->typeindex)
+    {
+    case LayerType::Convolution:
+    {
+        const Convolution* op = (const Convolution*)layer;
+        weight_count = op->dynamic_weight && bottom_blobs.size() > 1 ? blob_elemcount(bottom_blobs[1]) : op->weight_data_size;
+        workload.macs = conv_macs(top_elemcount, weight_count, op->num_output);
+        weight_elemsize = op->int8_scale_term ? 1u : 4u;
+        if (op->dynamic_weight)
+            weight_count = 0;
+        break;
+    }
+    case LayerType::ConvolutionDepthWise:
+    {
+        const ConvolutionDepthWise* op = (const ConvolutionDepthWise*)layer;
+        weight_count = op->dynamic_weight && bottom_blobs.size() > 1 ? blob_elemcount(bottom_blobs[1]) : op->weight_data_size;
+        workload.macs = conv_macs(top_elemcount, weight_count, op->num_output);
+        weight_elemsize = op->int8_scale_term ? 1u : 4u;
+        if (op->dynamic_weight)
+            weight_count = 0;
+        break;
+    }
+    case LayerType::Convolution1D:
+    {
+        const Convolution1D* op = (const Convolution1D*)layer;
+        weight_count = op->dynamic_weight && bottom_blobs.size() > 1 ? blob_elemcount(bottom_blobs[1]) : op->weight_data_size;
+        workload.macs = conv_macs(top_elemcount, weight_count, op->num_output);
+        if (op->dynamic_weight)
+            weight_count = 0;
+        break;
+    }
+    case LayerType::ConvolutionDepthWise1D:
+    {
+        const ConvolutionDepthWise1D* op = (const ConvolutionDepthWise1D*)layer;
+        weight_count = op->weight_data_size;
+        workload.macs = conv_macs(top_elemcount, weight_count, op->num_output);
+        break;
+    }
+    case LayerType::Convolution3D:
+    {
+        const Convolution3D* op = (const Convolution3D*)layer;
+        weight_count = op->weight_data_size;
+        workload.macs = conv_macs(top_elemcount, weight_count, op->num_output);
+        break;
+    }
+    case LayerType::ConvolutionDepthWise3D:
+    {
+        const ConvolutionDepthWise3D* op = (const ConvolutionDepthWise3D*)layer;
+        weight_count = op->weight_data_size;
+        workload.macs = conv_macs(top_elemcount, weight_count, op->num_output);
+        break;
+    }
+    case LayerType::InnerProduct:
+    {
+        const InnerProduct* op = (const InnerProduct*)layer;
+        weight_count = op->weight_data_size;
+        workload.macs = conv_macs(top_elemcount, weight_count, op->num_output);
+        weight_elemsize = op->int8_scale_term ? 1u : 4u;
+        break;
+    }
+    case LayerType::Deconvolution:
+    {
+        // every input element scatters into num_output kernel windows
+        const Deconvolution* op = (const Deconvolution*)layer;
+        weight_count = op->weight_data_size;
+        workload.macs = bottom_elemcount * op->num_output * op->kernel_w * op->kernel_h;
+        break;
+    }
+    case LayerType::DeconvolutionDepthWise:
+    {
+        const DeconvolutionDepthWise* op = (const DeconvolutionDepthWise*)layer;
+        weight_count = op->weight_data_size;
+        workload.macs = bottom_elemcount * (op->num_output / op->group) * op->kernel_w * op->kernel_h;
+        break;
+    }
+    case LayerType::Deconvolution1D:
+    {
+        const Deconvolution1D* op = (const Deconvolution1D*)layer;
+        weight_count = op->weight_data_size;
+        workload.macs = bottom_elemcount * op->num_output * op->kernel_w;
+        break;
+    }
+    case LayerType::DeconvolutionDepthWise1D:
+    {
+        const DeconvolutionDepthWise1D* op = (const DeconvolutionDepthWise1D*)layer;
+        weight_count = op->weight_data_size;
+        workload.macs = bottom_elemcount * (op->num_output / op->group) * op->kernel_w;
+        break;
+    }
+    case LayerType::Deconvolution3D:
+    {
+        const Deconvolution3D* op = (const Deconvolution3D*)layer;
+        weight_count = op->weight_data_size;
+        workload.macs = bottom_elemcount * op->num_output * op->kernel_w * op->kernel_h * op->kernel_d;
+        break;
+    }
+    case LayerType::DeconvolutionDepthWise3D:
+    {
+        const DeconvolutionDepthWise3D* op = (const DeconvolutionDepthWise3D*)layer;
+        weight_count = op->weight_data_size;
+        workload.macs = bottom_elemcount * (op->num_output / op->group) * op->kernel_w * op->kernel_h * op->kernel_d;
+        break;
+    }
+    case LayerType::Gemm:
+    {
+        // A is M x K and B is K x N, every output element is a K long dot product
+        // constant operands are MemoryData bottoms here, so K comes from A or else from B
+        const Gemm* op = (const Gemm*)layer;
+        const Mat& A = bottom_blobs[0];
+        uint64_t K = op->transA ? blob_rows(A) : (uint64_t)A.w;
+        if (A.dims == 0 && bottom_blobs.size() > 1)
+        {
+            const Mat& B = bottom_blobs[1];
+            K = op->transB ? (uint64_t)B.w : blob_rows(B);
+        }
+        workload.macs = top_elemcount * K;
+        break;
+    }
+    case LayerType::MatMul:
+    {
+        // the last axis of A is the reduction axis
+        if (bottom_blobs.size() < 2)
+            break;
+
+        const Mat& A = bottom_blobs[0];
+        workload.macs = top_elemcount * (A.dims == 1 ? (uint64_t)A.w * A.elempack : (uint64_t)A.w);
+        break;
+    }
+    case LayerType::MultiHeadAttention:
+    {
+        // q k v and out projections, q * k^T and attention * v
+        const MultiHeadAttention* op = (const MultiHeadAttention*)layer;
+        const uint64_t embed_dim = op->embed_dim;
+        const uint64_t q_seqlen = blob_rows(bottom_blobs[0]);
+        const uint64_t kv_seqlen = bottom_blobs.size() > 1 ? blob_rows(bottom_blobs[1]) : q_seqlen;
+        weight_count = op->weight_data_size * 4;
+        workload.macs = (q_seqlen * 2 + kv_seqlen * 2) * embed_dim * embed_dim + q_seqlen * kv_seqlen * embed_dim * 2;
+        break;
+    }
+    case LayerType::LSTM:
+    case LayerType::GRU:
+    case LayerType::RNN:
+    {
+        // input projection plus the hidden state recurrence on every timestep
+        int num_output = 0;
+        int gates = 1;
+        int direction = 0;
+        if (layer->typeindex == LayerType::LSTM)
+        {
+            const LSTM* op = (const LSTM*)layer;
+            num_output = op->num_output;
+            weight_count = op->weight_data_size;
+            direction = op->direction;
+            gates = 4;
+        }
+        else if (layer->typeindex == LayerType::GRU)
+        {
+            const GRU* op = (const GRU*)layer;
+            num_output = op->num_output;
+            weight_count = op->weight_data_size;
+            direction = op->direction;
+            gates = 3;
+        }
+        else
+        {
+            const RNN* op = (const RNN*)layer;
+            num_output = op->num_output;
+            weight_count = op->weight_data_size;
+            direction = op->direction;
+        }
+
+        const uint64_t num_directions = direction == 2 ? 2 : 1;
+        weight_count += num_directions * gates * num_output * num_output;
+        workload.macs = blob_rows(bottom_blobs[0]) * weight_count;
+        break;
+    }
+    case LayerType::Pooling:
+    {
+        const Pooling* op = (const Pooling*)layer;
+        workload.macs = op->global_pooling || op->adaptive_pooling ? bottom_elemcount : top_elemcount * op->kernel_w * op->kernel_h;
+        break;
+    }
+    case LayerType::Pooling1D:
+    {
+        const Pooling1D* op = (const Pooling1D*)layer;
+        workload.macs = op->global_pooling || op->adaptive_pooling ? bottom_elemcount : top_elemcount * op->kernel_w;
+        break;
+    }
+    case LayerType::Pooling3D:
+    {
+        const Pooling3D* op = (const Pooling3D*)layer;
+        workload.macs = op->global_pooling || op->adaptive_pooling ? bottom_elemcount : top_elemcount * op->kernel_w * op->kernel_h * op->kernel_d;
+        break;
+    }
+    case LayerType::Split:
+        // tops share the bottom data
+        workload.bytes_read = 0;
+        workload.bytes_written = 0;
+        break;
+    case LayerType::Eltwise:
+        workload.macs = bottom_blobs.size() > 1 ? top_elemcount * (bottom_blobs.size() - 1) : top_elemcount;
+        break;
+    case LayerType::AbsVal:
+    case LayerType::BatchNorm:
+    case LayerType::Bias:
+    case LayerType::BinaryOp:
+    case LayerType::BNLL:
+    case LayerType::Clip:
+    case LayerType::ELU:
+    case LayerType::Exp:
+    case LayerType::GELU:
+    case LayerType::HardSigmoid:
+    case LayerType::HardSwish:
+    case LayerType::Log:
+    case LayerType::Mish:
+    case LayerType::Power:
+    case LayerType::PReLU:
+    case LayerType::ReLU:
+    case LayerType::Scale:
+    case LayerType::SELU:
+    case LayerType::Sigmoid:
+    case LayerType::Softplus:
+    case LayerType::Swish:
+    case LayerType::TanH:
+    case LayerType::Threshold:
+    case LayerType::UnaryOp:
+        workload.macs = top_elemcount;
+        break;
+    default:
+        break;
+    }
+
+    workload.bytes_read += weight_count * weight_elemsize;
+
+    return workload;
+}
+
 #if NCNN_BENCHMARK
 
 void benchmark(const Layer* layer, double start, double end)
@@ -125,6 +581,15 @@ void benchmark(const Layer* layer, const Mat& bottom_blob, Mat& top_blob, double
                 ((DeconvolutionDepthWise*)layer)->stride_w,
                 ((DeconvolutionDepthWise*)layer)->stride_h);
     }
+
+    const LayerWorkload workload = estimate_layer_workload(layer, std::vector<Mat>(1, bottom_blob), std::vector<Mat>(1, top_blob));
+    const double seconds = (end - start) / 1000.0;
+    if (seconds > 0)
+    {
+        fprintf(stderr, "     %8.2lf GFLOPS %8.2lf GB/s",
+                workload.macs * 2 / seconds / 1e9,
+                (workload.bytes_read + workload.bytes_written) / seconds / 1e9);
+    }
     fprintf(stderr, "\n");
 }
 
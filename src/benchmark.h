@@ -19,11 +19,45 @@
 #include "mat.h"
 #include "platform.h"
 
+#include <stdint.h>
+
 namespace ncnn {
 
 // get now timestamp in ms
 NCNN_EXPORT double get_current_time();
 
+// chrome trace event recording of layers, implicit layout conversions and simpleomp parallel regions
+// every thread gets its own track, the written json opens in chrome://tracing or perfetto
+// available without NCNN_BENCHMARK, costs one flag check per event while stopped
+NCNN_EXPORT void start_trace();
+
+#if NCNN_STDIO
+// stop recording and write the events collected since start_trace
+// call when no inference is running
+// return 0 if success
+NCNN_EXPORT int stop_trace(const char* path);
+#endif // NCNN_STDIO
+
+// return true between start_trace and stop_trace
+NCNN_EXPORT bool trace_enabled();
+
+// record a complete event on the calling thread, start and end from get_current_time
+NCNN_EXPORT void trace_event(const char* category, const char* name, const char* detail, double start, double end);
+
+// theoretical cost of one layer run
+// macs counts multiply-accumulates, elementwise layers count one per output element
+// bytes_read counts every bottom blob once plus the weights, bytes_written every top blob once
+struct NCNN_EXPORT LayerWorkload
+{
+    uint64_t macs;
+    uint64_t bytes_read;
+    uint64_t bytes_written;
+};
+
+// estimate the workload from layer params and the bottom and top blob shapes, blob data is not touched
+// layer types without a cost model report zero macs and the blob traffic only
+NCNN_EXPORT LayerWorkload estimate_layer_workload(const Layer* layer, const std::vector<Mat>& bottom_blobs, const std::vector<Mat>& top_blobs);
+
 #if NCNN_BENCHMARK
 
 NCNN_EXPORT void benchmark(const Layer* layer, double start, double end);
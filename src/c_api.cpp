@@ -36,6 +36,7 @@ using ncnn::Blob;
 using ncnn::DataReader;
 using ncnn::Extractor;
 using ncnn::Layer;
+using ncnn::LayerProfile;
 using ncnn::Mat;
 using ncnn::ModelBin;
 using ncnn::Net;
@@ -1267,6 +1268,11 @@ int ncnn_net_load_model(ncnn_net_t net, const char* path)
 {
     return ((Net*)net->pthis)->load_model(path);
 }
+
+int ncnn_net_load_model_mmap(ncnn_net_t net, const char* path)
+{
+    return ((Net*)net->pthis)->load_model_mmap(path);
+}
 #endif /* NCNN_STDIO */
 
 #if NCNN_STDIO
@@ -1357,6 +1363,70 @@ int ncnn_extractor_extract_index(ncnn_extractor_t ex, int index, ncnn_mat_t* mat
     return ret;
 }
 
+void ncnn_extractor_set_profiling(ncnn_extractor_t ex, int enable)
+{
+    ((Extractor*)ex)->set_profiling(enable != 0);
+}
+
+int ncnn_extractor_get_profile_record_count(const ncnn_extractor_t ex)
+{
+    return (int)((const Extractor*)ex)->profile_records().size();
+}
+
+int ncnn_extractor_get_profile_record(const ncnn_extractor_t ex, int index, ncnn_layer_profile_t* record)
+{
+    const std::vector<LayerProfile>& records = ((const Extractor*)ex)->profile_records();
+    if (index < 0 || index >= (int)records.size())
+        return -1;
+
+    const LayerProfile& r = records[index];
+    record->layer_index = r.layer_index;
+    record->typeindex = r.typeindex;
+#if NCNN_STRING
+    record->type = r.type;
+    record->name = r.name;
+#else
+    record->type = 0;
+    record->name = 0;
+#endif
+    record->start = r.start;
+    record->end = r.end;
+    record->num_threads = r.num_threads;
+    record->bottom_count = (int)r.bottom_shapes.size();
+    record->top_count = (int)r.top_shapes.size();
+    record->allocated_bytes = r.allocated_bytes;
+    record->macs = r.macs;
+    record->bytes_read = r.bytes_read;
+    record->bytes_written = r.bytes_written;
+    return 0;
+}
+
+int ncnn_extractor_get_profile_blob(const ncnn_extractor_t ex, int index, int top, int blob_index, ncnn_blob_profile_t* blob)
+{
+    const std::vector<LayerProfile>& records = ((const Extractor*)ex)->profile_records();
+    if (index < 0 || index >= (int)records.size())
+        return -1;
+
+    const std::vector<Mat>& shapes = top ? records[index].top_shapes : records[index].bottom_shapes;
+    if (blob_index < 0 || blob_index >= (int)shapes.size())
+        return -1;
+
+    const Mat& m = shapes[blob_index];
+    blob->dims = m.dims;
+    blob->w = m.w;
+    blob->h = m.h;
+    blob->d = m.d;
+    blob->c = m.c;
+    blob->elempack = m.elempack;
+    blob->elemsize = m.elemsize;
+    return 0;
+}
+
+void ncnn_extractor_clear_profile_records(ncnn_extractor_t ex)
+{
+    ((Extractor*)ex)->clear_profile_records();
+}
+
 #ifdef __cplusplus
 } /* extern "C" */
 #endif
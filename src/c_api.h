@@ -21,6 +21,7 @@
 #if NCNN_C_API
 
 #include <stddef.h>
+#include <stdint.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -278,6 +279,7 @@ NCNN_EXPORT int ncnn_net_load_param(ncnn_net_t net, const char* path);
 #endif /* NCNN_STRING */
 NCNN_EXPORT int ncnn_net_load_param_bin(ncnn_net_t net, const char* path);
 NCNN_EXPORT int ncnn_net_load_model(ncnn_net_t net, const char* path);
+NCNN_EXPORT int ncnn_net_load_model_mmap(ncnn_net_t net, const char* path);
 #endif /* NCNN_STDIO */
 
 #if NCNN_STDIO
@@ -311,6 +313,42 @@ NCNN_EXPORT int ncnn_extractor_extract(ncnn_extractor_t ex, const char* name, nc
 NCNN_EXPORT int ncnn_extractor_input_index(ncnn_extractor_t ex, int index, const ncnn_mat_t mat);
 NCNN_EXPORT int ncnn_extractor_extract_index(ncnn_extractor_t ex, int index, ncnn_mat_t* mat);
 
+/* extractor profiling, one record per layer run on cpu */
+typedef struct ncnn_layer_profile_t
+{
+    int layer_index;
+    int typeindex;
+    const char* type;
+    const char* name;
+    double start;
+    double end;
+    int num_threads;
+    int bottom_count;
+    int top_count;
+    size_t allocated_bytes;
+    uint64_t macs;
+    uint64_t bytes_read;
+    uint64_t bytes_written;
+} ncnn_layer_profile_t;
+
+typedef struct ncnn_blob_profile_t
+{
+    int dims;
+    int w;
+    int h;
+    int d;
+    int c;
+    int elempack;
+    size_t elemsize;
+} ncnn_blob_profile_t;
+
+NCNN_EXPORT void ncnn_extractor_set_profiling(ncnn_extractor_t ex, int enable);
+NCNN_EXPORT int ncnn_extractor_get_profile_record_count(const ncnn_extractor_t ex);
+NCNN_EXPORT int ncnn_extractor_get_profile_record(const ncnn_extractor_t ex, int index, ncnn_layer_profile_t* record);
+/* blob_index selects among the bottom blobs of the record, or the top blobs if top is nonzero */
+NCNN_EXPORT int ncnn_extractor_get_profile_blob(const ncnn_extractor_t ex, int index, int top, int blob_index, ncnn_blob_profile_t* blob);
+NCNN_EXPORT void ncnn_extractor_clear_profile_records(ncnn_extractor_t ex);
+
 #ifdef __cplusplus
 } /* extern "C" */
 #endif
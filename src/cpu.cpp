@@ -1124,6 +1124,264 @@ int get_big_cpu_count()
     return big_cpu_count ? big_cpu_count : g_cpucount;
 }
 
+#if defined __ANDROID__ || defined __linux__
+// parse cpulist like 0-15,32-47 into set, return the largest number seen
+static int parse_cpulist(const char* list, CpuSet* set)
+{
+    int max_id = -1;
+
+    const char* p = list;
+    while (*p)
+    {
+        int begin = 0;
+        int end = 0;
+        int nscan = 0;
+        if (sscanf(p, "%d-%d%n", &begin, &end, &nscan) != 2)
+        {
+            if (sscanf(p, "%d%n", &begin, &nscan) != 1)
+                break;
+            end = begin;
+        }
+
+        for (int i = begin; i <= end && i < CPU_SETSIZE; i++)
+        {
+            if (set)
+                set->enable(i);
+        }
+
+        if (end > max_id)
+            max_id = end;
+
+        p += nscan;
+        if (*p != ',')
+            break;
+        p++;
+    }
+
+    return max_id;
+}
+
+static bool read_sysfs_line(const char* path, char* line, int size)
+{
+    FILE* fp = fopen(path, "rb");
+    if (!fp)
+        return false;
+
+    char* s = fgets(line, size, fp);
+    fclose(fp);
+
+    return s != 0;
+}
+#endif // defined __ANDROID__ || defined __linux__
+
+static std::vector<CpuSet> get_numa_node_cpusets(const char* sysfs_root)
+{
+    std::vector<CpuSet> cpusets;
+
+#if defined __ANDROID__ || defined __linux__
+    char line[1024];
+    char path[256];
+    sprintf(path, "%s/devices/system/node/online", sysfs_root);
+    if (read_sysfs_line(path, line, 1024))
+    {
+        const int node_count = parse_cpulist(line, 0) + 1;
+
+        cpusets.resize(node_count > 0 ? node_count : 0);
+        for (int i = 0; i < (int)cpusets.size(); i++)
+        {
+            sprintf(path, "%s/devices/system/node/node%d/cpulist", sysfs_root, i);
+            if (read_sysfs_line(path, line, 1024))
+            {
+                parse_cpulist(line, &cpusets[i]);
+            }
+        }
+    }
+#else
+    (void)sysfs_root;
+#endif // defined __ANDROID__ || defined __linux__
+
+    if (cpusets.empty())
+    {
+        cpusets.resize(1);
+        for (int i = 0; i < g_cpucount; i++)
+        {
+            cpusets[0].enable(i);
+        }
+    }
+
+    return cpusets;
+}
+
+static std::vector<CpuSet> g_numa_node_cpusets = get_numa_node_cpusets("/sys");
+
+int reload_numa_topology(const char* sysfs_root)
+{
+    if (strlen(sysfs_root) > 128)
+    {
+        NCNN_LOGE("sysfs root %s too long", sysfs_root);
+        return -1;
+    }
+
+    g_numa_node_cpusets = get_numa_node_cpusets(sysfs_root);
+
+    return 0;
+}
+
+int get_numa_node_count()
+{
+    return (int)g_numa_node_cpusets.size();
+}
+
+const CpuSet& get_numa_node_cpuset(int node)
+{
+    if (node < 0 || node >= (int)g_numa_node_cpusets.size())
+    {
+        NCNN_LOGE("numa node %d not exists", node);
+
+        // fallback to the first node anyway
+        return g_numa_node_cpusets[0];
+    }
+
+    return g_numa_node_cpusets[node];
+}
+
+int get_current_numa_node()
+{
+#if (defined __ANDROID__ || defined __linux__) && defined SYS_getcpu
+    unsigned int cpu = 0;
+    unsigned int node = 0;
+    if (syscall(SYS_getcpu, &cpu, &node, 0) == 0 && (int)node < (int)g_numa_node_cpusets.size())
+        return (int)node;
+#endif
+
+    return 0;
+}
+
+// data or unified cache of one cpu per level 1 to 3
+struct cpu_cache_info
+{
+    int size[3];
+    int shared_cpu_count[3];
+};
+
+#if defined __ANDROID__ || defined __linux__
+// parse cache size like 48K or 2M into bytes
+static int parse_cache_size(const char* str)
+{
+    int size = 0;
+    char unit = 0;
+    int nscan = sscanf(str, "%d%c", &size, &unit);
+    if (nscan < 1)
+        return 0;
+
+    if (nscan == 2 && (unit == 'K' || unit == 'k'))
+        size *= 1024;
+    if (nscan == 2 && (unit == 'M' || unit == 'm'))
+        size *= 1024 * 1024;
+
+    return size;
+}
+#endif // defined __ANDROID__ || defined __linux__
+
+static std::vector<cpu_cache_info> get_cpu_cache_infos()
+{
+    cpu_cache_info unknown;
+    memset(&unknown, 0, sizeof(cpu_cache_info));
+
+    std::vector<cpu_cache_info> infos(g_cpucount, unknown);
+
+#if defined __ANDROID__ || defined __linux__
+    char line[1024];
+    for (int i = 0; i < g_cpucount; i++)
+    {
+        for (int j = 0; j < 16; j++)
+        {
+            char path[256];
+            sprintf(path, "/sys/devices/system/cpu/cpu%d/cache/index%d/level", i, j);
+            if (!read_sysfs_line(path, line, 1024))
+                break;
+
+            int level = 0;
+            if (sscanf(line, "%d", &level) != 1 || level < 1 || level > 3)
+                continue;
+
+            // instruction caches do not hold data
+            sprintf(path, "/sys/devices/system/cpu/cpu%d/cache/index%d/type", i, j);
+            if (!read_sysfs_line(path, line, 1024) || strncmp(line, "Instruction", 11) == 0)
+                continue;
+
+            sprintf(path, "/sys/devices/system/cpu/cpu%d/cache/index%d/size", i, j);
+            if (!read_sysfs_line(path, line, 1024))
+                continue;
+
+            infos[i].size[level - 1] = parse_cache_size(line);
+
+            sprintf(path, "/sys/devices/system/cpu/cpu%d/cache/index%d/shared_cpu_list", i, j);
+            if (read_sysfs_line(path, line, 1024))
+            {
+                CpuSet shared;
+                shared.disable_all();
+                parse_cpulist(line, &shared);
+                infos[i].shared_cpu_count[level - 1] = shared.num_enabled();
+            }
+        }
+    }
+#endif // defined __ANDROID__ || defined __linux__
+
+    return infos;
+}
+
+static std::vector<cpu_cache_info> g_cpu_cache_infos = get_cpu_cache_infos();
+
+int get_cpu_cache_size(int cpu, int level)
+{
+    if (cpu < 0 || cpu >= (int)g_cpu_cache_infos.size() || level < 1 || level > 3)
+        return 0;
+
+    return g_cpu_cache_infos[cpu].size[level - 1];
+}
+
+int get_cpu_cache_shared_cpu_count(int cpu, int level)
+{
+    if (cpu < 0 || cpu >= (int)g_cpu_cache_infos.size() || level < 1 || level > 3)
+        return 0;
+
+    return g_cpu_cache_infos[cpu].shared_cpu_count[level - 1];
+}
+
+// the smallest known size among all cpus, fallback if none is known
+static int get_cpu_level_cache_size(int level, int fallback)
+{
+    int size = 0;
+    for (int i = 0; i < (int)g_cpu_cache_infos.size(); i++)
+    {
+        const int cpu_size = g_cpu_cache_infos[i].size[level - 1];
+        if (cpu_size > 0 && (size == 0 || cpu_size < size))
+            size = cpu_size;
+    }
+
+    return size > 0 ? size : fallback;
+}
+
+static int g_cpu_level1_cache_size = get_cpu_level_cache_size(1, 32 * 1024);
+static int g_cpu_level2_cache_size = get_cpu_level_cache_size(2, 256 * 1024);
+static int g_cpu_level3_cache_size = get_cpu_level_cache_size(3, 0);
+
+int get_cpu_level1_cache_size()
+{
+    return g_cpu_level1_cache_size;
+}
+
+int get_cpu_level2_cache_size()
+{
+    return g_cpu_level2_cache_size;
+}
+
+int get_cpu_level3_cache_size()
+{
+    return g_cpu_level3_cache_size;
+}
+
 #if defined __ANDROID__ || defined __linux__
 static int get_max_freq_khz(int cpuid)
 {
@@ -1473,6 +1731,82 @@ int set_cpu_thread_affinity(const CpuSet& thread_affinity_mask)
 #endif
 }
 
+int set_cpu_current_thread_affinity(const CpuSet& thread_affinity_mask)
+{
+#if defined __ANDROID__ || defined __linux__ || __APPLE__
+    return set_sched_affinity(thread_affinity_mask);
+#else
+    // CpuSet carries no cpus on other platforms, fail like set_cpu_thread_affinity does there
+    (void)thread_affinity_mask;
+    return -1;
+#endif
+}
+
+CpuSet get_cpu_partition(int partition_index, int partition_count)
+{
+    CpuSet partition;
+    partition.disable_all();
+
+    if (partition_count < 1 || partition_index < 0 || partition_index >= partition_count)
+    {
+        NCNN_LOGE("cpu partition %d of %d not exists", partition_index, partition_count);
+        return partition;
+    }
+
+    // an empty mask stands for all cores
+    CpuSet thread_affinity_mask = get_cpu_thread_affinity_mask(0);
+    if (thread_affinity_mask.num_enabled() == 0)
+    {
+        for (int j = 0; j < g_cpucount; j++)
+        {
+            thread_affinity_mask.enable(j);
+        }
+    }
+
+    std::vector<int> cpus;
+    CpuSet visited;
+    visited.disable_all();
+    for (int i = 0; i < (int)g_numa_node_cpusets.size(); i++)
+    {
+        for (int j = 0; j < g_cpucount; j++)
+        {
+            if (g_numa_node_cpusets[i].is_enabled(j) && thread_affinity_mask.is_enabled(j) && !visited.is_enabled(j))
+            {
+                cpus.push_back(j);
+                visited.enable(j);
+            }
+        }
+    }
+
+    // cores missing from the numa topology go last
+    for (int j = 0; j < g_cpucount; j++)
+    {
+        if (thread_affinity_mask.is_enabled(j) && !visited.is_enabled(j))
+        {
+            cpus.push_back(j);
+        }
+    }
+
+    const int cpu_count = (int)cpus.size();
+    if (cpu_count == 0)
+        return partition;
+
+    if (cpu_count < partition_count)
+    {
+        partition.enable(cpus[partition_index % cpu_count]);
+        return partition;
+    }
+
+    const int begin = (int)((long long)partition_index * cpu_count / partition_count);
+    const int end = (int)((long long)(partition_index + 1) * cpu_count / partition_count);
+    for (int i = begin; i < end; i++)
+    {
+        partition.enable(cpus[i]);
+    }
+
+    return partition;
+}
+
 int get_omp_num_threads()
 {
 #ifdef _OPENMP
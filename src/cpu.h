@@ -110,6 +110,31 @@ NCNN_EXPORT int get_cpu_count();
 NCNN_EXPORT int get_little_cpu_count();
 NCNN_EXPORT int get_big_cpu_count();
 
+// numa topology from linux sysfs
+// a single node with all cpus elsewhere
+// nodes without cpu have an empty cpuset
+NCNN_EXPORT int get_numa_node_count();
+NCNN_EXPORT const CpuSet& get_numa_node_cpuset(int node);
+
+// read the numa topology again from sysfs_root instead of /sys, e.g. a faked tree in tests
+// not thread safe, call it before loading any net
+// return 0 on success
+NCNN_EXPORT int reload_numa_topology(const char* sysfs_root);
+
+// the numa node of the cpu the calling thread runs on now
+NCNN_EXPORT int get_current_numa_node();
+
+// cache topology from linux sysfs, level 1 is the data cache
+// size in bytes and the count of cpus sharing the cache, 0 if unknown
+NCNN_EXPORT int get_cpu_cache_size(int cpu, int level);
+NCNN_EXPORT int get_cpu_cache_shared_cpu_count(int cpu, int level);
+
+// cache size for blocking kernels, the smallest among all cpus
+// 32K l1 and 256K l2 if unknown, 0 l3 if unknown or absent
+NCNN_EXPORT int get_cpu_level1_cache_size();
+NCNN_EXPORT int get_cpu_level2_cache_size();
+NCNN_EXPORT int get_cpu_level3_cache_size();
+
 // bind all threads on little clusters if powersave enabled
 // affects HMP arch cpu like ARM big.LITTLE
 // only implemented on android at the moment
@@ -127,6 +152,15 @@ NCNN_EXPORT const CpuSet& get_cpu_thread_affinity_mask(int powersave);
 // set explicit thread affinity
 NCNN_EXPORT int set_cpu_thread_affinity(const CpuSet& thread_affinity_mask);
 
+// set explicit thread affinity of the calling thread only, its openmp threads keep their cores
+// supported on android, linux and apple like set_cpu_thread_affinity, return -1 elsewhere
+NCNN_EXPORT int set_cpu_current_thread_affinity(const CpuSet& thread_affinity_mask);
+
+// split all cores into partition_count disjoint sets of nearly equal size for multi-stream inference
+// cores are taken numa node by numa node so that a partition stays within one node when possible
+// partitions share cores round-robin if there are fewer cores than partitions
+NCNN_EXPORT CpuSet get_cpu_partition(int partition_index, int partition_count);
+
 // misc function wrapper for openmp routines
 NCNN_EXPORT int get_omp_num_threads();
 NCNN_EXPORT void set_omp_num_threads(int num_threads);
@@ -16,6 +16,17 @@
 
 #include <string.h>
 
+#if NCNN_STDIO
+#include "allocator.h"
+
+#if defined __unix__ || defined __APPLE__
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#endif // NCNN_STDIO
+
 namespace ncnn {
 
 DataReader::DataReader()
@@ -85,6 +96,121 @@ size_t DataReaderFromStdio::read(void* buf, size_t size) const
 {
     return fread(buf, 1, size, d->fp);
 }
+
+class DataReaderFromMmapPrivate
+{
+public:
+    DataReaderFromMmapPrivate()
+        : data(0), size(0), pos(0), mapped(false)
+    {
+    }
+    unsigned char* data;
+    size_t size;
+    mutable size_t pos;
+    bool mapped;
+};
+
+DataReaderFromMmap::DataReaderFromMmap(const char* path)
+    : DataReader(), d(new DataReaderFromMmapPrivate)
+{
+#if defined __unix__ || defined __APPLE__
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0)
+    {
+        close(fd);
+        return;
+    }
+
+    // untouched pages stay shared with the page cache and other processes
+    // private writable mapping so that layers modifying weights in place get their own copy
+    void* ptr = mmap(0, (size_t)st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (ptr == MAP_FAILED)
+        return;
+
+    d->data = (unsigned char*)ptr;
+    d->size = (size_t)st.st_size;
+    d->mapped = true;
+#else
+    // no mmap, read the whole file into one aligned buffer
+    FILE* fp = fopen(path, "rb");
+    if (!fp)
+        return;
+
+    fseek(fp, 0, SEEK_END);
+    long len = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    if (len <= 0)
+    {
+        fclose(fp);
+        return;
+    }
+
+    unsigned char* data = (unsigned char*)fastMalloc((size_t)len);
+    size_t nread = fread(data, 1, (size_t)len, fp);
+    fclose(fp);
+    if (nread != (size_t)len)
+    {
+        fastFree(data);
+        return;
+    }
+
+    d->data = data;
+    d->size = (size_t)len;
+#endif
+}
+
+DataReaderFromMmap::~DataReaderFromMmap()
+{
+    if (d->data)
+    {
+#if defined __unix__ || defined __APPLE__
+        if (d->mapped)
+            munmap(d->data, d->size);
+#else
+        fastFree(d->data);
+#endif
+    }
+
+    delete d;
+}
+
+DataReaderFromMmap::DataReaderFromMmap(const DataReaderFromMmap&)
+    : d(0)
+{
+}
+
+DataReaderFromMmap& DataReaderFromMmap::operator=(const DataReaderFromMmap&)
+{
+    return *this;
+}
+
+bool DataReaderFromMmap::empty() const
+{
+    return d->data == 0;
+}
+
+size_t DataReaderFromMmap::read(void* buf, size_t size) const
+{
+    size_t nread = size < d->size - d->pos ? size : d->size - d->pos;
+    memcpy(buf, d->data + d->pos, nread);
+    d->pos += nread;
+    return nread;
+}
+
+size_t DataReaderFromMmap::reference(size_t size, const void** buf) const
+{
+    if (size > d->size - d->pos)
+        return 0;
+
+    *buf = d->data + d->pos;
+    d->pos += size;
+    return size;
+}
 #endif // NCNN_STDIO
 
 class DataReaderFromMemoryPrivate
@@ -70,6 +70,30 @@ private:
 private:
     DataReaderFromStdioPrivate* const d;
 };
+
+class DataReaderFromMmapPrivate;
+class NCNN_EXPORT DataReaderFromMmap : public DataReader
+{
+public:
+    // map binary model file copy-on-write
+    // weight data is referenced from the mapping, which is unmapped on destruction
+    // so the reader should be retained while the weights are used
+    explicit DataReaderFromMmap(const char* path);
+    virtual ~DataReaderFromMmap();
+
+    // return true if the file could not be mapped
+    bool empty() const;
+
+    virtual size_t read(void* buf, size_t size) const;
+    virtual size_t reference(size_t size, const void** buf) const;
+
+private:
+    DataReaderFromMmap(const DataReaderFromMmap&);
+    DataReaderFromMmap& operator=(const DataReaderFromMmap&);
+
+private:
+    DataReaderFromMmapPrivate* const d;
+};
 #endif // NCNN_STDIO
 
 class DataReaderFromMemoryPrivate;
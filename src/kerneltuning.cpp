@@ -0,0 +1,203 @@
+// Tencent is pleased to support the open source community by making ncnn available.
+//
+// Copyright (C) 2024 THL A29 Limited, a Tencent company. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this file except
+// in compliance with the License. You may obtain a copy of the License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software distributed
+// under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+// CONDITIONS OF ANY KIND, either express or implied. See the License for the
+// specific language governing permissions and limitations under the License.
+
+#include "kerneltuning.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if NCNN_STDIO && defined __APPLE__
+#include <sys/sysctl.h>
+#endif
+
+namespace ncnn {
+
+void apply_kernel_choice(Option& opt, int choice)
+{
+    if (choice == KERNEL_CHOICE_DIRECT)
+    {
+        opt.use_winograd_convolution = false;
+        opt.use_sgemm_convolution = false;
+    }
+    if (choice == KERNEL_CHOICE_SGEMM)
+    {
+        opt.use_winograd_convolution = false;
+    }
+    if (choice == KERNEL_CHOICE_WINOGRAD23)
+    {
+        opt.use_winograd43_convolution = false;
+        opt.use_winograd63_convolution = false;
+    }
+    if (choice == KERNEL_CHOICE_WINOGRAD43)
+    {
+        opt.use_winograd23_convolution = false;
+        opt.use_winograd63_convolution = false;
+    }
+    if (choice == KERNEL_CHOICE_WINOGRAD63)
+    {
+        opt.use_winograd23_convolution = false;
+        opt.use_winograd43_convolution = false;
+    }
+}
+
+bool kernel_choice_enabled(const Option& opt, int choice)
+{
+    if (choice == KERNEL_CHOICE_SGEMM)
+        return opt.use_sgemm_convolution;
+    if (choice == KERNEL_CHOICE_WINOGRAD23)
+        return opt.use_winograd_convolution && opt.use_winograd23_convolution;
+    if (choice == KERNEL_CHOICE_WINOGRAD43)
+        return opt.use_winograd_convolution && opt.use_winograd43_convolution;
+    if (choice == KERNEL_CHOICE_WINOGRAD63)
+        return opt.use_winograd_convolution && opt.use_winograd63_convolution;
+
+    return true;
+}
+
+#if NCNN_STDIO
+static std::string get_cpu_model_name()
+{
+    char name[256] = "unknown";
+
+#if defined __linux__
+    FILE* fp = fopen("/proc/cpuinfo", "rb");
+    if (fp)
+    {
+        char line[1024];
+        while (fgets(line, sizeof(line), fp))
+        {
+            // x86 reports model name, arm kernels report Hardware
+            if (strncmp(line, "model name", 10) != 0 && strncmp(line, "Hardware", 8) != 0)
+                continue;
+
+            const char* colon = strchr(line, ':');
+            if (!colon)
+                continue;
+
+            colon++;
+            while (*colon == ' ')
+                colon++;
+
+            size_t len = strcspn(colon, "\t\r\n");
+            if (len == 0 || len >= sizeof(name))
+                continue;
+
+            memcpy(name, colon, len);
+            name[len] = '\0';
+            break;
+        }
+        fclose(fp);
+    }
+#elif defined __APPLE__
+    size_t len = sizeof(name);
+    if (sysctlbyname("machdep.cpu.brand_string", name, &len, NULL, 0) != 0)
+    {
+        strcpy(name, "unknown");
+    }
+#endif
+
+    return std::string(name);
+}
+
+KernelTuningDatabase::KernelTuningDatabase()
+{
+    dirty = false;
+    cpu_model = get_cpu_model_name();
+}
+
+int KernelTuningDatabase::load(const char* path)
+{
+    FILE* fp = fopen(path, "rb");
+    if (!fp)
+        return -1;
+
+    char line[1024];
+    while (fgets(line, sizeof(line), fp))
+    {
+        char* tab0 = strchr(line, '\t');
+        char* tab1 = tab0 ? strchr(tab0 + 1, '\t') : 0;
+        if (!tab1)
+            continue;
+
+        *tab0 = '\0';
+        *tab1 = '\0';
+
+        tuning_entry e;
+        e.cpu_model = line;
+        e.key = tab0 + 1;
+        e.choice = atoi(tab1 + 1);
+        entries.push_back(e);
+    }
+
+    fclose(fp);
+
+    return 0;
+}
+
+int KernelTuningDatabase::find(const char* key) const
+{
+    for (size_t i = 0; i < entries.size(); i++)
+    {
+        const tuning_entry& e = entries[i];
+        if (e.cpu_model == cpu_model && e.key == key)
+            return e.choice;
+    }
+
+    return 0;
+}
+
+void KernelTuningDatabase::set(const char* key, int choice)
+{
+    dirty = true;
+
+    for (size_t i = 0; i < entries.size(); i++)
+    {
+        tuning_entry& e = entries[i];
+        if (e.cpu_model == cpu_model && e.key == key)
+        {
+            e.choice = choice;
+            return;
+        }
+    }
+
+    tuning_entry e;
+    e.cpu_model = cpu_model;
+    e.key = key;
+    e.choice = choice;
+    entries.push_back(e);
+}
+
+int KernelTuningDatabase::save(const char* path) const
+{
+    FILE* fp = fopen(path, "wb");
+    if (!fp)
+    {
+        NCNN_LOGE("fopen %s failed", path);
+        return -1;
+    }
+
+    for (size_t i = 0; i < entries.size(); i++)
+    {
+        const tuning_entry& e = entries[i];
+        fprintf(fp, "%s\t%s\t%d\n", e.cpu_model.c_str(), e.key.c_str(), e.choice);
+    }
+
+    fclose(fp);
+
+    return 0;
+}
+#endif // NCNN_STDIO
+
+} // namespace ncnn
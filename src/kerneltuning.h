@@ -0,0 +1,77 @@
+// Tencent is pleased to support the open source community by making ncnn available.
+//
+// Copyright (C) 2024 THL A29 Limited, a Tencent company. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this file except
+// in compliance with the License. You may obtain a copy of the License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software distributed
+// under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+// CONDITIONS OF ANY KIND, either express or implied. See the License for the
+// specific language governing permissions and limitations under the License.
+
+#ifndef NCNN_KERNELTUNING_H
+#define NCNN_KERNELTUNING_H
+
+#include "option.h"
+#include "platform.h"
+
+namespace ncnn {
+
+// convolution kernels autotune chooses from
+enum
+{
+    KERNEL_CHOICE_DIRECT = 1,
+    KERNEL_CHOICE_SGEMM = 2,
+    KERNEL_CHOICE_WINOGRAD23 = 3,
+    KERNEL_CHOICE_WINOGRAD43 = 4,
+    KERNEL_CHOICE_WINOGRAD63 = 5,
+    KERNEL_CHOICE_COUNT = 6
+};
+
+// only turn options off, kernels disabled by the user are never picked
+void apply_kernel_choice(Option& opt, int choice);
+
+// whether opt allows choice at all
+bool kernel_choice_enabled(const Option& opt, int choice);
+
+#if NCNN_STDIO
+// kernel choices measured by autotune, one line per cpu model and layer shape
+// cpu_model<TAB>key<TAB>choice
+// entries of other cpu models are kept when the file is rewritten
+class KernelTuningDatabase
+{
+public:
+    KernelTuningDatabase();
+
+    // read all entries, return 0 if the file exists
+    int load(const char* path);
+
+    // choice of the current cpu model, 0 if not found
+    int find(const char* key) const;
+
+    void set(const char* key, int choice);
+
+    int save(const char* path) const;
+
+    bool dirty;
+
+private:
+    struct tuning_entry
+    {
+        std::string cpu_model;
+        std::string key;
+        int choice;
+    };
+
+    std::vector<tuning_entry> entries;
+
+    std::string cpu_model;
+};
+#endif // NCNN_STDIO
+
+} // namespace ncnn
+
+#endif // NCNN_KERNELTUNING_H
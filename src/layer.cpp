@@ -85,6 +85,21 @@ int Layer::destroy_pipeline(const Option& /*opt*/)
     return 0;
 }
 
+int Layer::get_pipeline_weights(std::vector<Mat>& /*weights*/) const
+{
+    return -1;
+}
+
+int Layer::create_pipeline_from_weights(const std::vector<Mat>& /*weights*/, const Option& /*opt*/)
+{
+    return -1;
+}
+
+int Layer::get_kernel_info(LayerKernelInfo& /*info*/) const
+{
+    return -1;
+}
+
 int Layer::forward(const std::vector<Mat>& bottom_blobs, std::vector<Mat>& top_blobs, const Option& opt) const
 {
     if (!support_inplace)
@@ -32,6 +32,20 @@
 
 namespace ncnn {
 
+// implementation picked by create_pipeline
+struct NCNN_EXPORT LayerKernelInfo
+{
+    // kernel family, such as conv1x1s1_sgemm im2col_sgemm winograd63 direct gemv
+    const char* algorithm;
+    // instruction set of the layer variant, such as sse2 avx fma avx512 avx512vnni
+    const char* isa;
+    // arithmetic precision, fp32 fp16 bf16 or int8
+    const char* precision;
+    // packing of input and output channels
+    int elempack;
+    int out_elempack;
+};
+
 class NCNN_EXPORT Layer
 {
 public:
@@ -56,6 +70,19 @@ public:
     // return 0 if success
     virtual int destroy_pipeline(const Option& opt);
 
+    // weights prepared by create_pipeline, to be stored in the pipeline weight cache
+    // return 0 if success, -1 if not supported
+    virtual int get_pipeline_weights(std::vector<Mat>& weights) const;
+
+    // setup from weights returned by get_pipeline_weights in a former run
+    // skips the weight transform of create_pipeline
+    // return 0 if success, -1 to fall back to create_pipeline
+    virtual int create_pipeline_from_weights(const std::vector<Mat>& weights, const Option& opt);
+
+    // describe the implementation chosen by create_pipeline
+    // return 0 if success, -1 if the layer does not report it
+    virtual int get_kernel_info(LayerKernelInfo& info) const;
+
 public:
     // one input and one output blob
     bool one_blob_only;
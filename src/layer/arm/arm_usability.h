@@ -15,6 +15,24 @@
 #ifndef ARM_USABILITY_H
 #define ARM_USABILITY_H
 
+// instruction set of the layer variant built from this source
+static inline const char* arm_kernel_isa()
+{
+#if __ARM_FEATURE_MATMUL_INT8
+    return "i8mm";
+#elif __ARM_FEATURE_DOTPROD
+    return "asimddp";
+#elif __ARM_FEATURE_FP16_VECTOR_ARITHMETIC
+    return "asimdhp";
+#elif __aarch64__
+    return "asimd";
+#elif __ARM_NEON
+    return "neon";
+#else
+    return "generic";
+#endif
+}
+
 static inline signed char float2int8(float v)
 {
     int int32 = round(v);
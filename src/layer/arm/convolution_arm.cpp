@@ -125,6 +125,12 @@ Convolution_arm::Convolution_arm()
 
     activation = 0;
     convolution_dilation1 = 0;
+
+    kernel_info.algorithm = 0;
+    kernel_info.isa = arm_kernel_isa();
+    kernel_info.precision = "fp32";
+    kernel_info.elempack = 1;
+    kernel_info.out_elempack = 1;
 }
 
 int Convolution_arm::create_pipeline(const Option& opt)
@@ -194,6 +200,8 @@ int Convolution_arm::create_pipeline(const Option& opt)
 
         convolution_dilation1->create_pipeline(opt);
 
+        update_kernel_info(1, 1, "fp32");
+
         return 0;
     }
 
@@ -436,6 +444,8 @@ int Convolution_arm::create_pipeline(const Option& opt)
         weight_data.release();
     }
 
+    update_kernel_info(elempack, out_elempack, "fp32");
+
     return 0;
 }
 
@@ -455,6 +465,78 @@ int Convolution_arm::destroy_pipeline(const Option& opt)
         convolution_dilation1 = 0;
     }
 
+    // a later create_pipeline may pick another kernel
+    weight_data_tm.release();
+    weight_3x3s2_data.release();
+    weight_sgemm_data.release();
+    weight_winograd23_data.release();
+    weight_winograd43_data.release();
+    weight_winograd63_data.release();
+
+    kernel_info.algorithm = 0;
+
+    return 0;
+}
+
+#if NCNN_INT8
+// mirror the runtime dispatch of the int8 sgemm kernels
+static const char* convolution_int8_sgemm_isa()
+{
+#if !(__ARM_FEATURE_MATMUL_INT8 || __ARM_FEATURE_DOTPROD)
+#if NCNN_RUNTIME_CPU && NCNN_ARM84I8MM && __aarch64__ && !__ARM_FEATURE_MATMUL_INT8
+    if (ncnn::cpu_support_arm_i8mm())
+        return "i8mm";
+#endif
+#if NCNN_RUNTIME_CPU && NCNN_ARM82DOT && __aarch64__ && !__ARM_FEATURE_DOTPROD
+    if (ncnn::cpu_support_arm_asimddp())
+        return "asimddp";
+#endif
+#endif
+    return arm_kernel_isa();
+}
+#endif // NCNN_INT8
+
+void Convolution_arm::update_kernel_info(int elempack, int out_elempack, const char* precision)
+{
+    const bool k1 = kernel_w == 1 && kernel_h == 1;
+    const bool s1 = dilation_w == 1 && dilation_h == 1 && stride_w == 1 && stride_h == 1;
+    const bool s2 = dilation_w == 1 && dilation_h == 1 && stride_w == 2 && stride_h == 2;
+
+    // the transformed weights tell which kernel forward dispatches to
+    const char* algorithm = "direct";
+    if (convolution_dilation1)
+        algorithm = "dilation";
+    else if (!weight_winograd63_data.empty())
+        algorithm = "winograd63";
+    else if (!weight_winograd43_data.empty())
+        algorithm = "winograd43";
+    else if (!weight_winograd23_data.empty())
+        algorithm = "winograd23";
+    else if (!weight_3x3s2_data.empty())
+        algorithm = "conv3x3s2";
+    else if (!weight_sgemm_data.empty())
+    {
+        if (k1 && s1)
+            algorithm = "conv1x1s1_sgemm";
+        else if (k1 && s2)
+            algorithm = "conv1x1s2_sgemm";
+        else
+            algorithm = "im2col_sgemm";
+    }
+
+    kernel_info.algorithm = algorithm;
+    kernel_info.isa = arm_kernel_isa();
+    kernel_info.precision = precision;
+    kernel_info.elempack = elempack;
+    kernel_info.out_elempack = out_elempack;
+}
+
+int Convolution_arm::get_kernel_info(LayerKernelInfo& info) const
+{
+    if (!kernel_info.algorithm)
+        return -1;
+
+    info = kernel_info;
     return 0;
 }
 
@@ -1238,6 +1320,8 @@ int Convolution_arm::create_pipeline_bf16s(const Option& opt)
         weight_data.release();
     }
 
+    update_kernel_info(elempack, out_elempack, "bf16");
+
     return 0;
 }
 
@@ -1697,6 +1781,11 @@ int Convolution_arm::create_pipeline_int8_arm(const Option& opt)
         weight_data.release();
     }
 
+    update_kernel_info(elempack, out_elempack, "int8");
+
+    if (weight_winograd43_data.empty() && !weight_sgemm_data.empty())
+        kernel_info.isa = convolution_int8_sgemm_isa();
+
     return 0;
 }
 
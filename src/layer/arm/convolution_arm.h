@@ -27,6 +27,8 @@ public:
     virtual int create_pipeline(const Option& opt);
     virtual int destroy_pipeline(const Option& opt);
 
+    virtual int get_kernel_info(LayerKernelInfo& info) const;
+
     virtual int forward(const Mat& bottom_blob, Mat& top_blob, const Option& opt) const;
 
     virtual int forward(const std::vector<Mat>& bottom_blobs, std::vector<Mat>& top_blobs, const Option& opt) const;
@@ -47,6 +49,8 @@ protected:
 #endif
     int forwardDilation_arm(const Mat& bottom_blob, Mat& top_blob, const Option& opt) const;
 
+    void update_kernel_info(int elempack, int out_elempack, const char* precision);
+
 public:
     Layer* activation;
 
@@ -61,6 +65,8 @@ public:
     // forwardDilation
     Layer* convolution_dilation1;
 
+    LayerKernelInfo kernel_info;
+
     // fp16
     Mat bias_data_fp16;
 
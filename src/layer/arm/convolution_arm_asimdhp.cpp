@@ -354,6 +354,8 @@ int Convolution_arm::create_pipeline_fp16s(const Option& opt)
         weight_data.release();
     }
 
+    update_kernel_info(elempack, out_elempack, "fp16");
+
     return 0;
 }
 
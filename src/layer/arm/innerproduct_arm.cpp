@@ -46,6 +46,12 @@ InnerProduct_arm::InnerProduct_arm()
 #endif
 
     flatten = 0;
+
+    kernel_info.algorithm = 0;
+    kernel_info.isa = arm_kernel_isa();
+    kernel_info.precision = "fp32";
+    kernel_info.elempack = 1;
+    kernel_info.out_elempack = 1;
 }
 
 int InnerProduct_arm::create_pipeline(const Option& opt)
@@ -132,6 +138,8 @@ int InnerProduct_arm::create_pipeline(const Option& opt)
         weight_data.release();
     }
 
+    update_kernel_info(out_elempack, "fp32");
+
     return 0;
 }
 
@@ -144,6 +152,27 @@ int InnerProduct_arm::destroy_pipeline(const Option& opt)
         flatten = 0;
     }
 
+    kernel_info.algorithm = 0;
+
+    return 0;
+}
+
+void InnerProduct_arm::update_kernel_info(int out_elempack, const char* precision)
+{
+    // forward switches to gemm for 2-dim input with more than one row
+    kernel_info.algorithm = "gemv";
+    kernel_info.isa = arm_kernel_isa();
+    kernel_info.precision = precision;
+    kernel_info.elempack = 1;
+    kernel_info.out_elempack = out_elempack;
+}
+
+int InnerProduct_arm::get_kernel_info(LayerKernelInfo& info) const
+{
+    if (!kernel_info.algorithm)
+        return -1;
+
+    info = kernel_info;
     return 0;
 }
 
@@ -867,6 +896,48 @@ int InnerProduct_arm::create_pipeline_fp16s(const Option& opt)
         weight_data.release();
     }
 
+    int out_elempack = 1;
+    if (opt.use_packing_layout)
+    {
+        out_elempack = num_output % 4 == 0 ? 4 : 1;
+    }
+
+    update_kernel_info(out_elempack, "fp16");
+
+    // mirror the runtime dispatch of the fp16 kernels
+#if NCNN_ARM82
+    if (ncnn::cpu_support_arm_asimdhp() && opt.use_fp16_arithmetic)
+    {
+        if (opt.use_packing_layout && num_output % 8 == 0)
+            kernel_info.out_elempack = 8;
+        kernel_info.isa = "asimdhp";
+        return 0;
+    }
+#endif
+#if !(__ARM_FEATURE_FP16_FML || __ARM_FEATURE_FP16_VECTOR_ARITHMETIC)
+#if NCNN_RUNTIME_CPU && NCNN_ARM82FP16FML && __aarch64__ && !__ARM_FEATURE_FP16_FML
+    if (ncnn::cpu_support_arm_asimdfhm())
+    {
+        kernel_info.isa = "asimdfhm";
+        return 0;
+    }
+#endif
+#if NCNN_RUNTIME_CPU && NCNN_ARM82 && __aarch64__ && !__ARM_FEATURE_FP16_VECTOR_ARITHMETIC
+    if (ncnn::cpu_support_arm_asimdhp())
+    {
+        kernel_info.isa = "asimdhp";
+        return 0;
+    }
+#endif
+#endif
+#if NCNN_RUNTIME_CPU && NCNN_VFPV4 && __ARM_NEON && !__aarch64__ && !(__ARM_FP & 2)
+    if (ncnn::cpu_support_arm_vfpv4())
+    {
+        kernel_info.isa = "vfpv4";
+        return 0;
+    }
+#endif
+
     return 0;
 }
 
@@ -967,6 +1038,8 @@ int InnerProduct_arm::create_pipeline_bf16s(const Option& opt)
         weight_data.release();
     }
 
+    update_kernel_info(out_elempack, "bf16");
+
     return 0;
 }
 
@@ -1363,6 +1436,8 @@ int InnerProduct_arm::create_pipeline_int8_arm(const Option& opt)
         weight_data.release();
     }
 
+    update_kernel_info(out_elempack, "int8");
+
     return 0;
 }
 
@@ -329,221 +329,228 @@ static void im2col_sgemm_pack16_avx512(const Mat& bottom_im2col, Mat& top_blob,
         }
     }
 
-    #pragma omp parallel for num_threads(opt.num_threads)
-    for (int p = 0; p < outch; p++)
+    // walk the columns in passes whose packed input stays in l2 while every output channel runs over it
+    const int size_block = get_im2col_sgemm_size_block(size, inch * maxk * 16 * sizeof(float));
+    for (int i0 = 0; i0 < size; i0 += size_block)
     {
-        float* outptr0 = top_blob.channel(p);
+        const int i1 = std::min(i0 + size_block, size);
 
-        const float zeros[16] = {0.f, 0.f, 0.f, 0.f, 0.f, 0.f, 0.f, 0.f, 0.f, 0.f, 0.f, 0.f, 0.f, 0.f, 0.f, 0.f};
-        const float* biasptr = bias ? bias + p * 16 : zeros;
-
-        int i = 0;
-        for (; i + 11 < size; i += 12)
+        #pragma omp parallel for num_threads(opt.num_threads)
+        for (int p = 0; p < outch; p++)
         {
-            const float* tmpptr = tmp.channel(i / 12);
-            const float* kptr0 = kernel.channel(p);
-
-            int nn = inch * maxk * 16; // inch always > 0
-
-            __m512 _sum0 = _mm512_loadu_ps(biasptr);
-            __m512 _sum1 = _sum0;
-            __m512 _sum2 = _sum0;
-            __m512 _sum3 = _sum0;
-            __m512 _sum4 = _sum0;
-            __m512 _sum5 = _sum0;
-            __m512 _sum6 = _sum0;
-            __m512 _sum7 = _sum0;
-            __m512 _sum8 = _sum0;
-            __m512 _sum9 = _sum0;
-            __m512 _suma = _sum0;
-            __m512 _sumb = _sum0;
-
-            for (int j = 0; j < nn; j++)
+            float* outptr0 = (float*)top_blob.channel(p) + i0 * 16;
+
+            const float zeros[16] = {0.f, 0.f, 0.f, 0.f, 0.f, 0.f, 0.f, 0.f, 0.f, 0.f, 0.f, 0.f, 0.f, 0.f, 0.f, 0.f};
+            const float* biasptr = bias ? bias + p * 16 : zeros;
+
+            int i = i0;
+            for (; i + 11 < i1; i += 12)
             {
-                __m512 _w0 = _mm512_loadu_ps(kptr0);
-
-                __m512 _val0 = _mm512_set1_ps(tmpptr[0]);
-                __m512 _val1 = _mm512_set1_ps(tmpptr[1]);
-                _sum0 = _mm512_fmadd_ps(_val0, _w0, _sum0);
-                _sum1 = _mm512_fmadd_ps(_val1, _w0, _sum1);
-                __m512 _val2 = _mm512_set1_ps(tmpptr[2]);
-                __m512 _val3 = _mm512_set1_ps(tmpptr[3]);
-                _sum2 = _mm512_fmadd_ps(_val2, _w0, _sum2);
-                _sum3 = _mm512_fmadd_ps(_val3, _w0, _sum3);
-                __m512 _val4 = _mm512_set1_ps(tmpptr[4]);
-                __m512 _val5 = _mm512_set1_ps(tmpptr[5]);
-                _sum4 = _mm512_fmadd_ps(_val4, _w0, _sum4);
-                _sum5 = _mm512_fmadd_ps(_val5, _w0, _sum5);
-                __m512 _val6 = _mm512_set1_ps(tmpptr[6]);
-                __m512 _val7 = _mm512_set1_ps(tmpptr[7]);
-                _sum6 = _mm512_fmadd_ps(_val6, _w0, _sum6);
-                _sum7 = _mm512_fmadd_ps(_val7, _w0, _sum7);
-                __m512 _val8 = _mm512_set1_ps(tmpptr[8]);
-                __m512 _val9 = _mm512_set1_ps(tmpptr[9]);
-                _sum8 = _mm512_fmadd_ps(_val8, _w0, _sum8);
-                _sum9 = _mm512_fmadd_ps(_val9, _w0, _sum9);
-                __m512 _vala = _mm512_set1_ps(tmpptr[10]);
-                __m512 _valb = _mm512_set1_ps(tmpptr[11]);
-                _suma = _mm512_fmadd_ps(_vala, _w0, _suma);
-                _sumb = _mm512_fmadd_ps(_valb, _w0, _sumb);
-
-                tmpptr += 12;
-                kptr0 += 16;
+                const float* tmpptr = tmp.channel(i / 12);
+                const float* kptr0 = kernel.channel(p);
+
+                int nn = inch * maxk * 16; // inch always > 0
+
+                __m512 _sum0 = _mm512_loadu_ps(biasptr);
+                __m512 _sum1 = _sum0;
+                __m512 _sum2 = _sum0;
+                __m512 _sum3 = _sum0;
+                __m512 _sum4 = _sum0;
+                __m512 _sum5 = _sum0;
+                __m512 _sum6 = _sum0;
+                __m512 _sum7 = _sum0;
+                __m512 _sum8 = _sum0;
+                __m512 _sum9 = _sum0;
+                __m512 _suma = _sum0;
+                __m512 _sumb = _sum0;
+
+                for (int j = 0; j < nn; j++)
+                {
+                    __m512 _w0 = _mm512_loadu_ps(kptr0);
+
+                    __m512 _val0 = _mm512_set1_ps(tmpptr[0]);
+                    __m512 _val1 = _mm512_set1_ps(tmpptr[1]);
+                    _sum0 = _mm512_fmadd_ps(_val0, _w0, _sum0);
+                    _sum1 = _mm512_fmadd_ps(_val1, _w0, _sum1);
+                    __m512 _val2 = _mm512_set1_ps(tmpptr[2]);
+                    __m512 _val3 = _mm512_set1_ps(tmpptr[3]);
+                    _sum2 = _mm512_fmadd_ps(_val2, _w0, _sum2);
+                    _sum3 = _mm512_fmadd_ps(_val3, _w0, _sum3);
+                    __m512 _val4 = _mm512_set1_ps(tmpptr[4]);
+                    __m512 _val5 = _mm512_set1_ps(tmpptr[5]);
+                    _sum4 = _mm512_fmadd_ps(_val4, _w0, _sum4);
+                    _sum5 = _mm512_fmadd_ps(_val5, _w0, _sum5);
+                    __m512 _val6 = _mm512_set1_ps(tmpptr[6]);
+                    __m512 _val7 = _mm512_set1_ps(tmpptr[7]);
+                    _sum6 = _mm512_fmadd_ps(_val6, _w0, _sum6);
+                    _sum7 = _mm512_fmadd_ps(_val7, _w0, _sum7);
+                    __m512 _val8 = _mm512_set1_ps(tmpptr[8]);
+                    __m512 _val9 = _mm512_set1_ps(tmpptr[9]);
+                    _sum8 = _mm512_fmadd_ps(_val8, _w0, _sum8);
+                    _sum9 = _mm512_fmadd_ps(_val9, _w0, _sum9);
+                    __m512 _vala = _mm512_set1_ps(tmpptr[10]);
+                    __m512 _valb = _mm512_set1_ps(tmpptr[11]);
+                    _suma = _mm512_fmadd_ps(_vala, _w0, _suma);
+                    _sumb = _mm512_fmadd_ps(_valb, _w0, _sumb);
+
+                    tmpptr += 12;
+                    kptr0 += 16;
+                }
+
+                _mm512_storeu_ps(outptr0, _sum0);
+                _mm512_storeu_ps(outptr0 + 16, _sum1);
+                _mm512_storeu_ps(outptr0 + 16 * 2, _sum2);
+                _mm512_storeu_ps(outptr0 + 16 * 3, _sum3);
+                _mm512_storeu_ps(outptr0 + 16 * 4, _sum4);
+                _mm512_storeu_ps(outptr0 + 16 * 5, _sum5);
+                _mm512_storeu_ps(outptr0 + 16 * 6, _sum6);
+                _mm512_storeu_ps(outptr0 + 16 * 7, _sum7);
+                _mm512_storeu_ps(outptr0 + 16 * 8, _sum8);
+                _mm512_storeu_ps(outptr0 + 16 * 9, _sum9);
+                _mm512_storeu_ps(outptr0 + 16 * 10, _suma);
+                _mm512_storeu_ps(outptr0 + 16 * 11, _sumb);
+
+                outptr0 += 16 * 12;
             }
+            for (; i + 7 < i1; i += 8)
+            {
+                const float* tmpptr = tmp.channel(i / 12 + (i % 12) / 8);
+                const float* kptr0 = kernel.channel(p);
 
-            _mm512_storeu_ps(outptr0, _sum0);
-            _mm512_storeu_ps(outptr0 + 16, _sum1);
-            _mm512_storeu_ps(outptr0 + 16 * 2, _sum2);
-            _mm512_storeu_ps(outptr0 + 16 * 3, _sum3);
-            _mm512_storeu_ps(outptr0 + 16 * 4, _sum4);
-            _mm512_storeu_ps(outptr0 + 16 * 5, _sum5);
-            _mm512_storeu_ps(outptr0 + 16 * 6, _sum6);
-            _mm512_storeu_ps(outptr0 + 16 * 7, _sum7);
-            _mm512_storeu_ps(outptr0 + 16 * 8, _sum8);
-            _mm512_storeu_ps(outptr0 + 16 * 9, _sum9);
-            _mm512_storeu_ps(outptr0 + 16 * 10, _suma);
-            _mm512_storeu_ps(outptr0 + 16 * 11, _sumb);
-
-            outptr0 += 16 * 12;
-        }
-        for (; i + 7 < size; i += 8)
-        {
-            const float* tmpptr = tmp.channel(i / 12 + (i % 12) / 8);
-            const float* kptr0 = kernel.channel(p);
+                int nn = inch * maxk * 16; // inch always > 0
 
-            int nn = inch * maxk * 16; // inch always > 0
+                __m512 _sum0 = _mm512_loadu_ps(biasptr);
+                __m512 _sum1 = _sum0;
+                __m512 _sum2 = _sum0;
+                __m512 _sum3 = _sum0;
+                __m512 _sum4 = _sum0;
+                __m512 _sum5 = _sum0;
+                __m512 _sum6 = _sum0;
+                __m512 _sum7 = _sum0;
 
-            __m512 _sum0 = _mm512_loadu_ps(biasptr);
-            __m512 _sum1 = _sum0;
-            __m512 _sum2 = _sum0;
-            __m512 _sum3 = _sum0;
-            __m512 _sum4 = _sum0;
-            __m512 _sum5 = _sum0;
-            __m512 _sum6 = _sum0;
-            __m512 _sum7 = _sum0;
+                for (int j = 0; j < nn; j++)
+                {
+                    __m512 _w0 = _mm512_loadu_ps(kptr0);
+
+                    __m512 _val0 = _mm512_set1_ps(tmpptr[0]);
+                    __m512 _val1 = _mm512_set1_ps(tmpptr[1]);
+                    _sum0 = _mm512_fmadd_ps(_val0, _w0, _sum0);
+                    _sum1 = _mm512_fmadd_ps(_val1, _w0, _sum1);
+                    __m512 _val2 = _mm512_set1_ps(tmpptr[2]);
+                    __m512 _val3 = _mm512_set1_ps(tmpptr[3]);
+                    _sum2 = _mm512_fmadd_ps(_val2, _w0, _sum2);
+                    _sum3 = _mm512_fmadd_ps(_val3, _w0, _sum3);
+                    __m512 _val4 = _mm512_set1_ps(tmpptr[4]);
+                    __m512 _val5 = _mm512_set1_ps(tmpptr[5]);
+                    _sum4 = _mm512_fmadd_ps(_val4, _w0, _sum4);
+                    _sum5 = _mm512_fmadd_ps(_val5, _w0, _sum5);
+                    __m512 _val6 = _mm512_set1_ps(tmpptr[6]);
+                    __m512 _val7 = _mm512_set1_ps(tmpptr[7]);
+                    _sum6 = _mm512_fmadd_ps(_val6, _w0, _sum6);
+                    _sum7 = _mm512_fmadd_ps(_val7, _w0, _sum7);
+
+                    tmpptr += 8;
+                    kptr0 += 16;
+                }
 
-            for (int j = 0; j < nn; j++)
-            {
-                __m512 _w0 = _mm512_loadu_ps(kptr0);
-
-                __m512 _val0 = _mm512_set1_ps(tmpptr[0]);
-                __m512 _val1 = _mm512_set1_ps(tmpptr[1]);
-                _sum0 = _mm512_fmadd_ps(_val0, _w0, _sum0);
-                _sum1 = _mm512_fmadd_ps(_val1, _w0, _sum1);
-                __m512 _val2 = _mm512_set1_ps(tmpptr[2]);
-                __m512 _val3 = _mm512_set1_ps(tmpptr[3]);
-                _sum2 = _mm512_fmadd_ps(_val2, _w0, _sum2);
-                _sum3 = _mm512_fmadd_ps(_val3, _w0, _sum3);
-                __m512 _val4 = _mm512_set1_ps(tmpptr[4]);
-                __m512 _val5 = _mm512_set1_ps(tmpptr[5]);
-                _sum4 = _mm512_fmadd_ps(_val4, _w0, _sum4);
-                _sum5 = _mm512_fmadd_ps(_val5, _w0, _sum5);
-                __m512 _val6 = _mm512_set1_ps(tmpptr[6]);
-                __m512 _val7 = _mm512_set1_ps(tmpptr[7]);
-                _sum6 = _mm512_fmadd_ps(_val6, _w0, _sum6);
-                _sum7 = _mm512_fmadd_ps(_val7, _w0, _sum7);
-
-                tmpptr += 8;
-                kptr0 += 16;
+                _mm512_storeu_ps(outptr0, _sum0);
+                _mm512_storeu_ps(outptr0 + 16, _sum1);
+                _mm512_storeu_ps(outptr0 + 16 * 2, _sum2);
+                _mm512_storeu_ps(outptr0 + 16 * 3, _sum3);
+                _mm512_storeu_ps(outptr0 + 16 * 4, _sum4);
+                _mm512_storeu_ps(outptr0 + 16 * 5, _sum5);
+                _mm512_storeu_ps(outptr0 + 16 * 6, _sum6);
+                _mm512_storeu_ps(outptr0 + 16 * 7, _sum7);
+
+                outptr0 += 16 * 8;
             }
+            for (; i + 3 < i1; i += 4)
+            {
+                const float* tmpptr = tmp.channel(i / 12 + (i % 12) / 8 + (i % 12 % 8) / 4);
+                const float* kptr0 = kernel.channel(p);
 
-            _mm512_storeu_ps(outptr0, _sum0);
-            _mm512_storeu_ps(outptr0 + 16, _sum1);
-            _mm512_storeu_ps(outptr0 + 16 * 2, _sum2);
-            _mm512_storeu_ps(outptr0 + 16 * 3, _sum3);
-            _mm512_storeu_ps(outptr0 + 16 * 4, _sum4);
-            _mm512_storeu_ps(outptr0 + 16 * 5, _sum5);
-            _mm512_storeu_ps(outptr0 + 16 * 6, _sum6);
-            _mm512_storeu_ps(outptr0 + 16 * 7, _sum7);
+                int nn = inch * maxk * 16; // inch always > 0
 
-            outptr0 += 16 * 8;
-        }
-        for (; i + 3 < size; i += 4)
-        {
-            const float* tmpptr = tmp.channel(i / 12 + (i % 12) / 8 + (i % 12 % 8) / 4);
-            const float* kptr0 = kernel.channel(p);
+                __m512 _sum0 = _mm512_loadu_ps(biasptr);
+                __m512 _sum1 = _sum0;
+                __m512 _sum2 = _sum0;
+                __m512 _sum3 = _sum0;
 
-            int nn = inch * maxk * 16; // inch always > 0
+                for (int j = 0; j < nn; j++)
+                {
+                    __m512 _w0 = _mm512_loadu_ps(kptr0);
+
+                    __m512 _val0 = _mm512_set1_ps(tmpptr[0]);
+                    __m512 _val1 = _mm512_set1_ps(tmpptr[1]);
+                    _sum0 = _mm512_fmadd_ps(_val0, _w0, _sum0);
+                    _sum1 = _mm512_fmadd_ps(_val1, _w0, _sum1);
+                    __m512 _val2 = _mm512_set1_ps(tmpptr[2]);
+                    __m512 _val3 = _mm512_set1_ps(tmpptr[3]);
+                    _sum2 = _mm512_fmadd_ps(_val2, _w0, _sum2);
+                    _sum3 = _mm512_fmadd_ps(_val3, _w0, _sum3);
+
+                    tmpptr += 4;
+                    kptr0 += 16;
+                }
 
-            __m512 _sum0 = _mm512_loadu_ps(biasptr);
-            __m512 _sum1 = _sum0;
-            __m512 _sum2 = _sum0;
-            __m512 _sum3 = _sum0;
+                _mm512_storeu_ps(outptr0, _sum0);
+                _mm512_storeu_ps(outptr0 + 16, _sum1);
+                _mm512_storeu_ps(outptr0 + 16 * 2, _sum2);
+                _mm512_storeu_ps(outptr0 + 16 * 3, _sum3);
 
-            for (int j = 0; j < nn; j++)
-            {
-                __m512 _w0 = _mm512_loadu_ps(kptr0);
-
-                __m512 _val0 = _mm512_set1_ps(tmpptr[0]);
-                __m512 _val1 = _mm512_set1_ps(tmpptr[1]);
-                _sum0 = _mm512_fmadd_ps(_val0, _w0, _sum0);
-                _sum1 = _mm512_fmadd_ps(_val1, _w0, _sum1);
-                __m512 _val2 = _mm512_set1_ps(tmpptr[2]);
-                __m512 _val3 = _mm512_set1_ps(tmpptr[3]);
-                _sum2 = _mm512_fmadd_ps(_val2, _w0, _sum2);
-                _sum3 = _mm512_fmadd_ps(_val3, _w0, _sum3);
-
-                tmpptr += 4;
-                kptr0 += 16;
+                outptr0 += 16 * 4;
             }
+            for (; i + 1 < i1; i += 2)
+            {
+                const float* tmpptr = tmp.channel(i / 12 + (i % 12) / 8 + (i % 12 % 8) / 4 + (i % 12 % 4) / 2);
+                const float* kptr0 = kernel.channel(p);
 
-            _mm512_storeu_ps(outptr0, _sum0);
-            _mm512_storeu_ps(outptr0 + 16, _sum1);
-            _mm512_storeu_ps(outptr0 + 16 * 2, _sum2);
-            _mm512_storeu_ps(outptr0 + 16 * 3, _sum3);
+                int nn = inch * maxk * 16; // inch always > 0
 
-            outptr0 += 16 * 4;
-        }
-        for (; i + 1 < size; i += 2)
-        {
-            const float* tmpptr = tmp.channel(i / 12 + (i % 12) / 8 + (i % 12 % 8) / 4 + (i % 12 % 4) / 2);
-            const float* kptr0 = kernel.channel(p);
+                __m512 _sum0 = _mm512_loadu_ps(biasptr);
+                __m512 _sum1 = _sum0;
 
-            int nn = inch * maxk * 16; // inch always > 0
+                for (int j = 0; j < nn; j++)
+                {
+                    __m512 _w0 = _mm512_loadu_ps(kptr0);
 
-            __m512 _sum0 = _mm512_loadu_ps(biasptr);
-            __m512 _sum1 = _sum0;
+                    __m512 _val0 = _mm512_set1_ps(tmpptr[0]);
+                    __m512 _val1 = _mm512_set1_ps(tmpptr[1]);
+                    _sum0 = _mm512_fmadd_ps(_val0, _w0, _sum0);
+                    _sum1 = _mm512_fmadd_ps(_val1, _w0, _sum1);
 
-            for (int j = 0; j < nn; j++)
-            {
-                __m512 _w0 = _mm512_loadu_ps(kptr0);
+                    tmpptr += 2;
+                    kptr0 += 16;
+                }
 
-                __m512 _val0 = _mm512_set1_ps(tmpptr[0]);
-                __m512 _val1 = _mm512_set1_ps(tmpptr[1]);
-                _sum0 = _mm512_fmadd_ps(_val0, _w0, _sum0);
-                _sum1 = _mm512_fmadd_ps(_val1, _w0, _sum1);
+                _mm512_storeu_ps(outptr0, _sum0);
+                _mm512_storeu_ps(outptr0 + 16, _sum1);
 
-                tmpptr += 2;
-                kptr0 += 16;
+                outptr0 += 16 * 2;
             }
+            for (; i < i1; i++)
+            {
+                const float* tmpptr = tmp.channel(i / 12 + (i % 12) / 8 + (i % 12 % 8) / 4 + (i % 12 % 4) / 2 + i % 12 % 2);
+                const float* kptr0 = kernel.channel(p);
 
-            _mm512_storeu_ps(outptr0, _sum0);
-            _mm512_storeu_ps(outptr0 + 16, _sum1);
+                int nn = inch * maxk * 16; // inch always > 0
 
-            outptr0 += 16 * 2;
-        }
-        for (; i < size; i++)
-        {
-            const float* tmpptr = tmp.channel(i / 12 + (i % 12) / 8 + (i % 12 % 8) / 4 + (i % 12 % 4) / 2 + i % 12 % 2);
-            const float* kptr0 = kernel.channel(p);
+                __m512 _sum = _mm512_loadu_ps(biasptr);
 
-            int nn = inch * maxk * 16; // inch always > 0
+                for (int j = 0; j < nn; j++)
+                {
+                    __m512 _w0 = _mm512_loadu_ps(kptr0);
+                    __m512 _val0 = _mm512_set1_ps(tmpptr[0]);
+                    _sum = _mm512_fmadd_ps(_val0, _w0, _sum);
 
-            __m512 _sum = _mm512_loadu_ps(biasptr);
+                    tmpptr += 1;
+                    kptr0 += 16;
+                }
 
-            for (int j = 0; j < nn; j++)
-            {
-                __m512 _w0 = _mm512_loadu_ps(kptr0);
-                __m512 _val0 = _mm512_set1_ps(tmpptr[0]);
-                _sum = _mm512_fmadd_ps(_val0, _w0, _sum);
+                _mm512_storeu_ps(outptr0, _sum);
 
-                tmpptr += 1;
-                kptr0 += 16;
+                outptr0 += 16;
             }
-
-            _mm512_storeu_ps(outptr0, _sum);
-
-            outptr0 += 16;
         }
     }
 }
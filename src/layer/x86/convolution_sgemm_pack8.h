@@ -292,221 +292,228 @@ static void im2col_sgemm_pack8_avx(const Mat& bottom_im2col, Mat& top_blob, cons
         }
     }
 
-    #pragma omp parallel for num_threads(opt.num_threads)
-    for (int p = 0; p < outch; p++)
+    // walk the columns in passes whose packed input stays in l2 while every output channel runs over it
+    const int size_block = get_im2col_sgemm_size_block(size, inch * maxk * 8 * sizeof(float));
+    for (int i0 = 0; i0 < size; i0 += size_block)
     {
-        float* outptr0 = top_blob.channel(p);
+        const int i1 = std::min(i0 + size_block, size);
 
-        const float zeros[8] = {0.f, 0.f, 0.f, 0.f, 0.f, 0.f, 0.f, 0.f};
-        const float* biasptr = bias ? bias + p * 8 : zeros;
-
-        int i = 0;
-        for (; i + 11 < size; i += 12)
+        #pragma omp parallel for num_threads(opt.num_threads)
+        for (int p = 0; p < outch; p++)
         {
-            const float* tmpptr = tmp.channel(i / 12);
-            const float* kptr0 = kernel.channel(p);
-
-            int nn = inch * maxk * 8; // inch always > 0
-
-            __m256 _sum0 = _mm256_loadu_ps(biasptr);
-            __m256 _sum1 = _sum0;
-            __m256 _sum2 = _sum0;
-            __m256 _sum3 = _sum0;
-            __m256 _sum4 = _sum0;
-            __m256 _sum5 = _sum0;
-            __m256 _sum6 = _sum0;
-            __m256 _sum7 = _sum0;
-            __m256 _sum8 = _sum0;
-            __m256 _sum9 = _sum0;
-            __m256 _suma = _sum0;
-            __m256 _sumb = _sum0;
-
-            for (int j = 0; j < nn; j++)
+            float* outptr0 = (float*)top_blob.channel(p) + i0 * 8;
+
+            const float zeros[8] = {0.f, 0.f, 0.f, 0.f, 0.f, 0.f, 0.f, 0.f};
+            const float* biasptr = bias ? bias + p * 8 : zeros;
+
+            int i = i0;
+            for (; i + 11 < i1; i += 12)
             {
-                __m256 _w0 = _mm256_load_ps(kptr0);
-
-                __m256 _val0 = _mm256_broadcast_ss(tmpptr);
-                __m256 _val1 = _mm256_broadcast_ss(tmpptr + 1);
-                _sum0 = _mm256_comp_fmadd_ps(_val0, _w0, _sum0);
-                _sum1 = _mm256_comp_fmadd_ps(_val1, _w0, _sum1);
-                __m256 _val2 = _mm256_broadcast_ss(tmpptr + 2);
-                __m256 _val3 = _mm256_broadcast_ss(tmpptr + 3);
-                _sum2 = _mm256_comp_fmadd_ps(_val2, _w0, _sum2);
-                _sum3 = _mm256_comp_fmadd_ps(_val3, _w0, _sum3);
-                __m256 _val4 = _mm256_broadcast_ss(tmpptr + 4);
-                __m256 _val5 = _mm256_broadcast_ss(tmpptr + 5);
-                _sum4 = _mm256_comp_fmadd_ps(_val4, _w0, _sum4);
-                _sum5 = _mm256_comp_fmadd_ps(_val5, _w0, _sum5);
-                __m256 _val6 = _mm256_broadcast_ss(tmpptr + 6);
-                __m256 _val7 = _mm256_broadcast_ss(tmpptr + 7);
-                _sum6 = _mm256_comp_fmadd_ps(_val6, _w0, _sum6);
-                _sum7 = _mm256_comp_fmadd_ps(_val7, _w0, _sum7);
-                __m256 _val8 = _mm256_broadcast_ss(tmpptr + 8);
-                __m256 _val9 = _mm256_broadcast_ss(tmpptr + 9);
-                _sum8 = _mm256_comp_fmadd_ps(_val8, _w0, _sum8);
-                _sum9 = _mm256_comp_fmadd_ps(_val9, _w0, _sum9);
-                __m256 _vala = _mm256_broadcast_ss(tmpptr + 10);
-                __m256 _valb = _mm256_broadcast_ss(tmpptr + 11);
-                _suma = _mm256_comp_fmadd_ps(_vala, _w0, _suma);
-                _sumb = _mm256_comp_fmadd_ps(_valb, _w0, _sumb);
-
-                tmpptr += 12;
-                kptr0 += 8;
+                const float* tmpptr = tmp.channel(i / 12);
+                const float* kptr0 = kernel.channel(p);
+
+                int nn = inch * maxk * 8; // inch always > 0
+
+                __m256 _sum0 = _mm256_loadu_ps(biasptr);
+                __m256 _sum1 = _sum0;
+                __m256 _sum2 = _sum0;
+                __m256 _sum3 = _sum0;
+                __m256 _sum4 = _sum0;
+                __m256 _sum5 = _sum0;
+                __m256 _sum6 = _sum0;
+                __m256 _sum7 = _sum0;
+                __m256 _sum8 = _sum0;
+                __m256 _sum9 = _sum0;
+                __m256 _suma = _sum0;
+                __m256 _sumb = _sum0;
+
+                for (int j = 0; j < nn; j++)
+                {
+                    __m256 _w0 = _mm256_load_ps(kptr0);
+
+                    __m256 _val0 = _mm256_broadcast_ss(tmpptr);
+                    __m256 _val1 = _mm256_broadcast_ss(tmpptr + 1);
+                    _sum0 = _mm256_comp_fmadd_ps(_val0, _w0, _sum0);
+                    _sum1 = _mm256_comp_fmadd_ps(_val1, _w0, _sum1);
+                    __m256 _val2 = _mm256_broadcast_ss(tmpptr + 2);
+                    __m256 _val3 = _mm256_broadcast_ss(tmpptr + 3);
+                    _sum2 = _mm256_comp_fmadd_ps(_val2, _w0, _sum2);
+                    _sum3 = _mm256_comp_fmadd_ps(_val3, _w0, _sum3);
+                    __m256 _val4 = _mm256_broadcast_ss(tmpptr + 4);
+                    __m256 _val5 = _mm256_broadcast_ss(tmpptr + 5);
+                    _sum4 = _mm256_comp_fmadd_ps(_val4, _w0, _sum4);
+                    _sum5 = _mm256_comp_fmadd_ps(_val5, _w0, _sum5);
+                    __m256 _val6 = _mm256_broadcast_ss(tmpptr + 6);
+                    __m256 _val7 = _mm256_broadcast_ss(tmpptr + 7);
+                    _sum6 = _mm256_comp_fmadd_ps(_val6, _w0, _sum6);
+                    _sum7 = _mm256_comp_fmadd_ps(_val7, _w0, _sum7);
+                    __m256 _val8 = _mm256_broadcast_ss(tmpptr + 8);
+                    __m256 _val9 = _mm256_broadcast_ss(tmpptr + 9);
+                    _sum8 = _mm256_comp_fmadd_ps(_val8, _w0, _sum8);
+                    _sum9 = _mm256_comp_fmadd_ps(_val9, _w0, _sum9);
+                    __m256 _vala = _mm256_broadcast_ss(tmpptr + 10);
+                    __m256 _valb = _mm256_broadcast_ss(tmpptr + 11);
+                    _suma = _mm256_comp_fmadd_ps(_vala, _w0, _suma);
+                    _sumb = _mm256_comp_fmadd_ps(_valb, _w0, _sumb);
+
+                    tmpptr += 12;
+                    kptr0 += 8;
+                }
+
+                _mm256_store_ps(outptr0, _sum0);
+                _mm256_store_ps(outptr0 + 8, _sum1);
+                _mm256_store_ps(outptr0 + 8 * 2, _sum2);
+                _mm256_store_ps(outptr0 + 8 * 3, _sum3);
+                _mm256_store_ps(outptr0 + 8 * 4, _sum4);
+                _mm256_store_ps(outptr0 + 8 * 5, _sum5);
+                _mm256_store_ps(outptr0 + 8 * 6, _sum6);
+                _mm256_store_ps(outptr0 + 8 * 7, _sum7);
+                _mm256_store_ps(outptr0 + 8 * 8, _sum8);
+                _mm256_store_ps(outptr0 + 8 * 9, _sum9);
+                _mm256_store_ps(outptr0 + 8 * 10, _suma);
+                _mm256_store_ps(outptr0 + 8 * 11, _sumb);
+
+                outptr0 += 8 * 12;
             }
+            for (; i + 7 < i1; i += 8)
+            {
+                const float* tmpptr = tmp.channel(i / 12 + (i % 12) / 8);
+                const float* kptr0 = kernel.channel(p);
 
-            _mm256_store_ps(outptr0, _sum0);
-            _mm256_store_ps(outptr0 + 8, _sum1);
-            _mm256_store_ps(outptr0 + 8 * 2, _sum2);
-            _mm256_store_ps(outptr0 + 8 * 3, _sum3);
-            _mm256_store_ps(outptr0 + 8 * 4, _sum4);
-            _mm256_store_ps(outptr0 + 8 * 5, _sum5);
-            _mm256_store_ps(outptr0 + 8 * 6, _sum6);
-            _mm256_store_ps(outptr0 + 8 * 7, _sum7);
-            _mm256_store_ps(outptr0 + 8 * 8, _sum8);
-            _mm256_store_ps(outptr0 + 8 * 9, _sum9);
-            _mm256_store_ps(outptr0 + 8 * 10, _suma);
-            _mm256_store_ps(outptr0 + 8 * 11, _sumb);
-
-            outptr0 += 8 * 12;
-        }
-        for (; i + 7 < size; i += 8)
-        {
-            const float* tmpptr = tmp.channel(i / 12 + (i % 12) / 8);
-            const float* kptr0 = kernel.channel(p);
+                int nn = inch * maxk * 8; // inch always > 0
 
-            int nn = inch * maxk * 8; // inch always > 0
+                __m256 _sum0 = _mm256_loadu_ps(biasptr);
+                __m256 _sum1 = _sum0;
+                __m256 _sum2 = _sum0;
+                __m256 _sum3 = _sum0;
+                __m256 _sum4 = _sum0;
+                __m256 _sum5 = _sum0;
+                __m256 _sum6 = _sum0;
+                __m256 _sum7 = _sum0;
 
-            __m256 _sum0 = _mm256_loadu_ps(biasptr);
-            __m256 _sum1 = _sum0;
-            __m256 _sum2 = _sum0;
-            __m256 _sum3 = _sum0;
-            __m256 _sum4 = _sum0;
-            __m256 _sum5 = _sum0;
-            __m256 _sum6 = _sum0;
-            __m256 _sum7 = _sum0;
+                for (int j = 0; j < nn; j++)
+                {
+                    __m256 _w0 = _mm256_load_ps(kptr0);
+
+                    __m256 _val0 = _mm256_broadcast_ss(tmpptr);
+                    __m256 _val1 = _mm256_broadcast_ss(tmpptr + 1);
+                    _sum0 = _mm256_comp_fmadd_ps(_val0, _w0, _sum0);
+                    _sum1 = _mm256_comp_fmadd_ps(_val1, _w0, _sum1);
+                    __m256 _val2 = _mm256_broadcast_ss(tmpptr + 2);
+                    __m256 _val3 = _mm256_broadcast_ss(tmpptr + 3);
+                    _sum2 = _mm256_comp_fmadd_ps(_val2, _w0, _sum2);
+                    _sum3 = _mm256_comp_fmadd_ps(_val3, _w0, _sum3);
+                    __m256 _val4 = _mm256_broadcast_ss(tmpptr + 4);
+                    __m256 _val5 = _mm256_broadcast_ss(tmpptr + 5);
+                    _sum4 = _mm256_comp_fmadd_ps(_val4, _w0, _sum4);
+                    _sum5 = _mm256_comp_fmadd_ps(_val5, _w0, _sum5);
+                    __m256 _val6 = _mm256_broadcast_ss(tmpptr + 6);
+                    __m256 _val7 = _mm256_broadcast_ss(tmpptr + 7);
+                    _sum6 = _mm256_comp_fmadd_ps(_val6, _w0, _sum6);
+                    _sum7 = _mm256_comp_fmadd_ps(_val7, _w0, _sum7);
 
-            for (int j = 0; j < nn; j++)
-            {
-                __m256 _w0 = _mm256_load_ps(kptr0);
-
-                __m256 _val0 = _mm256_broadcast_ss(tmpptr);
-                __m256 _val1 = _mm256_broadcast_ss(tmpptr + 1);
-                _sum0 = _mm256_comp_fmadd_ps(_val0, _w0, _sum0);
-                _sum1 = _mm256_comp_fmadd_ps(_val1, _w0, _sum1);
-                __m256 _val2 = _mm256_broadcast_ss(tmpptr + 2);
-                __m256 _val3 = _mm256_broadcast_ss(tmpptr + 3);
-                _sum2 = _mm256_comp_fmadd_ps(_val2, _w0, _sum2);
-                _sum3 = _mm256_comp_fmadd_ps(_val3, _w0, _sum3);
-                __m256 _val4 = _mm256_broadcast_ss(tmpptr + 4);
-                __m256 _val5 = _mm256_broadcast_ss(tmpptr + 5);
-                _sum4 = _mm256_comp_fmadd_ps(_val4, _w0, _sum4);
-                _sum5 = _mm256_comp_fmadd_ps(_val5, _w0, _sum5);
-                __m256 _val6 = _mm256_broadcast_ss(tmpptr + 6);
-                __m256 _val7 = _mm256_broadcast_ss(tmpptr + 7);
-                _sum6 = _mm256_comp_fmadd_ps(_val6, _w0, _sum6);
-                _sum7 = _mm256_comp_fmadd_ps(_val7, _w0, _sum7);
-
-                tmpptr += 8;
-                kptr0 += 8;
+                    tmpptr += 8;
+                    kptr0 += 8;
+                }
+
+                _mm256_store_ps(outptr0, _sum0);
+                _mm256_store_ps(outptr0 + 8, _sum1);
+                _mm256_store_ps(outptr0 + 8 * 2, _sum2);
+                _mm256_store_ps(outptr0 + 8 * 3, _sum3);
+                _mm256_store_ps(outptr0 + 8 * 4, _sum4);
+                _mm256_store_ps(outptr0 + 8 * 5, _sum5);
+                _mm256_store_ps(outptr0 + 8 * 6, _sum6);
+                _mm256_store_ps(outptr0 + 8 * 7, _sum7);
+
+                outptr0 += 8 * 8;
             }
+            for (; i + 3 < i1; i += 4)
+            {
+                const float* tmpptr = tmp.channel(i / 12 + (i % 12) / 8 + (i % 12 % 8) / 4);
+                const float* kptr0 = kernel.channel(p);
 
-            _mm256_store_ps(outptr0, _sum0);
-            _mm256_store_ps(outptr0 + 8, _sum1);
-            _mm256_store_ps(outptr0 + 8 * 2, _sum2);
-            _mm256_store_ps(outptr0 + 8 * 3, _sum3);
-            _mm256_store_ps(outptr0 + 8 * 4, _sum4);
-            _mm256_store_ps(outptr0 + 8 * 5, _sum5);
-            _mm256_store_ps(outptr0 + 8 * 6, _sum6);
-            _mm256_store_ps(outptr0 + 8 * 7, _sum7);
+                int nn = inch * maxk * 8; // inch always > 0
 
-            outptr0 += 8 * 8;
-        }
-        for (; i + 3 < size; i += 4)
-        {
-            const float* tmpptr = tmp.channel(i / 12 + (i % 12) / 8 + (i % 12 % 8) / 4);
-            const float* kptr0 = kernel.channel(p);
+                __m256 _sum0 = _mm256_loadu_ps(biasptr);
+                __m256 _sum1 = _sum0;
+                __m256 _sum2 = _sum0;
+                __m256 _sum3 = _sum0;
 
-            int nn = inch * maxk * 8; // inch always > 0
+                for (int j = 0; j < nn; j++)
+                {
+                    __m256 _w0 = _mm256_load_ps(kptr0);
+
+                    __m256 _val0 = _mm256_broadcast_ss(tmpptr);
+                    __m256 _val1 = _mm256_broadcast_ss(tmpptr + 1);
+                    _sum0 = _mm256_comp_fmadd_ps(_val0, _w0, _sum0);
+                    _sum1 = _mm256_comp_fmadd_ps(_val1, _w0, _sum1);
+                    __m256 _val2 = _mm256_broadcast_ss(tmpptr + 2);
+                    __m256 _val3 = _mm256_broadcast_ss(tmpptr + 3);
+                    _sum2 = _mm256_comp_fmadd_ps(_val2, _w0, _sum2);
+                    _sum3 = _mm256_comp_fmadd_ps(_val3, _w0, _sum3);
+
+                    tmpptr += 4;
+                    kptr0 += 8;
+                }
 
-            __m256 _sum0 = _mm256_loadu_ps(biasptr);
-            __m256 _sum1 = _sum0;
-            __m256 _sum2 = _sum0;
-            __m256 _sum3 = _sum0;
+                _mm256_store_ps(outptr0, _sum0);
+                _mm256_store_ps(outptr0 + 8, _sum1);
+                _mm256_store_ps(outptr0 + 8 * 2, _sum2);
+                _mm256_store_ps(outptr0 + 8 * 3, _sum3);
 
-            for (int j = 0; j < nn; j++)
-            {
-                __m256 _w0 = _mm256_load_ps(kptr0);
-
-                __m256 _val0 = _mm256_broadcast_ss(tmpptr);
-                __m256 _val1 = _mm256_broadcast_ss(tmpptr + 1);
-                _sum0 = _mm256_comp_fmadd_ps(_val0, _w0, _sum0);
-                _sum1 = _mm256_comp_fmadd_ps(_val1, _w0, _sum1);
-                __m256 _val2 = _mm256_broadcast_ss(tmpptr + 2);
-                __m256 _val3 = _mm256_broadcast_ss(tmpptr + 3);
-                _sum2 = _mm256_comp_fmadd_ps(_val2, _w0, _sum2);
-                _sum3 = _mm256_comp_fmadd_ps(_val3, _w0, _sum3);
-
-                tmpptr += 4;
-                kptr0 += 8;
+                outptr0 += 8 * 4;
             }
+            for (; i + 1 < i1; i += 2)
+            {
+                const float* tmpptr = tmp.channel(i / 12 + (i % 12) / 8 + (i % 12 % 8) / 4 + (i % 12 % 4) / 2);
+                const float* kptr0 = kernel.channel(p);
 
-            _mm256_store_ps(outptr0, _sum0);
-            _mm256_store_ps(outptr0 + 8, _sum1);
-            _mm256_store_ps(outptr0 + 8 * 2, _sum2);
-            _mm256_store_ps(outptr0 + 8 * 3, _sum3);
+                int nn = inch * maxk * 8; // inch always > 0
 
-            outptr0 += 8 * 4;
-        }
-        for (; i + 1 < size; i += 2)
-        {
-            const float* tmpptr = tmp.channel(i / 12 + (i % 12) / 8 + (i % 12 % 8) / 4 + (i % 12 % 4) / 2);
-            const float* kptr0 = kernel.channel(p);
+                __m256 _sum0 = _mm256_loadu_ps(biasptr);
+                __m256 _sum1 = _sum0;
 
-            int nn = inch * maxk * 8; // inch always > 0
+                for (int j = 0; j < nn; j++)
+                {
+                    __m256 _w0 = _mm256_load_ps(kptr0);
 
-            __m256 _sum0 = _mm256_loadu_ps(biasptr);
-            __m256 _sum1 = _sum0;
+                    __m256 _val0 = _mm256_broadcast_ss(tmpptr);
+                    __m256 _val1 = _mm256_broadcast_ss(tmpptr + 1);
+                    _sum0 = _mm256_comp_fmadd_ps(_val0, _w0, _sum0);
+                    _sum1 = _mm256_comp_fmadd_ps(_val1, _w0, _sum1);
 
-            for (int j = 0; j < nn; j++)
-            {
-                __m256 _w0 = _mm256_load_ps(kptr0);
+                    tmpptr += 2;
+                    kptr0 += 8;
+                }
 
-                __m256 _val0 = _mm256_broadcast_ss(tmpptr);
-                __m256 _val1 = _mm256_broadcast_ss(tmpptr + 1);
-                _sum0 = _mm256_comp_fmadd_ps(_val0, _w0, _sum0);
-                _sum1 = _mm256_comp_fmadd_ps(_val1, _w0, _sum1);
+                _mm256_store_ps(outptr0, _sum0);
+                _mm256_store_ps(outptr0 + 8, _sum1);
 
-                tmpptr += 2;
-                kptr0 += 8;
+                outptr0 += 8 * 2;
             }
+            for (; i < i1; i++)
+            {
+                const float* tmpptr = tmp.channel(i / 12 + (i % 12) / 8 + (i % 12 % 8) / 4 + (i % 12 % 4) / 2 + i % 12 % 2);
+                const float* kptr0 = kernel.channel(p);
 
-            _mm256_store_ps(outptr0, _sum0);
-            _mm256_store_ps(outptr0 + 8, _sum1);
+                int nn = inch * maxk * 8; // inch always > 0
 
-            outptr0 += 8 * 2;
-        }
-        for (; i < size; i++)
-        {
-            const float* tmpptr = tmp.channel(i / 12 + (i % 12) / 8 + (i % 12 % 8) / 4 + (i % 12 % 4) / 2 + i % 12 % 2);
-            const float* kptr0 = kernel.channel(p);
+                __m256 _sum = _mm256_loadu_ps(biasptr);
 
-            int nn = inch * maxk * 8; // inch always > 0
+                for (int j = 0; j < nn; j++)
+                {
+                    __m256 _w0 = _mm256_load_ps(kptr0);
+                    __m256 _val0 = _mm256_broadcast_ss(tmpptr);
+                    _sum = _mm256_comp_fmadd_ps(_val0, _w0, _sum);
 
-            __m256 _sum = _mm256_loadu_ps(biasptr);
+                    tmpptr += 1;
+                    kptr0 += 8;
+                }
 
-            for (int j = 0; j < nn; j++)
-            {
-                __m256 _w0 = _mm256_load_ps(kptr0);
-                __m256 _val0 = _mm256_broadcast_ss(tmpptr);
-                _sum = _mm256_comp_fmadd_ps(_val0, _w0, _sum);
+                _mm256_store_ps(outptr0, _sum);
 
-                tmpptr += 1;
-                kptr0 += 8;
+                outptr0 += 8;
             }
-
-            _mm256_store_ps(outptr0, _sum);
-
-            outptr0 += 8;
         }
     }
 }
@@ -32,6 +32,15 @@
 
 namespace ncnn {
 
+// columns per pass of im2col sgemm, a multiple of 12 unless it covers all
+// the packed input of one pass takes half of l2 so that every output channel of a thread reuses it from cache
+static int get_im2col_sgemm_size_block(int size, size_t column_bytes)
+{
+    const size_t l2_half = get_cpu_level2_cache_size() / 2;
+    const int block = (int)std::max(l2_half / (column_bytes * 12), (size_t)1) * 12;
+    return std::min(block, size);
+}
+
 #include "convolution_sgemm.h"
 #include "convolution_winograd_transform.h"
 #include "convolution_winograd_dot.h"
@@ -142,6 +151,12 @@ Convolution_x86::Convolution_x86()
 
     activation = 0;
     convolution_dilation1 = 0;
+
+    kernel_info.algorithm = 0;
+    kernel_info.isa = x86_kernel_isa();
+    kernel_info.precision = "fp32";
+    kernel_info.elempack = 1;
+    kernel_info.out_elempack = 1;
 }
 
 static void convolution_transform_kernel_packed_sse(const Mat& weight_data, Mat& weight_data_tm, int num_input, int num_output, int kernel_w, int kernel_h, int elempack, int out_elempack)
@@ -241,6 +256,8 @@ int Convolution_x86::create_pipeline(const Option& opt)
             weight_data.release();
         }
 
+        update_kernel_info(opt, false);
+
         return 0;
     }
 
@@ -713,6 +730,8 @@ int Convolution_x86::create_pipeline(const Option& opt)
         weight_data.release();
     }
 
+    update_kernel_info(opt, false);
+
     return 0;
 }
 
@@ -732,6 +751,184 @@ int Convolution_x86::destroy_pipeline(const Option& opt)
         convolution_dilation1 = 0;
     }
 
+    // a later create_pipeline may pick another kernel
+    weight_data_tm.release();
+    weight_sgemm_data.release();
+    weight_winograd23_data.release();
+    weight_winograd43_data.release();
+    weight_winograd63_data.release();
+
+    kernel_info.algorithm = 0;
+
+    return 0;
+}
+
+int Convolution_x86::get_pipeline_weights(std::vector<Mat>& weights) const
+{
+    if (dynamic_weight || convolution_dilation1)
+        return -1;
+
+    weights.resize(6);
+    weights[0] = weight_data_tm;
+    weights[1] = weight_sgemm_data;
+    weights[2] = weight_winograd23_data;
+    weights[3] = weight_winograd43_data;
+    weights[4] = weight_winograd63_data;
+#if NCNN_INT8
+    weights[5] = scale_in_data;
+#endif
+
+    return 0;
+}
+
+int Convolution_x86::create_pipeline_from_weights(const std::vector<Mat>& weights, const Option& opt)
+{
+    if (dynamic_weight || weights.size() != 6)
+        return -1;
+
+    bool use_int8 = false;
+#if NCNN_INT8
+    // runtime quantized weights were cached after quantization
+    use_int8 = opt.use_int8_inference && (weight_data.elemsize == (size_t)1u || int8_scale_term);
+#endif
+
+    // dilation fallback owns a sub convolution
+    if (!use_int8 && !opt.use_packing_layout && kernel_w == kernel_h && dilation_w != 1 && dilation_h == dilation_w && stride_w == 1 && stride_h == 1)
+        return -1;
+
+    activation = create_activation_layer(activation_type, activation_params, opt);
+
+    weight_data_tm = weights[0];
+    weight_sgemm_data = weights[1];
+    weight_winograd23_data = weights[2];
+    weight_winograd43_data = weights[3];
+    weight_winograd63_data = weights[4];
+#if NCNN_INT8
+    scale_in_data = weights[5];
+#endif
+
+    if (opt.lightmode)
+    {
+        weight_data.release();
+    }
+
+    update_kernel_info(opt, use_int8);
+
+    return 0;
+}
+
+#if NCNN_INT8
+// mirror the runtime dispatch of the int8 sgemm kernels
+static const char* convolution_int8_sgemm_isa()
+{
+#if NCNN_RUNTIME_CPU && NCNN_AVX512VNNI && __AVX512F__ && !__AVX512VNNI__
+    if (ncnn::cpu_support_x86_avx512_vnni())
+        return "avx512vnni";
+#endif
+#if NCNN_RUNTIME_CPU && NCNN_AVXVNNI && __AVX2__ && !__AVXVNNI__
+    if (ncnn::cpu_support_x86_avx_vnni())
+        return "avxvnni";
+#endif
+#if NCNN_RUNTIME_CPU && NCNN_AVX2 && __AVX__ && !__AVX2__
+    if (ncnn::cpu_support_x86_avx2())
+        return "avx2";
+#endif
+#if NCNN_RUNTIME_CPU && NCNN_XOP && __SSE2__ && !__XOP__
+    if (ncnn::cpu_support_x86_xop())
+        return "xop";
+#endif
+    return x86_kernel_isa();
+}
+#endif // NCNN_INT8
+
+void Convolution_x86::update_kernel_info(const Option& opt, bool use_int8)
+{
+    const int maxk = kernel_w * kernel_h;
+    const int num_input = weight_data_size / maxk / num_output;
+
+    int elempack = 1;
+    int out_elempack = 1;
+#if __SSE2__
+    if (opt.use_packing_layout)
+    {
+        if (use_int8)
+        {
+            elempack = num_input % 8 == 0 ? 8 : 1;
+            out_elempack = num_output % 4 == 0 ? 4 : 1;
+        }
+        else
+        {
+#if __AVX512F__
+            elempack = num_input % 16 == 0 ? 16 : num_input % 8 == 0 ? 8 : num_input % 4 == 0 ? 4 : 1;
+            out_elempack = num_output % 16 == 0 ? 16 : num_output % 8 == 0 ? 8 : num_output % 4 == 0 ? 4 : 1;
+#elif __AVX__
+            elempack = num_input % 8 == 0 ? 8 : num_input % 4 == 0 ? 4 : 1;
+            out_elempack = num_output % 8 == 0 ? 8 : num_output % 4 == 0 ? 4 : 1;
+#else
+            elempack = num_input % 4 == 0 ? 4 : 1;
+            out_elempack = num_output % 4 == 0 ? 4 : 1;
+#endif
+        }
+    }
+#else
+    (void)opt;
+#endif // __SSE2__
+
+    const bool k1 = kernel_w == 1 && kernel_h == 1;
+    const bool k3 = kernel_w == 3 && kernel_h == 3;
+    const bool s1 = dilation_w == 1 && dilation_h == 1 && stride_w == 1 && stride_h == 1;
+    const bool s2 = dilation_w == 1 && dilation_h == 1 && stride_w == 2 && stride_h == 2;
+
+    // the transformed weights tell which kernel forward dispatches to
+    const char* algorithm = "direct";
+    if (convolution_dilation1)
+        algorithm = "dilation";
+    else if (!weight_winograd63_data.empty())
+        algorithm = "winograd63";
+    else if (!weight_winograd43_data.empty())
+        algorithm = "winograd43";
+    else if (!weight_winograd23_data.empty())
+        algorithm = "winograd23";
+    else if (!weight_sgemm_data.empty())
+    {
+        if (k1 && s1)
+            algorithm = "conv1x1s1_sgemm";
+        else if (k1 && s2)
+            algorithm = "conv1x1s2_sgemm";
+        else if (use_int8 && elempack == 1 && out_elempack == 4 && k3 && s1)
+            algorithm = "conv3x3s1";
+        else if (use_int8 && elempack == 1 && out_elempack == 4 && k3 && s2)
+            algorithm = "conv3x3s2";
+        else if (use_int8 && elempack == 1 && out_elempack == 4 && kernel_w == 7 && kernel_h == 7 && s2)
+            algorithm = "conv7x7s2";
+        else
+            algorithm = "im2col_sgemm";
+    }
+    else if (!use_int8 && k3 && s1 && ((elempack == 16 && out_elempack == 1) || (elempack == 8 && (out_elempack == 8 || out_elempack == 1)) || (elempack == 1 && (out_elempack == 8 || out_elempack == 4))))
+        algorithm = "conv3x3s1";
+    else if (!use_int8 && k3 && s2 && elempack == 1 && (out_elempack == 8 || out_elempack == 4))
+        algorithm = "conv3x3s2";
+    else if (!use_int8 && kernel_w == 2 && kernel_h == 2 && s1 && elempack == 8 && out_elempack == 8)
+        algorithm = "conv2x2s1";
+
+    kernel_info.algorithm = algorithm;
+    kernel_info.isa = x86_kernel_isa();
+    kernel_info.precision = use_int8 ? "int8" : "fp32";
+    kernel_info.elempack = elempack;
+    kernel_info.out_elempack = out_elempack;
+
+#if NCNN_INT8
+    if (use_int8 && !weight_sgemm_data.empty())
+        kernel_info.isa = convolution_int8_sgemm_isa();
+#endif
+}
+
+int Convolution_x86::get_kernel_info(LayerKernelInfo& info) const
+{
+    if (!kernel_info.algorithm)
+        return -1;
+
+    info = kernel_info;
     return 0;
 }
 
@@ -1894,6 +2091,8 @@ int Convolution_x86::create_pipeline_int8_x86(const Option& opt)
         weight_data.release();
     }
 
+    update_kernel_info(opt, true);
+
     return 0;
 }
 
@@ -27,6 +27,11 @@ public:
     virtual int create_pipeline(const Option& opt);
     virtual int destroy_pipeline(const Option& opt);
 
+    virtual int get_pipeline_weights(std::vector<Mat>& weights) const;
+    virtual int create_pipeline_from_weights(const std::vector<Mat>& weights, const Option& opt);
+
+    virtual int get_kernel_info(LayerKernelInfo& info) const;
+
     virtual int forward(const Mat& bottom_blob, Mat& top_blob, const Option& opt) const;
 
     virtual int forward(const std::vector<Mat>& bottom_blobs, std::vector<Mat>& top_blobs, const Option& opt) const;
@@ -38,6 +43,8 @@ protected:
 #endif
     int forwardDilation_x86(const Mat& bottom_blob, Mat& top_blob, const Option& opt) const;
 
+    void update_kernel_info(const Option& opt, bool use_int8);
+
 public:
     Layer* activation;
 
@@ -50,6 +57,8 @@ public:
     // forwardDilation
     Layer* convolution_dilation1;
 
+    LayerKernelInfo kernel_info;
+
 #if NCNN_INT8
     Mat scale_in_data;
 #endif
@@ -52,6 +52,12 @@ ConvolutionDepthWise_x86::ConvolutionDepthWise_x86()
     support_packing = true;
 #endif // __SSE2__
     activation = 0;
+
+    kernel_info.algorithm = 0;
+    kernel_info.isa = x86_kernel_isa();
+    kernel_info.precision = "fp32";
+    kernel_info.elempack = 1;
+    kernel_info.out_elempack = 1;
 }
 
 int ConvolutionDepthWise_x86::create_pipeline(const Option& opt)
@@ -137,6 +143,8 @@ int ConvolutionDepthWise_x86::create_pipeline(const Option& opt)
             weight_data.release();
         }
 
+        update_kernel_info(elempack, false);
+
         return 0;
     }
 
@@ -148,6 +156,8 @@ int ConvolutionDepthWise_x86::create_pipeline(const Option& opt)
         weight_data.release();
     }
 
+    update_kernel_info(1, false);
+
     return 0;
 }
 
@@ -248,6 +258,46 @@ int ConvolutionDepthWise_x86::create_group_ops(const Option& opt)
     return 0;
 }
 
+void ConvolutionDepthWise_x86::update_kernel_info(int elempack, bool use_int8)
+{
+    const bool s1 = dilation_w == 1 && dilation_h == 1 && stride_w == 1 && stride_h == 1;
+    const bool s2 = dilation_w == 1 && dilation_h == 1 && stride_w == 2 && stride_h == 2;
+
+    // per-channel or per-group convolutions report in get_kernel_info
+    const char* algorithm = "group";
+    if (group_ops.empty())
+    {
+        algorithm = "convdw";
+        if (kernel_w == 3 && kernel_h == 3 && s1 && (!use_int8 || (elempack == 1 && activation_type <= 1)))
+            algorithm = "convdw3x3s1";
+        else if (kernel_w == 3 && kernel_h == 3 && s2 && (!use_int8 || (elempack == 1 && activation_type <= 1)))
+            algorithm = "convdw3x3s2";
+        else if (kernel_w == 5 && kernel_h == 5 && s1 && !use_int8 && elempack > 1)
+            algorithm = "convdw5x5s1";
+        else if (kernel_w == 5 && kernel_h == 5 && s2 && !use_int8 && elempack > 1)
+            algorithm = "convdw5x5s2";
+    }
+
+    kernel_info.algorithm = algorithm;
+    kernel_info.isa = x86_kernel_isa();
+    kernel_info.precision = use_int8 ? "int8" : "fp32";
+    kernel_info.elempack = elempack;
+    kernel_info.out_elempack = elempack;
+}
+
+int ConvolutionDepthWise_x86::get_kernel_info(LayerKernelInfo& info) const
+{
+    if (!kernel_info.algorithm)
+        return -1;
+
+    // group convolution runs the kernel of its per-group convolutions
+    if (!group_ops.empty())
+        return group_ops[0]->get_kernel_info(info);
+
+    info = kernel_info;
+    return 0;
+}
+
 int ConvolutionDepthWise_x86::destroy_pipeline(const Option& opt)
 {
     if (activation)
@@ -849,6 +899,8 @@ int ConvolutionDepthWise_x86::create_pipeline_int8_x86(const Option& opt)
             weight_data_tm = weight_data;
         }
 
+        update_kernel_info(elempack, true);
+
         return 0;
     }
 
@@ -860,6 +912,8 @@ int ConvolutionDepthWise_x86::create_pipeline_int8_x86(const Option& opt)
         weight_data.release();
     }
 
+    update_kernel_info(1, true);
+
     return 0;
 }
 
@@ -27,12 +27,15 @@ public:
     virtual int create_pipeline(const Option& opt);
     virtual int destroy_pipeline(const Option& opt);
 
+    virtual int get_kernel_info(LayerKernelInfo& info) const;
+
     virtual int forward(const Mat& bottom_blob, Mat& top_blob, const Option& opt) const;
 
     virtual int forward(const std::vector<Mat>& bottom_blobs, std::vector<Mat>& top_blobs, const Option& opt) const;
 
 protected:
     int create_group_ops(const Option& opt);
+    void update_kernel_info(int elempack, bool use_int8);
 #if NCNN_INT8
     int create_pipeline_int8_x86(const Option& opt);
     int forward_int8_x86(const Mat& bottom_blob, Mat& top_blob, const Option& opt) const;
@@ -43,6 +46,8 @@ public:
     std::vector<ncnn::Layer*> group_ops;
 
     Mat weight_data_tm;
+
+    LayerKernelInfo kernel_info;
 };
 
 } // namespace ncnn
@@ -35,6 +35,19 @@ namespace ncnn {
 #include "innerproduct_gemm_fp16s.h"
 #endif
 
+// outputs per pass of the gemm path, a multiple of 16 unless it covers all
+// the weights of one pass take half of l2 so that the following rows of a thread reuse them from cache
+static int get_gemm_num_output_block(int num_input, int num_output, int h, int num_threads)
+{
+    // with one row per thread the weights are read once anyway
+    if (h <= num_threads)
+        return num_output;
+
+    const size_t l2_half = get_cpu_level2_cache_size() / 2;
+    const int block = (int)std::max(l2_half / ((size_t)num_input * 16 * sizeof(float)), (size_t)1) * 16;
+    return std::min(block, num_output);
+}
+
 InnerProduct_x86::InnerProduct_x86()
 {
 #if __SSE2__
@@ -42,6 +55,12 @@ InnerProduct_x86::InnerProduct_x86()
 #endif // __SSE2__
 
     flatten = 0;
+
+    kernel_info.algorithm = 0;
+    kernel_info.isa = x86_kernel_isa();
+    kernel_info.precision = "fp32";
+    kernel_info.elempack = 1;
+    kernel_info.out_elempack = 1;
 }
 
 int InnerProduct_x86::create_pipeline(const Option& opt)
@@ -121,6 +140,27 @@ int InnerProduct_x86::create_pipeline(const Option& opt)
         weight_data.release();
     }
 
+    update_kernel_info("fp32");
+
+    return 0;
+}
+
+void InnerProduct_x86::update_kernel_info(const char* precision)
+{
+    // forward switches to gemm for 2-dim input with more than one row
+    kernel_info.algorithm = "gemv";
+    kernel_info.isa = x86_kernel_isa();
+    kernel_info.precision = precision;
+    kernel_info.elempack = 1;
+    kernel_info.out_elempack = weight_data_tm.elempack ? weight_data_tm.elempack : 1;
+}
+
+int InnerProduct_x86::get_kernel_info(LayerKernelInfo& info) const
+{
+    if (!kernel_info.algorithm)
+        return -1;
+
+    info = kernel_info;
     return 0;
 }
 
@@ -179,1197 +219,1204 @@ int InnerProduct_x86::forward(const Mat& bottom_blob, Mat& top_blob, const Optio
         }
 #endif // __SSE2__
 
-        #pragma omp parallel for num_threads(opt.num_threads)
-        for (int j = 0; j < h; j++)
+        // walk the outputs in passes whose weights stay in l2 while every row of a thread runs over them
+        const int num_output_block = get_gemm_num_output_block(num_input, num_output, h, opt.num_threads);
+        for (int out_start = 0; out_start < num_output; out_start += num_output_block)
         {
+            const int out_end = std::min(out_start + num_output_block, num_output);
+
+            #pragma omp parallel for num_threads(opt.num_threads)
+            for (int j = 0; j < h; j++)
+            {
 #if __SSE2__
 #if __AVX__
 #if __AVX512F__
-            if (elempack == 16 && num_output_elempack == 16)
-            {
-                float* outptr = top_blob.row(j);
-
-                for (int p = 0; p < num_output / num_output_elempack; p++)
+                if (elempack == 16 && num_output_elempack == 16)
                 {
-                    const float* kptr = weight_data_tm.row(p);
-                    const float* m = bottom_blob.row(j);
-
-                    __m512 _sum0 = _mm512_set1_ps(0.f);
-                    __m512 _sum1 = _mm512_set1_ps(0.f);
-                    __m512 _sum2 = _mm512_set1_ps(0.f);
-                    __m512 _sum3 = _mm512_set1_ps(0.f);
-                    __m512 _sum4 = _mm512_set1_ps(0.f);
-                    __m512 _sum5 = _mm512_set1_ps(0.f);
-                    __m512 _sum6 = _mm512_set1_ps(0.f);
-                    __m512 _sum7 = _mm512_set1_ps(0.f);
-                    __m512 _sum8 = _mm512_set1_ps(0.f);
-                    __m512 _sum9 = _mm512_set1_ps(0.f);
-                    __m512 _suma = _mm512_set1_ps(0.f);
-                    __m512 _sumb = _mm512_set1_ps(0.f);
-                    __m512 _sumc = _mm512_set1_ps(0.f);
-                    __m512 _sumd = _mm512_set1_ps(0.f);
-                    __m512 _sume = _mm512_set1_ps(0.f);
-                    __m512 _sumf = _mm512_set1_ps(0.f);
+                    float* outptr = top_blob.row(j) + out_start * elempack;
 
-                    if (bias_term)
+                    for (int p = out_start / num_output_elempack; p < out_end / num_output_elempack; p++)
                     {
-                        _sum0 = _mm512_set1_ps(bias_data[p * 16 + 0]);
-                        _sum1 = _mm512_set1_ps(bias_data[p * 16 + 1]);
-                        _sum2 = _mm512_set1_ps(bias_data[p * 16 + 2]);
-                        _sum3 = _mm512_set1_ps(bias_data[p * 16 + 3]);
-                        _sum4 = _mm512_set1_ps(bias_data[p * 16 + 4]);
-                        _sum5 = _mm512_set1_ps(bias_data[p * 16 + 5]);
-                        _sum6 = _mm512_set1_ps(bias_data[p * 16 + 6]);
-                        _sum7 = _mm512_set1_ps(bias_data[p * 16 + 7]);
-                        _sum8 = _mm512_set1_ps(bias_data[p * 16 + 8]);
-                        _sum9 = _mm512_set1_ps(bias_data[p * 16 + 9]);
-                        _suma = _mm512_set1_ps(bias_data[p * 16 + 10]);
-                        _sumb = _mm512_set1_ps(bias_data[p * 16 + 11]);
-                        _sumc = _mm512_set1_ps(bias_data[p * 16 + 12]);
-                        _sumd = _mm512_set1_ps(bias_data[p * 16 + 13]);
-                        _sume = _mm512_set1_ps(bias_data[p * 16 + 14]);
-                        _sumf = _mm512_set1_ps(bias_data[p * 16 + 15]);
+                        const float* kptr = weight_data_tm.row(p);
+                        const float* m = bottom_blob.row(j);
+
+                        __m512 _sum0 = _mm512_set1_ps(0.f);
+                        __m512 _sum1 = _mm512_set1_ps(0.f);
+                        __m512 _sum2 = _mm512_set1_ps(0.f);
+                        __m512 _sum3 = _mm512_set1_ps(0.f);
+                        __m512 _sum4 = _mm512_set1_ps(0.f);
+                        __m512 _sum5 = _mm512_set1_ps(0.f);
+                        __m512 _sum6 = _mm512_set1_ps(0.f);
+                        __m512 _sum7 = _mm512_set1_ps(0.f);
+                        __m512 _sum8 = _mm512_set1_ps(0.f);
+                        __m512 _sum9 = _mm512_set1_ps(0.f);
+                        __m512 _suma = _mm512_set1_ps(0.f);
+                        __m512 _sumb = _mm512_set1_ps(0.f);
+                        __m512 _sumc = _mm512_set1_ps(0.f);
+                        __m512 _sumd = _mm512_set1_ps(0.f);
+                        __m512 _sume = _mm512_set1_ps(0.f);
+                        __m512 _sumf = _mm512_set1_ps(0.f);
+
+                        if (bias_term)
+                        {
+                            _sum0 = _mm512_set1_ps(bias_data[p * 16 + 0]);
+                            _sum1 = _mm512_set1_ps(bias_data[p * 16 + 1]);
+                            _sum2 = _mm512_set1_ps(bias_data[p * 16 + 2]);
+                            _sum3 = _mm512_set1_ps(bias_data[p * 16 + 3]);
+                            _sum4 = _mm512_set1_ps(bias_data[p * 16 + 4]);
+                            _sum5 = _mm512_set1_ps(bias_data[p * 16 + 5]);
+                            _sum6 = _mm512_set1_ps(bias_data[p * 16 + 6]);
+                            _sum7 = _mm512_set1_ps(bias_data[p * 16 + 7]);
+                            _sum8 = _mm512_set1_ps(bias_data[p * 16 + 8]);
+                            _sum9 = _mm512_set1_ps(bias_data[p * 16 + 9]);
+                            _suma = _mm512_set1_ps(bias_data[p * 16 + 10]);
+                            _sumb = _mm512_set1_ps(bias_data[p * 16 + 11]);
+                            _sumc = _mm512_set1_ps(bias_data[p * 16 + 12]);
+                            _sumd = _mm512_set1_ps(bias_data[p * 16 + 13]);
+                            _sume = _mm512_set1_ps(bias_data[p * 16 + 14]);
+                            _sumf = _mm512_set1_ps(bias_data[p * 16 + 15]);
+                        }
+
+                        for (int i = 0; i < num_input; i++)
+                        {
+                            __m512 _val = _mm512_loadu_ps(m);
+                            _sum0 = _mm512_fmadd_ps(_val, _mm512_set1_ps(kptr[0]), _sum0);
+                            _sum1 = _mm512_fmadd_ps(_val, _mm512_set1_ps(kptr[1]), _sum1);
+                            _sum2 = _mm512_fmadd_ps(_val, _mm512_set1_ps(kptr[2]), _sum2);
+                            _sum3 = _mm512_fmadd_ps(_val, _mm512_set1_ps(kptr[3]), _sum3);
+                            _sum4 = _mm512_fmadd_ps(_val, _mm512_set1_ps(kptr[4]), _sum4);
+                            _sum5 = _mm512_fmadd_ps(_val, _mm512_set1_ps(kptr[5]), _sum5);
+                            _sum6 = _mm512_fmadd_ps(_val, _mm512_set1_ps(kptr[6]), _sum6);
+                            _sum7 = _mm512_fmadd_ps(_val, _mm512_set1_ps(kptr[7]), _sum7);
+                            _sum8 = _mm512_fmadd_ps(_val, _mm512_set1_ps(kptr[8]), _sum8);
+                            _sum9 = _mm512_fmadd_ps(_val, _mm512_set1_ps(kptr[9]), _sum9);
+                            _suma = _mm512_fmadd_ps(_val, _mm512_set1_ps(kptr[10]), _suma);
+                            _sumb = _mm512_fmadd_ps(_val, _mm512_set1_ps(kptr[11]), _sumb);
+                            _sumc = _mm512_fmadd_ps(_val, _mm512_set1_ps(kptr[12]), _sumc);
+                            _sumd = _mm512_fmadd_ps(_val, _mm512_set1_ps(kptr[13]), _sumd);
+                            _sume = _mm512_fmadd_ps(_val, _mm512_set1_ps(kptr[14]), _sume);
+                            _sumf = _mm512_fmadd_ps(_val, _mm512_set1_ps(kptr[15]), _sumf);
+
+                            m += 16;
+                            kptr += 16;
+                        }
+
+                        _sum0 = activation_avx512(_sum0, activation_type, activation_params);
+                        _sum1 = activation_avx512(_sum1, activation_type, activation_params);
+                        _sum2 = activation_avx512(_sum2, activation_type, activation_params);
+                        _sum3 = activation_avx512(_sum3, activation_type, activation_params);
+                        _sum4 = activation_avx512(_sum4, activation_type, activation_params);
+                        _sum5 = activation_avx512(_sum5, activation_type, activation_params);
+                        _sum6 = activation_avx512(_sum6, activation_type, activation_params);
+                        _sum7 = activation_avx512(_sum7, activation_type, activation_params);
+                        _sum8 = activation_avx512(_sum8, activation_type, activation_params);
+                        _sum9 = activation_avx512(_sum9, activation_type, activation_params);
+                        _suma = activation_avx512(_suma, activation_type, activation_params);
+                        _sumb = activation_avx512(_sumb, activation_type, activation_params);
+                        _sumc = activation_avx512(_sumc, activation_type, activation_params);
+                        _sumd = activation_avx512(_sumd, activation_type, activation_params);
+                        _sume = activation_avx512(_sume, activation_type, activation_params);
+                        _sumf = activation_avx512(_sumf, activation_type, activation_params);
+
+                        _mm512_storeu_ps(outptr, _sum0);
+                        _mm512_storeu_ps(outptr + 16, _sum1);
+                        _mm512_storeu_ps(outptr + 16 * 2, _sum2);
+                        _mm512_storeu_ps(outptr + 16 * 3, _sum3);
+                        _mm512_storeu_ps(outptr + 16 * 4, _sum4);
+                        _mm512_storeu_ps(outptr + 16 * 5, _sum5);
+                        _mm512_storeu_ps(outptr + 16 * 6, _sum6);
+                        _mm512_storeu_ps(outptr + 16 * 7, _sum7);
+                        _mm512_storeu_ps(outptr + 16 * 8, _sum8);
+                        _mm512_storeu_ps(outptr + 16 * 9, _sum9);
+                        _mm512_storeu_ps(outptr + 16 * 10, _suma);
+                        _mm512_storeu_ps(outptr + 16 * 11, _sumb);
+                        _mm512_storeu_ps(outptr + 16 * 12, _sumc);
+                        _mm512_storeu_ps(outptr + 16 * 13, _sumd);
+                        _mm512_storeu_ps(outptr + 16 * 14, _sume);
+                        _mm512_storeu_ps(outptr + 16 * 15, _sumf);
+                        outptr += 256;
                     }
-
-                    for (int i = 0; i < num_input; i++)
-                    {
-                        __m512 _val = _mm512_loadu_ps(m);
-                        _sum0 = _mm512_fmadd_ps(_val, _mm512_set1_ps(kptr[0]), _sum0);
-                        _sum1 = _mm512_fmadd_ps(_val, _mm512_set1_ps(kptr[1]), _sum1);
-                        _sum2 = _mm512_fmadd_ps(_val, _mm512_set1_ps(kptr[2]), _sum2);
-                        _sum3 = _mm512_fmadd_ps(_val, _mm512_set1_ps(kptr[3]), _sum3);
-                        _sum4 = _mm512_fmadd_ps(_val, _mm512_set1_ps(kptr[4]), _sum4);
-                        _sum5 = _mm512_fmadd_ps(_val, _mm512_set1_ps(kptr[5]), _sum5);
-                        _sum6 = _mm512_fmadd_ps(_val, _mm512_set1_ps(kptr[6]), _sum6);
-                        _sum7 = _mm512_fmadd_ps(_val, _mm512_set1_ps(kptr[7]), _sum7);
-                        _sum8 = _mm512_fmadd_ps(_val, _mm512_set1_ps(kptr[8]), _sum8);
-                        _sum9 = _mm512_fmadd_ps(_val, _mm512_set1_ps(kptr[9]), _sum9);
-                        _suma = _mm512_fmadd_ps(_val, _mm512_set1_ps(kptr[10]), _suma);
-                        _sumb = _mm512_fmadd_ps(_val, _mm512_set1_ps(kptr[11]), _sumb);
-                        _sumc = _mm512_fmadd_ps(_val, _mm512_set1_ps(kptr[12]), _sumc);
-                        _sumd = _mm512_fmadd_ps(_val, _mm512_set1_ps(kptr[13]), _sumd);
-                        _sume = _mm512_fmadd_ps(_val, _mm512_set1_ps(kptr[14]), _sume);
-                        _sumf = _mm512_fmadd_ps(_val, _mm512_set1_ps(kptr[15]), _sumf);
-
-                        m += 16;
-                        kptr += 16;
-                    }
-
-                    _sum0 = activation_avx512(_sum0, activation_type, activation_params);
-                    _sum1 = activation_avx512(_sum1, activation_type, activation_params);
-                    _sum2 = activation_avx512(_sum2, activation_type, activation_params);
-                    _sum3 = activation_avx512(_sum3, activation_type, activation_params);
-                    _sum4 = activation_avx512(_sum4, activation_type, activation_params);
-                    _sum5 = activation_avx512(_sum5, activation_type, activation_params);
-                    _sum6 = activation_avx512(_sum6, activation_type, activation_params);
-                    _sum7 = activation_avx512(_sum7, activation_type, activation_params);
-                    _sum8 = activation_avx512(_sum8, activation_type, activation_params);
-                    _sum9 = activation_avx512(_sum9, activation_type, activation_params);
-                    _suma = activation_avx512(_suma, activation_type, activation_params);
-                    _sumb = activation_avx512(_sumb, activation_type, activation_params);
-                    _sumc = activation_avx512(_sumc, activation_type, activation_params);
-                    _sumd = activation_avx512(_sumd, activation_type, activation_params);
-                    _sume = activation_avx512(_sume, activation_type, activation_params);
-                    _sumf = activation_avx512(_sumf, activation_type, activation_params);
-
-                    _mm512_storeu_ps(outptr, _sum0);
-                    _mm512_storeu_ps(outptr + 16, _sum1);
-                    _mm512_storeu_ps(outptr + 16 * 2, _sum2);
-                    _mm512_storeu_ps(outptr + 16 * 3, _sum3);
-                    _mm512_storeu_ps(outptr + 16 * 4, _sum4);
-                    _mm512_storeu_ps(outptr + 16 * 5, _sum5);
-                    _mm512_storeu_ps(outptr + 16 * 6, _sum6);
-                    _mm512_storeu_ps(outptr + 16 * 7, _sum7);
-                    _mm512_storeu_ps(outptr + 16 * 8, _sum8);
-                    _mm512_storeu_ps(outptr + 16 * 9, _sum9);
-                    _mm512_storeu_ps(outptr + 16 * 10, _suma);
-                    _mm512_storeu_ps(outptr + 16 * 11, _sumb);
-                    _mm512_storeu_ps(outptr + 16 * 12, _sumc);
-                    _mm512_storeu_ps(outptr + 16 * 13, _sumd);
-                    _mm512_storeu_ps(outptr + 16 * 14, _sume);
-                    _mm512_storeu_ps(outptr + 16 * 15, _sumf);
-                    outptr += 256;
                 }
-            }
 
-            if (elempack == 1 && num_output_elempack == 16)
-            {
-                float* outptr = top_blob.row(j);
-
-                for (int p = 0; p < num_output / num_output_elempack; p++)
+                if (elempack == 1 && num_output_elempack == 16)
                 {
-                    const float* kptr = weight_data_tm.row(p);
-                    const float* m = bottom_blob.row(j);
-
-                    __m512 _sum = _mm512_set1_ps(0.f);
-
-                    if (bias_term)
-                    {
-                        _sum = _mm512_loadu_ps((const float*)bias_data + p * 16);
-                    }
+                    float* outptr = top_blob.row(j) + out_start * elempack;
 
-                    int i = 0;
-                    for (; i < num_input; i++)
+                    for (int p = out_start / num_output_elempack; p < out_end / num_output_elempack; p++)
                     {
-                        __m512 _val = _mm512_set1_ps(m[0]);
-                        __m512 _w = _mm512_loadu_ps(kptr);
-                        _sum = _mm512_fmadd_ps(_val, _w, _sum);
+                        const float* kptr = weight_data_tm.row(p);
+                        const float* m = bottom_blob.row(j);
 
-                        m += 1;
-                        kptr += 16;
-                    }
+                        __m512 _sum = _mm512_set1_ps(0.f);
 
-                    _sum = activation_avx512(_sum, activation_type, activation_params);
+                        if (bias_term)
+                        {
+                            _sum = _mm512_loadu_ps((const float*)bias_data + p * 16);
+                        }
 
-                    _mm512_storeu_ps(outptr, _sum);
-                    outptr += 16;
-                }
-            }
-
-            if (elempack == 4 && num_output_elempack == 16)
-            {
-                float* outptr = top_blob.row(j);
+                        int i = 0;
+                        for (; i < num_input; i++)
+                        {
+                            __m512 _val = _mm512_set1_ps(m[0]);
+                            __m512 _w = _mm512_loadu_ps(kptr);
+                            _sum = _mm512_fmadd_ps(_val, _w, _sum);
 
-                for (int p = 0; p < num_output / num_output_elempack; p++)
-                {
-                    const float* kptr = weight_data_tm.row(p);
-                    const float* m = bottom_blob.row(j);
-
-                    __m128 _sum0 = _mm_set1_ps(0.f);
-                    __m128 _sum1 = _mm_set1_ps(0.f);
-                    __m128 _sum2 = _mm_set1_ps(0.f);
-                    __m128 _sum3 = _mm_set1_ps(0.f);
-                    __m128 _sum4 = _mm_set1_ps(0.f);
-                    __m128 _sum5 = _mm_set1_ps(0.f);
-                    __m128 _sum6 = _mm_set1_ps(0.f);
-                    __m128 _sum7 = _mm_set1_ps(0.f);
-                    __m128 _sum8 = _mm_set1_ps(0.f);
-                    __m128 _sum9 = _mm_set1_ps(0.f);
-                    __m128 _suma = _mm_set1_ps(0.f);
-                    __m128 _sumb = _mm_set1_ps(0.f);
-                    __m128 _sumc = _mm_set1_ps(0.f);
-                    __m128 _sumd = _mm_set1_ps(0.f);
-                    __m128 _sume = _mm_set1_ps(0.f);
-                    __m128 _sumf = _mm_set1_ps(0.f);
+                            m += 1;
+                            kptr += 16;
+                        }
 
-                    if (bias_term)
-                    {
-                        _sum0 = _mm_set1_ps(bias_data[p * 16 + 0]);
-                        _sum1 = _mm_set1_ps(bias_data[p * 16 + 1]);
-                        _sum2 = _mm_set1_ps(bias_data[p * 16 + 2]);
-                        _sum3 = _mm_set1_ps(bias_data[p * 16 + 3]);
-                        _sum4 = _mm_set1_ps(bias_data[p * 16 + 4]);
-                        _sum5 = _mm_set1_ps(bias_data[p * 16 + 5]);
-                        _sum6 = _mm_set1_ps(bias_data[p * 16 + 6]);
-                        _sum7 = _mm_set1_ps(bias_data[p * 16 + 7]);
-                        _sum8 = _mm_set1_ps(bias_data[p * 16 + 8]);
-                        _sum9 = _mm_set1_ps(bias_data[p * 16 + 9]);
-                        _suma = _mm_set1_ps(bias_data[p * 16 + 10]);
-                        _sumb = _mm_set1_ps(bias_data[p * 16 + 11]);
-                        _sumc = _mm_set1_ps(bias_data[p * 16 + 12]);
-                        _sumd = _mm_set1_ps(bias_data[p * 16 + 13]);
-                        _sume = _mm_set1_ps(bias_data[p * 16 + 14]);
-                        _sumf = _mm_set1_ps(bias_data[p * 16 + 15]);
-                    }
+                        _sum = activation_avx512(_sum, activation_type, activation_params);
 
-                    int i = 0;
-                    for (; i < num_input; i++)
-                    {
-                        __m128 _val = _mm_loadu_ps(m);
-                        _sum0 = _mm_fmadd_ps(_val, _mm_set1_ps(kptr[0]), _sum0);
-                        _sum1 = _mm_fmadd_ps(_val, _mm_set1_ps(kptr[1]), _sum1);
-                        _sum2 = _mm_fmadd_ps(_val, _mm_set1_ps(kptr[2]), _sum2);
-                        _sum3 = _mm_fmadd_ps(_val, _mm_set1_ps(kptr[3]), _sum3);
-                        _sum4 = _mm_fmadd_ps(_val, _mm_set1_ps(kptr[4]), _sum4);
-                        _sum5 = _mm_fmadd_ps(_val, _mm_set1_ps(kptr[5]), _sum5);
-                        _sum6 = _mm_fmadd_ps(_val, _mm_set1_ps(kptr[6]), _sum6);
-                        _sum7 = _mm_fmadd_ps(_val, _mm_set1_ps(kptr[7]), _sum7);
-                        _sum8 = _mm_fmadd_ps(_val, _mm_set1_ps(kptr[8]), _sum8);
-                        _sum9 = _mm_fmadd_ps(_val, _mm_set1_ps(kptr[9]), _sum9);
-                        _suma = _mm_fmadd_ps(_val, _mm_set1_ps(kptr[10]), _suma);
-                        _sumb = _mm_fmadd_ps(_val, _mm_set1_ps(kptr[11]), _sumb);
-                        _sumc = _mm_fmadd_ps(_val, _mm_set1_ps(kptr[12]), _sumc);
-                        _sumd = _mm_fmadd_ps(_val, _mm_set1_ps(kptr[13]), _sumd);
-                        _sume = _mm_fmadd_ps(_val, _mm_set1_ps(kptr[14]), _sume);
-                        _sumf = _mm_fmadd_ps(_val, _mm_set1_ps(kptr[15]), _sumf);
-
-                        m += 4;
-                        kptr += 16;
+                        _mm512_storeu_ps(outptr, _sum);
+                        outptr += 16;
                     }
-
-                    _sum0 = activation_sse(_sum0, activation_type, activation_params);
-                    _sum1 = activation_sse(_sum1, activation_type, activation_params);
-                    _sum2 = activation_sse(_sum2, activation_type, activation_params);
-                    _sum3 = activation_sse(_sum3, activation_type, activation_params);
-                    _sum4 = activation_sse(_sum4, activation_type, activation_params);
-                    _sum5 = activation_sse(_sum5, activation_type, activation_params);
-                    _sum6 = activation_sse(_sum6, activation_type, activation_params);
-                    _sum7 = activation_sse(_sum7, activation_type, activation_params);
-                    _sum8 = activation_sse(_sum8, activation_type, activation_params);
-                    _sum9 = activation_sse(_sum9, activation_type, activation_params);
-                    _suma = activation_sse(_suma, activation_type, activation_params);
-                    _sumb = activation_sse(_sumb, activation_type, activation_params);
-                    _sumc = activation_sse(_sumc, activation_type, activation_params);
-                    _sumd = activation_sse(_sumd, activation_type, activation_params);
-                    _sume = activation_sse(_sume, activation_type, activation_params);
-                    _sumf = activation_sse(_sumf, activation_type, activation_params);
-
-                    _mm_storeu_ps(outptr, _sum0);
-                    _mm_storeu_ps(outptr + 4, _sum1);
-                    _mm_storeu_ps(outptr + 4 * 2, _sum2);
-                    _mm_storeu_ps(outptr + 4 * 3, _sum3);
-                    _mm_storeu_ps(outptr + 4 * 4, _sum4);
-                    _mm_storeu_ps(outptr + 4 * 5, _sum5);
-                    _mm_storeu_ps(outptr + 4 * 6, _sum6);
-                    _mm_storeu_ps(outptr + 4 * 7, _sum7);
-                    _mm_storeu_ps(outptr + 4 * 8, _sum8);
-                    _mm_storeu_ps(outptr + 4 * 9, _sum9);
-                    _mm_storeu_ps(outptr + 4 * 10, _suma);
-                    _mm_storeu_ps(outptr + 4 * 11, _sumb);
-                    _mm_storeu_ps(outptr + 4 * 12, _sumc);
-                    _mm_storeu_ps(outptr + 4 * 13, _sumd);
-                    _mm_storeu_ps(outptr + 4 * 14, _sume);
-                    _mm_storeu_ps(outptr + 4 * 15, _sumf);
-                    outptr += 64;
                 }
-            }
 
-            if (elempack == 8 && num_output_elempack == 16)
-            {
-                float* outptr = top_blob.row(j);
-
-                for (int p = 0; p < num_output / num_output_elempack; p++)
+                if (elempack == 4 && num_output_elempack == 16)
                 {
-                    const float* kptr = weight_data_tm.row(p);
-                    const float* m = bottom_blob.row(j);
-
-                    __m256 _sum0 = _mm256_set1_ps(0.f);
-                    __m256 _sum1 = _mm256_set1_ps(0.f);
-                    __m256 _sum2 = _mm256_set1_ps(0.f);
-                    __m256 _sum3 = _mm256_set1_ps(0.f);
-                    __m256 _sum4 = _mm256_set1_ps(0.f);
-                    __m256 _sum5 = _mm256_set1_ps(0.f);
-                    __m256 _sum6 = _mm256_set1_ps(0.f);
-                    __m256 _sum7 = _mm256_set1_ps(0.f);
-                    __m256 _sum8 = _mm256_set1_ps(0.f);
-                    __m256 _sum9 = _mm256_set1_ps(0.f);
-                    __m256 _suma = _mm256_set1_ps(0.f);
-                    __m256 _sumb = _mm256_set1_ps(0.f);
-                    __m256 _sumc = _mm256_set1_ps(0.f);
-                    __m256 _sumd = _mm256_set1_ps(0.f);
-                    __m256 _sume = _mm256_set1_ps(0.f);
-                    __m256 _sumf = _mm256_set1_ps(0.f);
-
-                    if (bias_term)
-                    {
-                        _sum0 = _mm256_set1_ps(bias_data[p * 16 + 0]);
-                        _sum1 = _mm256_set1_ps(bias_data[p * 16 + 1]);
-                        _sum2 = _mm256_set1_ps(bias_data[p * 16 + 2]);
-                        _sum3 = _mm256_set1_ps(bias_data[p * 16 + 3]);
-                        _sum4 = _mm256_set1_ps(bias_data[p * 16 + 4]);
-                        _sum5 = _mm256_set1_ps(bias_data[p * 16 + 5]);
-                        _sum6 = _mm256_set1_ps(bias_data[p * 16 + 6]);
-                        _sum7 = _mm256_set1_ps(bias_data[p * 16 + 7]);
-                        _sum8 = _mm256_set1_ps(bias_data[p * 16 + 8]);
-                        _sum9 = _mm256_set1_ps(bias_data[p * 16 + 9]);
-                        _suma = _mm256_set1_ps(bias_data[p * 16 + 10]);
-                        _sumb = _mm256_set1_ps(bias_data[p * 16 + 11]);
-                        _sumc = _mm256_set1_ps(bias_data[p * 16 + 12]);
-                        _sumd = _mm256_set1_ps(bias_data[p * 16 + 13]);
-                        _sume = _mm256_set1_ps(bias_data[p * 16 + 14]);
-                        _sumf = _mm256_set1_ps(bias_data[p * 16 + 15]);
-                    }
+                    float* outptr = top_blob.row(j) + out_start * elempack;
 
-                    int i = 0;
-                    for (; i < num_input; i++)
+                    for (int p = out_start / num_output_elempack; p < out_end / num_output_elempack; p++)
                     {
-                        __m256 _val = _mm256_loadu_ps(m);
-                        _sum0 = _mm256_fmadd_ps(_val, _mm256_set1_ps(kptr[0]), _sum0);
-                        _sum1 = _mm256_fmadd_ps(_val, _mm256_set1_ps(kptr[1]), _sum1);
-                        _sum2 = _mm256_fmadd_ps(_val, _mm256_set1_ps(kptr[2]), _sum2);
-                        _sum3 = _mm256_fmadd_ps(_val, _mm256_set1_ps(kptr[3]), _sum3);
-                        _sum4 = _mm256_fmadd_ps(_val, _mm256_set1_ps(kptr[4]), _sum4);
-                        _sum5 = _mm256_fmadd_ps(_val, _mm256_set1_ps(kptr[5]), _sum5);
-                        _sum6 = _mm256_fmadd_ps(_val, _mm256_set1_ps(kptr[6]), _sum6);
-                        _sum7 = _mm256_fmadd_ps(_val, _mm256_set1_ps(kptr[7]), _sum7);
-                        _sum8 = _mm256_fmadd_ps(_val, _mm256_set1_ps(kptr[8]), _sum8);
-                        _sum9 = _mm256_fmadd_ps(_val, _mm256_set1_ps(kptr[9]), _sum9);
-                        _suma = _mm256_fmadd_ps(_val, _mm256_set1_ps(kptr[10]), _suma);
-                        _sumb = _mm256_fmadd_ps(_val, _mm256_set1_ps(kptr[11]), _sumb);
-                        _sumc = _mm256_fmadd_ps(_val, _mm256_set1_ps(kptr[12]), _sumc);
-                        _sumd = _mm256_fmadd_ps(_val, _mm256_set1_ps(kptr[13]), _sumd);
-                        _sume = _mm256_fmadd_ps(_val, _mm256_set1_ps(kptr[14]), _sume);
-                        _sumf = _mm256_fmadd_ps(_val, _mm256_set1_ps(kptr[15]), _sumf);
-
-                        m += 8;
-                        kptr += 16;
+                        const float* kptr = weight_data_tm.row(p);
+                        const float* m = bottom_blob.row(j);
+
+                        __m128 _sum0 = _mm_set1_ps(0.f);
+                        __m128 _sum1 = _mm_set1_ps(0.f);
+                        __m128 _sum2 = _mm_set1_ps(0.f);
+                        __m128 _sum3 = _mm_set1_ps(0.f);
+                        __m128 _sum4 = _mm_set1_ps(0.f);
+                        __m128 _sum5 = _mm_set1_ps(0.f);
+                        __m128 _sum6 = _mm_set1_ps(0.f);
+                        __m128 _sum7 = _mm_set1_ps(0.f);
+                        __m128 _sum8 = _mm_set1_ps(0.f);
+                        __m128 _sum9 = _mm_set1_ps(0.f);
+                        __m128 _suma = _mm_set1_ps(0.f);
+                        __m128 _sumb = _mm_set1_ps(0.f);
+                        __m128 _sumc = _mm_set1_ps(0.f);
+                        __m128 _sumd = _mm_set1_ps(0.f);
+                        __m128 _sume = _mm_set1_ps(0.f);
+                        __m128 _sumf = _mm_set1_ps(0.f);
+
+                        if (bias_term)
+                        {
+                            _sum0 = _mm_set1_ps(bias_data[p * 16 + 0]);
+                            _sum1 = _mm_set1_ps(bias_data[p * 16 + 1]);
+                            _sum2 = _mm_set1_ps(bias_data[p * 16 + 2]);
+                            _sum3 = _mm_set1_ps(bias_data[p * 16 + 3]);
+                            _sum4 = _mm_set1_ps(bias_data[p * 16 + 4]);
+                            _sum5 = _mm_set1_ps(bias_data[p * 16 + 5]);
+                            _sum6 = _mm_set1_ps(bias_data[p * 16 + 6]);
+                            _sum7 = _mm_set1_ps(bias_data[p * 16 + 7]);
+                            _sum8 = _mm_set1_ps(bias_data[p * 16 + 8]);
+                            _sum9 = _mm_set1_ps(bias_data[p * 16 + 9]);
+                            _suma = _mm_set1_ps(bias_data[p * 16 + 10]);
+                            _sumb = _mm_set1_ps(bias_data[p * 16 + 11]);
+                            _sumc = _mm_set1_ps(bias_data[p * 16 + 12]);
+                            _sumd = _mm_set1_ps(bias_data[p * 16 + 13]);
+                            _sume = _mm_set1_ps(bias_data[p * 16 + 14]);
+                            _sumf = _mm_set1_ps(bias_data[p * 16 + 15]);
+                        }
+
+                        int i = 0;
+                        for (; i < num_input; i++)
+                        {
+                            __m128 _val = _mm_loadu_ps(m);
+                            _sum0 = _mm_fmadd_ps(_val, _mm_set1_ps(kptr[0]), _sum0);
+                            _sum1 = _mm_fmadd_ps(_val, _mm_set1_ps(kptr[1]), _sum1);
+                            _sum2 = _mm_fmadd_ps(_val, _mm_set1_ps(kptr[2]), _sum2);
+                            _sum3 = _mm_fmadd_ps(_val, _mm_set1_ps(kptr[3]), _sum3);
+                            _sum4 = _mm_fmadd_ps(_val, _mm_set1_ps(kptr[4]), _sum4);
+                            _sum5 = _mm_fmadd_ps(_val, _mm_set1_ps(kptr[5]), _sum5);
+                            _sum6 = _mm_fmadd_ps(_val, _mm_set1_ps(kptr[6]), _sum6);
+                            _sum7 = _mm_fmadd_ps(_val, _mm_set1_ps(kptr[7]), _sum7);
+                            _sum8 = _mm_fmadd_ps(_val, _mm_set1_ps(kptr[8]), _sum8);
+                            _sum9 = _mm_fmadd_ps(_val, _mm_set1_ps(kptr[9]), _sum9);
+                            _suma = _mm_fmadd_ps(_val, _mm_set1_ps(kptr[10]), _suma);
+                            _sumb = _mm_fmadd_ps(_val, _mm_set1_ps(kptr[11]), _sumb);
+                            _sumc = _mm_fmadd_ps(_val, _mm_set1_ps(kptr[12]), _sumc);
+                            _sumd = _mm_fmadd_ps(_val, _mm_set1_ps(kptr[13]), _sumd);
+                            _sume = _mm_fmadd_ps(_val, _mm_set1_ps(kptr[14]), _sume);
+                            _sumf = _mm_fmadd_ps(_val, _mm_set1_ps(kptr[15]), _sumf);
+
+                            m += 4;
+                            kptr += 16;
+                        }
+
+                        _sum0 = activation_sse(_sum0, activation_type, activation_params);
+                        _sum1 = activation_sse(_sum1, activation_type, activation_params);
+                        _sum2 = activation_sse(_sum2, activation_type, activation_params);
+                        _sum3 = activation_sse(_sum3, activation_type, activation_params);
+                        _sum4 = activation_sse(_sum4, activation_type, activation_params);
+                        _sum5 = activation_sse(_sum5, activation_type, activation_params);
+                        _sum6 = activation_sse(_sum6, activation_type, activation_params);
+                        _sum7 = activation_sse(_sum7, activation_type, activation_params);
+                        _sum8 = activation_sse(_sum8, activation_type, activation_params);
+                        _sum9 = activation_sse(_sum9, activation_type, activation_params);
+                        _suma = activation_sse(_suma, activation_type, activation_params);
+                        _sumb = activation_sse(_sumb, activation_type, activation_params);
+                        _sumc = activation_sse(_sumc, activation_type, activation_params);
+                        _sumd = activation_sse(_sumd, activation_type, activation_params);
+                        _sume = activation_sse(_sume, activation_type, activation_params);
+                        _sumf = activation_sse(_sumf, activation_type, activation_params);
+
+                        _mm_storeu_ps(outptr, _sum0);
+                        _mm_storeu_ps(outptr + 4, _sum1);
+                        _mm_storeu_ps(outptr + 4 * 2, _sum2);
+                        _mm_storeu_ps(outptr + 4 * 3, _sum3);
+                        _mm_storeu_ps(outptr + 4 * 4, _sum4);
+                        _mm_storeu_ps(outptr + 4 * 5, _sum5);
+                        _mm_storeu_ps(outptr + 4 * 6, _sum6);
+                        _mm_storeu_ps(outptr + 4 * 7, _sum7);
+                        _mm_storeu_ps(outptr + 4 * 8, _sum8);
+                        _mm_storeu_ps(outptr + 4 * 9, _sum9);
+                        _mm_storeu_ps(outptr + 4 * 10, _suma);
+                        _mm_storeu_ps(outptr + 4 * 11, _sumb);
+                        _mm_storeu_ps(outptr + 4 * 12, _sumc);
+                        _mm_storeu_ps(outptr + 4 * 13, _sumd);
+                        _mm_storeu_ps(outptr + 4 * 14, _sume);
+                        _mm_storeu_ps(outptr + 4 * 15, _sumf);
+                        outptr += 64;
                     }
-
-                    _sum0 = activation_avx(_sum0, activation_type, activation_params);
-                    _sum1 = activation_avx(_sum1, activation_type, activation_params);
-                    _sum2 = activation_avx(_sum2, activation_type, activation_params);
-                    _sum3 = activation_avx(_sum3, activation_type, activation_params);
-                    _sum4 = activation_avx(_sum4, activation_type, activation_params);
-                    _sum5 = activation_avx(_sum5, activation_type, activation_params);
-                    _sum6 = activation_avx(_sum6, activation_type, activation_params);
-                    _sum7 = activation_avx(_sum7, activation_type, activation_params);
-                    _sum8 = activation_avx(_sum8, activation_type, activation_params);
-                    _sum9 = activation_avx(_sum9, activation_type, activation_params);
-                    _suma = activation_avx(_suma, activation_type, activation_params);
-                    _sumb = activation_avx(_sumb, activation_type, activation_params);
-                    _sumc = activation_avx(_sumc, activation_type, activation_params);
-                    _sumd = activation_avx(_sumd, activation_type, activation_params);
-                    _sume = activation_avx(_sume, activation_type, activation_params);
-                    _sumf = activation_avx(_sumf, activation_type, activation_params);
-
-                    _mm256_storeu_ps(outptr, _sum0);
-                    _mm256_storeu_ps(outptr + 8, _sum1);
-                    _mm256_storeu_ps(outptr + 8 * 2, _sum2);
-                    _mm256_storeu_ps(outptr + 8 * 3, _sum3);
-                    _mm256_storeu_ps(outptr + 8 * 4, _sum4);
-                    _mm256_storeu_ps(outptr + 8 * 5, _sum5);
-                    _mm256_storeu_ps(outptr + 8 * 6, _sum6);
-                    _mm256_storeu_ps(outptr + 8 * 7, _sum7);
-                    _mm256_storeu_ps(outptr + 8 * 8, _sum8);
-                    _mm256_storeu_ps(outptr + 8 * 9, _sum9);
-                    _mm256_storeu_ps(outptr + 8 * 10, _suma);
-                    _mm256_storeu_ps(outptr + 8 * 11, _sumb);
-                    _mm256_storeu_ps(outptr + 8 * 12, _sumc);
-                    _mm256_storeu_ps(outptr + 8 * 13, _sumd);
-                    _mm256_storeu_ps(outptr + 8 * 14, _sume);
-                    _mm256_storeu_ps(outptr + 8 * 15, _sumf);
-                    outptr += 128;
                 }
-            }
 
-            if (elempack == 16 && num_output_elempack == 1)
-            {
-                float* outptr = top_blob.row(j);
-
-                for (int p = 0; p < num_output; p++)
+                if (elempack == 8 && num_output_elempack == 16)
                 {
-                    const float* kptr = (const float*)weight_data_tm + num_input * p;
-                    const float* m = bottom_blob.row(j);
-
-                    __m512 _sum0 = _mm512_set1_ps(0.f);
+                    float* outptr = top_blob.row(j) + out_start * elempack;
 
-                    if (bias_term)
+                    for (int p = out_start / num_output_elempack; p < out_end / num_output_elempack; p++)
                     {
-                        _sum0 = _mm512_set1_ps(bias_data[p]);
+                        const float* kptr = weight_data_tm.row(p);
+                        const float* m = bottom_blob.row(j);
+
+                        __m256 _sum0 = _mm256_set1_ps(0.f);
+                        __m256 _sum1 = _mm256_set1_ps(0.f);
+                        __m256 _sum2 = _mm256_set1_ps(0.f);
+                        __m256 _sum3 = _mm256_set1_ps(0.f);
+                        __m256 _sum4 = _mm256_set1_ps(0.f);
+                        __m256 _sum5 = _mm256_set1_ps(0.f);
+                        __m256 _sum6 = _mm256_set1_ps(0.f);
+                        __m256 _sum7 = _mm256_set1_ps(0.f);
+                        __m256 _sum8 = _mm256_set1_ps(0.f);
+                        __m256 _sum9 = _mm256_set1_ps(0.f);
+                        __m256 _suma = _mm256_set1_ps(0.f);
+                        __m256 _sumb = _mm256_set1_ps(0.f);
+                        __m256 _sumc = _mm256_set1_ps(0.f);
+                        __m256 _sumd = _mm256_set1_ps(0.f);
+                        __m256 _sume = _mm256_set1_ps(0.f);
+                        __m256 _sumf = _mm256_set1_ps(0.f);
+
+                        if (bias_term)
+                        {
+                            _sum0 = _mm256_set1_ps(bias_data[p * 16 + 0]);
+                            _sum1 = _mm256_set1_ps(bias_data[p * 16 + 1]);
+                            _sum2 = _mm256_set1_ps(bias_data[p * 16 + 2]);
+                            _sum3 = _mm256_set1_ps(bias_data[p * 16 + 3]);
+                            _sum4 = _mm256_set1_ps(bias_data[p * 16 + 4]);
+                            _sum5 = _mm256_set1_ps(bias_data[p * 16 + 5]);
+                            _sum6 = _mm256_set1_ps(bias_data[p * 16 + 6]);
+                            _sum7 = _mm256_set1_ps(bias_data[p * 16 + 7]);
+                            _sum8 = _mm256_set1_ps(bias_data[p * 16 + 8]);
+                            _sum9 = _mm256_set1_ps(bias_data[p * 16 + 9]);
+                            _suma = _mm256_set1_ps(bias_data[p * 16 + 10]);
+                            _sumb = _mm256_set1_ps(bias_data[p * 16 + 11]);
+                            _sumc = _mm256_set1_ps(bias_data[p * 16 + 12]);
+                            _sumd = _mm256_set1_ps(bias_data[p * 16 + 13]);
+                            _sume = _mm256_set1_ps(bias_data[p * 16 + 14]);
+                            _sumf = _mm256_set1_ps(bias_data[p * 16 + 15]);
+                        }
+
+                        int i = 0;
+                        for (; i < num_input; i++)
+                        {
+                            __m256 _val = _mm256_loadu_ps(m);
+                            _sum0 = _mm256_fmadd_ps(_val, _mm256_set1_ps(kptr[0]), _sum0);
+                            _sum1 = _mm256_fmadd_ps(_val, _mm256_set1_ps(kptr[1]), _sum1);
+                            _sum2 = _mm256_fmadd_ps(_val, _mm256_set1_ps(kptr[2]), _sum2);
+                            _sum3 = _mm256_fmadd_ps(_val, _mm256_set1_ps(kptr[3]), _sum3);
+                            _sum4 = _mm256_fmadd_ps(_val, _mm256_set1_ps(kptr[4]), _sum4);
+                            _sum5 = _mm256_fmadd_ps(_val, _mm256_set1_ps(kptr[5]), _sum5);
+                            _sum6 = _mm256_fmadd_ps(_val, _mm256_set1_ps(kptr[6]), _sum6);
+                            _sum7 = _mm256_fmadd_ps(_val, _mm256_set1_ps(kptr[7]), _sum7);
+                            _sum8 = _mm256_fmadd_ps(_val, _mm256_set1_ps(kptr[8]), _sum8);
+                            _sum9 = _mm256_fmadd_ps(_val, _mm256_set1_ps(kptr[9]), _sum9);
+                            _suma = _mm256_fmadd_ps(_val, _mm256_set1_ps(kptr[10]), _suma);
+                            _sumb = _mm256_fmadd_ps(_val, _mm256_set1_ps(kptr[11]), _sumb);
+                            _sumc = _mm256_fmadd_ps(_val, _mm256_set1_ps(kptr[12]), _sumc);
+                            _sumd = _mm256_fmadd_ps(_val, _mm256_set1_ps(kptr[13]), _sumd);
+                            _sume = _mm256_fmadd_ps(_val, _mm256_set1_ps(kptr[14]), _sume);
+                            _sumf = _mm256_fmadd_ps(_val, _mm256_set1_ps(kptr[15]), _sumf);
+
+                            m += 8;
+                            kptr += 16;
+                        }
+
+                        _sum0 = activation_avx(_sum0, activation_type, activation_params);
+                        _sum1 = activation_avx(_sum1, activation_type, activation_params);
+                        _sum2 = activation_avx(_sum2, activation_type, activation_params);
+                        _sum3 = activation_avx(_sum3, activation_type, activation_params);
+                        _sum4 = activation_avx(_sum4, activation_type, activation_params);
+                        _sum5 = activation_avx(_sum5, activation_type, activation_params);
+                        _sum6 = activation_avx(_sum6, activation_type, activation_params);
+                        _sum7 = activation_avx(_sum7, activation_type, activation_params);
+                        _sum8 = activation_avx(_sum8, activation_type, activation_params);
+                        _sum9 = activation_avx(_sum9, activation_type, activation_params);
+                        _suma = activation_avx(_suma, activation_type, activation_params);
+                        _sumb = activation_avx(_sumb, activation_type, activation_params);
+                        _sumc = activation_avx(_sumc, activation_type, activation_params);
+                        _sumd = activation_avx(_sumd, activation_type, activation_params);
+                        _sume = activation_avx(_sume, activation_type, activation_params);
+                        _sumf = activation_avx(_sumf, activation_type, activation_params);
+
+                        _mm256_storeu_ps(outptr, _sum0);
+                        _mm256_storeu_ps(outptr + 8, _sum1);
+                        _mm256_storeu_ps(outptr + 8 * 2, _sum2);
+                        _mm256_storeu_ps(outptr + 8 * 3, _sum3);
+                        _mm256_storeu_ps(outptr + 8 * 4, _sum4);
+                        _mm256_storeu_ps(outptr + 8 * 5, _sum5);
+                        _mm256_storeu_ps(outptr + 8 * 6, _sum6);
+                        _mm256_storeu_ps(outptr + 8 * 7, _sum7);
+                        _mm256_storeu_ps(outptr + 8 * 8, _sum8);
+                        _mm256_storeu_ps(outptr + 8 * 9, _sum9);
+                        _mm256_storeu_ps(outptr + 8 * 10, _suma);
+                        _mm256_storeu_ps(outptr + 8 * 11, _sumb);
+                        _mm256_storeu_ps(outptr + 8 * 12, _sumc);
+                        _mm256_storeu_ps(outptr + 8 * 13, _sumd);
+                        _mm256_storeu_ps(outptr + 8 * 14, _sume);
+                        _mm256_storeu_ps(outptr + 8 * 15, _sumf);
+                        outptr += 128;
                     }
-
-                    int i = 0;
-                    for (; i < num_input; i++)
-                    {
-                        __m512 _val = _mm512_loadu_ps(m);
-                        __m512 _k = _mm512_set1_ps(kptr[0]);
-                        _sum0 = _mm512_fmadd_ps(_val, _k, _sum0);
-
-                        m += 16;
-                        kptr += 1;
-                    }
-
-                    _sum0 = activation_avx512(_sum0, activation_type, activation_params);
-
-                    _mm512_storeu_ps(outptr, _sum0);
-                    outptr += 16;
                 }
-            }
-
-            if (elempack == 16 && num_output_elempack == 4)
-            {
-                float* outptr = top_blob.row(j);
 
-                for (int p = 0; p < num_output / num_output_elempack; p++)
+                if (elempack == 16 && num_output_elempack == 1)
                 {
-                    const float* kptr = weight_data_tm.row(p);
-                    const float* m = bottom_blob.row(j);
-
-                    __m512 _sum0 = _mm512_set1_ps(0.f);
-                    __m512 _sum1 = _mm512_set1_ps(0.f);
-                    __m512 _sum2 = _mm512_set1_ps(0.f);
-                    __m512 _sum3 = _mm512_set1_ps(0.f);
-
-                    if (bias_term)
-                    {
-                        _sum0 = _mm512_set1_ps(bias_data[p * 4 + 0]);
-                        _sum1 = _mm512_set1_ps(bias_data[p * 4 + 1]);
-                        _sum2 = _mm512_set1_ps(bias_data[p * 4 + 2]);
-                        _sum3 = _mm512_set1_ps(bias_data[p * 4 + 3]);
-                    }
+                    float* outptr = top_blob.row(j) + out_start * elempack;
 
-                    int i = 0;
-                    for (; i < num_input; i++)
+                    for (int p = out_start; p < out_end; p++)
                     {
-                        __m512 _val = _mm512_loadu_ps(m);
-                        _sum0 = _mm512_fmadd_ps(_val, _mm512_set1_ps(kptr[0]), _sum0);
-                        _sum1 = _mm512_fmadd_ps(_val, _mm512_set1_ps(kptr[1]), _sum1);
-                        _sum2 = _mm512_fmadd_ps(_val, _mm512_set1_ps(kptr[2]), _sum2);
-                        _sum3 = _mm512_fmadd_ps(_val, _mm512_set1_ps(kptr[3]), _sum3);
-
-                        m += 16;
-                        kptr += 4;
-                    }
+                        const float* kptr = (const float*)weight_data_tm + num_input * p;
+                        const float* m = bottom_blob.row(j);
 
-                    _sum0 = activation_avx512(_sum0, activation_type, activation_params);
-                    _sum1 = activation_avx512(_sum1, activation_type, activation_params);
-                    _sum2 = activation_avx512(_sum2, activation_type, activation_params);
-                    _sum3 = activation_avx512(_sum3, activation_type, activation_params);
+                        __m512 _sum0 = _mm512_set1_ps(0.f);
 
-                    _mm512_storeu_ps(outptr, _sum0);
-                    _mm512_storeu_ps(outptr + 16, _sum1);
-                    _mm512_storeu_ps(outptr + 32, _sum2);
-                    _mm512_storeu_ps(outptr + 48, _sum3);
-                    outptr += 64;
-                }
-            }
+                        if (bias_term)
+                        {
+                            _sum0 = _mm512_set1_ps(bias_data[p]);
+                        }
 
-            if (elempack == 16 && num_output_elempack == 8)
-            {
-                float* outptr = top_blob.row(j);
+                        int i = 0;
+                        for (; i < num_input; i++)
+                        {
+                            __m512 _val = _mm512_loadu_ps(m);
+                            __m512 _k = _mm512_set1_ps(kptr[0]);
+                            _sum0 = _mm512_fmadd_ps(_val, _k, _sum0);
 
-                for (int p = 0; p < num_output / num_output_elempack; p++)
-                {
-                    const float* kptr = weight_data_tm.row(p);
-                    const float* m = bottom_blob.row(j);
-
-                    __m512 _sum0 = _mm512_set1_ps(0.f);
-                    __m512 _sum1 = _mm512_set1_ps(0.f);
-                    __m512 _sum2 = _mm512_set1_ps(0.f);
-                    __m512 _sum3 = _mm512_set1_ps(0.f);
-                    __m512 _sum4 = _mm512_set1_ps(0.f);
-                    __m512 _sum5 = _mm512_set1_ps(0.f);
-                    __m512 _sum6 = _mm512_set1_ps(0.f);
-                    __m512 _sum7 = _mm512_set1_ps(0.f);
+                            m += 16;
+                            kptr += 1;
+                        }
 
-                    if (bias_term)
-                    {
-                        _sum0 = _mm512_set1_ps(bias_data[p * 8 + 0]);
-                        _sum1 = _mm512_set1_ps(bias_data[p * 8 + 1]);
-                        _sum2 = _mm512_set1_ps(bias_data[p * 8 + 2]);
-                        _sum3 = _mm512_set1_ps(bias_data[p * 8 + 3]);
-                        _sum4 = _mm512_set1_ps(bias_data[p * 8 + 4]);
-                        _sum5 = _mm512_set1_ps(bias_data[p * 8 + 5]);
-                        _sum6 = _mm512_set1_ps(bias_data[p * 8 + 6]);
-                        _sum7 = _mm512_set1_ps(bias_data[p * 8 + 7]);
-                    }
+                        _sum0 = activation_avx512(_sum0, activation_type, activation_params);
 
-                    int i = 0;
-                    for (; i < num_input; i++)
-                    {
-                        __m512 _val = _mm512_loadu_ps(m);
-                        _sum0 = _mm512_fmadd_ps(_val, _mm512_set1_ps(kptr[0]), _sum0);
-                        _sum1 = _mm512_fmadd_ps(_val, _mm512_set1_ps(kptr[1]), _sum1);
-                        _sum2 = _mm512_fmadd_ps(_val, _mm512_set1_ps(kptr[2]), _sum2);
-                        _sum3 = _mm512_fmadd_ps(_val, _mm512_set1_ps(kptr[3]), _sum3);
-                        _sum4 = _mm512_fmadd_ps(_val, _mm512_set1_ps(kptr[4]), _sum4);
-                        _sum5 = _mm512_fmadd_ps(_val, _mm512_set1_ps(kptr[5]), _sum5);
-                        _sum6 = _mm512_fmadd_ps(_val, _mm512_set1_ps(kptr[6]), _sum6);
-                        _sum7 = _mm512_fmadd_ps(_val, _mm512_set1_ps(kptr[7]), _sum7);
-
-                        m += 16;
-                        kptr += 8;
+                        _mm512_storeu_ps(outptr, _sum0);
+                        outptr += 16;
                     }
-
-                    _sum0 = activation_avx512(_sum0, activation_type, activation_params);
-                    _sum1 = activation_avx512(_sum1, activation_type, activation_params);
-                    _sum2 = activation_avx512(_sum2, activation_type, activation_params);
-                    _sum3 = activation_avx512(_sum3, activation_type, activation_params);
-                    _sum4 = activation_avx512(_sum4, activation_type, activation_params);
-                    _sum5 = activation_avx512(_sum5, activation_type, activation_params);
-                    _sum6 = activation_avx512(_sum6, activation_type, activation_params);
-                    _sum7 = activation_avx512(_sum7, activation_type, activation_params);
-
-                    _mm512_storeu_ps(outptr, _sum0);
-                    _mm512_storeu_ps(outptr + 16, _sum1);
-                    _mm512_storeu_ps(outptr + 16 * 2, _sum2);
-                    _mm512_storeu_ps(outptr + 16 * 3, _sum3);
-                    _mm512_storeu_ps(outptr + 16 * 4, _sum4);
-                    _mm512_storeu_ps(outptr + 16 * 5, _sum5);
-                    _mm512_storeu_ps(outptr + 16 * 6, _sum6);
-                    _mm512_storeu_ps(outptr + 16 * 7, _sum7);
-                    outptr += 128;
                 }
-            }
 
-#endif // __AVX512F__
-
-            if (elempack == 8 && num_output_elempack == 8)
-            {
-                float* outptr = top_blob.row(j);
-
-                for (int p = 0; p < num_output / num_output_elempack; p++)
+                if (elempack == 16 && num_output_elempack == 4)
                 {
-                    const float* kptr = weight_data_tm.row(p);
-                    const float* m = bottom_blob.row(j);
-
-                    __m256 _sum0 = _mm256_set1_ps(0.f);
-                    __m256 _sum1 = _mm256_set1_ps(0.f);
-                    __m256 _sum2 = _mm256_set1_ps(0.f);
-                    __m256 _sum3 = _mm256_set1_ps(0.f);
-                    __m256 _sum4 = _mm256_set1_ps(0.f);
-                    __m256 _sum5 = _mm256_set1_ps(0.f);
-                    __m256 _sum6 = _mm256_set1_ps(0.f);
-                    __m256 _sum7 = _mm256_set1_ps(0.f);
-
-                    if (bias_term)
-                    {
-                        _sum0 = _mm256_set1_ps(bias_data[p * 8 + 0]);
-                        _sum1 = _mm256_set1_ps(bias_data[p * 8 + 1]);
-                        _sum2 = _mm256_set1_ps(bias_data[p * 8 + 2]);
-                        _sum3 = _mm256_set1_ps(bias_data[p * 8 + 3]);
-                        _sum4 = _mm256_set1_ps(bias_data[p * 8 + 4]);
-                        _sum5 = _mm256_set1_ps(bias_data[p * 8 + 5]);
-                        _sum6 = _mm256_set1_ps(bias_data[p * 8 + 6]);
-                        _sum7 = _mm256_set1_ps(bias_data[p * 8 + 7]);
-                    }
+                    float* outptr = top_blob.row(j) + out_start * elempack;
 
-                    for (int i = 0; i < num_input; i++)
+                    for (int p = out_start / num_output_elempack; p < out_end / num_output_elempack; p++)
                     {
-                        __m256 _val = _mm256_loadu_ps(m);
-                        __m256 _k0 = _mm256_set1_ps(kptr[0]);
-                        __m256 _k1 = _mm256_set1_ps(kptr[1]);
-                        __m256 _k2 = _mm256_set1_ps(kptr[2]);
-                        __m256 _k3 = _mm256_set1_ps(kptr[3]);
-                        __m256 _k4 = _mm256_set1_ps(kptr[4]);
-                        __m256 _k5 = _mm256_set1_ps(kptr[5]);
-                        __m256 _k6 = _mm256_set1_ps(kptr[6]);
-                        __m256 _k7 = _mm256_set1_ps(kptr[7]);
-                        _sum0 = _mm256_comp_fmadd_ps(_val, _k0, _sum0);
-                        _sum1 = _mm256_comp_fmadd_ps(_val, _k1, _sum1);
-                        _sum2 = _mm256_comp_fmadd_ps(_val, _k2, _sum2);
-                        _sum3 = _mm256_comp_fmadd_ps(_val, _k3, _sum3);
-                        _sum4 = _mm256_comp_fmadd_ps(_val, _k4, _sum4);
-                        _sum5 = _mm256_comp_fmadd_ps(_val, _k5, _sum5);
-                        _sum6 = _mm256_comp_fmadd_ps(_val, _k6, _sum6);
-                        _sum7 = _mm256_comp_fmadd_ps(_val, _k7, _sum7);
-
-                        m += 8;
-                        kptr += 8;
+                        const float* kptr = weight_data_tm.row(p);
+                        const float* m = bottom_blob.row(j);
+
+                        __m512 _sum0 = _mm512_set1_ps(0.f);
+                        __m512 _sum1 = _mm512_set1_ps(0.f);
+                        __m512 _sum2 = _mm512_set1_ps(0.f);
+                        __m512 _sum3 = _mm512_set1_ps(0.f);
+
+                        if (bias_term)
+                        {
+                            _sum0 = _mm512_set1_ps(bias_data[p * 4 + 0]);
+                            _sum1 = _mm512_set1_ps(bias_data[p * 4 + 1]);
+                            _sum2 = _mm512_set1_ps(bias_data[p * 4 + 2]);
+                            _sum3 = _mm512_set1_ps(bias_data[p * 4 + 3]);
+                        }
+
+                        int i = 0;
+                        for (; i < num_input; i++)
+                        {
+                            __m512 _val = _mm512_loadu_ps(m);
+                            _sum0 = _mm512_fmadd_ps(_val, _mm512_set1_ps(kptr[0]), _sum0);
+                            _sum1 = _mm512_fmadd_ps(_val, _mm512_set1_ps(kptr[1]), _sum1);
+                            _sum2 = _mm512_fmadd_ps(_val, _mm512_set1_ps(kptr[2]), _sum2);
+                            _sum3 = _mm512_fmadd_ps(_val, _mm512_set1_ps(kptr[3]), _sum3);
+
+                            m += 16;
+                            kptr += 4;
+                        }
+
+                        _sum0 = activation_avx512(_sum0, activation_type, activation_params);
+                        _sum1 = activation_avx512(_sum1, activation_type, activation_params);
+                        _sum2 = activation_avx512(_sum2, activation_type, activation_params);
+                        _sum3 = activation_avx512(_sum3, activation_type, activation_params);
+
+                        _mm512_storeu_ps(outptr, _sum0);
+                        _mm512_storeu_ps(outptr + 16, _sum1);
+                        _mm512_storeu_ps(outptr + 32, _sum2);
+                        _mm512_storeu_ps(outptr + 48, _sum3);
+                        outptr += 64;
                     }
-
-                    _sum0 = activation_avx(_sum0, activation_type, activation_params);
-                    _sum1 = activation_avx(_sum1, activation_type, activation_params);
-                    _sum2 = activation_avx(_sum2, activation_type, activation_params);
-                    _sum3 = activation_avx(_sum3, activation_type, activation_params);
-                    _sum4 = activation_avx(_sum4, activation_type, activation_params);
-                    _sum5 = activation_avx(_sum5, activation_type, activation_params);
-                    _sum6 = activation_avx(_sum6, activation_type, activation_params);
-                    _sum7 = activation_avx(_sum7, activation_type, activation_params);
-
-                    _mm256_storeu_ps(outptr, _sum0);
-                    _mm256_storeu_ps(outptr + 8, _sum1);
-                    _mm256_storeu_ps(outptr + 16, _sum2);
-                    _mm256_storeu_ps(outptr + 24, _sum3);
-                    _mm256_storeu_ps(outptr + 32, _sum4);
-                    _mm256_storeu_ps(outptr + 40, _sum5);
-                    _mm256_storeu_ps(outptr + 48, _sum6);
-                    _mm256_storeu_ps(outptr + 56, _sum7);
-                    outptr += 64;
                 }
-            }
-
-            if (elempack == 1 && num_output_elempack == 8)
-            {
-                float* outptr = top_blob.row(j);
 
-                for (int p = 0; p < num_output / num_output_elempack; p++)
+                if (elempack == 16 && num_output_elempack == 8)
                 {
-                    const float* kptr = weight_data_tm.row(p);
-                    const float* m = bottom_blob.row(j);
-
-                    __m256 _sum = _mm256_set1_ps(0.f);
+                    float* outptr = top_blob.row(j) + out_start * elempack;
 
-                    if (bias_term)
-                    {
-                        _sum = _mm256_loadu_ps((const float*)bias_data + p * 8);
-                    }
-
-                    int i = 0;
-                    for (; i + 7 < num_input; i += 8)
-                    {
-                        __m256 _val0 = _mm256_broadcast_ss(m);
-                        __m256 _val1 = _mm256_broadcast_ss(m + 1);
-                        __m256 _val2 = _mm256_broadcast_ss(m + 2);
-                        __m256 _val3 = _mm256_broadcast_ss(m + 3);
-                        __m256 _val4 = _mm256_broadcast_ss(m + 4);
-                        __m256 _val5 = _mm256_broadcast_ss(m + 5);
-                        __m256 _val6 = _mm256_broadcast_ss(m + 6);
-                        __m256 _val7 = _mm256_broadcast_ss(m + 7);
-
-                        __m256 _w0 = _mm256_loadu_ps(kptr);
-                        _sum = _mm256_comp_fmadd_ps(_val0, _w0, _sum);
-                        __m256 _w1 = _mm256_loadu_ps(kptr + 8);
-                        _sum = _mm256_comp_fmadd_ps(_val1, _w1, _sum);
-                        __m256 _w2 = _mm256_loadu_ps(kptr + 16);
-                        _sum = _mm256_comp_fmadd_ps(_val2, _w2, _sum);
-                        __m256 _w3 = _mm256_loadu_ps(kptr + 24);
-                        _sum = _mm256_comp_fmadd_ps(_val3, _w3, _sum);
-                        __m256 _w4 = _mm256_loadu_ps(kptr + 32);
-                        _sum = _mm256_comp_fmadd_ps(_val4, _w4, _sum);
-                        __m256 _w5 = _mm256_loadu_ps(kptr + 40);
-                        _sum = _mm256_comp_fmadd_ps(_val5, _w5, _sum);
-                        __m256 _w6 = _mm256_loadu_ps(kptr + 48);
-                        _sum = _mm256_comp_fmadd_ps(_val6, _w6, _sum);
-                        __m256 _w7 = _mm256_loadu_ps(kptr + 56);
-                        _sum = _mm256_comp_fmadd_ps(_val7, _w7, _sum);
-
-                        m += 8;
-                        kptr += 64;
-                    }
-                    for (; i + 3 < num_input; i += 4)
+                    for (int p = out_start / num_output_elempack; p < out_end / num_output_elempack; p++)
                     {
-                        __m256 _val0 = _mm256_broadcast_ss(m);
-                        __m256 _val1 = _mm256_broadcast_ss(m + 1);
-                        __m256 _val2 = _mm256_broadcast_ss(m + 2);
-                        __m256 _val3 = _mm256_broadcast_ss(m + 3);
-
-                        __m256 _w0 = _mm256_loadu_ps(kptr);
-                        _sum = _mm256_comp_fmadd_ps(_val0, _w0, _sum);
-                        __m256 _w1 = _mm256_loadu_ps(kptr + 8);
-                        _sum = _mm256_comp_fmadd_ps(_val1, _w1, _sum);
-                        __m256 _w2 = _mm256_loadu_ps(kptr + 16);
-                        _sum = _mm256_comp_fmadd_ps(_val2, _w2, _sum);
-                        __m256 _w3 = _mm256_loadu_ps(kptr + 24);
-                        _sum = _mm256_comp_fmadd_ps(_val3, _w3, _sum);
-
-                        m += 4;
-                        kptr += 32;
+                        const float* kptr = weight_data_tm.row(p);
+                        const float* m = bottom_blob.row(j);
+
+                        __m512 _sum0 = _mm512_set1_ps(0.f);
+                        __m512 _sum1 = _mm512_set1_ps(0.f);
+                        __m512 _sum2 = _mm512_set1_ps(0.f);
+                        __m512 _sum3 = _mm512_set1_ps(0.f);
+                        __m512 _sum4 = _mm512_set1_ps(0.f);
+                        __m512 _sum5 = _mm512_set1_ps(0.f);
+                        __m512 _sum6 = _mm512_set1_ps(0.f);
+                        __m512 _sum7 = _mm512_set1_ps(0.f);
+
+                        if (bias_term)
+                        {
+                            _sum0 = _mm512_set1_ps(bias_data[p * 8 + 0]);
+                            _sum1 = _mm512_set1_ps(bias_data[p * 8 + 1]);
+                            _sum2 = _mm512_set1_ps(bias_data[p * 8 + 2]);
+                            _sum3 = _mm512_set1_ps(bias_data[p * 8 + 3]);
+                            _sum4 = _mm512_set1_ps(bias_data[p * 8 + 4]);
+                            _sum5 = _mm512_set1_ps(bias_data[p * 8 + 5]);
+                            _sum6 = _mm512_set1_ps(bias_data[p * 8 + 6]);
+                            _sum7 = _mm512_set1_ps(bias_data[p * 8 + 7]);
+                        }
+
+                        int i = 0;
+                        for (; i < num_input; i++)
+                        {
+                            __m512 _val = _mm512_loadu_ps(m);
+                            _sum0 = _mm512_fmadd_ps(_val, _mm512_set1_ps(kptr[0]), _sum0);
+                            _sum1 = _mm512_fmadd_ps(_val, _mm512_set1_ps(kptr[1]), _sum1);
+                            _sum2 = _mm512_fmadd_ps(_val, _mm512_set1_ps(kptr[2]), _sum2);
+                            _sum3 = _mm512_fmadd_ps(_val, _mm512_set1_ps(kptr[3]), _sum3);
+                            _sum4 = _mm512_fmadd_ps(_val, _mm512_set1_ps(kptr[4]), _sum4);
+                            _sum5 = _mm512_fmadd_ps(_val, _mm512_set1_ps(kptr[5]), _sum5);
+                            _sum6 = _mm512_fmadd_ps(_val, _mm512_set1_ps(kptr[6]), _sum6);
+                            _sum7 = _mm512_fmadd_ps(_val, _mm512_set1_ps(kptr[7]), _sum7);
+
+                            m += 16;
+                            kptr += 8;
+                        }
+
+                        _sum0 = activation_avx512(_sum0, activation_type, activation_params);
+                        _sum1 = activation_avx512(_sum1, activation_type, activation_params);
+                        _sum2 = activation_avx512(_sum2, activation_type, activation_params);
+                        _sum3 = activation_avx512(_sum3, activation_type, activation_params);
+                        _sum4 = activation_avx512(_sum4, activation_type, activation_params);
+                        _sum5 = activation_avx512(_sum5, activation_type, activation_params);
+                        _sum6 = activation_avx512(_sum6, activation_type, activation_params);
+                        _sum7 = activation_avx512(_sum7, activation_type, activation_params);
+
+                        _mm512_storeu_ps(outptr, _sum0);
+                        _mm512_storeu_ps(outptr + 16, _sum1);
+                        _mm512_storeu_ps(outptr + 16 * 2, _sum2);
+                        _mm512_storeu_ps(outptr + 16 * 3, _sum3);
+                        _mm512_storeu_ps(outptr + 16 * 4, _sum4);
+                        _mm512_storeu_ps(outptr + 16 * 5, _sum5);
+                        _mm512_storeu_ps(outptr + 16 * 6, _sum6);
+                        _mm512_storeu_ps(outptr + 16 * 7, _sum7);
+                        outptr += 128;
                     }
-                    for (; i < num_input; i++)
-                    {
-                        __m256 _val = _mm256_set1_ps(m[0]);
-                        __m256 _w = _mm256_loadu_ps(kptr);
-                        _sum = _mm256_comp_fmadd_ps(_val, _w, _sum);
-
-                        m += 1;
-                        kptr += 8;
-                    }
-
-                    _sum = activation_avx(_sum, activation_type, activation_params);
-
-                    _mm256_storeu_ps(outptr, _sum);
-                    outptr += 8;
                 }
-            }
 
-            if (elempack == 4 && num_output_elempack == 8)
-            {
-                float* outptr = top_blob.row(j);
+#endif // __AVX512F__
 
-                for (int p = 0; p < num_output / num_output_elempack; p++)
+                if (elempack == 8 && num_output_elempack == 8)
                 {
-                    const float* kptr = weight_data_tm.row(p);
-                    const float* m = bottom_blob.row(j);
-
-                    __m128 _sum0 = _mm_set1_ps(0.f);
-                    __m128 _sum1 = _mm_set1_ps(0.f);
-                    __m128 _sum2 = _mm_set1_ps(0.f);
-                    __m128 _sum3 = _mm_set1_ps(0.f);
-                    __m128 _sum4 = _mm_set1_ps(0.f);
-                    __m128 _sum5 = _mm_set1_ps(0.f);
-                    __m128 _sum6 = _mm_set1_ps(0.f);
-                    __m128 _sum7 = _mm_set1_ps(0.f);
+                    float* outptr = top_blob.row(j) + out_start * elempack;
 
-                    if (bias_term)
-                    {
-                        _sum0 = _mm_set1_ps(bias_data[p * 8 + 0]);
-                        _sum1 = _mm_set1_ps(bias_data[p * 8 + 1]);
-                        _sum2 = _mm_set1_ps(bias_data[p * 8 + 2]);
-                        _sum3 = _mm_set1_ps(bias_data[p * 8 + 3]);
-                        _sum4 = _mm_set1_ps(bias_data[p * 8 + 4]);
-                        _sum5 = _mm_set1_ps(bias_data[p * 8 + 5]);
-                        _sum6 = _mm_set1_ps(bias_data[p * 8 + 6]);
-                        _sum7 = _mm_set1_ps(bias_data[p * 8 + 7]);
-                    }
-
-                    int i = 0;
-                    for (; i < num_input; i++)
+                    for (int p = out_start / num_output_elempack; p < out_end / num_output_elempack; p++)
                     {
-                        __m128 _val = _mm_loadu_ps(m);
-                        _sum0 = _mm_comp_fmadd_ps(_val, _mm_set1_ps(kptr[0]), _sum0);
-                        _sum1 = _mm_comp_fmadd_ps(_val, _mm_set1_ps(kptr[1]), _sum1);
-                        _sum2 = _mm_comp_fmadd_ps(_val, _mm_set1_ps(kptr[2]), _sum2);
-                        _sum3 = _mm_comp_fmadd_ps(_val, _mm_set1_ps(kptr[3]), _sum3);
-                        _sum4 = _mm_comp_fmadd_ps(_val, _mm_set1_ps(kptr[4]), _sum4);
-                        _sum5 = _mm_comp_fmadd_ps(_val, _mm_set1_ps(kptr[5]), _sum5);
-                        _sum6 = _mm_comp_fmadd_ps(_val, _mm_set1_ps(kptr[6]), _sum6);
-                        _sum7 = _mm_comp_fmadd_ps(_val, _mm_set1_ps(kptr[7]), _sum7);
-
-                        m += 4;
-                        kptr += 8;
+                        const float* kptr = weight_data_tm.row(p);
+                        const float* m = bottom_blob.row(j);
+
+                        __m256 _sum0 = _mm256_set1_ps(0.f);
+                        __m256 _sum1 = _mm256_set1_ps(0.f);
+                        __m256 _sum2 = _mm256_set1_ps(0.f);
+                        __m256 _sum3 = _mm256_set1_ps(0.f);
+                        __m256 _sum4 = _mm256_set1_ps(0.f);
+                        __m256 _sum5 = _mm256_set1_ps(0.f);
+                        __m256 _sum6 = _mm256_set1_ps(0.f);
+                        __m256 _sum7 = _mm256_set1_ps(0.f);
+
+                        if (bias_term)
+                        {
+                            _sum0 = _mm256_set1_ps(bias_data[p * 8 + 0]);
+                            _sum1 = _mm256_set1_ps(bias_data[p * 8 + 1]);
+                            _sum2 = _mm256_set1_ps(bias_data[p * 8 + 2]);
+                            _sum3 = _mm256_set1_ps(bias_data[p * 8 + 3]);
+                            _sum4 = _mm256_set1_ps(bias_data[p * 8 + 4]);
+                            _sum5 = _mm256_set1_ps(bias_data[p * 8 + 5]);
+                            _sum6 = _mm256_set1_ps(bias_data[p * 8 + 6]);
+                            _sum7 = _mm256_set1_ps(bias_data[p * 8 + 7]);
+                        }
+
+                        for (int i = 0; i < num_input; i++)
+                        {
+                            __m256 _val = _mm256_loadu_ps(m);
+                            __m256 _k0 = _mm256_set1_ps(kptr[0]);
+                            __m256 _k1 = _mm256_set1_ps(kptr[1]);
+                            __m256 _k2 = _mm256_set1_ps(kptr[2]);
+                            __m256 _k3 = _mm256_set1_ps(kptr[3]);
+                            __m256 _k4 = _mm256_set1_ps(kptr[4]);
+                            __m256 _k5 = _mm256_set1_ps(kptr[5]);
+                            __m256 _k6 = _mm256_set1_ps(kptr[6]);
+                            __m256 _k7 = _mm256_set1_ps(kptr[7]);
+                            _sum0 = _mm256_comp_fmadd_ps(_val, _k0, _sum0);
+                            _sum1 = _mm256_comp_fmadd_ps(_val, _k1, _sum1);
+                            _sum2 = _mm256_comp_fmadd_ps(_val, _k2, _sum2);
+                            _sum3 = _mm256_comp_fmadd_ps(_val, _k3, _sum3);
+                            _sum4 = _mm256_comp_fmadd_ps(_val, _k4, _sum4);
+                            _sum5 = _mm256_comp_fmadd_ps(_val, _k5, _sum5);
+                            _sum6 = _mm256_comp_fmadd_ps(_val, _k6, _sum6);
+                            _sum7 = _mm256_comp_fmadd_ps(_val, _k7, _sum7);
+
+                            m += 8;
+                            kptr += 8;
+                        }
+
+                        _sum0 = activation_avx(_sum0, activation_type, activation_params);
+                        _sum1 = activation_avx(_sum1, activation_type, activation_params);
+                        _sum2 = activation_avx(_sum2, activation_type, activation_params);
+                        _sum3 = activation_avx(_sum3, activation_type, activation_params);
+                        _sum4 = activation_avx(_sum4, activation_type, activation_params);
+                        _sum5 = activation_avx(_sum5, activation_type, activation_params);
+                        _sum6 = activation_avx(_sum6, activation_type, activation_params);
+                        _sum7 = activation_avx(_sum7, activation_type, activation_params);
+
+                        _mm256_storeu_ps(outptr, _sum0);
+                        _mm256_storeu_ps(outptr + 8, _sum1);
+                        _mm256_storeu_ps(outptr + 16, _sum2);
+                        _mm256_storeu_ps(outptr + 24, _sum3);
+                        _mm256_storeu_ps(outptr + 32, _sum4);
+                        _mm256_storeu_ps(outptr + 40, _sum5);
+                        _mm256_storeu_ps(outptr + 48, _sum6);
+                        _mm256_storeu_ps(outptr + 56, _sum7);
+                        outptr += 64;
                     }
-
-                    _sum0 = activation_sse(_sum0, activation_type, activation_params);
-                    _sum1 = activation_sse(_sum1, activation_type, activation_params);
-                    _sum2 = activation_sse(_sum2, activation_type, activation_params);
-                    _sum3 = activation_sse(_sum3, activation_type, activation_params);
-                    _sum4 = activation_sse(_sum4, activation_type, activation_params);
-                    _sum5 = activation_sse(_sum5, activation_type, activation_params);
-                    _sum6 = activation_sse(_sum6, activation_type, activation_params);
-                    _sum7 = activation_sse(_sum7, activation_type, activation_params);
-
-                    _mm_storeu_ps(outptr, _sum0);
-                    _mm_storeu_ps(outptr + 4, _sum1);
-                    _mm_storeu_ps(outptr + 8, _sum2);
-                    _mm_storeu_ps(outptr + 12, _sum3);
-                    _mm_storeu_ps(outptr + 16, _sum4);
-                    _mm_storeu_ps(outptr + 20, _sum5);
-                    _mm_storeu_ps(outptr + 24, _sum6);
-                    _mm_storeu_ps(outptr + 28, _sum7);
-                    outptr += 32;
                 }
-            }
 
-            if (elempack == 8 && num_output_elempack == 1)
-            {
-                float* outptr = top_blob.row(j);
-
-                for (int p = 0; p < num_output; p++)
+                if (elempack == 1 && num_output_elempack == 8)
                 {
-                    const float* kptr = (const float*)weight_data_tm + num_input * p;
-                    const float* m = bottom_blob.row(j);
+                    float* outptr = top_blob.row(j) + out_start * elempack;
 
-                    __m256 _sum0 = _mm256_set1_ps(0.f);
-                    __m256 _sum1 = _mm256_set1_ps(0.f);
-                    __m256 _sum2 = _mm256_set1_ps(0.f);
-                    __m256 _sum3 = _mm256_set1_ps(0.f);
-
-                    if (bias_term)
+                    for (int p = out_start / num_output_elempack; p < out_end / num_output_elempack; p++)
                     {
-                        _sum0 = _mm256_set1_ps(bias_data[p]);
+                        const float* kptr = weight_data_tm.row(p);
+                        const float* m = bottom_blob.row(j);
+
+                        __m256 _sum = _mm256_set1_ps(0.f);
+
+                        if (bias_term)
+                        {
+                            _sum = _mm256_loadu_ps((const float*)bias_data + p * 8);
+                        }
+
+                        int i = 0;
+                        for (; i + 7 < num_input; i += 8)
+                        {
+                            __m256 _val0 = _mm256_broadcast_ss(m);
+                            __m256 _val1 = _mm256_broadcast_ss(m + 1);
+                            __m256 _val2 = _mm256_broadcast_ss(m + 2);
+                            __m256 _val3 = _mm256_broadcast_ss(m + 3);
+                            __m256 _val4 = _mm256_broadcast_ss(m + 4);
+                            __m256 _val5 = _mm256_broadcast_ss(m + 5);
+                            __m256 _val6 = _mm256_broadcast_ss(m + 6);
+                            __m256 _val7 = _mm256_broadcast_ss(m + 7);
+
+                            __m256 _w0 = _mm256_loadu_ps(kptr);
+                            _sum = _mm256_comp_fmadd_ps(_val0, _w0, _sum);
+                            __m256 _w1 = _mm256_loadu_ps(kptr + 8);
+                            _sum = _mm256_comp_fmadd_ps(_val1, _w1, _sum);
+                            __m256 _w2 = _mm256_loadu_ps(kptr + 16);
+                            _sum = _mm256_comp_fmadd_ps(_val2, _w2, _sum);
+                            __m256 _w3 = _mm256_loadu_ps(kptr + 24);
+                            _sum = _mm256_comp_fmadd_ps(_val3, _w3, _sum);
+                            __m256 _w4 = _mm256_loadu_ps(kptr + 32);
+                            _sum = _mm256_comp_fmadd_ps(_val4, _w4, _sum);
+                            __m256 _w5 = _mm256_loadu_ps(kptr + 40);
+                            _sum = _mm256_comp_fmadd_ps(_val5, _w5, _sum);
+                            __m256 _w6 = _mm256_loadu_ps(kptr + 48);
+                            _sum = _mm256_comp_fmadd_ps(_val6, _w6, _sum);
+                            __m256 _w7 = _mm256_loadu_ps(kptr + 56);
+                            _sum = _mm256_comp_fmadd_ps(_val7, _w7, _sum);
+
+                            m += 8;
+                            kptr += 64;
+                        }
+                        for (; i + 3 < num_input; i += 4)
+                        {
+                            __m256 _val0 = _mm256_broadcast_ss(m);
+                            __m256 _val1 = _mm256_broadcast_ss(m + 1);
+                            __m256 _val2 = _mm256_broadcast_ss(m + 2);
+                            __m256 _val3 = _mm256_broadcast_ss(m + 3);
+
+                            __m256 _w0 = _mm256_loadu_ps(kptr);
+                            _sum = _mm256_comp_fmadd_ps(_val0, _w0, _sum);
+                            __m256 _w1 = _mm256_loadu_ps(kptr + 8);
+                            _sum = _mm256_comp_fmadd_ps(_val1, _w1, _sum);
+                            __m256 _w2 = _mm256_loadu_ps(kptr + 16);
+                            _sum = _mm256_comp_fmadd_ps(_val2, _w2, _sum);
+                            __m256 _w3 = _mm256_loadu_ps(kptr + 24);
+                            _sum = _mm256_comp_fmadd_ps(_val3, _w3, _sum);
+
+                            m += 4;
+                            kptr += 32;
+                        }
+                        for (; i < num_input; i++)
+                        {
+                            __m256 _val = _mm256_set1_ps(m[0]);
+                            __m256 _w = _mm256_loadu_ps(kptr);
+                            _sum = _mm256_comp_fmadd_ps(_val, _w, _sum);
+
+                            m += 1;
+                            kptr += 8;
+                        }
+
+                        _sum = activation_avx(_sum, activation_type, activation_params);
+
+                        _mm256_storeu_ps(outptr, _sum);
+                        outptr += 8;
                     }
+                }
 
-                    int i = 0;
-                    for (; i + 7 < num_input; i += 8)
-                    {
-                        __m256 _val0 = _mm256_loadu_ps(m);
-                        __m256 _val1 = _mm256_loadu_ps(m + 8);
-                        __m256 _val2 = _mm256_loadu_ps(m + 16);
-                        __m256 _val3 = _mm256_loadu_ps(m + 24);
-                        __m256 _val4 = _mm256_loadu_ps(m + 32);
-                        __m256 _val5 = _mm256_loadu_ps(m + 40);
-                        __m256 _val6 = _mm256_loadu_ps(m + 48);
-                        __m256 _val7 = _mm256_loadu_ps(m + 56);
-                        _sum0 = _mm256_comp_fmadd_ps(_val0, _mm256_set1_ps(kptr[0]), _sum0);
-                        _sum1 = _mm256_comp_fmadd_ps(_val1, _mm256_set1_ps(kptr[1]), _sum1);
-                        _sum2 = _mm256_comp_fmadd_ps(_val2, _mm256_set1_ps(kptr[2]), _sum2);
-                        _sum3 = _mm256_comp_fmadd_ps(_val3, _mm256_set1_ps(kptr[3]), _sum3);
-                        _sum0 = _mm256_comp_fmadd_ps(_val4, _mm256_set1_ps(kptr[4]), _sum0);
-                        _sum1 = _mm256_comp_fmadd_ps(_val5, _mm256_set1_ps(kptr[5]), _sum1);
-                        _sum2 = _mm256_comp_fmadd_ps(_val6, _mm256_set1_ps(kptr[6]), _sum2);
-                        _sum3 = _mm256_comp_fmadd_ps(_val7, _mm256_set1_ps(kptr[7]), _sum3);
-
-                        m += 64;
-                        kptr += 8;
-                    }
-                    for (; i + 3 < num_input; i += 4)
-                    {
-                        __m256 _val0 = _mm256_loadu_ps(m);
-                        __m256 _val1 = _mm256_loadu_ps(m + 8);
-                        __m256 _val2 = _mm256_loadu_ps(m + 16);
-                        __m256 _val3 = _mm256_loadu_ps(m + 24);
-                        _sum0 = _mm256_comp_fmadd_ps(_val0, _mm256_set1_ps(kptr[0]), _sum0);
-                        _sum1 = _mm256_comp_fmadd_ps(_val1, _mm256_set1_ps(kptr[1]), _sum1);
-                        _sum2 = _mm256_comp_fmadd_ps(_val2, _mm256_set1_ps(kptr[2]), _sum2);
-                        _sum3 = _mm256_comp_fmadd_ps(_val3, _mm256_set1_ps(kptr[3]), _sum3);
-
-                        m += 32;
-                        kptr += 4;
-                    }
-                    for (; i < num_input; i++)
-                    {
-                        __m256 _val = _mm256_loadu_ps(m);
-                        __m256 _k = _mm256_set1_ps(kptr[0]);
-                        _sum0 = _mm256_comp_fmadd_ps(_val, _k, _sum0);
+                if (elempack == 4 && num_output_elempack == 8)
+                {
+                    float* outptr = top_blob.row(j) + out_start * elempack;
 
-                        m += 8;
-                        kptr += 1;
+                    for (int p = out_start / num_output_elempack; p < out_end / num_output_elempack; p++)
+                    {
+                        const float* kptr = weight_data_tm.row(p);
+                        const float* m = bottom_blob.row(j);
+
+                        __m128 _sum0 = _mm_set1_ps(0.f);
+                        __m128 _sum1 = _mm_set1_ps(0.f);
+                        __m128 _sum2 = _mm_set1_ps(0.f);
+                        __m128 _sum3 = _mm_set1_ps(0.f);
+                        __m128 _sum4 = _mm_set1_ps(0.f);
+                        __m128 _sum5 = _mm_set1_ps(0.f);
+                        __m128 _sum6 = _mm_set1_ps(0.f);
+                        __m128 _sum7 = _mm_set1_ps(0.f);
+
+                        if (bias_term)
+                        {
+                            _sum0 = _mm_set1_ps(bias_data[p * 8 + 0]);
+                            _sum1 = _mm_set1_ps(bias_data[p * 8 + 1]);
+                            _sum2 = _mm_set1_ps(bias_data[p * 8 + 2]);
+                            _sum3 = _mm_set1_ps(bias_data[p * 8 + 3]);
+                            _sum4 = _mm_set1_ps(bias_data[p * 8 + 4]);
+                            _sum5 = _mm_set1_ps(bias_data[p * 8 + 5]);
+                            _sum6 = _mm_set1_ps(bias_data[p * 8 + 6]);
+                            _sum7 = _mm_set1_ps(bias_data[p * 8 + 7]);
+                        }
+
+                        int i = 0;
+                        for (; i < num_input; i++)
+                        {
+                            __m128 _val = _mm_loadu_ps(m);
+                            _sum0 = _mm_comp_fmadd_ps(_val, _mm_set1_ps(kptr[0]), _sum0);
+                            _sum1 = _mm_comp_fmadd_ps(_val, _mm_set1_ps(kptr[1]), _sum1);
+                            _sum2 = _mm_comp_fmadd_ps(_val, _mm_set1_ps(kptr[2]), _sum2);
+                            _sum3 = _mm_comp_fmadd_ps(_val, _mm_set1_ps(kptr[3]), _sum3);
+                            _sum4 = _mm_comp_fmadd_ps(_val, _mm_set1_ps(kptr[4]), _sum4);
+                            _sum5 = _mm_comp_fmadd_ps(_val, _mm_set1_ps(kptr[5]), _sum5);
+                            _sum6 = _mm_comp_fmadd_ps(_val, _mm_set1_ps(kptr[6]), _sum6);
+                            _sum7 = _mm_comp_fmadd_ps(_val, _mm_set1_ps(kptr[7]), _sum7);
+
+                            m += 4;
+                            kptr += 8;
+                        }
+
+                        _sum0 = activation_sse(_sum0, activation_type, activation_params);
+                        _sum1 = activation_sse(_sum1, activation_type, activation_params);
+                        _sum2 = activation_sse(_sum2, activation_type, activation_params);
+                        _sum3 = activation_sse(_sum3, activation_type, activation_params);
+                        _sum4 = activation_sse(_sum4, activation_type, activation_params);
+                        _sum5 = activation_sse(_sum5, activation_type, activation_params);
+                        _sum6 = activation_sse(_sum6, activation_type, activation_params);
+                        _sum7 = activation_sse(_sum7, activation_type, activation_params);
+
+                        _mm_storeu_ps(outptr, _sum0);
+                        _mm_storeu_ps(outptr + 4, _sum1);
+                        _mm_storeu_ps(outptr + 8, _sum2);
+                        _mm_storeu_ps(outptr + 12, _sum3);
+                        _mm_storeu_ps(outptr + 16, _sum4);
+                        _mm_storeu_ps(outptr + 20, _sum5);
+                        _mm_storeu_ps(outptr + 24, _sum6);
+                        _mm_storeu_ps(outptr + 28, _sum7);
+                        outptr += 32;
                     }
-
-                    _sum0 = _mm256_add_ps(_sum0, _sum1);
-                    _sum2 = _mm256_add_ps(_sum2, _sum3);
-                    _sum0 = _mm256_add_ps(_sum0, _sum2);
-
-                    _sum0 = activation_avx(_sum0, activation_type, activation_params);
-
-                    _mm256_storeu_ps(outptr, _sum0);
-                    outptr += 8;
                 }
-            }
 
-            if (elempack == 8 && num_output_elempack == 4)
-            {
-                float* outptr = top_blob.row(j);
-
-                for (int p = 0; p < num_output / num_output_elempack; p++)
+                if (elempack == 8 && num_output_elempack == 1)
                 {
-                    const float* kptr = weight_data_tm.row(p);
-                    const float* m = bottom_blob.row(j);
+                    float* outptr = top_blob.row(j) + out_start * elempack;
 
-                    __m256 _sum0 = _mm256_set1_ps(0.f);
-                    __m256 _sum1 = _mm256_set1_ps(0.f);
-                    __m256 _sum2 = _mm256_set1_ps(0.f);
-                    __m256 _sum3 = _mm256_set1_ps(0.f);
-
-                    if (bias_term)
+                    for (int p = out_start; p < out_end; p++)
                     {
-                        _sum0 = _mm256_set1_ps(bias_data[p * 4 + 0]);
-                        _sum1 = _mm256_set1_ps(bias_data[p * 4 + 1]);
-                        _sum2 = _mm256_set1_ps(bias_data[p * 4 + 2]);
-                        _sum3 = _mm256_set1_ps(bias_data[p * 4 + 3]);
+                        const float* kptr = (const float*)weight_data_tm + num_input * p;
+                        const float* m = bottom_blob.row(j);
+
+                        __m256 _sum0 = _mm256_set1_ps(0.f);
+                        __m256 _sum1 = _mm256_set1_ps(0.f);
+                        __m256 _sum2 = _mm256_set1_ps(0.f);
+                        __m256 _sum3 = _mm256_set1_ps(0.f);
+
+                        if (bias_term)
+                        {
+                            _sum0 = _mm256_set1_ps(bias_data[p]);
+                        }
+
+                        int i = 0;
+                        for (; i + 7 < num_input; i += 8)
+                        {
+                            __m256 _val0 = _mm256_loadu_ps(m);
+                            __m256 _val1 = _mm256_loadu_ps(m + 8);
+                            __m256 _val2 = _mm256_loadu_ps(m + 16);
+                            __m256 _val3 = _mm256_loadu_ps(m + 24);
+                            __m256 _val4 = _mm256_loadu_ps(m + 32);
+                            __m256 _val5 = _mm256_loadu_ps(m + 40);
+                            __m256 _val6 = _mm256_loadu_ps(m + 48);
+                            __m256 _val7 = _mm256_loadu_ps(m + 56);
+                            _sum0 = _mm256_comp_fmadd_ps(_val0, _mm256_set1_ps(kptr[0]), _sum0);
+                            _sum1 = _mm256_comp_fmadd_ps(_val1, _mm256_set1_ps(kptr[1]), _sum1);
+                            _sum2 = _mm256_comp_fmadd_ps(_val2, _mm256_set1_ps(kptr[2]), _sum2);
+                            _sum3 = _mm256_comp_fmadd_ps(_val3, _mm256_set1_ps(kptr[3]), _sum3);
+                            _sum0 = _mm256_comp_fmadd_ps(_val4, _mm256_set1_ps(kptr[4]), _sum0);
+                            _sum1 = _mm256_comp_fmadd_ps(_val5, _mm256_set1_ps(kptr[5]), _sum1);
+                            _sum2 = _mm256_comp_fmadd_ps(_val6, _mm256_set1_ps(kptr[6]), _sum2);
+                            _sum3 = _mm256_comp_fmadd_ps(_val7, _mm256_set1_ps(kptr[7]), _sum3);
+
+                            m += 64;
+                            kptr += 8;
+                        }
+                        for (; i + 3 < num_input; i += 4)
+                        {
+                            __m256 _val0 = _mm256_loadu_ps(m);
+                            __m256 _val1 = _mm256_loadu_ps(m + 8);
+                            __m256 _val2 = _mm256_loadu_ps(m + 16);
+                            __m256 _val3 = _mm256_loadu_ps(m + 24);
+                            _sum0 = _mm256_comp_fmadd_ps(_val0, _mm256_set1_ps(kptr[0]), _sum0);
+                            _sum1 = _mm256_comp_fmadd_ps(_val1, _mm256_set1_ps(kptr[1]), _sum1);
+                            _sum2 = _mm256_comp_fmadd_ps(_val2, _mm256_set1_ps(kptr[2]), _sum2);
+                            _sum3 = _mm256_comp_fmadd_ps(_val3, _mm256_set1_ps(kptr[3]), _sum3);
+
+                            m += 32;
+                            kptr += 4;
+                        }
+                        for (; i < num_input; i++)
+                        {
+                            __m256 _val = _mm256_loadu_ps(m);
+                            __m256 _k = _mm256_set1_ps(kptr[0]);
+                            _sum0 = _mm256_comp_fmadd_ps(_val, _k, _sum0);
+
+                            m += 8;
+                            kptr += 1;
+                        }
+
+                        _sum0 = _mm256_add_ps(_sum0, _sum1);
+                        _sum2 = _mm256_add_ps(_sum2, _sum3);
+                        _sum0 = _mm256_add_ps(_sum0, _sum2);
+
+                        _sum0 = activation_avx(_sum0, activation_type, activation_params);
+
+                        _mm256_storeu_ps(outptr, _sum0);
+                        outptr += 8;
                     }
+                }
 
-                    int i = 0;
-                    for (; i + 3 < num_input; i += 4)
-                    {
-                        __m256 _val0 = _mm256_loadu_ps(m);
-                        __m256 _val1 = _mm256_loadu_ps(m + 8);
-                        __m256 _val2 = _mm256_loadu_ps(m + 16);
-                        __m256 _val3 = _mm256_loadu_ps(m + 24);
-                        _sum0 = _mm256_comp_fmadd_ps(_val0, _mm256_set1_ps(kptr[0]), _sum0);
-                        _sum1 = _mm256_comp_fmadd_ps(_val0, _mm256_set1_ps(kptr[1]), _sum1);
-                        _sum2 = _mm256_comp_fmadd_ps(_val0, _mm256_set1_ps(kptr[2]), _sum2);
-                        _sum3 = _mm256_comp_fmadd_ps(_val0, _mm256_set1_ps(kptr[3]), _sum3);
-                        _sum0 = _mm256_comp_fmadd_ps(_val1, _mm256_set1_ps(kptr[4]), _sum0);
-                        _sum1 = _mm256_comp_fmadd_ps(_val1, _mm256_set1_ps(kptr[5]), _sum1);
-                        _sum2 = _mm256_comp_fmadd_ps(_val1, _mm256_set1_ps(kptr[6]), _sum2);
-                        _sum3 = _mm256_comp_fmadd_ps(_val1, _mm256_set1_ps(kptr[7]), _sum3);
-                        kptr += 8;
-
-                        _sum0 = _mm256_comp_fmadd_ps(_val2, _mm256_set1_ps(kptr[0]), _sum0);
-                        _sum1 = _mm256_comp_fmadd_ps(_val2, _mm256_set1_ps(kptr[1]), _sum1);
-                        _sum2 = _mm256_comp_fmadd_ps(_val2, _mm256_set1_ps(kptr[2]), _sum2);
-                        _sum3 = _mm256_comp_fmadd_ps(_val2, _mm256_set1_ps(kptr[3]), _sum3);
-                        _sum0 = _mm256_comp_fmadd_ps(_val3, _mm256_set1_ps(kptr[4]), _sum0);
-                        _sum1 = _mm256_comp_fmadd_ps(_val3, _mm256_set1_ps(kptr[5]), _sum1);
-                        _sum2 = _mm256_comp_fmadd_ps(_val3, _mm256_set1_ps(kptr[6]), _sum2);
-                        _sum3 = _mm256_comp_fmadd_ps(_val3, _mm256_set1_ps(kptr[7]), _sum3);
+                if (elempack == 8 && num_output_elempack == 4)
+                {
+                    float* outptr = top_blob.row(j) + out_start * elempack;
 
-                        m += 32;
-                        kptr += 8;
-                    }
-                    for (; i < num_input; i++)
+                    for (int p = out_start / num_output_elempack; p < out_end / num_output_elempack; p++)
                     {
-                        __m256 _val = _mm256_loadu_ps(m);
-                        _sum0 = _mm256_comp_fmadd_ps(_val, _mm256_set1_ps(kptr[0]), _sum0);
-                        _sum1 = _mm256_comp_fmadd_ps(_val, _mm256_set1_ps(kptr[1]), _sum1);
-                        _sum2 = _mm256_comp_fmadd_ps(_val, _mm256_set1_ps(kptr[2]), _sum2);
-                        _sum3 = _mm256_comp_fmadd_ps(_val, _mm256_set1_ps(kptr[3]), _sum3);
-
-                        m += 8;
-                        kptr += 4;
+                        const float* kptr = weight_data_tm.row(p);
+                        const float* m = bottom_blob.row(j);
+
+                        __m256 _sum0 = _mm256_set1_ps(0.f);
+                        __m256 _sum1 = _mm256_set1_ps(0.f);
+                        __m256 _sum2 = _mm256_set1_ps(0.f);
+                        __m256 _sum3 = _mm256_set1_ps(0.f);
+
+                        if (bias_term)
+                        {
+                            _sum0 = _mm256_set1_ps(bias_data[p * 4 + 0]);
+                            _sum1 = _mm256_set1_ps(bias_data[p * 4 + 1]);
+                            _sum2 = _mm256_set1_ps(bias_data[p * 4 + 2]);
+                            _sum3 = _mm256_set1_ps(bias_data[p * 4 + 3]);
+                        }
+
+                        int i = 0;
+                        for (; i + 3 < num_input; i += 4)
+                        {
+                            __m256 _val0 = _mm256_loadu_ps(m);
+                            __m256 _val1 = _mm256_loadu_ps(m + 8);
+                            __m256 _val2 = _mm256_loadu_ps(m + 16);
+                            __m256 _val3 = _mm256_loadu_ps(m + 24);
+                            _sum0 = _mm256_comp_fmadd_ps(_val0, _mm256_set1_ps(kptr[0]), _sum0);
+                            _sum1 = _mm256_comp_fmadd_ps(_val0, _mm256_set1_ps(kptr[1]), _sum1);
+                            _sum2 = _mm256_comp_fmadd_ps(_val0, _mm256_set1_ps(kptr[2]), _sum2);
+                            _sum3 = _mm256_comp_fmadd_ps(_val0, _mm256_set1_ps(kptr[3]), _sum3);
+                            _sum0 = _mm256_comp_fmadd_ps(_val1, _mm256_set1_ps(kptr[4]), _sum0);
+                            _sum1 = _mm256_comp_fmadd_ps(_val1, _mm256_set1_ps(kptr[5]), _sum1);
+                            _sum2 = _mm256_comp_fmadd_ps(_val1, _mm256_set1_ps(kptr[6]), _sum2);
+                            _sum3 = _mm256_comp_fmadd_ps(_val1, _mm256_set1_ps(kptr[7]), _sum3);
+                            kptr += 8;
+
+                            _sum0 = _mm256_comp_fmadd_ps(_val2, _mm256_set1_ps(kptr[0]), _sum0);
+                            _sum1 = _mm256_comp_fmadd_ps(_val2, _mm256_set1_ps(kptr[1]), _sum1);
+                            _sum2 = _mm256_comp_fmadd_ps(_val2, _mm256_set1_ps(kptr[2]), _sum2);
+                            _sum3 = _mm256_comp_fmadd_ps(_val2, _mm256_set1_ps(kptr[3]), _sum3);
+                            _sum0 = _mm256_comp_fmadd_ps(_val3, _mm256_set1_ps(kptr[4]), _sum0);
+                            _sum1 = _mm256_comp_fmadd_ps(_val3, _mm256_set1_ps(kptr[5]), _sum1);
+                            _sum2 = _mm256_comp_fmadd_ps(_val3, _mm256_set1_ps(kptr[6]), _sum2);
+                            _sum3 = _mm256_comp_fmadd_ps(_val3, _mm256_set1_ps(kptr[7]), _sum3);
+
+                            m += 32;
+                            kptr += 8;
+                        }
+                        for (; i < num_input; i++)
+                        {
+                            __m256 _val = _mm256_loadu_ps(m);
+                            _sum0 = _mm256_comp_fmadd_ps(_val, _mm256_set1_ps(kptr[0]), _sum0);
+                            _sum1 = _mm256_comp_fmadd_ps(_val, _mm256_set1_ps(kptr[1]), _sum1);
+                            _sum2 = _mm256_comp_fmadd_ps(_val, _mm256_set1_ps(kptr[2]), _sum2);
+                            _sum3 = _mm256_comp_fmadd_ps(_val, _mm256_set1_ps(kptr[3]), _sum3);
+
+                            m += 8;
+                            kptr += 4;
+                        }
+
+                        _sum0 = activation_avx(_sum0, activation_type, activation_params);
+                        _sum1 = activation_avx(_sum1, activation_type, activation_params);
+                        _sum2 = activation_avx(_sum2, activation_type, activation_params);
+                        _sum3 = activation_avx(_sum3, activation_type, activation_params);
+
+                        _mm256_storeu_ps(outptr, _sum0);
+                        _mm256_storeu_ps(outptr + 8, _sum1);
+                        _mm256_storeu_ps(outptr + 16, _sum2);
+                        _mm256_storeu_ps(outptr + 24, _sum3);
+                        outptr += 32;
                     }
-
-                    _sum0 = activation_avx(_sum0, activation_type, activation_params);
-                    _sum1 = activation_avx(_sum1, activation_type, activation_params);
-                    _sum2 = activation_avx(_sum2, activation_type, activation_params);
-                    _sum3 = activation_avx(_sum3, activation_type, activation_params);
-
-                    _mm256_storeu_ps(outptr, _sum0);
-                    _mm256_storeu_ps(outptr + 8, _sum1);
-                    _mm256_storeu_ps(outptr + 16, _sum2);
-                    _mm256_storeu_ps(outptr + 24, _sum3);
-                    outptr += 32;
                 }
-            }
 #endif // __AVX__
 
-            if (elempack == 4 && num_output_elempack == 4)
-            {
-                float* outptr = top_blob.row(j);
-
-                for (int p = 0; p < num_output / num_output_elempack; p++)
+                if (elempack == 4 && num_output_elempack == 4)
                 {
-                    const float* kptr = weight_data_tm.row(p);
-                    const float* m = bottom_blob.row(j);
-
-                    __m128 _sum0 = _mm_set1_ps(0.f);
-                    __m128 _sum1 = _mm_set1_ps(0.f);
-                    __m128 _sum2 = _mm_set1_ps(0.f);
-                    __m128 _sum3 = _mm_set1_ps(0.f);
-
-                    if (bias_term)
-                    {
-                        _sum0 = _mm_set1_ps(bias_data[p * 4 + 0]);
-                        _sum1 = _mm_set1_ps(bias_data[p * 4 + 1]);
-                        _sum2 = _mm_set1_ps(bias_data[p * 4 + 2]);
-                        _sum3 = _mm_set1_ps(bias_data[p * 4 + 3]);
-                    }
+                    float* outptr = top_blob.row(j) + out_start * elempack;
 
-                    int i = 0;
-                    for (; i + 3 < num_input; i += 4)
+                    for (int p = out_start / num_output_elempack; p < out_end / num_output_elempack; p++)
                     {
-                        __m128 _val0 = _mm_loadu_ps(m);
-                        __m128 _val1 = _mm_loadu_ps(m + 4);
-                        __m128 _val2 = _mm_loadu_ps(m + 8);
-                        __m128 _val3 = _mm_loadu_ps(m + 12);
-                        _sum0 = _mm_add_ps(_mm_mul_ps(_val0, _mm_set1_ps(kptr[0])), _sum0);
-                        _sum1 = _mm_add_ps(_mm_mul_ps(_val0, _mm_set1_ps(kptr[1])), _sum1);
-                        _sum2 = _mm_add_ps(_mm_mul_ps(_val0, _mm_set1_ps(kptr[2])), _sum2);
-                        _sum3 = _mm_add_ps(_mm_mul_ps(_val0, _mm_set1_ps(kptr[3])), _sum3);
-                        _sum0 = _mm_add_ps(_mm_mul_ps(_val1, _mm_set1_ps(kptr[4])), _sum0);
-                        _sum1 = _mm_add_ps(_mm_mul_ps(_val1, _mm_set1_ps(kptr[5])), _sum1);
-                        _sum2 = _mm_add_ps(_mm_mul_ps(_val1, _mm_set1_ps(kptr[6])), _sum2);
-                        _sum3 = _mm_add_ps(_mm_mul_ps(_val1, _mm_set1_ps(kptr[7])), _sum3);
-                        _sum0 = _mm_add_ps(_mm_mul_ps(_val2, _mm_set1_ps(kptr[8])), _sum0);
-                        _sum1 = _mm_add_ps(_mm_mul_ps(_val2, _mm_set1_ps(kptr[9])), _sum1);
-                        _sum2 = _mm_add_ps(_mm_mul_ps(_val2, _mm_set1_ps(kptr[10])), _sum2);
-                        _sum3 = _mm_add_ps(_mm_mul_ps(_val2, _mm_set1_ps(kptr[11])), _sum3);
-                        _sum0 = _mm_add_ps(_mm_mul_ps(_val3, _mm_set1_ps(kptr[12])), _sum0);
-                        _sum1 = _mm_add_ps(_mm_mul_ps(_val3, _mm_set1_ps(kptr[13])), _sum1);
-                        _sum2 = _mm_add_ps(_mm_mul_ps(_val3, _mm_set1_ps(kptr[14])), _sum2);
-                        _sum3 = _mm_add_ps(_mm_mul_ps(_val3, _mm_set1_ps(kptr[15])), _sum3);
-
-                        m += 16;
-                        kptr += 16;
+                        const float* kptr = weight_data_tm.row(p);
+                        const float* m = bottom_blob.row(j);
+
+                        __m128 _sum0 = _mm_set1_ps(0.f);
+                        __m128 _sum1 = _mm_set1_ps(0.f);
+                        __m128 _sum2 = _mm_set1_ps(0.f);
+                        __m128 _sum3 = _mm_set1_ps(0.f);
+
+                        if (bias_term)
+                        {
+                            _sum0 = _mm_set1_ps(bias_data[p * 4 + 0]);
+                            _sum1 = _mm_set1_ps(bias_data[p * 4 + 1]);
+                            _sum2 = _mm_set1_ps(bias_data[p * 4 + 2]);
+                            _sum3 = _mm_set1_ps(bias_data[p * 4 + 3]);
+                        }
+
+                        int i = 0;
+                        for (; i + 3 < num_input; i += 4)
+                        {
+                            __m128 _val0 = _mm_loadu_ps(m);
+                            __m128 _val1 = _mm_loadu_ps(m + 4);
+                            __m128 _val2 = _mm_loadu_ps(m + 8);
+                            __m128 _val3 = _mm_loadu_ps(m + 12);
+                            _sum0 = _mm_add_ps(_mm_mul_ps(_val0, _mm_set1_ps(kptr[0])), _sum0);
+                            _sum1 = _mm_add_ps(_mm_mul_ps(_val0, _mm_set1_ps(kptr[1])), _sum1);
+                            _sum2 = _mm_add_ps(_mm_mul_ps(_val0, _mm_set1_ps(kptr[2])), _sum2);
+                            _sum3 = _mm_add_ps(_mm_mul_ps(_val0, _mm_set1_ps(kptr[3])), _sum3);
+                            _sum0 = _mm_add_ps(_mm_mul_ps(_val1, _mm_set1_ps(kptr[4])), _sum0);
+                            _sum1 = _mm_add_ps(_mm_mul_ps(_val1, _mm_set1_ps(kptr[5])), _sum1);
+                            _sum2 = _mm_add_ps(_mm_mul_ps(_val1, _mm_set1_ps(kptr[6])), _sum2);
+                            _sum3 = _mm_add_ps(_mm_mul_ps(_val1, _mm_set1_ps(kptr[7])), _sum3);
+                            _sum0 = _mm_add_ps(_mm_mul_ps(_val2, _mm_set1_ps(kptr[8])), _sum0);
+                            _sum1 = _mm_add_ps(_mm_mul_ps(_val2, _mm_set1_ps(kptr[9])), _sum1);
+                            _sum2 = _mm_add_ps(_mm_mul_ps(_val2, _mm_set1_ps(kptr[10])), _sum2);
+                            _sum3 = _mm_add_ps(_mm_mul_ps(_val2, _mm_set1_ps(kptr[11])), _sum3);
+                            _sum0 = _mm_add_ps(_mm_mul_ps(_val3, _mm_set1_ps(kptr[12])), _sum0);
+                            _sum1 = _mm_add_ps(_mm_mul_ps(_val3, _mm_set1_ps(kptr[13])), _sum1);
+                            _sum2 = _mm_add_ps(_mm_mul_ps(_val3, _mm_set1_ps(kptr[14])), _sum2);
+                            _sum3 = _mm_add_ps(_mm_mul_ps(_val3, _mm_set1_ps(kptr[15])), _sum3);
+
+                            m += 16;
+                            kptr += 16;
+                        }
+                        for (; i < num_input; i++)
+                        {
+                            __m128 _val = _mm_loadu_ps(m);
+                            _sum0 = _mm_add_ps(_mm_mul_ps(_val, _mm_set1_ps(kptr[0])), _sum0);
+                            _sum1 = _mm_add_ps(_mm_mul_ps(_val, _mm_set1_ps(kptr[1])), _sum1);
+                            _sum2 = _mm_add_ps(_mm_mul_ps(_val, _mm_set1_ps(kptr[2])), _sum2);
+                            _sum3 = _mm_add_ps(_mm_mul_ps(_val, _mm_set1_ps(kptr[3])), _sum3);
+
+                            m += 4;
+                            kptr += 4;
+                        }
+
+                        _sum0 = activation_sse(_sum0, activation_type, activation_params);
+                        _sum1 = activation_sse(_sum1, activation_type, activation_params);
+                        _sum2 = activation_sse(_sum2, activation_type, activation_params);
+                        _sum3 = activation_sse(_sum3, activation_type, activation_params);
+
+                        _mm_storeu_ps(outptr, _sum0);
+                        _mm_storeu_ps(outptr + 4, _sum1);
+                        _mm_storeu_ps(outptr + 8, _sum2);
+                        _mm_storeu_ps(outptr + 12, _sum3);
+                        outptr += 16;
                     }
-                    for (; i < num_input; i++)
-                    {
-                        __m128 _val = _mm_loadu_ps(m);
-                        _sum0 = _mm_add_ps(_mm_mul_ps(_val, _mm_set1_ps(kptr[0])), _sum0);
-                        _sum1 = _mm_add_ps(_mm_mul_ps(_val, _mm_set1_ps(kptr[1])), _sum1);
-                        _sum2 = _mm_add_ps(_mm_mul_ps(_val, _mm_set1_ps(kptr[2])), _sum2);
-                        _sum3 = _mm_add_ps(_mm_mul_ps(_val, _mm_set1_ps(kptr[3])), _sum3);
-
-                        m += 4;
-                        kptr += 4;
-                    }
-
-                    _sum0 = activation_sse(_sum0, activation_type, activation_params);
-                    _sum1 = activation_sse(_sum1, activation_type, activation_params);
-                    _sum2 = activation_sse(_sum2, activation_type, activation_params);
-                    _sum3 = activation_sse(_sum3, activation_type, activation_params);
-
-                    _mm_storeu_ps(outptr, _sum0);
-                    _mm_storeu_ps(outptr + 4, _sum1);
-                    _mm_storeu_ps(outptr + 8, _sum2);
-                    _mm_storeu_ps(outptr + 12, _sum3);
-                    outptr += 16;
                 }
-            }
 
-            if (elempack == 1 && num_output_elempack == 4)
-            {
-                float* outptr = top_blob.row(j);
-
-                for (int p = 0; p < num_output / num_output_elempack; p++)
+                if (elempack == 1 && num_output_elempack == 4)
                 {
-                    const float* kptr = weight_data_tm.row(p);
-                    const float* m = bottom_blob.row(j);
-
-                    __m128 _sum = _mm_set1_ps(0.f);
+                    float* outptr = top_blob.row(j) + out_start * elempack;
 
-                    if (bias_term)
+                    for (int p = out_start / num_output_elempack; p < out_end / num_output_elempack; p++)
                     {
-                        _sum = _mm_loadu_ps((const float*)bias_data + p * 4);
-                    }
+                        const float* kptr = weight_data_tm.row(p);
+                        const float* m = bottom_blob.row(j);
 
-                    int i = 0;
+                        __m128 _sum = _mm_set1_ps(0.f);
+
+                        if (bias_term)
+                        {
+                            _sum = _mm_loadu_ps((const float*)bias_data + p * 4);
+                        }
+
+                        int i = 0;
 #if __AVX__
-                    for (; i + 7 < num_input; i += 8)
-                    {
-                        __m128 _val0 = _mm_broadcast_ss(m);
-                        __m128 _val1 = _mm_broadcast_ss(m + 1);
-                        __m128 _val2 = _mm_broadcast_ss(m + 2);
-                        __m128 _val3 = _mm_broadcast_ss(m + 3);
-                        __m128 _val4 = _mm_broadcast_ss(m + 4);
-                        __m128 _val5 = _mm_broadcast_ss(m + 5);
-                        __m128 _val6 = _mm_broadcast_ss(m + 6);
-                        __m128 _val7 = _mm_broadcast_ss(m + 7);
-
-                        __m128 _w0 = _mm_loadu_ps(kptr);
-                        _sum = _mm_comp_fmadd_ps(_val0, _w0, _sum);
-                        __m128 _w1 = _mm_loadu_ps(kptr + 4);
-                        _sum = _mm_comp_fmadd_ps(_val1, _w1, _sum);
-                        __m128 _w2 = _mm_loadu_ps(kptr + 8);
-                        _sum = _mm_comp_fmadd_ps(_val2, _w2, _sum);
-                        __m128 _w3 = _mm_loadu_ps(kptr + 12);
-                        _sum = _mm_comp_fmadd_ps(_val3, _w3, _sum);
-                        __m128 _w4 = _mm_loadu_ps(kptr + 16);
-                        _sum = _mm_comp_fmadd_ps(_val4, _w4, _sum);
-                        __m128 _w5 = _mm_loadu_ps(kptr + 20);
-                        _sum = _mm_comp_fmadd_ps(_val5, _w5, _sum);
-                        __m128 _w6 = _mm_loadu_ps(kptr + 24);
-                        _sum = _mm_comp_fmadd_ps(_val6, _w6, _sum);
-                        __m128 _w7 = _mm_loadu_ps(kptr + 28);
-                        _sum = _mm_comp_fmadd_ps(_val7, _w7, _sum);
-
-                        m += 8;
-                        kptr += 32;
-                    }
+                        for (; i + 7 < num_input; i += 8)
+                        {
+                            __m128 _val0 = _mm_broadcast_ss(m);
+                            __m128 _val1 = _mm_broadcast_ss(m + 1);
+                            __m128 _val2 = _mm_broadcast_ss(m + 2);
+                            __m128 _val3 = _mm_broadcast_ss(m + 3);
+                            __m128 _val4 = _mm_broadcast_ss(m + 4);
+                            __m128 _val5 = _mm_broadcast_ss(m + 5);
+                            __m128 _val6 = _mm_broadcast_ss(m + 6);
+                            __m128 _val7 = _mm_broadcast_ss(m + 7);
+
+                            __m128 _w0 = _mm_loadu_ps(kptr);
+                            _sum = _mm_comp_fmadd_ps(_val0, _w0, _sum);
+                            __m128 _w1 = _mm_loadu_ps(kptr + 4);
+                            _sum = _mm_comp_fmadd_ps(_val1, _w1, _sum);
+                            __m128 _w2 = _mm_loadu_ps(kptr + 8);
+                            _sum = _mm_comp_fmadd_ps(_val2, _w2, _sum);
+                            __m128 _w3 = _mm_loadu_ps(kptr + 12);
+                            _sum = _mm_comp_fmadd_ps(_val3, _w3, _sum);
+                            __m128 _w4 = _mm_loadu_ps(kptr + 16);
+                            _sum = _mm_comp_fmadd_ps(_val4, _w4, _sum);
+                            __m128 _w5 = _mm_loadu_ps(kptr + 20);
+                            _sum = _mm_comp_fmadd_ps(_val5, _w5, _sum);
+                            __m128 _w6 = _mm_loadu_ps(kptr + 24);
+                            _sum = _mm_comp_fmadd_ps(_val6, _w6, _sum);
+                            __m128 _w7 = _mm_loadu_ps(kptr + 28);
+                            _sum = _mm_comp_fmadd_ps(_val7, _w7, _sum);
+
+                            m += 8;
+                            kptr += 32;
+                        }
 #endif // __AVX__
-                    for (; i + 3 < num_input; i += 4)
-                    {
-                        __m128 _val0 = _mm_set1_ps(m[0]);
-                        __m128 _val1 = _mm_set1_ps(m[1]);
-                        __m128 _val2 = _mm_set1_ps(m[2]);
-                        __m128 _val3 = _mm_set1_ps(m[3]);
-
-                        __m128 _w0 = _mm_loadu_ps(kptr);
-                        _sum = _mm_add_ps(_mm_mul_ps(_val0, _w0), _sum);
-                        __m128 _w1 = _mm_loadu_ps(kptr + 4);
-                        _sum = _mm_add_ps(_mm_mul_ps(_val1, _w1), _sum);
-                        __m128 _w2 = _mm_loadu_ps(kptr + 8);
-                        _sum = _mm_add_ps(_mm_mul_ps(_val2, _w2), _sum);
-                        __m128 _w3 = _mm_loadu_ps(kptr + 12);
-                        _sum = _mm_add_ps(_mm_mul_ps(_val3, _w3), _sum);
-
-                        m += 4;
-                        kptr += 16;
+                        for (; i + 3 < num_input; i += 4)
+                        {
+                            __m128 _val0 = _mm_set1_ps(m[0]);
+                            __m128 _val1 = _mm_set1_ps(m[1]);
+                            __m128 _val2 = _mm_set1_ps(m[2]);
+                            __m128 _val3 = _mm_set1_ps(m[3]);
+
+                            __m128 _w0 = _mm_loadu_ps(kptr);
+                            _sum = _mm_add_ps(_mm_mul_ps(_val0, _w0), _sum);
+                            __m128 _w1 = _mm_loadu_ps(kptr + 4);
+                            _sum = _mm_add_ps(_mm_mul_ps(_val1, _w1), _sum);
+                            __m128 _w2 = _mm_loadu_ps(kptr + 8);
+                            _sum = _mm_add_ps(_mm_mul_ps(_val2, _w2), _sum);
+                            __m128 _w3 = _mm_loadu_ps(kptr + 12);
+                            _sum = _mm_add_ps(_mm_mul_ps(_val3, _w3), _sum);
+
+                            m += 4;
+                            kptr += 16;
+                        }
+                        for (; i < num_input; i++)
+                        {
+                            __m128 _val = _mm_set1_ps(m[0]);
+                            __m128 _k = _mm_loadu_ps(kptr);
+                            _sum = _mm_add_ps(_mm_mul_ps(_val, _k), _sum);
+
+                            m += 1;
+                            kptr += 4;
+                        }
+
+                        _sum = activation_sse(_sum, activation_type, activation_params);
+
+                        _mm_storeu_ps(outptr, _sum);
+                        outptr += 4;
                     }
-                    for (; i < num_input; i++)
-                    {
-                        __m128 _val = _mm_set1_ps(m[0]);
-                        __m128 _k = _mm_loadu_ps(kptr);
-                        _sum = _mm_add_ps(_mm_mul_ps(_val, _k), _sum);
-
-                        m += 1;
-                        kptr += 4;
-                    }
-
-                    _sum = activation_sse(_sum, activation_type, activation_params);
-
-                    _mm_storeu_ps(outptr, _sum);
-                    outptr += 4;
                 }
-            }
 
-            if (elempack == 4 && num_output_elempack == 1)
-            {
-                float* outptr = top_blob.row(j);
-
-                for (int p = 0; p < num_output; p++)
+                if (elempack == 4 && num_output_elempack == 1)
                 {
-                    const float* kptr = (const float*)weight_data_tm + num_input * p;
-                    const float* m = bottom_blob.row(j);
-
-                    __m128 _sum0 = _mm_set1_ps(0.f);
-                    __m128 _sum1 = _mm_set1_ps(0.f);
-                    __m128 _sum2 = _mm_set1_ps(0.f);
-                    __m128 _sum3 = _mm_set1_ps(0.f);
-
-                    if (bias_term)
-                    {
-                        _sum0 = _mm_set1_ps(bias_data[p]);
-                    }
+                    float* outptr = top_blob.row(j) + out_start * elempack;
 
-                    int i = 0;
-                    for (; i + 7 < num_input; i += 8)
+                    for (int p = out_start; p < out_end; p++)
                     {
-                        __m128 _val0 = _mm_loadu_ps(m);
-                        __m128 _val1 = _mm_loadu_ps(m + 4);
-                        __m128 _val2 = _mm_loadu_ps(m + 8);
-                        __m128 _val3 = _mm_loadu_ps(m + 12);
-                        __m128 _val4 = _mm_loadu_ps(m + 16);
-                        __m128 _val5 = _mm_loadu_ps(m + 20);
-                        __m128 _val6 = _mm_loadu_ps(m + 24);
-                        __m128 _val7 = _mm_loadu_ps(m + 28);
-                        _sum0 = _mm_add_ps(_mm_mul_ps(_val0, _mm_set1_ps(kptr[0])), _sum0);
-                        _sum1 = _mm_add_ps(_mm_mul_ps(_val1, _mm_set1_ps(kptr[1])), _sum1);
-                        _sum2 = _mm_add_ps(_mm_mul_ps(_val2, _mm_set1_ps(kptr[2])), _sum2);
-                        _sum3 = _mm_add_ps(_mm_mul_ps(_val3, _mm_set1_ps(kptr[3])), _sum3);
-                        _sum0 = _mm_add_ps(_mm_mul_ps(_val4, _mm_set1_ps(kptr[4])), _sum0);
-                        _sum1 = _mm_add_ps(_mm_mul_ps(_val5, _mm_set1_ps(kptr[5])), _sum1);
-                        _sum2 = _mm_add_ps(_mm_mul_ps(_val6, _mm_set1_ps(kptr[6])), _sum2);
-                        _sum3 = _mm_add_ps(_mm_mul_ps(_val7, _mm_set1_ps(kptr[7])), _sum3);
-
-                        m += 32;
-                        kptr += 8;
+                        const float* kptr = (const float*)weight_data_tm + num_input * p;
+                        const float* m = bottom_blob.row(j);
+
+                        __m128 _sum0 = _mm_set1_ps(0.f);
+                        __m128 _sum1 = _mm_set1_ps(0.f);
+                        __m128 _sum2 = _mm_set1_ps(0.f);
+                        __m128 _sum3 = _mm_set1_ps(0.f);
+
+                        if (bias_term)
+                        {
+                            _sum0 = _mm_set1_ps(bias_data[p]);
+                        }
+
+                        int i = 0;
+                        for (; i + 7 < num_input; i += 8)
+                        {
+                            __m128 _val0 = _mm_loadu_ps(m);
+                            __m128 _val1 = _mm_loadu_ps(m + 4);
+                            __m128 _val2 = _mm_loadu_ps(m + 8);
+                            __m128 _val3 = _mm_loadu_ps(m + 12);
+                            __m128 _val4 = _mm_loadu_ps(m + 16);
+                            __m128 _val5 = _mm_loadu_ps(m + 20);
+                            __m128 _val6 = _mm_loadu_ps(m + 24);
+                            __m128 _val7 = _mm_loadu_ps(m + 28);
+                            _sum0 = _mm_add_ps(_mm_mul_ps(_val0, _mm_set1_ps(kptr[0])), _sum0);
+                            _sum1 = _mm_add_ps(_mm_mul_ps(_val1, _mm_set1_ps(kptr[1])), _sum1);
+                            _sum2 = _mm_add_ps(_mm_mul_ps(_val2, _mm_set1_ps(kptr[2])), _sum2);
+                            _sum3 = _mm_add_ps(_mm_mul_ps(_val3, _mm_set1_ps(kptr[3])), _sum3);
+                            _sum0 = _mm_add_ps(_mm_mul_ps(_val4, _mm_set1_ps(kptr[4])), _sum0);
+                            _sum1 = _mm_add_ps(_mm_mul_ps(_val5, _mm_set1_ps(kptr[5])), _sum1);
+                            _sum2 = _mm_add_ps(_mm_mul_ps(_val6, _mm_set1_ps(kptr[6])), _sum2);
+                            _sum3 = _mm_add_ps(_mm_mul_ps(_val7, _mm_set1_ps(kptr[7])), _sum3);
+
+                            m += 32;
+                            kptr += 8;
+                        }
+                        for (; i + 3 < num_input; i += 4)
+                        {
+                            __m128 _val0 = _mm_loadu_ps(m);
+                            __m128 _val1 = _mm_loadu_ps(m + 4);
+                            __m128 _val2 = _mm_loadu_ps(m + 8);
+                            __m128 _val3 = _mm_loadu_ps(m + 12);
+                            _sum0 = _mm_add_ps(_mm_mul_ps(_val0, _mm_set1_ps(kptr[0])), _sum0);
+                            _sum1 = _mm_add_ps(_mm_mul_ps(_val1, _mm_set1_ps(kptr[1])), _sum1);
+                            _sum2 = _mm_add_ps(_mm_mul_ps(_val2, _mm_set1_ps(kptr[2])), _sum2);
+                            _sum3 = _mm_add_ps(_mm_mul_ps(_val3, _mm_set1_ps(kptr[3])), _sum3);
+
+                            m += 16;
+                            kptr += 4;
+                        }
+                        for (; i < num_input; i++)
+                        {
+                            __m128 _val = _mm_loadu_ps(m);
+                            __m128 _k = _mm_set1_ps(kptr[0]);
+                            _sum0 = _mm_add_ps(_mm_mul_ps(_val, _k), _sum0);
+
+                            m += 4;
+                            kptr += 1;
+                        }
+
+                        _sum0 = _mm_add_ps(_sum0, _sum1);
+                        _sum2 = _mm_add_ps(_sum2, _sum3);
+                        _sum0 = _mm_add_ps(_sum0, _sum2);
+
+                        _sum0 = activation_sse(_sum0, activation_type, activation_params);
+
+                        _mm_storeu_ps(outptr, _sum0);
+                        outptr += 4;
                     }
-                    for (; i + 3 < num_input; i += 4)
-                    {
-                        __m128 _val0 = _mm_loadu_ps(m);
-                        __m128 _val1 = _mm_loadu_ps(m + 4);
-                        __m128 _val2 = _mm_loadu_ps(m + 8);
-                        __m128 _val3 = _mm_loadu_ps(m + 12);
-                        _sum0 = _mm_add_ps(_mm_mul_ps(_val0, _mm_set1_ps(kptr[0])), _sum0);
-                        _sum1 = _mm_add_ps(_mm_mul_ps(_val1, _mm_set1_ps(kptr[1])), _sum1);
-                        _sum2 = _mm_add_ps(_mm_mul_ps(_val2, _mm_set1_ps(kptr[2])), _sum2);
-                        _sum3 = _mm_add_ps(_mm_mul_ps(_val3, _mm_set1_ps(kptr[3])), _sum3);
-
-                        m += 16;
-                        kptr += 4;
-                    }
-                    for (; i < num_input; i++)
-                    {
-                        __m128 _val = _mm_loadu_ps(m);
-                        __m128 _k = _mm_set1_ps(kptr[0]);
-                        _sum0 = _mm_add_ps(_mm_mul_ps(_val, _k), _sum0);
-
-                        m += 4;
-                        kptr += 1;
-                    }
-
-                    _sum0 = _mm_add_ps(_sum0, _sum1);
-                    _sum2 = _mm_add_ps(_sum2, _sum3);
-                    _sum0 = _mm_add_ps(_sum0, _sum2);
-
-                    _sum0 = activation_sse(_sum0, activation_type, activation_params);
-
-                    _mm_storeu_ps(outptr, _sum0);
-                    outptr += 4;
                 }
-            }
 #endif // __SSE2__
 
-            if (elempack == 1 && num_output_elempack == 1)
-            {
-                float* outptr = top_blob.row(j);
-
-                for (int p = 0; p < num_output; p++)
+                if (elempack == 1 && num_output_elempack == 1)
                 {
-                    const float* kptr = (const float*)weight_data_tm + num_input * p;
-                    const float* m = bottom_blob.row(j);
+                    float* outptr = top_blob.row(j) + out_start * elempack;
 
-                    float sum = 0.f;
-
-                    if (bias_term)
+                    for (int p = out_start; p < out_end; p++)
                     {
-                        sum = bias_data[p];
-                    }
+                        const float* kptr = (const float*)weight_data_tm + num_input * p;
+                        const float* m = bottom_blob.row(j);
 
-                    int i = 0;
+                        float sum = 0.f;
+
+                        if (bias_term)
+                        {
+                            sum = bias_data[p];
+                        }
+
+                        int i = 0;
 #if __SSE2__
 #if __AVX__
-                    __m256 _sum = _mm256_set1_ps(0.f);
-                    for (; i + 7 < num_input; i += 8)
-                    {
-                        __m256 _m = _mm256_loadu_ps(m);
-                        __m256 _w = _mm256_loadu_ps(kptr);
-                        _sum = _mm256_comp_fmadd_ps(_m, _w, _sum);
-
-                        m += 8;
-                        kptr += 8;
-                    }
+                        __m256 _sum = _mm256_set1_ps(0.f);
+                        for (; i + 7 < num_input; i += 8)
+                        {
+                            __m256 _m = _mm256_loadu_ps(m);
+                            __m256 _w = _mm256_loadu_ps(kptr);
+                            _sum = _mm256_comp_fmadd_ps(_m, _w, _sum);
+
+                            m += 8;
+                            kptr += 8;
+                        }
 #endif // __AVX__
-                    __m128 _suml = _mm_set1_ps(0.f);
-                    for (; i + 3 < num_input; i += 4)
-                    {
-                        __m128 _val = _mm_loadu_ps(m);
-                        __m128 _k = _mm_loadu_ps(kptr);
-                        _suml = _mm_add_ps(_mm_mul_ps(_val, _k), _suml);
-
-                        m += 4;
-                        kptr += 4;
-                    }
+                        __m128 _suml = _mm_set1_ps(0.f);
+                        for (; i + 3 < num_input; i += 4)
+                        {
+                            __m128 _val = _mm_loadu_ps(m);
+                            __m128 _k = _mm_loadu_ps(kptr);
+                            _suml = _mm_add_ps(_mm_mul_ps(_val, _k), _suml);
+
+                            m += 4;
+                            kptr += 4;
+                        }
 #endif // __SSE2__
-                    for (; i < num_input; i++)
-                    {
-                        sum += *m++ * *kptr++;
-                    }
+                        for (; i < num_input; i++)
+                        {
+                            sum += *m++ * *kptr++;
+                        }
 
 #if __SSE2__
 #if __AVX__
-                    sum += _mm256_reduce_add_ps(_sum);
+                        sum += _mm256_reduce_add_ps(_sum);
 #endif // __AVX__
-                    sum += _mm_reduce_add_ps(_suml);
+                        sum += _mm_reduce_add_ps(_suml);
 #endif // __SSE2__
 
-                    sum = activation_ss(sum, activation_type, activation_params);
+                        sum = activation_ss(sum, activation_type, activation_params);
 
-                    outptr[0] = sum;
-                    outptr += 1;
+                        outptr[0] = sum;
+                        outptr += 1;
+                    }
                 }
             }
         }
@@ -2016,6 +2063,14 @@ int InnerProduct_x86::create_pipeline_fp16s(const Option& opt)
         weight_data.release();
     }
 
+    update_kernel_info("fp16");
+
+#if NCNN_RUNTIME_CPU && NCNN_F16C && __AVX__ && !__F16C__
+    // fp16 kernels dispatch to the f16c build at runtime
+    if (ncnn::cpu_support_x86_f16c())
+        kernel_info.isa = "f16c";
+#endif
+
     return 0;
 }
 
@@ -2145,6 +2200,8 @@ int InnerProduct_x86::create_pipeline_int8_x86(const Option& opt)
         weight_data.release();
     }
 
+    update_kernel_info("int8");
+
     return 0;
 }
 
@@ -27,9 +27,13 @@ public:
     virtual int create_pipeline(const Option& opt);
     virtual int destroy_pipeline(const Option& opt);
 
+    virtual int get_kernel_info(LayerKernelInfo& info) const;
+
     virtual int forward(const Mat& bottom_blob, Mat& top_blob, const Option& opt) const;
 
 protected:
+    void update_kernel_info(const char* precision);
+
 #if NCNN_F16C
     int create_pipeline_fp16s(const Option& opt);
     int forward_fp16s(const Mat& bottom_blob, Mat& top_blob, const Option& opt) const;
@@ -47,6 +51,8 @@ public:
 #if NCNN_INT8
     Mat scale_in_data;
 #endif
+
+    LayerKernelInfo kernel_info;
 };
 
 } // namespace ncnn
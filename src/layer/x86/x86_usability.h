@@ -30,6 +30,30 @@
 #endif
 #endif // __SSE2__
 
+// instruction set of the runtime dispatched layer variant built from this source
+static inline const char* x86_kernel_isa()
+{
+#if __AVX512VNNI__
+    return "avx512vnni";
+#elif __AVX512F__
+    return "avx512";
+#elif __AVXVNNI__
+    return "avxvnni";
+#elif __AVX2__
+    return "avx2";
+#elif __XOP__
+    return "xop";
+#elif __FMA__
+    return "fma";
+#elif __AVX__
+    return "avx";
+#elif __SSE2__
+    return "sse2";
+#else
+    return "generic";
+#endif
+}
+
 static NCNN_FORCEINLINE signed char float2int8(float v)
 {
     int int32 = (int)round(v);
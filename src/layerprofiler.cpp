@@ -0,0 +1,104 @@
+// Tencent is pleased to support the open source community by making ncnn available.
+//
+// Copyright (C) 2024 THL A29 Limited, a Tencent company. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this file except
+// in compliance with the License. You may obtain a copy of the License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software distributed
+// under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+// CONDITIONS OF ANY KIND, either express or implied. See the License for the
+// specific language governing permissions and limitations under the License.
+
+#include "layerprofiler.h"
+
+#include "benchmark.h"
+
+namespace ncnn {
+
+Mat blob_storage_shape(const Mat& m)
+{
+    if (m.dims == 1)
+        return Mat(m.w, (void*)0, m.elemsize, m.elempack);
+    if (m.dims == 2)
+        return Mat(m.w, m.h, (void*)0, m.elemsize, m.elempack);
+    if (m.dims == 3)
+        return Mat(m.w, m.h, m.c, (void*)0, m.elemsize, m.elempack);
+    if (m.dims == 4)
+        return Mat(m.w, m.h, m.d, m.c, (void*)0, m.elemsize, m.elempack);
+
+    return Mat();
+}
+
+void LayerProfiler::begin(const Layer* layer, int layer_index, const std::vector<Mat>& blob_mats, const Option& opt, LayerProfile& record) const
+{
+    record.layer_index = layer_index;
+    record.typeindex = layer->typeindex;
+#if NCNN_STRING
+    record.type = layer->type.c_str();
+    record.name = layer->name.c_str();
+#endif // NCNN_STRING
+    record.num_threads = opt.num_threads;
+    record.allocated_bytes = 0;
+
+    record.bottom_shapes.resize(layer->bottoms.size());
+    for (size_t i = 0; i < layer->bottoms.size(); i++)
+    {
+        const Mat& m = blob_mats[layer->bottoms[i]];
+        record.bottom_shapes[i] = blob_storage_shape(m);
+
+        // remember where the bottom lives for telling inplace tops apart
+        record.bottom_shapes[i].data = m.data;
+    }
+
+    record.start = get_current_time();
+}
+
+void LayerProfiler::end(const Layer* layer, const std::vector<Mat>& blob_mats, LayerProfile& record)
+{
+    record.end = get_current_time();
+
+    record.top_shapes.resize(layer->tops.size());
+    for (size_t i = 0; i < layer->tops.size(); i++)
+    {
+        const Mat& m = blob_mats[layer->tops[i]];
+        record.top_shapes[i] = blob_storage_shape(m);
+
+        bool inplace = false;
+        for (size_t j = 0; j < record.bottom_shapes.size(); j++)
+        {
+            if (m.data && m.data == record.bottom_shapes[j].data)
+                inplace = true;
+        }
+
+        if (!inplace)
+            record.allocated_bytes += m.total() * m.elemsize;
+    }
+
+    for (size_t i = 0; i < record.bottom_shapes.size(); i++)
+    {
+        record.bottom_shapes[i].data = 0;
+    }
+
+    set_workload(layer, record);
+
+    add(record);
+}
+
+void LayerProfiler::set_workload(const Layer* layer, LayerProfile& record)
+{
+    const LayerWorkload workload = estimate_layer_workload(layer, record.bottom_shapes, record.top_shapes);
+    record.macs = workload.macs;
+    record.bytes_read = workload.bytes_read;
+    record.bytes_written = workload.bytes_written;
+}
+
+void LayerProfiler::add(const LayerProfile& record)
+{
+    MutexLockGuard guard(lock);
+    records.push_back(record);
+}
+
+} // namespace ncnn
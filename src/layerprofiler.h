@@ -0,0 +1,50 @@
+// Tencent is pleased to support the open source community by making ncnn available.
+//
+// Copyright (C) 2024 THL A29 Limited, a Tencent company. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this file except
+// in compliance with the License. You may obtain a copy of the License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software distributed
+// under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+// CONDITIONS OF ANY KIND, either express or implied. See the License for the
+// specific language governing permissions and limitations under the License.
+
+#ifndef NCNN_LAYERPROFILER_H
+#define NCNN_LAYERPROFILER_H
+
+#include "layer.h"
+#include "mat.h"
+#include "net.h"
+#include "option.h"
+#include "platform.h"
+
+namespace ncnn {
+
+// shape and layout of m without data
+Mat blob_storage_shape(const Mat& m);
+
+// collects LayerProfile records for Extractor profiling
+// layers of independent branches may finish concurrently
+class LayerProfiler
+{
+public:
+    // capture bottom shapes before the layer runs, inplace layers overwrite them
+    void begin(const Layer* layer, int layer_index, const std::vector<Mat>& blob_mats, const Option& opt, LayerProfile& record) const;
+
+    // capture top shapes and append the record
+    void end(const Layer* layer, const std::vector<Mat>& blob_mats, LayerProfile& record);
+
+    static void set_workload(const Layer* layer, LayerProfile& record);
+
+    void add(const LayerProfile& record);
+
+    Mutex lock;
+    std::vector<LayerProfile> records;
+};
+
+} // namespace ncnn
+
+#endif // NCNN_LAYERPROFILER_H
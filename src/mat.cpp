@@ -33,6 +33,15 @@
 
 namespace ncnn {
 
+// large weights created while loading may go to huge pages, see set_thread_hugepage_allocation
+static void* default_fastMalloc(size_t size)
+{
+    if (size >= NCNN_HUGEPAGE_SIZE && get_thread_hugepage_allocation())
+        return fastMalloc_hugepage(size);
+
+    return fastMalloc(size);
+}
+
 Mat Mat::clone(Allocator* _allocator) const
 {
     if (empty())
@@ -250,7 +259,7 @@ void Mat::create(int _w, size_t _elemsize, Allocator* _allocator)
         if (allocator)
             data = allocator->fastMalloc(totalsize + (int)sizeof(*refcount));
         else
-            data = fastMalloc(totalsize + (int)sizeof(*refcount));
+            data = default_fastMalloc(totalsize + (int)sizeof(*refcount));
     }
 
     if (data)
@@ -285,7 +294,7 @@ void Mat::create(int _w, int _h, size_t _elemsize, Allocator* _allocator)
         if (allocator)
             data = allocator->fastMalloc(totalsize + (int)sizeof(*refcount));
         else
-            data = fastMalloc(totalsize + (int)sizeof(*refcount));
+            data = default_fastMalloc(totalsize + (int)sizeof(*refcount));
     }
 
     if (data)
@@ -320,7 +329,7 @@ void Mat::create(int _w, int _h, int _c, size_t _elemsize, Allocator* _allocator
         if (allocator)
             data = allocator->fastMalloc(totalsize + (int)sizeof(*refcount));
         else
-            data = fastMalloc(totalsize + (int)sizeof(*refcount));
+            data = default_fastMalloc(totalsize + (int)sizeof(*refcount));
     }
 
     if (data)
@@ -355,7 +364,7 @@ void Mat::create(int _w, int _h, int _d, int _c, size_t _elemsize, Allocator* _a
         if (allocator)
             data = allocator->fastMalloc(totalsize + (int)sizeof(*refcount));
         else
-            data = fastMalloc(totalsize + (int)sizeof(*refcount));
+            data = default_fastMalloc(totalsize + (int)sizeof(*refcount));
     }
 
     if (data)
@@ -390,7 +399,7 @@ void Mat::create(int _w, size_t _elemsize, int _elempack, Allocator* _allocator)
         if (allocator)
             data = allocator->fastMalloc(totalsize + (int)sizeof(*refcount));
         else
-            data = fastMalloc(totalsize + (int)sizeof(*refcount));
+            data = default_fastMalloc(totalsize + (int)sizeof(*refcount));
     }
 
     if (data)
@@ -425,7 +434,7 @@ void Mat::create(int _w, int _h, size_t _elemsize, int _elempack, Allocator* _al
         if (allocator)
             data = allocator->fastMalloc(totalsize + (int)sizeof(*refcount));
         else
-            data = fastMalloc(totalsize + (int)sizeof(*refcount));
+            data = default_fastMalloc(totalsize + (int)sizeof(*refcount));
     }
 
     if (data)
@@ -460,7 +469,7 @@ void Mat::create(int _w, int _h, int _c, size_t _elemsize, int _elempack, Alloca
         if (allocator)
             data = allocator->fastMalloc(totalsize + (int)sizeof(*refcount));
         else
-            data = fastMalloc(totalsize + (int)sizeof(*refcount));
+            data = default_fastMalloc(totalsize + (int)sizeof(*refcount));
     }
 
     if (data)
@@ -495,7 +504,7 @@ void Mat::create(int _w, int _h, int _d, int _c, size_t _elemsize, int _elempack
         if (allocator)
             data = allocator->fastMalloc(totalsize + (int)sizeof(*refcount));
         else
-            data = fastMalloc(totalsize + (int)sizeof(*refcount));
+            data = default_fastMalloc(totalsize + (int)sizeof(*refcount));
     }
 
     if (data)
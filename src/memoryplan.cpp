@@ -0,0 +1,357 @@
+// Tencent is pleased to support the open source community by making ncnn available.
+//
+// Copyright (C) 2024 THL A29 Limited, a Tencent company. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this file except
+// in compliance with the License. You may obtain a copy of the License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software distributed
+// under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+// CONDITIONS OF ANY KIND, either express or implied. See the License for the
+// specific language governing permissions and limitations under the License.
+
+#include "memoryplan.h"
+
+#include <limits.h>
+
+namespace ncnn {
+
+static ThreadLocalStorage tls_memory_plan_layer;
+
+int get_memory_plan_layer()
+{
+    return (int)reinterpret_cast<size_t>(tls_memory_plan_layer.get()) - 1;
+}
+
+void set_memory_plan_layer(int layer_index)
+{
+    tls_memory_plan_layer.set(reinterpret_cast<void*>((size_t)(layer_index + 1)));
+}
+
+MemoryPlan::~MemoryPlan()
+{
+    for (size_t i = 0; i < arenas.size(); i++)
+    {
+        ncnn::fastFree(arenas[i]);
+    }
+}
+
+unsigned char* MemoryPlan::acquire_arena()
+{
+    {
+        MutexLockGuard guard(arenas_lock);
+        if (!arenas.empty())
+        {
+            unsigned char* arena = arenas.back();
+            arenas.pop_back();
+            return arena;
+        }
+    }
+
+    return (unsigned char*)ncnn::fastMalloc(arena_size);
+}
+
+void MemoryPlan::release_arena(unsigned char* arena)
+{
+    MutexLockGuard guard(arenas_lock);
+    arenas.push_back(arena);
+}
+
+SharedMemoryPlan::SharedMemoryPlan()
+{
+    plan = 0;
+    misses = 0;
+}
+
+SharedMemoryPlan::~SharedMemoryPlan()
+{
+    clear();
+}
+
+MemoryPlan* SharedMemoryPlan::acquire()
+{
+    MutexLockGuard guard(lock);
+    if (plan)
+        plan->addref();
+    return plan;
+}
+
+void SharedMemoryPlan::publish(MemoryPlan* new_plan)
+{
+    MutexLockGuard guard(lock);
+    if (!plan)
+    {
+        plan = new_plan;
+    }
+    else
+    {
+        // another extractor published first
+        new_plan->release();
+    }
+}
+
+void SharedMemoryPlan::invalidate(const MemoryPlan* stale_plan)
+{
+    MutexLockGuard guard(lock);
+    if (plan == stale_plan)
+    {
+        plan->release();
+        plan = 0;
+    }
+}
+
+void SharedMemoryPlan::clear()
+{
+    MutexLockGuard guard(lock);
+    if (plan)
+    {
+        plan->release();
+        plan = 0;
+    }
+    misses = 0;
+}
+
+size_t SharedMemoryPlan::arena_size() const
+{
+    MutexLockGuard guard(lock);
+    return plan ? plan->arena_size : 0;
+}
+
+void SharedMemoryPlan::add_misses(size_t count)
+{
+    MutexLockGuard guard(lock);
+    misses += count;
+}
+
+size_t SharedMemoryPlan::miss_count() const
+{
+    MutexLockGuard guard(lock);
+    return misses;
+}
+
+MemoryPlanAllocator::MemoryPlanAllocator(SharedMemoryPlan* _shared_plan)
+    : shared_plan(_shared_plan)
+{
+    arena = 0;
+    replay_failed = false;
+    misses = 0;
+    tick = 0;
+
+    plan = shared_plan->acquire();
+}
+
+MemoryPlanAllocator::~MemoryPlanAllocator()
+{
+    if (!live.empty())
+    {
+        NCNN_LOGE("MemoryPlanAllocator %d still in use", (int)live.size());
+    }
+
+    if (plan)
+    {
+        if (replay_failed)
+        {
+            // drop the stale plan so that the next extractor records again
+            shared_plan->invalidate(plan);
+        }
+
+        if (misses)
+        {
+            shared_plan->add_misses(misses);
+        }
+
+        // a stale plan frees its arenas once the last extractor lets it go
+        if (arena)
+        {
+            plan->release_arena(arena);
+        }
+
+        plan->release();
+    }
+    else
+    {
+        publish_plan();
+    }
+}
+
+void* MemoryPlanAllocator::fastMalloc(size_t size)
+{
+    MutexLockGuard guard(lock);
+
+    // the allocations of one layer come from its own thread in a fixed order
+    const int layer_index = get_memory_plan_layer();
+    if ((int)layer_alloc_counts.size() < layer_index + 2)
+    {
+        layer_alloc_counts.resize(layer_index + 2, 0);
+    }
+    const std::pair<int, int> key(layer_index, layer_alloc_counts[layer_index + 1]++);
+
+    if (!plan)
+    {
+        // record
+        void* ptr = ncnn::fastMalloc(size);
+
+        event_keys.push_back(key);
+        event_sizes.push_back(size);
+        event_starts.push_back(tick++);
+        event_ends.push_back(INT_MAX);
+
+        live.push_back(std::make_pair(ptr, (int)event_sizes.size() - 1));
+        return ptr;
+    }
+
+    int i = -1;
+    if (!replay_failed)
+    {
+        std::map<std::pair<int, int>, int>::const_iterator it = plan->slots.find(key);
+        if (it == plan->slots.end() || plan->sizes[it->second] != size)
+        {
+            // the graph or the input shape changed
+            replay_failed = true;
+        }
+        else
+        {
+            i = it->second;
+        }
+    }
+
+    if (replay_failed)
+    {
+        void* ptr = ncnn::fastMalloc(size);
+        live.push_back(std::make_pair(ptr, -1));
+        misses++;
+        return ptr;
+    }
+
+    // never hand out memory overlapping a live blob
+    // this happens when branches run in another order than recorded,
+    // serve the blob from the heap and keep the plan for the others
+    const size_t offset = plan->offsets[i];
+    const size_t end = offset + alignSize(size, NCNN_MALLOC_ALIGN);
+    for (size_t j = 0; j < live.size(); j++)
+    {
+        const int k = live[j].second;
+        if (k == -1)
+            continue;
+
+        const size_t offset_k = plan->offsets[k];
+        const size_t end_k = offset_k + alignSize(plan->sizes[k], NCNN_MALLOC_ALIGN);
+        if (offset < end_k && offset_k < end)
+        {
+            void* ptr = ncnn::fastMalloc(size);
+            live.push_back(std::make_pair(ptr, -1));
+            misses++;
+            return ptr;
+        }
+    }
+
+    if (!arena)
+    {
+        arena = plan->acquire_arena();
+    }
+
+    void* ptr = arena + offset;
+    live.push_back(std::make_pair(ptr, i));
+    return ptr;
+}
+
+void MemoryPlanAllocator::fastFree(void* ptr)
+{
+    MutexLockGuard guard(lock);
+
+    for (int j = (int)live.size() - 1; j >= 0; j--)
+    {
+        if (live[j].first != ptr)
+            continue;
+
+        const int k = live[j].second;
+
+        live.erase(live.begin() + j);
+
+        if (!plan)
+        {
+            event_ends[k] = tick++;
+            ncnn::fastFree(ptr);
+        }
+        else if (k == -1)
+        {
+            ncnn::fastFree(ptr);
+        }
+
+        return;
+    }
+
+    NCNN_LOGE("MemoryPlanAllocator FATAL ERROR! unlocked memory %p", ptr);
+}
+
+void MemoryPlanAllocator::publish_plan()
+{
+    const int count = (int)event_sizes.size();
+    if (count == 0)
+        return;
+
+    MemoryPlan* new_plan = new MemoryPlan;
+    new_plan->sizes = event_sizes;
+    new_plan->offsets.resize(count);
+    for (int i = 0; i < count; i++)
+    {
+        new_plan->slots[event_keys[i]] = i;
+    }
+
+    // greedy placement, largest blob first
+    std::vector<int> order(count);
+    for (int i = 0; i < count; i++)
+    {
+        int j = i;
+        for (; j > 0 && event_sizes[order[j - 1]] < event_sizes[i]; j--)
+        {
+            order[j] = order[j - 1];
+        }
+        order[j] = i;
+    }
+
+    // placed events kept sorted by offset
+    std::vector<int> placed;
+    placed.reserve(count);
+
+    size_t arena_size = 0;
+    for (int i = 0; i < count; i++)
+    {
+        const int e = order[i];
+        const size_t size = alignSize(event_sizes[e], NCNN_MALLOC_ALIGN);
+
+        // lowest gap that fits among the placed events alive at the same time
+        size_t offset = 0;
+        for (size_t j = 0; j < placed.size(); j++)
+        {
+            const int p = placed[j];
+            if (event_ends[p] <= event_starts[e] || event_ends[e] <= event_starts[p])
+                continue;
+
+            const size_t offset_p = new_plan->offsets[p];
+            if (offset_p >= offset + size)
+                break;
+
+            offset = std::max(offset, offset_p + alignSize(event_sizes[p], NCNN_MALLOC_ALIGN));
+        }
+
+        new_plan->offsets[e] = offset;
+        arena_size = std::max(arena_size, offset + size);
+
+        size_t j = placed.size();
+        placed.push_back(e);
+        for (; j > 0 && new_plan->offsets[placed[j - 1]] > offset; j--)
+        {
+            placed[j] = placed[j - 1];
+        }
+        placed[j] = e;
+    }
+
+    new_plan->arena_size = arena_size;
+
+    shared_plan->publish(new_plan);
+}
+
+} // namespace ncnn
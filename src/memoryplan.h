@@ -0,0 +1,148 @@
+// Tencent is pleased to support the open source community by making ncnn available.
+//
+// Copyright (C) 2024 THL A29 Limited, a Tencent company. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this file except
+// in compliance with the License. You may obtain a copy of the License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software distributed
+// under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+// CONDITIONS OF ANY KIND, either express or implied. See the License for the
+// specific language governing permissions and limitations under the License.
+
+#ifndef NCNN_MEMORYPLAN_H
+#define NCNN_MEMORYPLAN_H
+
+#include "allocator.h"
+#include "platform.h"
+
+#include <map>
+
+namespace ncnn {
+
+// layer whose forward runs on the calling thread, -1 outside of layers
+// blob allocations are keyed by it so that concurrent branches replay the same slots
+int get_memory_plan_layer();
+void set_memory_plan_layer(int layer_index);
+
+// static blob memory plan recorded from one extractor run
+// the i-th recorded blob allocation lives at offsets[i] inside the arena
+// slots maps layer index and allocation ordinal within the layer to i
+// arenas given back by finished extractors are kept for the next ones
+class MemoryPlan
+{
+public:
+    MemoryPlan()
+        : arena_size(0), refcount(1)
+    {
+    }
+
+    // a kept arena if any, otherwise a new one
+    unsigned char* acquire_arena();
+
+    // keep arena for the next extractor
+    void release_arena(unsigned char* arena);
+
+    void addref()
+    {
+        NCNN_XADD(&refcount, 1);
+    }
+
+    void release()
+    {
+        if (NCNN_XADD(&refcount, -1) == 1)
+            delete this;
+    }
+
+    std::vector<size_t> sizes;
+    std::vector<size_t> offsets;
+    std::map<std::pair<int, int>, int> slots;
+    size_t arena_size;
+
+private:
+    ~MemoryPlan();
+
+    int refcount;
+
+    Mutex arenas_lock;
+    std::vector<unsigned char*> arenas;
+};
+
+// the plan shared by all extractors of a net, replaced when replay mismatches
+class SharedMemoryPlan
+{
+public:
+    SharedMemoryPlan();
+    ~SharedMemoryPlan();
+
+    // current plan with a reference taken, null if none
+    MemoryPlan* acquire();
+
+    // install new_plan unless another extractor published first
+    void publish(MemoryPlan* new_plan);
+
+    // drop stale_plan if it is still the current one
+    void invalidate(const MemoryPlan* stale_plan);
+
+    void clear();
+
+    // arena size of the current plan, 0 if none
+    size_t arena_size() const;
+
+    // count blobs served from the heap while a plan was available
+    void add_misses(size_t count);
+
+    // blobs served from the heap since the last clear
+    size_t miss_count() const;
+
+private:
+    mutable Mutex lock;
+    MemoryPlan* plan;
+    size_t misses;
+};
+
+// blob allocator backed by the static memory plan of the net
+// records allocation sizes and lifetimes when there is no plan yet,
+// otherwise hands out the planned offsets inside one arena taken from the plan
+class MemoryPlanAllocator : public Allocator
+{
+public:
+    MemoryPlanAllocator(SharedMemoryPlan* _shared_plan);
+    virtual ~MemoryPlanAllocator();
+
+    virtual void* fastMalloc(size_t size);
+    virtual void fastFree(void* ptr);
+
+protected:
+    void publish_plan();
+
+private:
+    SharedMemoryPlan* shared_plan;
+    MemoryPlan* plan;
+
+    Mutex lock;
+
+    // replay state
+    unsigned char* arena;
+    bool replay_failed;
+    size_t misses;
+
+    // allocation count of each layer, -1 at front, and event clock
+    std::vector<int> layer_alloc_counts;
+    int tick;
+
+    // recorded allocation events
+    std::vector<std::pair<int, int> > event_keys;
+    std::vector<size_t> event_sizes;
+    std::vector<int> event_starts;
+    std::vector<int> event_ends;
+
+    // live allocations as pointer and event index
+    std::vector<std::pair<void*, int> > live;
+};
+
+} // namespace ncnn
+
+#endif // NCNN_MEMORYPLAN_H
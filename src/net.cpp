@@ -16,17 +16,24 @@
 
 #include "cpu.h"
 #include "datareader.h"
+#include "kerneltuning.h"
 #include "layer_type.h"
+#include "layerprofiler.h"
+#include "memoryplan.h"
 #include "modelbin.h"
+#include "numareplica.h"
 #include "paramdict.h"
+#include "pipelineweightcache.h"
+#include "threadplanner.h"
 
 #include <stdarg.h>
 #include <stdint.h>
+#include <stdlib.h>
 #include <string.h>
 
-#if NCNN_BENCHMARK
 #include "benchmark.h"
-#endif // NCNN_BENCHMARK
+
+#include "layer/convolution.h"
 
 #if NCNN_VULKAN
 #include "command.h"
@@ -35,6 +42,43 @@
 
 namespace ncnn {
 
+static void trace_layer(const Layer* layer, double start)
+{
+#if NCNN_STRING
+    trace_event("layer", layer->type.c_str(), layer->name.c_str(), start, get_current_time());
+#else
+    trace_event("layer", "layer", 0, start, get_current_time());
+#endif
+}
+
+struct branch_parallel_context;
+
+// threads kept by the net for running independent branches, started on first use
+class BranchWorkerPool
+{
+public:
+    BranchWorkerPool();
+    ~BranchWorkerPool();
+
+    // let count pool threads join ctx, starting more threads if there are too few
+    void post(branch_parallel_context* ctx, int count);
+
+    // withdraw the posts of ctx not taken yet and wait for the threads working on it
+    void wait(branch_parallel_context* ctx);
+
+private:
+    static void* worker(void* args);
+
+    Mutex lock;
+    ConditionVariable condition;
+    std::vector<branch_parallel_context*> jobs;
+    std::vector<Thread*> threads;
+    bool stop;
+
+    // binding id of the thread starting new threads, which inherit its affinity
+    int spawn_affinity_id;
+};
+
 class NetPrivate
 {
 public:
@@ -49,14 +93,42 @@ public:
 #endif // NCNN_VULKAN
 
     friend class Extractor;
-    int forward_layer(int layer_index, std::vector<Mat>& blob_mats, const Option& opt) const;
+    // profiler collects a record for the layer when not null
+    // numa_node picks the layer replica, -1 for the loaded layers
+    int forward_layer(int layer_index, std::vector<Mat>& blob_mats, const Option& opt, LayerProfiler* profiler = 0, int numa_node = -1) const;
 
 #if NCNN_VULKAN
     int forward_layer(int layer_index, std::vector<Mat>& blob_mats, std::vector<VkMat>& blob_mats_gpu, VkCompute& cmd, const Option& opt) const;
     int forward_layer(int layer_index, std::vector<Mat>& blob_mats, std::vector<VkMat>& blob_mats_gpu, std::vector<VkImageMat>& blob_mats_gpu_image, VkCompute& cmd, const Option& opt) const;
 #endif // NCNN_VULKAN
 
+    // forward layer_queue in reverse order, running independent branches concurrently
+    // the pool threads joining in take the binding identified by thread_affinity_id
+    int forward_layers_parallel(const std::vector<int>& layer_queue, std::vector<Mat>& blob_mats, const Option& opt, LayerProfiler* profiler, int numa_node, const CpuSet& thread_affinity_mask, int thread_affinity_id) const;
+
+    // forward one layer for every sample of a batch, innerproduct runs the whole batch in one call
+    int forward_layer_batch(int layer_index, std::vector<std::vector<Mat> >& batch_blob_mats, const Option& opt, LayerProfiler* profiler = 0, int numa_node = -1) const;
+
+    // the replica of layer_index on numa_node, or the loaded layer
+    const Layer* numa_layer(int layer_index, int numa_node) const;
+
+    // the pools for extractors bound to numa_node, or the shared ones
+    PoolAllocator* get_local_blob_allocator(int numa_node) const;
+    PoolAllocator* get_local_workspace_allocator(int numa_node) const;
+
+    // load and transform replicas of all layers on the numa nodes other than home_node
+    int create_numa_replicas(int home_node, const std::vector<std::vector<Mat> >& layer_weights);
+
+    void destroy_layer(Layer* layer);
+
     int convert_layout(Mat& bottom_blob, const Layer* layer, const Option& opt) const;
+    int do_convert_layout(Mat& bottom_blob, const Layer* layer, const Option& opt) const;
+
+    // forward_layer with profiling, a tuned kernel or a planned thread count
+    int forward_layer_tuned(const Layer* layer, int layer_index, std::vector<Mat>& blob_mats, const Option& opt, int kernel_choice, LayerProfiler* profiler) const;
+
+    // do_forward_layer within the trace and NCNN_BENCHMARK timing
+    int forward_layer_timed(const Layer* layer, std::vector<Mat>& blob_mats, const Option& opt) const;
 
     int do_forward_layer(const Layer* layer, std::vector<Mat>& blob_mats, const Option& opt) const;
 #if NCNN_VULKAN
@@ -69,9 +141,16 @@ public:
     void update_input_output_names();
 #endif // NCNN_STRING
 
+    // layers required for producing blob_index in depth-first execution order
+    void build_execution_plan(int blob_index, std::vector<int>& plan) const;
+    void build_execution_plans();
+
     std::vector<Blob> blobs;
     std::vector<Layer*> layers;
 
+    // precomputed execution plan per output blob, empty for the others
+    std::vector<std::vector<int> > execution_plans;
+
     std::vector<int> input_blob_indexes;
     std::vector<int> output_blob_indexes;
 #if NCNN_STRING
@@ -84,6 +163,40 @@ public:
     PoolAllocator* local_blob_allocator;
     PoolAllocator* local_workspace_allocator;
 
+    // params kept for building numa replicas, empty unless opt.use_numa_replica
+    std::vector<ParamDict> layer_params;
+
+    // layers replicated per numa node, empty for the node holding layers
+    std::vector<std::vector<Layer*> > numa_layers;
+    std::vector<PoolAllocator*> numa_blob_allocators;
+    std::vector<PoolAllocator*> numa_workspace_allocators;
+
+    // shared by all extractors, replaced when replay mismatches
+    SharedMemoryPlan memory_plan;
+
+#if NCNN_STDIO
+    // persistent cache of weights transformed in create_pipeline
+    std::string pipeline_weight_cache_path;
+    PipelineWeightCache* pipeline_weight_cache;
+
+    // params of each layer, part of its weight cache entry
+    std::vector<uint64_t> layer_param_hashes;
+
+    // mapped model file referenced by layer weights
+    DataReaderFromMmap* model_mmap;
+
+    std::string autotune_cache_path;
+#endif // NCNN_STDIO
+
+    // kernel picked by autotune per layer, 0 keeps the layer heuristics
+    std::vector<int> layer_kernel_choices;
+
+    // null unless opt.use_adaptive_threads
+    LayerThreadPlanner* thread_planner;
+
+    // threads running independent branches, shared by all extractors
+    mutable BranchWorkerPool branch_workers;
+
 #if NCNN_VULKAN
     const VulkanDevice* vkdev;
 
@@ -100,6 +213,13 @@ NetPrivate::NetPrivate(Option& _opt)
     local_blob_allocator = 0;
     local_workspace_allocator = 0;
 
+    thread_planner = 0;
+
+#if NCNN_STDIO
+    pipeline_weight_cache = 0;
+    model_mmap = 0;
+#endif // NCNN_STDIO
+
 #if NCNN_VULKAN
     vkdev = 0;
     weight_vkallocator = 0;
@@ -147,40 +267,82 @@ int NetPrivate::upload_model()
 }
 #endif // NCNN_VULKAN
 
-int NetPrivate::forward_layer(int layer_index, std::vector<Mat>& blob_mats, const Option& opt) const
+int NetPrivate::forward_layer(int layer_index, std::vector<Mat>& blob_mats, const Option& opt, LayerProfiler* profiler, int numa_node) const
 {
-    const Layer* layer = layers[layer_index];
+    const Layer* layer = numa_layer(layer_index, numa_node);
 
     //     NCNN_LOGE("forward_layer %d %s", layer_index, layer->name.c_str());
 
-    if (layer->one_blob_only)
-    {
-        // load bottom blob
-        int bottom_blob_index = layer->bottoms[0];
+    // bottom blobs are ready here, the execution plan runs producers first
 
-        if (blob_mats[bottom_blob_index].dims == 0)
-        {
-            int ret = forward_layer(blobs[bottom_blob_index].producer, blob_mats, opt);
-            if (ret != 0)
-                return ret;
-        }
+    // without profiling, autotune and adaptive threads the layer runs with opt as is
+    // blob allocations made by this layer are keyed to it in the memory plan
+    const int memory_plan_layer = get_memory_plan_layer();
+    set_memory_plan_layer(layer_index);
+
+    int ret = 0;
+    const int kernel_choice = layer_index < (int)layer_kernel_choices.size() ? layer_kernel_choices[layer_index] : 0;
+    if (profiler || kernel_choice || (thread_planner && opt.num_threads > 1))
+    {
+        ret = forward_layer_tuned(layer, layer_index, blob_mats, opt, kernel_choice, profiler);
     }
     else
     {
-        // load bottom blobs
-        for (size_t i = 0; i < layer->bottoms.size(); i++)
-        {
-            int bottom_blob_index = layer->bottoms[i];
+        ret = forward_layer_timed(layer, blob_mats, opt);
+    }
 
-            if (blob_mats[bottom_blob_index].dims == 0)
-            {
-                int ret = forward_layer(blobs[bottom_blob_index].producer, blob_mats, opt);
-                if (ret != 0)
-                    return ret;
-            }
-        }
+    set_memory_plan_layer(memory_plan_layer);
+
+    if (ret != 0)
+        return ret;
+
+    //     NCNN_LOGE("forward_layer %d %s done", layer_index, layer->name.c_str());
+    //     const Mat& blob = blob_mats[layer->tops[0]];
+    //     NCNN_LOGE("[%-2d %-16s %-16s]  %d    blobs count = %-3d   size = %-3d x %-3d", layer_index, layer->type.c_str(), layer->name.c_str(), layer->tops[0], blob.c, blob.h, blob.w);
+
+    return 0;
+}
+
+int NetPrivate::forward_layer_tuned(const Layer* layer, int layer_index, std::vector<Mat>& blob_mats, const Option& _opt, int kernel_choice, LayerProfiler* profiler) const
+{
+    // small layers run on fewer threads than their fork and join would cost
+    int num_threads = _opt.num_threads;
+    std::vector<Mat> thread_bottom_shapes;
+    bool plan_threads = false;
+    if (thread_planner && _opt.num_threads > 1)
+    {
+        num_threads = thread_planner->get(layer, layer_index, blob_mats, _opt.num_threads, thread_bottom_shapes);
+        plan_threads = num_threads == 0;
+        if (plan_threads)
+            num_threads = _opt.num_threads;
+    }
+
+    // forward must see the same kernel options as create_pipeline
+    Option opt = _opt;
+    opt.num_threads = num_threads;
+    if (kernel_choice)
+        apply_kernel_choice(opt, kernel_choice);
+
+    LayerProfile record;
+    if (profiler)
+    {
+        profiler->begin(layer, layer_index, blob_mats, opt, record);
+    }
+    int ret = forward_layer_timed(layer, blob_mats, opt);
+    if (profiler && ret == 0)
+    {
+        profiler->end(layer, blob_mats, record);
+    }
+    if (plan_threads && ret == 0)
+    {
+        thread_planner->set(layer, layer_index, thread_bottom_shapes, blob_mats, _opt.num_threads);
     }
 
+    return ret;
+}
+
+int NetPrivate::forward_layer_timed(const Layer* layer, std::vector<Mat>& blob_mats, const Option& opt) const
+{
 #if NCNN_BENCHMARK
     double start = get_current_time();
     Mat bottom_blob;
@@ -195,7 +357,12 @@ int NetPrivate::forward_layer(int layer_index, std::vector<Mat>& blob_mats, cons
         bottom_blob.elemsize = blob_mats[bottom_blob_index].elemsize;
     }
 #endif
+    const double trace_start = trace_enabled() ? get_current_time() : 0;
     int ret = do_forward_layer(layer, blob_mats, opt);
+    if (trace_start != 0)
+    {
+        trace_layer(layer, trace_start);
+    }
 #if NCNN_BENCHMARK
     double end = get_current_time();
     if (layer->one_blob_only)
@@ -208,14 +375,8 @@ int NetPrivate::forward_layer(int layer_index, std::vector<Mat>& blob_mats, cons
         benchmark(layer, start, end);
     }
 #endif
-    if (ret != 0)
-        return ret;
-
-    //     NCNN_LOGE("forward_layer %d %s done", layer_index, layer->name.c_str());
-    //     const Mat& blob = blob_mats[layer->tops[0]];
-    //     NCNN_LOGE("[%-2d %-16s %-16s]  %d    blobs count = %-3d   size = %-3d x %-3d", layer_index, layer->type.c_str(), layer->name.c_str(), layer->tops[0], blob.c, blob.h, blob.w);
 
-    return 0;
+    return ret;
 }
 
 #if NCNN_VULKAN
@@ -232,13 +393,6 @@ int NetPrivate::forward_layer(int layer_index, std::vector<Mat>& blob_mats, std:
         // load bottom blob
         int bottom_blob_index = layer->bottoms[0];
 
-        if (blob_mats_gpu[bottom_blob_index].dims == 0 && blob_mats[bottom_blob_index].dims == 0)
-        {
-            int ret = forward_layer(blobs[bottom_blob_index].producer, blob_mats, blob_mats_gpu, cmd, opt);
-            if (ret != 0)
-                return ret;
-        }
-
         if (layer->support_vulkan)
         {
             if (blob_mats_gpu[bottom_blob_index].dims == 0)
@@ -281,13 +435,6 @@ int NetPrivate::forward_layer(int layer_index, std::vector<Mat>& blob_mats, std:
         {
             int bottom_blob_index = layer->bottoms[i];
 
-            if (blob_mats_gpu[bottom_blob_index].dims == 0 && blob_mats[bottom_blob_index].dims == 0)
-            {
-                int ret = forward_layer(blobs[bottom_blob_index].producer, blob_mats, blob_mats_gpu, cmd, opt);
-                if (ret != 0)
-                    return ret;
-            }
-
             if (layer->support_vulkan)
             {
                 if (blob_mats_gpu[bottom_blob_index].dims == 0)
@@ -415,13 +562,6 @@ IMAGE_ALLOCATION_FAILED:
         // load bottom blob
         int bottom_blob_index = layer->bottoms[0];
 
-        if (blob_mats_gpu_image[bottom_blob_index].dims == 0 && blob_mats_gpu[bottom_blob_index].dims == 0 && blob_mats[bottom_blob_index].dims == 0)
-        {
-            int ret = forward_layer(blobs[bottom_blob_index].producer, blob_mats, blob_mats_gpu, blob_mats_gpu_image, cmd, opt);
-            if (ret != 0)
-                return ret;
-        }
-
         if (layer->support_vulkan && !image_allocation_failed)
         {
             if (layer->support_image_storage)
@@ -534,13 +674,6 @@ IMAGE_ALLOCATION_FAILED:
         {
             int bottom_blob_index = layer->bottoms[i];
 
-            if (blob_mats_gpu_image[bottom_blob_index].dims == 0 && blob_mats_gpu[bottom_blob_index].dims == 0 && blob_mats[bottom_blob_index].dims == 0)
-            {
-                int ret = forward_layer(blobs[bottom_blob_index].producer, blob_mats, blob_mats_gpu, blob_mats_gpu_image, cmd, opt);
-                if (ret != 0)
-                    return ret;
-            }
-
             if (layer->support_vulkan && !image_allocation_failed)
             {
                 if (layer->support_image_storage)
@@ -726,99 +859,585 @@ IMAGE_ALLOCATION_FAILED:
 }
 #endif // NCNN_VULKAN
 
-int NetPrivate::convert_layout(Mat& bottom_blob, const Layer* layer, const Option& opt) const
+// the binding id last applied to the calling thread and its openmp threads
+static ThreadLocalStorage tls_thread_affinity_id;
+
+static void set_stream_thread_affinity(const CpuSet& mask)
 {
-    // clang-format off
-    // *INDENT-OFF*
-#if NCNN_ARM82
-    if (opt.use_fp16_storage && cpu_support_arm_asimdhp())
+#if NCNN_SIMPLEOMP
+    // the simpleomp pool threads are shared by all streams, pinning them would steal the cores of the other streams
+    set_cpu_current_thread_affinity(mask);
+#else
+    set_cpu_thread_affinity(mask);
+#endif
+}
+
+// bind the calling thread and its openmp threads to mask unless it carries thread_affinity_id already
+// only the calling thread with the simpleomp runtime
+// thread_affinity_id 0 puts a thread bound before back on the default cores
+static void bind_thread_affinity(const CpuSet& mask, int thread_affinity_id)
+{
+    if ((int)reinterpret_cast<size_t>(tls_thread_affinity_id.get()) == thread_affinity_id)
+        return;
+
+    if (thread_affinity_id == 0)
     {
-        if (bottom_blob.elembits() == 32 && layer->support_fp16_storage)
-        {
-            Mat bottom_blob_fp16;
-            cast_float32_to_float16(bottom_blob, bottom_blob_fp16, opt);
-            bottom_blob = bottom_blob_fp16;
-        }
-        if (bottom_blob.elembits() == 16 && !layer->support_fp16_storage)
+        // the powersave mask is empty when it means no binding, reset to all cores then
+        CpuSet default_mask = get_cpu_thread_affinity_mask(get_cpu_powersave());
+        if (default_mask.num_enabled() == 0)
         {
-            Mat bottom_blob_fp32;
-            cast_float16_to_float32(bottom_blob, bottom_blob_fp32, opt);
-            bottom_blob = bottom_blob_fp32;
+            for (int i = 0; i < get_cpu_count(); i++)
+                default_mask.enable(i);
         }
+
+        set_stream_thread_affinity(default_mask);
     }
     else
-#endif // NCNN_ARM82
-#if NCNN_RVV
-    if (opt.use_fp16_storage && cpu_support_riscv_v() && cpu_support_riscv_zfh())
     {
-        if (bottom_blob.elembits() == 32 && layer->support_fp16_storage)
-        {
-            Mat bottom_blob_fp16;
-            cast_float32_to_float16(bottom_blob, bottom_blob_fp16, opt);
-            bottom_blob = bottom_blob_fp16;
-        }
-        if (bottom_blob.elembits() == 16 && !layer->support_fp16_storage)
-        {
-            Mat bottom_blob_fp32;
-            cast_float16_to_float32(bottom_blob, bottom_blob_fp32, opt);
-            bottom_blob = bottom_blob_fp32;
-        }
+        set_stream_thread_affinity(mask);
     }
-    else
-#endif // NCNN_RVV
-#if NCNN_BF16
-    if (opt.use_bf16_storage)
+
+    tls_thread_affinity_id.set(reinterpret_cast<void*>((size_t)thread_affinity_id));
+}
+
+struct branch_parallel_context
+{
+    const NetPrivate* netd;
+    std::vector<Mat>* blob_mats;
+    Option opt;
+    LayerProfiler* profiler;
+    int numa_node;
+
+    // binding of the extractor, applied to the pool threads joining in
+    const CpuSet* thread_affinity_mask;
+    int thread_affinity_id;
+
+    // pool threads working on this context, guarded by the pool lock
+    int joined;
+
+    // dependency graph over the queued layers
+    std::vector<int> layer_indexes;
+    std::vector<int> pending;
+    std::vector<std::vector<int> > consumers;
+
+    Mutex lock;
+    ConditionVariable condition;
+    std::vector<int> ready;
+    int remaining;
+    int ret;
+};
+
+static void* branch_parallel_worker(void* args)
+{
+    branch_parallel_context* ctx = (branch_parallel_context*)args;
+
+    // denormal flushing and affinity are per-thread state
+    set_flush_denormals(ctx->opt.flush_denormals);
+    bind_thread_affinity(*ctx->thread_affinity_mask, ctx->thread_affinity_id);
+
+    ctx->lock.lock();
+    for (;;)
     {
-        if (bottom_blob.elembits() == 32 && layer->support_bf16_storage)
+        while (ctx->ready.empty() && ctx->remaining > 0 && ctx->ret == 0)
         {
-            Mat bottom_blob_bf16;
-            cast_float32_to_bfloat16(bottom_blob, bottom_blob_bf16, opt);
-            bottom_blob = bottom_blob_bf16;
+            ctx->condition.wait(ctx->lock);
         }
-        if (bottom_blob.elembits() == 16 && !layer->support_bf16_storage)
+
+        if (ctx->remaining == 0 || ctx->ret != 0)
+            break;
+
+        const int i = ctx->ready.back();
+        ctx->ready.pop_back();
+
+        ctx->lock.unlock();
+
+        int ret = ctx->netd->forward_layer(ctx->layer_indexes[i], *ctx->blob_mats, ctx->opt, ctx->profiler, ctx->numa_node);
+
+        ctx->lock.lock();
+
+        if (ret != 0)
         {
-            Mat bottom_blob_fp32;
-            cast_bfloat16_to_float32(bottom_blob, bottom_blob_fp32, opt);
-            bottom_blob = bottom_blob_fp32;
+            ctx->ret = ret;
+            ctx->condition.broadcast();
+            break;
+        }
+
+        ctx->remaining--;
+
+        const std::vector<int>& consumers = ctx->consumers[i];
+        for (size_t j = 0; j < consumers.size(); j++)
+        {
+            if (--ctx->pending[consumers[j]] == 0)
+            {
+                ctx->ready.push_back(consumers[j]);
+            }
         }
+
+        ctx->condition.broadcast();
     }
-    else
-#endif // NCNN_BF16
+    ctx->lock.unlock();
+
+    return 0;
+}
+
+BranchWorkerPool::BranchWorkerPool()
+{
+    stop = false;
+    spawn_affinity_id = 0;
+}
+
+BranchWorkerPool::~BranchWorkerPool()
+{
+    lock.lock();
+    stop = true;
+    condition.broadcast();
+    lock.unlock();
+
+    for (size_t i = 0; i < threads.size(); i++)
     {
-        // no type conversion
+        threads[i]->join();
+        delete threads[i];
     }
-    // *INDENT-ON*
-    // clang-format on
+}
 
-    if (opt.use_packing_layout)
+void BranchWorkerPool::post(branch_parallel_context* ctx, int count)
+{
+    MutexLockGuard guard(lock);
+
+    for (int i = 0; i < count; i++)
     {
-        // resolve dst_elempack
-        int dims = bottom_blob.dims;
-        int elemcount = 0;
-        if (dims == 1) elemcount = bottom_blob.elempack * bottom_blob.w;
-        if (dims == 2) elemcount = bottom_blob.elempack * bottom_blob.h;
-        if (dims == 3 || dims == 4) elemcount = bottom_blob.elempack * bottom_blob.c;
+        jobs.push_back(ctx);
+    }
 
-        int elembits = bottom_blob.elembits();
+    // other extractors may hold some threads, the caller works on ctx too so it never stalls
+    spawn_affinity_id = (int)reinterpret_cast<size_t>(tls_thread_affinity_id.get());
+    while ((int)threads.size() < count)
+    {
+        threads.push_back(new Thread(worker, (void*)this));
+    }
 
-        int dst_elempack = 1;
-        if (layer->support_packing)
+    condition.broadcast();
+}
+
+void BranchWorkerPool::wait(branch_parallel_context* ctx)
+{
+    MutexLockGuard guard(lock);
+
+    size_t j = 0;
+    for (size_t i = 0; i < jobs.size(); i++)
+    {
+        if (jobs[i] != ctx)
+            jobs[j++] = jobs[i];
+    }
+    jobs.resize(j);
+
+    while (ctx->joined > 0)
+    {
+        condition.wait(lock);
+    }
+}
+
+void* BranchWorkerPool::worker(void* args)
+{
+    BranchWorkerPool* pool = (BranchWorkerPool*)args;
+
+    pool->lock.lock();
+    tls_thread_affinity_id.set(reinterpret_cast<void*>((size_t)pool->spawn_affinity_id));
+    for (;;)
+    {
+        while (pool->jobs.empty() && !pool->stop)
         {
-            if (elembits == 32)
-            {
-#if NCNN_AVX512
-                if (elemcount % 16 == 0 && ncnn::cpu_support_x86_avx512())
-                    dst_elempack = 16;
-                else if (elemcount % 8 == 0 && ncnn::cpu_support_x86_avx())
-                    dst_elempack = 8;
-                else if (elemcount % 4 == 0)
-                    dst_elempack = 4;
-#elif NCNN_AVX
-                if (elemcount % 8 == 0 && ncnn::cpu_support_x86_avx())
-                    dst_elempack = 8;
-                else if (elemcount % 4 == 0)
-                    dst_elempack = 4;
-#elif NCNN_RVV
+            pool->condition.wait(pool->lock);
+        }
+
+        if (pool->stop)
+            break;
+
+        branch_parallel_context* ctx = pool->jobs.back();
+        pool->jobs.pop_back();
+        ctx->joined++;
+
+        pool->lock.unlock();
+
+        branch_parallel_worker((void*)ctx);
+
+        pool->lock.lock();
+
+        ctx->joined--;
+        pool->condition.broadcast();
+    }
+    pool->lock.unlock();
+
+    return 0;
+}
+
+int NetPrivate::forward_layers_parallel(const std::vector<int>& layer_queue, std::vector<Mat>& blob_mats, const Option& opt, LayerProfiler* profiler, int numa_node, const CpuSet& thread_affinity_mask, int thread_affinity_id) const
+{
+    const int count = (int)layer_queue.size();
+
+    branch_parallel_context ctx;
+    ctx.netd = this;
+    ctx.blob_mats = &blob_mats;
+    ctx.opt = opt;
+    ctx.profiler = profiler;
+    ctx.numa_node = numa_node;
+    ctx.thread_affinity_mask = &thread_affinity_mask;
+    ctx.thread_affinity_id = thread_affinity_id;
+    ctx.joined = 0;
+    ctx.layer_indexes.resize(count);
+    ctx.pending.resize(count, 0);
+    ctx.consumers.resize(count);
+    ctx.remaining = count;
+    ctx.ret = 0;
+
+    // queue position of each layer, execution order is reversed queue order
+    std::vector<int> position(layers.size(), -1);
+    for (int i = 0; i < count; i++)
+    {
+        ctx.layer_indexes[i] = layer_queue[count - 1 - i];
+        position[ctx.layer_indexes[i]] = i;
+    }
+
+    // depth of each layer tells how many branches may run side by side
+    std::vector<int> depth(count, 0);
+    std::vector<int> depth_width(count, 0);
+    int max_width = 0;
+    for (int i = 0; i < count; i++)
+    {
+        const Layer* layer = layers[ctx.layer_indexes[i]];
+        for (size_t j = 0; j < layer->bottoms.size(); j++)
+        {
+            int producer = blobs[layer->bottoms[j]].producer;
+            if (producer == -1 || position[producer] == -1)
+                continue;
+
+            const int p = position[producer];
+            ctx.consumers[p].push_back(i);
+            ctx.pending[i]++;
+            depth[i] = std::max(depth[i], depth[p] + 1);
+        }
+
+        depth_width[depth[i]]++;
+        max_width = std::max(max_width, depth_width[depth[i]]);
+    }
+
+    const int num_workers = std::min(max_width, opt.num_threads);
+    if (num_workers <= 1)
+    {
+        for (int i = 0; i < count; i++)
+        {
+            int ret = forward_layer(ctx.layer_indexes[i], blob_mats, opt, profiler, numa_node);
+            if (ret != 0)
+                return ret;
+        }
+
+        return 0;
+    }
+
+    // each concurrent layer gets its own slice of the threads
+    ctx.opt.num_threads = std::max(opt.num_threads / num_workers, 1);
+
+    // ready layers are taken from the back, keep the plan order among them
+    for (int i = count - 1; i >= 0; i--)
+    {
+        if (ctx.pending[i] == 0)
+            ctx.ready.push_back(i);
+    }
+
+    branch_workers.post(&ctx, num_workers - 1);
+
+    branch_parallel_worker((void*)&ctx);
+
+    branch_workers.wait(&ctx);
+
+    return ctx.ret;
+}
+
+int NetPrivate::forward_layer_batch(int layer_index, std::vector<std::vector<Mat> >& batch_blob_mats, const Option& opt, LayerProfiler* profiler, int numa_node) const
+{
+    const Layer* layer = numa_layer(layer_index, numa_node);
+    const int batch = (int)batch_blob_mats.size();
+
+    // fold the batch into one gemm for innerproduct
+    // every sample is flattened into one row of a w=num_input h=batch bottom blob
+    bool fold = batch > 1 && layer->typeindex == LayerType::InnerProduct && layer->one_blob_only;
+    if (fold)
+    {
+        int bottom_blob_index = layer->bottoms[0];
+        const Mat& b0 = batch_blob_mats[0][bottom_blob_index];
+        const int size0 = b0.w * b0.h * b0.d * b0.c * b0.elempack;
+        const size_t elemsize0 = b0.elemsize / b0.elempack;
+
+        for (int b = 0; b < batch; b++)
+        {
+            const Mat& m = batch_blob_mats[b][bottom_blob_index];
+
+            // 2-dim input is already treated as rows by innerproduct
+            if (m.dims == 2 || m.w * m.h * m.d * m.c * m.elempack != size0 || m.elemsize / m.elempack != elemsize0)
+            {
+                fold = false;
+                break;
+            }
+        }
+    }
+
+    if (!fold)
+    {
+        for (int b = 0; b < batch; b++)
+        {
+            int ret = forward_layer(layer_index, batch_blob_mats[b], opt, profiler, numa_node);
+            if (ret != 0)
+                return ret;
+        }
+
+        return 0;
+    }
+
+#if NCNN_BENCHMARK
+    double start = get_current_time();
+#endif
+
+    // one record covers the folded batch
+    LayerProfile record;
+    if (profiler)
+    {
+        profiler->begin(layer, layer_index, batch_blob_mats[0], opt, record);
+    }
+    const double trace_start = trace_enabled() ? get_current_time() : 0;
+
+    int bottom_blob_index = layer->bottoms[0];
+    int top_blob_index = layer->tops[0];
+
+    Mat bottom_blob;
+    for (int b = 0; b < batch; b++)
+    {
+        Mat m = batch_blob_mats[b][bottom_blob_index];
+        if (m.elempack != 1)
+        {
+            Mat m_unpacked;
+            convert_packing(m, m_unpacked, 1, opt);
+            m = m_unpacked;
+        }
+
+        // drop the channel gap
+        const int size = m.w * m.h * m.d * m.c;
+        m = m.reshape(size, opt.workspace_allocator);
+        if (m.empty())
+            return -100;
+
+        if (b == 0)
+        {
+            bottom_blob.create(size, batch, m.elemsize, opt.blob_allocator);
+            if (bottom_blob.empty())
+                return -100;
+        }
+
+        memcpy(bottom_blob.row<unsigned char>(b), m.data, size * m.elemsize);
+
+        if (opt.lightmode)
+        {
+            // delete after taken in light mode
+            batch_blob_mats[b][bottom_blob_index].release();
+        }
+    }
+
+    convert_layout(bottom_blob, layer, opt);
+
+    if (profiler)
+    {
+        record.bottom_shapes[0] = blob_storage_shape(bottom_blob);
+    }
+
+    Mat top_blob;
+    int ret = layer->forward(bottom_blob, top_blob, opt);
+    if (ret != 0)
+        return ret;
+
+    bottom_blob.release();
+
+    if (profiler)
+    {
+        record.top_shapes.resize(1);
+        record.top_shapes[0] = blob_storage_shape(top_blob);
+        record.allocated_bytes = top_blob.total() * top_blob.elemsize;
+    }
+
+    if (top_blob.elempack != 1)
+    {
+        Mat top_blob_unpacked;
+        convert_packing(top_blob, top_blob_unpacked, 1, opt);
+        top_blob = top_blob_unpacked;
+    }
+
+    // split rows back into per-sample top blobs
+    for (int b = 0; b < batch; b++)
+    {
+        Mat& m = batch_blob_mats[b][top_blob_index];
+        m.create(top_blob.w, top_blob.elemsize, opt.blob_allocator);
+        if (m.empty())
+            return -100;
+
+        memcpy(m.data, top_blob.row<const unsigned char>(b), top_blob.w * top_blob.elemsize);
+    }
+
+    if (trace_start != 0)
+    {
+        trace_layer(layer, trace_start);
+    }
+
+    if (profiler)
+    {
+        record.end = get_current_time();
+        LayerProfiler::set_workload(layer, record);
+        profiler->add(record);
+    }
+
+#if NCNN_BENCHMARK
+    double end = get_current_time();
+    benchmark(layer, start, end);
+#endif
+
+    return 0;
+}
+
+const Layer* NetPrivate::numa_layer(int layer_index, int numa_node) const
+{
+    if (numa_node >= 0 && numa_node < (int)numa_layers.size() && !numa_layers[numa_node].empty())
+        return numa_layers[numa_node][layer_index];
+
+    return layers[layer_index];
+}
+
+PoolAllocator* NetPrivate::get_local_blob_allocator(int numa_node) const
+{
+    if (numa_node >= 0 && numa_node < (int)numa_blob_allocators.size())
+        return numa_blob_allocators[numa_node];
+
+    return local_blob_allocator;
+}
+
+PoolAllocator* NetPrivate::get_local_workspace_allocator(int numa_node) const
+{
+    if (numa_node >= 0 && numa_node < (int)numa_workspace_allocators.size())
+        return numa_workspace_allocators[numa_node];
+
+    return local_workspace_allocator;
+}
+
+int NetPrivate::convert_layout(Mat& bottom_blob, const Layer* layer, const Option& opt) const
+{
+    if (!trace_enabled())
+        return do_convert_layout(bottom_blob, layer, opt);
+
+    // trace actual conversions only, blobs already in the layer layout pass through
+    const double start = get_current_time();
+    const void* data = bottom_blob.data;
+    int ret = do_convert_layout(bottom_blob, layer, opt);
+    if (bottom_blob.data != data)
+    {
+#if NCNN_STRING
+        trace_event("layout", "convert_layout", layer->name.c_str(), start, get_current_time());
+#else
+        trace_event("layout", "convert_layout", 0, start, get_current_time());
+#endif
+    }
+
+    return ret;
+}
+
+int NetPrivate::do_convert_layout(Mat& bottom_blob, const Layer* layer, const Option& opt) const
+{
+    // clang-format off
+    // *INDENT-OFF*
+#if NCNN_ARM82
+    if (opt.use_fp16_storage && cpu_support_arm_asimdhp())
+    {
+        if (bottom_blob.elembits() == 32 && layer->support_fp16_storage)
+        {
+            Mat bottom_blob_fp16;
+            cast_float32_to_float16(bottom_blob, bottom_blob_fp16, opt);
+            bottom_blob = bottom_blob_fp16;
+        }
+        if (bottom_blob.elembits() == 16 && !layer->support_fp16_storage)
+        {
+            Mat bottom_blob_fp32;
+            cast_float16_to_float32(bottom_blob, bottom_blob_fp32, opt);
+            bottom_blob = bottom_blob_fp32;
+        }
+    }
+    else
+#endif // NCNN_ARM82
+#if NCNN_RVV
+    if (opt.use_fp16_storage && cpu_support_riscv_v() && cpu_support_riscv_zfh())
+    {
+        if (bottom_blob.elembits() == 32 && layer->support_fp16_storage)
+        {
+            Mat bottom_blob_fp16;
+            cast_float32_to_float16(bottom_blob, bottom_blob_fp16, opt);
+            bottom_blob = bottom_blob_fp16;
+        }
+        if (bottom_blob.elembits() == 16 && !layer->support_fp16_storage)
+        {
+            Mat bottom_blob_fp32;
+            cast_float16_to_float32(bottom_blob, bottom_blob_fp32, opt);
+            bottom_blob = bottom_blob_fp32;
+        }
+    }
+    else
+#endif // NCNN_RVV
+#if NCNN_BF16
+    if (opt.use_bf16_storage)
+    {
+        if (bottom_blob.elembits() == 32 && layer->support_bf16_storage)
+        {
+            Mat bottom_blob_bf16;
+            cast_float32_to_bfloat16(bottom_blob, bottom_blob_bf16, opt);
+            bottom_blob = bottom_blob_bf16;
+        }
+        if (bottom_blob.elembits() == 16 && !layer->support_bf16_storage)
+        {
+            Mat bottom_blob_fp32;
+            cast_bfloat16_to_float32(bottom_blob, bottom_blob_fp32, opt);
+            bottom_blob = bottom_blob_fp32;
+        }
+    }
+    else
+#endif // NCNN_BF16
+    {
+        // no type conversion
+    }
+    // *INDENT-ON*
+    // clang-format on
+
+    if (opt.use_packing_layout)
+    {
+        // resolve dst_elempack
+        int dims = bottom_blob.dims;
+        int elemcount = 0;
+        if (dims == 1) elemcount = bottom_blob.elempack * bottom_blob.w;
+        if (dims == 2) elemcount = bottom_blob.elempack * bottom_blob.h;
+        if (dims == 3 || dims == 4) elemcount = bottom_blob.elempack * bottom_blob.c;
+
+        int elembits = bottom_blob.elembits();
+
+        int dst_elempack = 1;
+        if (layer->support_packing)
+        {
+            if (elembits == 32)
+            {
+#if NCNN_AVX512
+                if (elemcount % 16 == 0 && ncnn::cpu_support_x86_avx512())
+                    dst_elempack = 16;
+                else if (elemcount % 8 == 0 && ncnn::cpu_support_x86_avx())
+                    dst_elempack = 8;
+                else if (elemcount % 4 == 0)
+                    dst_elempack = 4;
+#elif NCNN_AVX
+                if (elemcount % 8 == 0 && ncnn::cpu_support_x86_avx())
+                    dst_elempack = 8;
+                else if (elemcount % 4 == 0)
+                    dst_elempack = 4;
+#elif NCNN_RVV
                 const int packn = ncnn::cpu_riscv_vlenb() / 4;
                 if (elemcount % packn == 0)
                     dst_elempack = packn;
@@ -1289,22 +1908,74 @@ void NetPrivate::update_input_output_names()
 }
 #endif // NCNN_STRING
 
-Net::Net()
-    : d(new NetPrivate(opt))
+void NetPrivate::build_execution_plan(int blob_index, std::vector<int>& plan) const
 {
-}
+    plan.clear();
 
-Net::~Net()
-{
-    clear();
+    int producer = blobs[blob_index].producer;
+    if (producer == -1)
+        return;
 
-    delete d;
+    // iterative depth-first post-order walk over producers
+    // producers run before consumers and each branch is finished before the next one
+    std::vector<unsigned char> visited(layers.size(), 0);
+    std::vector<std::pair<int, int> > stack;
+
+    stack.push_back(std::make_pair(producer, 0));
+    visited[producer] = 1;
+
+    while (!stack.empty())
+    {
+        const int layer_index = stack.back().first;
+        const int bottom_index = stack.back().second;
+        const Layer* layer = layers[layer_index];
+
+        if (bottom_index < (int)layer->bottoms.size())
+        {
+            stack.back().second = bottom_index + 1;
+
+            int bottom_producer = blobs[layer->bottoms[bottom_index]].producer;
+            if (bottom_producer != -1 && !visited[bottom_producer])
+            {
+                visited[bottom_producer] = 1;
+                stack.push_back(std::make_pair(bottom_producer, 0));
+            }
+            continue;
+        }
+
+        plan.push_back(layer_index);
+        stack.pop_back();
+    }
 }
 
-Net::Net(const Net&)
-    : d(0)
+void NetPrivate::build_execution_plans()
 {
-}
+    execution_plans.clear();
+    execution_plans.resize(blobs.size());
+
+    for (size_t i = 0; i < output_blob_indexes.size(); i++)
+    {
+        int blob_index = output_blob_indexes[i];
+        build_execution_plan(blob_index, execution_plans[blob_index]);
+    }
+}
+
+Net::Net()
+    : d(new NetPrivate(opt))
+{
+}
+
+Net::~Net()
+{
+    clear();
+
+    delete d;
+}
+
+Net::Net(const Net&)
+    : d(0)
+{
+}
 
 Net& Net::operator=(const Net&)
 {
@@ -1400,6 +2071,10 @@ int Net::load_param(const DataReader& dr)
     }
 
     d->layers.resize((size_t)layer_count);
+    d->layer_params.resize(opt.use_numa_replica ? (size_t)layer_count : 0);
+#if NCNN_STDIO
+    d->layer_param_hashes.resize((size_t)layer_count, 0);
+#endif // NCNN_STDIO
     d->blobs.resize((size_t)blob_count);
 
 #if NCNN_VULKAN
@@ -1579,6 +2254,13 @@ int Net::load_param(const DataReader& dr)
         }
 
         d->layers[i] = layer;
+
+        if (!d->layer_params.empty())
+            d->layer_params[i] = pd;
+
+#if NCNN_STDIO
+        d->layer_param_hashes[i] = hash_param_dict(0xcbf29ce484222325ULL, pd);
+#endif // NCNN_STDIO
     }
 
     d->update_input_output_indexes();
@@ -1617,6 +2299,10 @@ int Net::load_param_bin(const DataReader& dr)
     }
 
     d->layers.resize(layer_count);
+    d->layer_params.resize(opt.use_numa_replica ? layer_count : 0);
+#if NCNN_STDIO
+    d->layer_param_hashes.resize(layer_count, 0);
+#endif // NCNN_STDIO
     d->blobs.resize(blob_count);
 
 #if NCNN_VULKAN
@@ -1786,6 +2472,13 @@ int Net::load_param_bin(const DataReader& dr)
         }
 
         d->layers[i] = layer;
+
+        if (!d->layer_params.empty())
+            d->layer_params[i] = pd;
+
+#if NCNN_STDIO
+        d->layer_param_hashes[i] = hash_param_dict(0xcbf29ce484222325ULL, pd);
+#endif // NCNN_STDIO
     }
 
     d->update_input_output_indexes();
@@ -1794,179 +2487,719 @@ int Net::load_param_bin(const DataReader& dr)
     return 0;
 }
 
-int Net::load_model(const DataReader& dr)
+// weight transform state shared by the create_pipeline calls of one load_model
+struct pipeline_create_context
 {
-    if (d->layers.empty())
-    {
-        NCNN_LOGE("network graph not ready");
-        return -1;
-    }
+    NetPrivate* netd;
+    Option opt;
 
-    int layer_count = (int)d->layers.size();
+#if NCNN_STDIO
+    // the weight cache keys each layer by the hash of the data it loads
+    bool use_pipeline_weight_cache;
+    std::vector<uint64_t> weight_hashes;
+    std::vector<int> typeindexes;
+    std::vector<std::vector<Mat> > pipeline_weights;
+    std::vector<int> pipeline_weights_dirty;
+
+    // null unless opt.use_autotune
+    KernelTuningDatabase* autotune_db;
+#endif // NCNN_STDIO
 
-    // load file
-    int ret = 0;
+    // layers loaded and waiting for create_pipeline, in load order
+    Mutex lock;
+    ConditionVariable condition;
+    std::vector<int> loaded;
+    int next;
+    bool loading_done;
+    int ret;
+};
 
-    ModelBinFromDataReader mb(dr);
-    for (int i = 0; i < layer_count; i++)
+// fp32 convolution on cpu with a known input shape
+static bool autotune_supported(const Layer* layer, const Option& opt)
+{
+    if (layer->typeindex != LayerType::Convolution || opt.use_vulkan_compute)
+        return false;
+
+    if (layer->bottom_shapes.size() != 1 || layer->bottom_shapes[0].dims != 3)
+        return false;
+
+    const Convolution* op = (const Convolution*)layer;
+    if (op->dynamic_weight || op->weight_data.elemsize != 4u)
+        return false;
+
+    if (opt.use_int8_inference && op->int8_scale_term)
+        return false;
+
+    return true;
+}
+
+static void autotune_key(const Layer* layer, const Option& opt, char* key, size_t size)
+{
+    const Convolution* op = (const Convolution*)layer;
+    const Mat& shape = layer->bottom_shapes[0];
+    const int num_input = op->weight_data_size / (op->kernel_w * op->kernel_h) / op->num_output;
+
+    snprintf(key, size, "conv k%dx%d s%dx%d d%dx%d p%d,%d,%d,%d %dx%dx%d-%d t%d p%d f%d b%d",
+             op->kernel_w, op->kernel_h, op->stride_w, op->stride_h, op->dilation_w, op->dilation_h,
+             op->pad_left, op->pad_right, op->pad_top, op->pad_bottom,
+             shape.w, shape.h, num_input, op->num_output,
+             opt.num_threads, opt.use_packing_layout, opt.use_fp16_storage, opt.use_bf16_storage);
+}
+
+// time every enabled kernel on the hinted input shape, return the fastest choice
+// candidates resolving to the same kernel are timed once
+static int autotune_convolution(const NetPrivate* netd, Layer* layer, const Option& opt)
+{
+    const Mat& shape = layer->bottom_shapes[0];
+
+    Mat bottom_blob(shape.w, shape.h, shape.c, (size_t)4u);
+    if (bottom_blob.empty())
+        return 0;
+
+    bottom_blob.fill(0.5f);
+
+    const char* tuned_algorithms[KERNEL_CHOICE_COUNT] = {0};
+
+    int best_choice = 0;
+    double best_time = 0;
+    for (int choice = KERNEL_CHOICE_DIRECT; choice < KERNEL_CHOICE_COUNT; choice++)
     {
-        Layer* layer = d->layers[i];
+        if (!kernel_choice_enabled(opt, choice))
+            continue;
 
-        //Here we found inconsistent content in the parameter file.
-        if (!layer)
+        // keep weight_data for the next candidate
+        Option opt1 = opt;
+        opt1.lightmode = false;
+        apply_kernel_choice(opt1, choice);
+
+        if (layer->create_pipeline(opt1) != 0)
         {
-            NCNN_LOGE("load_model error at layer %d, parameter file has inconsistent content.", i);
-            ret = -1;
-            break;
+            layer->destroy_pipeline(opt1);
+            continue;
         }
 
-        int lret = layer->load_model(mb);
-        if (lret != 0)
+        LayerKernelInfo info;
+        bool duplicated = false;
+        if (layer->get_kernel_info(info) == 0)
         {
-#if NCNN_STRING
-            NCNN_LOGE("layer load_model %d %s failed", i, layer->name.c_str());
-#else
-            NCNN_LOGE("layer load_model %d failed", i);
-#endif
-            ret = -1;
-            break;
+            for (int j = KERNEL_CHOICE_DIRECT; j < choice; j++)
+            {
+                if (tuned_algorithms[j] && strcmp(tuned_algorithms[j], info.algorithm) == 0)
+                    duplicated = true;
+            }
+            tuned_algorithms[choice] = info.algorithm;
         }
 
-        if (layer->support_int8_storage)
+        double time = 0;
+        int ret = duplicated ? -1 : 0;
+        Mat bottom_blob1 = bottom_blob;
+        if (ret == 0)
+            ret = netd->do_convert_layout(bottom_blob1, layer, opt1);
+
+        // one warmup run, then the fastest of three
+        for (int k = 0; k < 4 && ret == 0; k++)
         {
-            // no int8 gpu support yet
-            opt.use_vulkan_compute = false;
+            Mat top_blob;
+            double start = get_current_time();
+            ret = layer->forward(bottom_blob1, top_blob, opt1);
+            double end = get_current_time();
+
+            if (k == 1 || (k > 1 && end - start < time))
+                time = end - start;
+        }
+
+        layer->destroy_pipeline(opt1);
+
+        if (ret != 0)
+            continue;
+
+        if (best_choice == 0 || time < best_time)
+        {
+            best_choice = choice;
+            best_time = time;
         }
     }
 
+    return best_choice;
+}
+
+static int create_layer_pipeline(pipeline_create_context* ctx, int i)
+{
+    Layer* layer = ctx->netd->layers[i];
+
+    Option opt1 = ctx->opt;
 #if NCNN_VULKAN
-    if (opt.use_vulkan_compute)
+    if (opt1.use_vulkan_compute)
     {
-        if (!opt.pipeline_cache)
-        {
-            if (!d->pipeline_cache)
-                d->pipeline_cache = new PipelineCache(d->vkdev);
-            opt.pipeline_cache = d->pipeline_cache;
-        }
+        if (!layer->support_image_storage) opt1.use_image_storage = false;
     }
 #endif // NCNN_VULKAN
 
-    for (int i = 0; i < layer_count; i++)
+    if (opt1.use_autotune && autotune_supported(layer, opt1))
     {
-        Layer* layer = d->layers[i];
+        int choice = 0;
 
-        Option opt1 = opt;
-#if NCNN_VULKAN
-        if (opt.use_vulkan_compute)
+#if NCNN_STDIO
+        char key[256];
+        autotune_key(layer, opt1, key, sizeof(key));
+        choice = ctx->autotune_db->find(key);
+        if (choice == 0)
         {
-            if (!layer->support_image_storage) opt1.use_image_storage = false;
+            choice = autotune_convolution(ctx->netd, layer, opt1);
+            if (choice != 0)
+                ctx->autotune_db->set(key, choice);
         }
-#endif // NCNN_VULKAN
 
-        int cret = layer->create_pipeline(opt1);
-        if (cret != 0)
+        // weights cached for another choice are transformed differently
+        ctx->weight_hashes[i] = hash_bytes(ctx->weight_hashes[i], &choice, sizeof(int));
+#else
+        choice = autotune_convolution(ctx->netd, layer, opt1);
+#endif // NCNN_STDIO
+
+        ctx->netd->layer_kernel_choices[i] = choice;
+        apply_kernel_choice(opt1, choice);
+    }
+
+#if NCNN_STDIO
+    if (ctx->use_pipeline_weight_cache)
+    {
+        ctx->typeindexes[i] = layer->typeindex;
+
+        // a layer restored from the weight cache skips its weight transform
+        std::vector<Mat>& weights = ctx->pipeline_weights[i];
+        const PipelineWeightCache* cache = ctx->netd->pipeline_weight_cache;
+        if (cache && cache->find(i, layer->typeindex, ctx->weight_hashes[i], weights) == 0)
         {
+            if (layer->create_pipeline_from_weights(weights, opt1) == 0)
+                return 0;
+
+            weights.clear();
+        }
+    }
+#endif // NCNN_STDIO
+
+    int cret = layer->create_pipeline(opt1);
+    if (cret != 0)
+    {
 #if NCNN_STRING
-            NCNN_LOGE("layer create_pipeline %d %s failed", i, layer->name.c_str());
+        NCNN_LOGE("layer create_pipeline %d %s failed", i, layer->name.c_str());
 #else
-            NCNN_LOGE("layer create_pipeline %d failed", i);
+        NCNN_LOGE("layer create_pipeline %d failed", i);
 #endif
-            ret = -1;
+        return -1;
+    }
+
+#if NCNN_STDIO
+    if (ctx->use_pipeline_weight_cache && layer->get_pipeline_weights(ctx->pipeline_weights[i]) == 0)
+    {
+        ctx->pipeline_weights_dirty[i] = 1;
+    }
+#endif // NCNN_STDIO
+
+    return 0;
+}
+
+static void* pipeline_create_worker(void* args)
+{
+    pipeline_create_context* ctx = (pipeline_create_context*)args;
+
+    const bool hugepage_allocation = get_thread_hugepage_allocation();
+    set_thread_hugepage_allocation(hugepage_allocation || ctx->netd->opt.use_hugepage);
+
+    ctx->lock.lock();
+    for (;;)
+    {
+        while (ctx->next == (int)ctx->loaded.size() && !ctx->loading_done && ctx->ret == 0)
+        {
+            ctx->condition.wait(ctx->lock);
+        }
+
+        if (ctx->next == (int)ctx->loaded.size() || ctx->ret != 0)
             break;
+
+        const int i = ctx->loaded[ctx->next++];
+
+        ctx->lock.unlock();
+
+        int ret = create_layer_pipeline(ctx, i);
+
+        ctx->lock.lock();
+
+        if (ret != 0 && ctx->ret == 0)
+        {
+            ctx->ret = ret;
+            ctx->condition.broadcast();
         }
     }
+    ctx->lock.unlock();
 
-    if (opt.use_local_pool_allocator)
+    set_thread_hugepage_allocation(hugepage_allocation);
+
+    return 0;
+}
+
+int NetPrivate::create_numa_replicas(int home_node, const std::vector<std::vector<Mat> >& layer_weights)
+{
+    const int node_count = get_numa_node_count();
+
+    numa_layers.resize(node_count);
+
+    int ret = 0;
+    for (int node = 0; node < node_count && ret == 0; node++)
     {
-        if (opt.blob_allocator == 0)
+        if (node == home_node || get_numa_node_cpuset(node).num_enabled() == 0)
+            continue;
+
+        std::vector<Layer*>& replicas = numa_layers[node];
+        replicas.resize(layers.size(), (Layer*)0);
+        for (size_t i = 0; i < layers.size(); i++)
         {
-            if (!d->local_blob_allocator)
+            const int typeindex = layers[i]->typeindex;
+            if (typeindex & LayerType::CustomBit)
             {
-                d->local_blob_allocator = new PoolAllocator;
-                d->local_blob_allocator->set_size_compare_ratio(0.f);
+                const custom_layer_registry_entry& entry = custom_layer_registry[typeindex & ~LayerType::CustomBit];
+                replicas[i] = entry.creator ? entry.creator(entry.userdata) : 0;
+                if (replicas[i])
+                    replicas[i]->typeindex = typeindex;
             }
-        }
-        if (opt.workspace_allocator == 0)
-        {
-            if (!d->local_workspace_allocator)
+            else
             {
-                d->local_workspace_allocator = new PoolAllocator;
-                d->local_workspace_allocator->set_size_compare_ratio(0.5f);
+                replicas[i] = create_layer(typeindex);
+            }
+
+            if (!replicas[i])
+            {
+                NCNN_LOGE("numa replica of layer %d type %d not created", (int)i, typeindex);
+                ret = -1;
+                break;
             }
         }
     }
 
-#if NCNN_VULKAN
-    if (opt.use_vulkan_compute)
+    if (ret == 0)
     {
-        d->upload_model();
+        ret = load_numa_replicas(layers, numa_layers, layer_params, layer_weights, layer_kernel_choices, opt);
     }
-#endif // NCNN_VULKAN
 
-    return ret;
-}
+    if (ret != 0)
+    {
+        // extractors fall back to the loaded layers
+        for (int node = 0; node < node_count; node++)
+        {
+            for (size_t i = 0; i < numa_layers[node].size(); i++)
+            {
+                if (numa_layers[node][i])
+                    destroy_layer(numa_layers[node][i]);
+            }
+        }
+        numa_layers.clear();
+    }
 
-#if NCNN_STDIO
-#if NCNN_STRING
-int Net::load_param(FILE* fp)
-{
-    DataReaderFromStdio dr(fp);
-    return load_param(dr);
-}
+    layer_params.clear();
 
-int Net::load_param_mem(const char* _mem)
-{
-    const unsigned char* mem = (const unsigned char*)_mem;
-    DataReaderFromMemory dr(mem);
-    return load_param(dr);
+    return ret;
 }
 
-int Net::load_param(const char* protopath)
+void NetPrivate::destroy_layer(Layer* layer)
 {
-    FILE* fp = fopen(protopath, "rb");
-    if (!fp)
+    Option opt1 = opt;
+    if (!layer->support_image_storage)
     {
-        NCNN_LOGE("fopen %s failed", protopath);
-        return -1;
+        opt1.use_image_storage = false;
     }
 
-    int ret = load_param(fp);
-    fclose(fp);
-    return ret;
-}
-#endif // NCNN_STRING
+    int dret = layer->destroy_pipeline(opt1);
+    if (dret != 0)
+    {
+        NCNN_LOGE("layer destroy_pipeline failed");
+        // ignore anyway
+    }
 
-int Net::load_param_bin(FILE* fp)
-{
-    DataReaderFromStdio dr(fp);
-    return load_param_bin(dr);
+    if (layer->typeindex & ncnn::LayerType::CustomBit)
+    {
+        int custom_index = layer->typeindex & ~ncnn::LayerType::CustomBit;
+        if (custom_layer_registry[custom_index].destroyer)
+        {
+            custom_layer_registry[custom_index].destroyer(layer, custom_layer_registry[custom_index].userdata);
+        }
+        else
+        {
+            delete layer;
+        }
+    }
+    else
+    {
+        delete layer;
+    }
 }
 
-int Net::load_param_bin(const char* protopath)
+int Net::load_model(const DataReader& dr)
 {
-    FILE* fp = fopen(protopath, "rb");
-    if (!fp)
+    if (d->layers.empty())
     {
-        NCNN_LOGE("fopen %s failed", protopath);
+        NCNN_LOGE("network graph not ready");
         return -1;
     }
 
-    int ret = load_param_bin(fp);
-    fclose(fp);
-    return ret;
-}
+    int layer_count = (int)d->layers.size();
 
-int Net::load_model(FILE* fp)
-{
-    DataReaderFromStdio dr(fp);
-    return load_model(dr);
-}
+    // weights and packed weights are created with the default allocator
+    const bool hugepage_allocation = get_thread_hugepage_allocation();
+    set_thread_hugepage_allocation(hugepage_allocation || opt.use_hugepage);
 
-int Net::load_model(const char* modelpath)
-{
-    FILE* fp = fopen(modelpath, "rb");
-    if (!fp)
-    {
+    // the loaded layers count as replica of the node loading them
+    const bool use_numa_replica = opt.use_numa_replica && !opt.use_vulkan_compute && get_numa_node_count() > 1 && (int)d->layer_params.size() == layer_count;
+    const int home_numa_node = get_current_numa_node();
+    std::vector<std::vector<Mat> > layer_weights(use_numa_replica ? layer_count : 0);
+
+    pipeline_create_context ctx;
+    ctx.netd = d;
+    ctx.next = 0;
+    ctx.loading_done = false;
+    ctx.ret = 0;
+
+#if NCNN_STDIO
+    ctx.use_pipeline_weight_cache = !d->pipeline_weight_cache_path.empty() && !opt.use_vulkan_compute;
+    ctx.weight_hashes.resize(layer_count, 0);
+
+    uint64_t pipeline_weight_cache_key = 0;
+    if (ctx.use_pipeline_weight_cache)
+    {
+        pipeline_weight_cache_key = PipelineWeightCache::make_key(opt);
+
+        delete d->pipeline_weight_cache;
+        d->pipeline_weight_cache = new PipelineWeightCache;
+        if (d->pipeline_weight_cache->load(d->pipeline_weight_cache_path.c_str(), pipeline_weight_cache_key) != 0)
+        {
+            delete d->pipeline_weight_cache;
+            d->pipeline_weight_cache = 0;
+        }
+
+        ctx.typeindexes.resize(layer_count, 0);
+        ctx.pipeline_weights.resize(layer_count);
+        ctx.pipeline_weights_dirty.resize(layer_count, 0);
+    }
+
+    ctx.autotune_db = 0;
+    if (opt.use_autotune)
+    {
+        ctx.autotune_db = new KernelTuningDatabase;
+        if (!d->autotune_cache_path.empty())
+        {
+            ctx.autotune_db->load(d->autotune_cache_path.c_str());
+        }
+    }
+#endif // NCNN_STDIO
+
+    d->layer_kernel_choices.clear();
+    d->layer_kernel_choices.resize(layer_count, 0);
+
+    // create pipelines on worker threads while the following layers are still being read
+    // every worker transforms one layer at a time with a single thread
+    // layers may only allocate weights from the default allocator here
+#if NCNN_THREADS
+    // concurrent pipeline creation would disturb autotune timing
+    const bool parallel_load = opt.use_parallel_load && opt.num_threads > 1 && !opt.use_vulkan_compute && !opt.use_autotune;
+#else
+    const bool parallel_load = false;
+#endif // NCNN_THREADS
+
+    std::vector<Thread*> workers;
+    if (parallel_load)
+    {
+        ctx.opt = opt;
+        ctx.opt.num_threads = 1;
+        ctx.opt.blob_allocator = 0;
+        ctx.opt.workspace_allocator = 0;
+
+        workers.resize(opt.num_threads - 1);
+        for (size_t i = 0; i < workers.size(); i++)
+        {
+            workers[i] = new Thread(pipeline_create_worker, (void*)&ctx);
+        }
+    }
+
+    // load file
+    int ret = 0;
+
+#if NCNN_STDIO
+    DataReaderHashing drh(dr);
+    ModelBinFromDataReader mb(ctx.use_pipeline_weight_cache ? (const DataReader&)drh : dr);
+#else
+    ModelBinFromDataReader mb(dr);
+#endif // NCNN_STDIO
+    for (int i = 0; i < layer_count; i++)
+    {
+        Layer* layer = d->layers[i];
+
+        //Here we found inconsistent content in the parameter file.
+        if (!layer)
+        {
+            NCNN_LOGE("load_model error at layer %d, parameter file has inconsistent content.", i);
+            ret = -1;
+            break;
+        }
+
+        int lret = 0;
+        if (use_numa_replica)
+        {
+            ModelBinRecorder mbr(mb, layer_weights[i]);
+            lret = layer->load_model(mbr);
+        }
+        else
+        {
+            lret = layer->load_model(mb);
+        }
+        if (lret != 0)
+        {
+#if NCNN_STRING
+            NCNN_LOGE("layer load_model %d %s failed", i, layer->name.c_str());
+#else
+            NCNN_LOGE("layer load_model %d failed", i);
+#endif
+            ret = -1;
+            break;
+        }
+
+#if NCNN_STDIO
+        // weights transformed for other params must not be restored
+        ctx.weight_hashes[i] = drh.hash;
+        if (i < (int)d->layer_param_hashes.size())
+            ctx.weight_hashes[i] = hash_bytes(ctx.weight_hashes[i], &d->layer_param_hashes[i], sizeof(uint64_t));
+        drh.hash = 0xcbf29ce484222325ULL;
+#endif // NCNN_STDIO
+
+        if (layer->support_int8_storage)
+        {
+            // no int8 gpu support yet
+            opt.use_vulkan_compute = false;
+        }
+
+        if (parallel_load)
+        {
+            ctx.lock.lock();
+            ctx.loaded.push_back(i);
+            ctx.condition.signal();
+            ctx.lock.unlock();
+        }
+    }
+
+    if (parallel_load)
+    {
+        ctx.lock.lock();
+        ctx.loading_done = true;
+        if (ret != 0 && ctx.ret == 0)
+            ctx.ret = ret;
+        ctx.condition.broadcast();
+        ctx.lock.unlock();
+
+        // help with the remaining layers
+        pipeline_create_worker((void*)&ctx);
+
+        for (size_t i = 0; i < workers.size(); i++)
+        {
+            workers[i]->join();
+            delete workers[i];
+        }
+
+        ret = ctx.ret;
+    }
+
+#if NCNN_VULKAN
+    if (opt.use_vulkan_compute)
+    {
+        if (!opt.pipeline_cache)
+        {
+            if (!d->pipeline_cache)
+                d->pipeline_cache = new PipelineCache(d->vkdev);
+            opt.pipeline_cache = d->pipeline_cache;
+        }
+    }
+#endif // NCNN_VULKAN
+
+    if (!parallel_load && ret == 0)
+    {
+        ctx.opt = opt;
+
+        for (int i = 0; i < layer_count; i++)
+        {
+            ret = create_layer_pipeline(&ctx, i);
+            if (ret != 0)
+                break;
+        }
+    }
+
+    set_thread_hugepage_allocation(hugepage_allocation);
+
+    if (use_numa_replica && ret == 0)
+    {
+        d->create_numa_replicas(home_numa_node, layer_weights);
+    }
+    layer_weights.clear();
+
+#if NCNN_STDIO
+    if (ret == 0 && ctx.use_pipeline_weight_cache)
+    {
+        bool pipeline_weight_cache_dirty = false;
+        for (int i = 0; i < layer_count; i++)
+        {
+            if (ctx.pipeline_weights_dirty[i])
+                pipeline_weight_cache_dirty = true;
+        }
+
+        if (pipeline_weight_cache_dirty)
+        {
+            PipelineWeightCache::save(d->pipeline_weight_cache_path.c_str(), pipeline_weight_cache_key, ctx.typeindexes, ctx.weight_hashes, ctx.pipeline_weights);
+        }
+    }
+
+    if (ret == 0 && ctx.autotune_db && ctx.autotune_db->dirty && !d->autotune_cache_path.empty())
+    {
+        ctx.autotune_db->save(d->autotune_cache_path.c_str());
+    }
+
+    delete ctx.autotune_db;
+#endif // NCNN_STDIO
+
+    if (ret == 0)
+    {
+        d->build_execution_plans();
+    }
+
+    delete d->thread_planner;
+    d->thread_planner = 0;
+    if (ret == 0 && opt.use_adaptive_threads && !opt.use_vulkan_compute)
+    {
+        d->thread_planner = new LayerThreadPlanner(layer_count);
+
+        // calibrate the default thread count now instead of in the first extract
+        get_parallel_cost(opt.num_threads);
+    }
+
+    if (opt.use_local_pool_allocator)
+    {
+        if (opt.blob_allocator == 0)
+        {
+            if (!d->local_blob_allocator)
+            {
+                d->local_blob_allocator = new PoolAllocator;
+                d->local_blob_allocator->set_size_compare_ratio(0.f);
+                d->local_blob_allocator->set_use_hugepage(opt.use_hugepage);
+            }
+        }
+        if (opt.workspace_allocator == 0)
+        {
+            if (!d->local_workspace_allocator)
+            {
+                d->local_workspace_allocator = new PoolAllocator;
+                d->local_workspace_allocator->set_size_compare_ratio(0.5f);
+                d->local_workspace_allocator->set_use_hugepage(opt.use_hugepage);
+            }
+        }
+
+        // node local pools for bound extractors, blocks are first touched on their node
+        if (opt.use_numa_replica && d->numa_blob_allocators.empty() && get_numa_node_count() > 1)
+        {
+            const int node_count = get_numa_node_count();
+            d->numa_blob_allocators.resize(node_count);
+            d->numa_workspace_allocators.resize(node_count);
+            for (int i = 0; i < node_count; i++)
+            {
+                d->numa_blob_allocators[i] = new PoolAllocator;
+                d->numa_blob_allocators[i]->set_size_compare_ratio(0.f);
+                d->numa_blob_allocators[i]->set_use_hugepage(opt.use_hugepage);
+                d->numa_workspace_allocators[i] = new PoolAllocator;
+                d->numa_workspace_allocators[i]->set_size_compare_ratio(0.5f);
+                d->numa_workspace_allocators[i]->set_use_hugepage(opt.use_hugepage);
+            }
+        }
+    }
+
+#if NCNN_VULKAN
+    if (opt.use_vulkan_compute)
+    {
+        d->upload_model();
+    }
+#endif // NCNN_VULKAN
+
+    return ret;
+}
+
+#if NCNN_STDIO
+#if NCNN_STRING
+int Net::load_param(FILE* fp)
+{
+    DataReaderFromStdio dr(fp);
+    return load_param(dr);
+}
+
+int Net::load_param_mem(const char* _mem)
+{
+    const unsigned char* mem = (const unsigned char*)_mem;
+    DataReaderFromMemory dr(mem);
+    return load_param(dr);
+}
+
+int Net::load_param(const char* protopath)
+{
+    FILE* fp = fopen(protopath, "rb");
+    if (!fp)
+    {
+        NCNN_LOGE("fopen %s failed", protopath);
+        return -1;
+    }
+
+    int ret = load_param(fp);
+    fclose(fp);
+    return ret;
+}
+#endif // NCNN_STRING
+
+int Net::load_param_bin(FILE* fp)
+{
+    DataReaderFromStdio dr(fp);
+    return load_param_bin(dr);
+}
+
+int Net::load_param_bin(const char* protopath)
+{
+    FILE* fp = fopen(protopath, "rb");
+    if (!fp)
+    {
+        NCNN_LOGE("fopen %s failed", protopath);
+        return -1;
+    }
+
+    int ret = load_param_bin(fp);
+    fclose(fp);
+    return ret;
+}
+
+int Net::load_model(FILE* fp)
+{
+    DataReaderFromStdio dr(fp);
+    return load_model(dr);
+}
+
+int Net::set_pipeline_weight_cache(const char* cachepath)
+{
+    d->pipeline_weight_cache_path = cachepath ? cachepath : "";
+
+    return 0;
+}
+
+int Net::set_autotune_cache(const char* cachepath)
+{
+    d->autotune_cache_path = cachepath ? cachepath : "";
+
+    return 0;
+}
+
+int Net::load_model(const char* modelpath)
+{
+    FILE* fp = fopen(modelpath, "rb");
+    if (!fp)
+    {
         NCNN_LOGE("fopen %s failed", modelpath);
         return -1;
     }
@@ -1975,6 +3208,25 @@ int Net::load_model(const char* modelpath)
     fclose(fp);
     return ret;
 }
+
+int Net::load_model_mmap(const char* modelpath)
+{
+    DataReaderFromMmap* dr = new DataReaderFromMmap(modelpath);
+    if (dr->empty())
+    {
+        NCNN_LOGE("mmap %s failed", modelpath);
+        delete dr;
+        return -1;
+    }
+
+    int ret = load_model(*dr);
+
+    // reloaded layers no longer reference the previous mapping
+    delete d->model_mmap;
+    d->model_mmap = dr;
+
+    return ret;
+}
 #endif // NCNN_STDIO
 
 int Net::load_param(const unsigned char* _mem)
@@ -2062,41 +3314,37 @@ int Net::load_model(AAssetManager* mgr, const char* assetpath)
 void Net::clear()
 {
     d->blobs.clear();
+    d->layer_kernel_choices.clear();
     for (size_t i = 0; i < d->layers.size(); i++)
     {
-        Layer* layer = d->layers[i];
+        d->destroy_layer(d->layers[i]);
+    }
+    d->layers.clear();
 
-        Option opt1 = opt;
-        if (!layer->support_image_storage)
+    for (size_t i = 0; i < d->numa_layers.size(); i++)
+    {
+        for (size_t j = 0; j < d->numa_layers[i].size(); j++)
         {
-            opt1.use_image_storage = false;
+            d->destroy_layer(d->numa_layers[i][j]);
         }
+    }
+    d->numa_layers.clear();
+    d->layer_params.clear();
+#if NCNN_STDIO
+    d->layer_param_hashes.clear();
+#endif // NCNN_STDIO
 
-        int dret = layer->destroy_pipeline(opt1);
-        if (dret != 0)
-        {
-            NCNN_LOGE("layer destroy_pipeline failed");
-            // ignore anyway
-        }
+    for (size_t i = 0; i < d->numa_blob_allocators.size(); i++)
+    {
+        delete d->numa_blob_allocators[i];
+        delete d->numa_workspace_allocators[i];
+    }
+    d->numa_blob_allocators.clear();
+    d->numa_workspace_allocators.clear();
+    d->execution_plans.clear();
 
-        if (layer->typeindex & ncnn::LayerType::CustomBit)
-        {
-            int custom_index = layer->typeindex & ~ncnn::LayerType::CustomBit;
-            if (d->custom_layer_registry[custom_index].destroyer)
-            {
-                d->custom_layer_registry[custom_index].destroyer(layer, d->custom_layer_registry[custom_index].userdata);
-            }
-            else
-            {
-                delete layer;
-            }
-        }
-        else
-        {
-            delete layer;
-        }
-    }
-    d->layers.clear();
+    delete d->thread_planner;
+    d->thread_planner = 0;
 
     if (d->local_blob_allocator)
     {
@@ -2109,6 +3357,24 @@ void Net::clear()
         d->local_workspace_allocator = 0;
     }
 
+    d->memory_plan.clear();
+
+#if NCNN_STDIO
+    // cached pipeline weights live in the mapping until layers are gone
+    if (d->pipeline_weight_cache)
+    {
+        delete d->pipeline_weight_cache;
+        d->pipeline_weight_cache = 0;
+    }
+
+    // mapped weights are referenced until layers are gone
+    if (d->model_mmap)
+    {
+        delete d->model_mmap;
+        d->model_mmap = 0;
+    }
+#endif // NCNN_STDIO
+
 #if NCNN_VULKAN
     if (d->weight_vkallocator)
     {
@@ -2134,6 +3400,16 @@ Extractor Net::create_extractor() const
     return Extractor(this, d->blobs.size());
 }
 
+size_t Net::memory_plan_size() const
+{
+    return d->memory_plan.arena_size();
+}
+
+size_t Net::memory_plan_miss_count() const
+{
+    return d->memory_plan.miss_count();
+}
+
 const std::vector<int>& Net::input_indexes() const
 {
     return d->input_blob_indexes;
@@ -2201,85 +3477,505 @@ int Net::find_blob_index_by_name(const char* name) const
         const Blob& blob = d->blobs[i];
         if (blob.name == name)
         {
-            return static_cast<int>(i);
+            return static_cast<int>(i);
+        }
+    }
+
+    NCNN_LOGE("find_blob_index_by_name %s failed", name);
+    return -1;
+}
+
+int Net::find_layer_index_by_name(const char* name) const
+{
+    for (size_t i = 0; i < d->layers.size(); i++)
+    {
+        const Layer* layer = d->layers[i];
+        if (layer->name == name)
+        {
+            return static_cast<int>(i);
+        }
+    }
+
+    NCNN_LOGE("find_layer_index_by_name %s failed", name);
+    return -1;
+}
+
+int Net::custom_layer_to_index(const char* type)
+{
+    const size_t custom_layer_registry_entry_count = d->custom_layer_registry.size();
+    for (size_t i = 0; i < custom_layer_registry_entry_count; i++)
+    {
+        if (strcmp(type, d->custom_layer_registry[i].name) == 0)
+            return static_cast<int>(i);
+    }
+
+    return -1;
+}
+
+Layer* Net::create_custom_layer(const char* type)
+{
+    int index = custom_layer_to_index(type);
+    if (index == -1)
+        return 0;
+
+    return create_custom_layer(index);
+}
+#endif // NCNN_STRING
+
+Layer* Net::create_custom_layer(int index)
+{
+    const size_t custom_layer_registry_entry_count = d->custom_layer_registry.size();
+    if (index < 0 || static_cast<unsigned int>(index) >= custom_layer_registry_entry_count)
+        return 0;
+
+    layer_creator_func layer_creator = d->custom_layer_registry[index].creator;
+    if (!layer_creator)
+        return 0;
+
+    Layer* layer = layer_creator(d->custom_layer_registry[index].userdata);
+    layer->typeindex = ncnn::LayerType::CustomBit | index;
+    return layer;
+}
+
+struct execution_plan_blob_available
+{
+    execution_plan_blob_available(const std::vector<Mat>& _blob_mats)
+        : blob_mats(_blob_mats)
+    {
+    }
+
+    bool operator()(int blob_index) const
+    {
+        return blob_mats[blob_index].dims != 0;
+    }
+
+    const std::vector<Mat>& blob_mats;
+};
+
+#if NCNN_VULKAN
+struct execution_plan_blob_available_gpu
+{
+    execution_plan_blob_available_gpu(const std::vector<Mat>& _blob_mats, const std::vector<VkMat>& _blob_mats_gpu)
+        : blob_mats(_blob_mats), blob_mats_gpu(_blob_mats_gpu)
+    {
+    }
+
+    bool operator()(int blob_index) const
+    {
+        return blob_mats[blob_index].dims != 0 || blob_mats_gpu[blob_index].dims != 0;
+    }
+
+    const std::vector<Mat>& blob_mats;
+    const std::vector<VkMat>& blob_mats_gpu;
+};
+
+struct execution_plan_blob_available_gpu_image
+{
+    execution_plan_blob_available_gpu_image(const std::vector<Mat>& _blob_mats, const std::vector<VkMat>& _blob_mats_gpu, const std::vector<VkImageMat>& _blob_mats_gpu_image)
+        : blob_mats(_blob_mats), blob_mats_gpu(_blob_mats_gpu), blob_mats_gpu_image(_blob_mats_gpu_image)
+    {
+    }
+
+    bool operator()(int blob_index) const
+    {
+        return blob_mats[blob_index].dims != 0 || blob_mats_gpu[blob_index].dims != 0 || blob_mats_gpu_image[blob_index].dims != 0;
+    }
+
+    const std::vector<Mat>& blob_mats;
+    const std::vector<VkMat>& blob_mats_gpu;
+    const std::vector<VkImageMat>& blob_mats_gpu_image;
+};
+#endif // NCNN_VULKAN
+
+class ExtractorPrivate
+{
+public:
+    ExtractorPrivate(const Net* _net)
+        : net(_net)
+    {
+        memory_plan_allocator = 0;
+        profiler = 0;
+        numa_node = -1;
+        thread_affinity_id = 0;
+        local_workspace_allocator = 0;
+    }
+
+    // collect the layers that must run for producing blob_index into layer_queue
+    // layers whose needed top blobs are all available already are skipped
+    // return 0 if success
+    template<typename T>
+    int resolve_execution_plan(const NetPrivate* netd, int blob_index, const T& blob_available);
+
+    // forward the layers needed for blob_index on cpu
+    // return 0 if success
+    int forward(const NetPrivate* netd, int blob_index);
+
+    // forward the layers needed for blob_index on cpu for every sample, layer by layer
+    // return 0 if success
+    int forward_batch(const NetPrivate* netd, int blob_index);
+
+    // convert extracted blob to the layout and precision requested by type
+    void convert_output(const NetPrivate* netd, Mat& feat, int type) const;
+
+    // detach blob mats and allocator pointing into another extractor memory plan arena
+    void detach_memory_plan(const Allocator* allocator);
+
+    // create or destroy the profiler, a new profiler starts with no records
+    void set_profiling(bool enable);
+
+    // bind the calling thread and its openmp threads to thread_affinity_mask
+    // unless this thread carries the binding already
+    void bind_thread_affinity();
+
+    // new binding from set_numa_node or set_thread_affinity, empty mask for no binding
+    void update_thread_affinity(const CpuSet& mask);
+
+    // allocator is null or one of the pool and plan allocators owned by the net or this extractor
+    bool thread_safe_allocator(const NetPrivate* netd, const Allocator* allocator) const;
+
+    // a workspace pool not shared with the other streams
+    void create_local_workspace_allocator();
+
+    // take over the binding of rhs, with a private workspace pool of our own
+    void assign_thread_affinity(const ExtractorPrivate* rhs);
+
+    const Net* net;
+    std::vector<Mat> blob_mats;
+    Option opt;
+
+    // per-sample blob mats for batched input and extract
+    std::vector<std::vector<Mat> > batch_blob_mats;
+
+    MemoryPlanAllocator* memory_plan_allocator;
+
+    // null unless profiling is enabled
+    LayerProfiler* profiler;
+
+    // -1 unless set_numa_node
+    int numa_node;
+
+    // cores from set_numa_node or set_thread_affinity
+    // thread_affinity_id identifies the binding, 0 for none
+    CpuSet thread_affinity_mask;
+    int thread_affinity_id;
+
+    // private workspace pool of an extractor with explicit thread affinity
+    PoolAllocator* local_workspace_allocator;
+
+    // execution plan scratch, reused across extract calls
+    std::vector<int> local_plan;
+    std::vector<unsigned char> blob_needed;
+    // layers to run in reverse execution order
+    std::vector<int> layer_queue;
+
+#if NCNN_VULKAN
+    VkAllocator* local_blob_vkallocator;
+    VkAllocator* local_staging_vkallocator;
+
+    std::vector<VkMat> blob_mats_gpu;
+    std::vector<VkImageMat> blob_mats_gpu_image;
+#endif // NCNN_VULKAN
+};
+
+template<typename T>
+int ExtractorPrivate::resolve_execution_plan(const NetPrivate* netd, int blob_index, const T& blob_available)
+{
+    const std::vector<int>* plan = 0;
+    if (blob_index < (int)netd->execution_plans.size() && !netd->execution_plans[blob_index].empty())
+    {
+        plan = &netd->execution_plans[blob_index];
+    }
+    else
+    {
+        netd->build_execution_plan(blob_index, local_plan);
+        plan = &local_plan;
+    }
+
+    blob_needed.resize(netd->blobs.size());
+    memset(&blob_needed[0], 0, blob_needed.size());
+    blob_needed[blob_index] = 1;
+
+    layer_queue.clear();
+
+    // walk consumers before producers and propagate the missing blobs
+    for (int i = (int)plan->size() - 1; i >= 0; i--)
+    {
+        const int layer_index = (*plan)[i];
+        const Layer* layer = netd->layers[layer_index];
+
+        bool needed = false;
+        for (size_t j = 0; j < layer->tops.size(); j++)
+        {
+            if (blob_needed[layer->tops[j]])
+            {
+                needed = true;
+                break;
+            }
+        }
+
+        if (!needed)
+            continue;
+
+        if (layer->typeindex == LayerType::Input)
+        {
+#if NCNN_STRING
+            NCNN_LOGE("input blob %s not set", netd->blobs[layer->tops[0]].name.c_str());
+#else
+            NCNN_LOGE("input blob %d not set", layer->tops[0]);
+#endif
+            return -1;
+        }
+
+        layer_queue.push_back(layer_index);
+
+        for (size_t j = 0; j < layer->bottoms.size(); j++)
+        {
+            int bottom_blob_index = layer->bottoms[j];
+            if (!blob_available(bottom_blob_index))
+            {
+                blob_needed[bottom_blob_index] = 1;
+            }
+        }
+    }
+
+    return 0;
+}
+
+static int g_thread_affinity_id = 0;
+
+// serializes an allocator that may not be thread-safe
+class SerializedAllocator : public Allocator
+{
+public:
+    SerializedAllocator(Allocator* _allocator)
+        : allocator(_allocator)
+    {
+    }
+
+    virtual void* fastMalloc(size_t size)
+    {
+        MutexLockGuard guard(lock);
+        return allocator->fastMalloc(size);
+    }
+
+    virtual void fastFree(void* ptr)
+    {
+        MutexLockGuard guard(lock);
+        allocator->fastFree(ptr);
+    }
+
+private:
+    Allocator* allocator;
+    Mutex lock;
+};
+
+void ExtractorPrivate::bind_thread_affinity()
+{
+    ncnn::bind_thread_affinity(thread_affinity_mask, thread_affinity_id);
+}
+
+void ExtractorPrivate::update_thread_affinity(const CpuSet& mask)
+{
+    thread_affinity_mask = mask;
+    thread_affinity_id = mask.num_enabled() > 0 ? NCNN_XADD(&g_thread_affinity_id, 1) + 1 : 0;
+}
+
+bool ExtractorPrivate::thread_safe_allocator(const NetPrivate* netd, const Allocator* allocator) const
+{
+    return allocator == 0
+           || allocator == memory_plan_allocator
+           || allocator == local_workspace_allocator
+           || allocator == netd->get_local_blob_allocator(numa_node)
+           || allocator == netd->get_local_workspace_allocator(numa_node);
+}
+
+void ExtractorPrivate::create_local_workspace_allocator()
+{
+    if (local_workspace_allocator)
+        return;
+
+    local_workspace_allocator = new PoolAllocator;
+    local_workspace_allocator->set_size_compare_ratio(0.5f);
+    local_workspace_allocator->set_use_hugepage(opt.use_hugepage);
+}
+
+void ExtractorPrivate::assign_thread_affinity(const ExtractorPrivate* rhs)
+{
+    numa_node = rhs->numa_node;
+    thread_affinity_mask = rhs->thread_affinity_mask;
+    thread_affinity_id = rhs->thread_affinity_id;
+
+    if (rhs->local_workspace_allocator)
+    {
+        create_local_workspace_allocator();
+    }
+
+    if (rhs->local_workspace_allocator && opt.workspace_allocator == rhs->local_workspace_allocator)
+    {
+        opt.workspace_allocator = local_workspace_allocator;
+    }
+}
+
+int ExtractorPrivate::forward(const NetPrivate* netd, int blob_index)
+{
+    int ret = resolve_execution_plan(netd, blob_index, execution_plan_blob_available(blob_mats));
+    if (ret != 0)
+        return ret;
+
+    bind_thread_affinity();
+
+#if NCNN_THREADS
+    if (opt.use_branch_parallel && opt.num_threads > 1 && layer_queue.size() > 1)
+    {
+        // allocators from the user may not be thread-safe, serialize them while branches run
+        SerializedAllocator blob_allocator(opt.blob_allocator);
+        SerializedAllocator workspace_allocator(opt.workspace_allocator);
+
+        Option opt_parallel = opt;
+        if (!thread_safe_allocator(netd, opt.blob_allocator))
+        {
+            opt_parallel.blob_allocator = &blob_allocator;
+        }
+        if (!thread_safe_allocator(netd, opt.workspace_allocator))
+        {
+            opt_parallel.workspace_allocator = opt.workspace_allocator == opt.blob_allocator ? (Allocator*)&blob_allocator : (Allocator*)&workspace_allocator;
+        }
+
+        ret = netd->forward_layers_parallel(layer_queue, blob_mats, opt_parallel, profiler, numa_node, thread_affinity_mask, thread_affinity_id);
+
+        // blobs outlive the wrappers
+        for (size_t i = 0; i < blob_mats.size(); i++)
+        {
+            if (blob_mats[i].allocator == &blob_allocator)
+                blob_mats[i].allocator = opt.blob_allocator;
+            else if (blob_mats[i].allocator == &workspace_allocator)
+                blob_mats[i].allocator = opt.workspace_allocator;
+        }
+
+        return ret;
+    }
+#endif // NCNN_THREADS
+
+    for (int i = (int)layer_queue.size() - 1; i >= 0; i--)
+    {
+        ret = netd->forward_layer(layer_queue[i], blob_mats, opt, profiler, numa_node);
+        if (ret != 0)
+            return ret;
+    }
+
+    return 0;
+}
+
+int ExtractorPrivate::forward_batch(const NetPrivate* netd, int blob_index)
+{
+    // every sample shares the graph, resolve with the first one
+    int ret = resolve_execution_plan(netd, blob_index, execution_plan_blob_available(batch_blob_mats[0]));
+    if (ret != 0)
+        return ret;
+
+    bind_thread_affinity();
+
+    // run each layer over the whole batch before moving on so its weights stay hot in cache
+    for (int i = (int)layer_queue.size() - 1; i >= 0; i--)
+    {
+        ret = netd->forward_layer_batch(layer_queue[i], batch_blob_mats, opt, profiler, numa_node);
+        if (ret != 0)
+            return ret;
+    }
+
+    return 0;
+}
+
+void ExtractorPrivate::convert_output(const NetPrivate* netd, Mat& feat, int type) const
+{
+    if (opt.use_packing_layout && (type == 0) && feat.elempack != 1)
+    {
+        Mat bottom_blob_unpacked;
+        convert_packing(feat, bottom_blob_unpacked, 1, opt);
+        feat = bottom_blob_unpacked;
+    }
+
+    // clang-format off
+    // *INDENT-OFF*
+#if NCNN_ARM82
+    if (opt.use_fp16_storage && cpu_support_arm_asimdhp() && (type == 0))
+    {
+        if (feat.elembits() == 16)
+        {
+            Mat feat_fp32;
+            cast_float16_to_float32(feat, feat_fp32, opt);
+            feat = feat_fp32;
+        }
+    }
+    else
+#endif // NCNN_ARM82
+#if NCNN_BF16
+    if (opt.use_bf16_storage && (type == 0))
+    {
+        if (feat.elembits() == 16)
+        {
+            Mat feat_fp32;
+            cast_bfloat16_to_float32(feat, feat_fp32, opt);
+            feat = feat_fp32;
         }
     }
-
-    NCNN_LOGE("find_blob_index_by_name %s failed", name);
-    return -1;
-}
-
-int Net::find_layer_index_by_name(const char* name) const
-{
-    for (size_t i = 0; i < d->layers.size(); i++)
+    else
+#endif // NCNN_BF16
+    if (feat.elembits() == 8 && (type == 0))
     {
-        const Layer* layer = d->layers[i];
-        if (layer->name == name)
-        {
-            return static_cast<int>(i);
-        }
+        Mat feat_fp32;
+        cast_int8_to_float32(feat, feat_fp32, opt);
+        feat = feat_fp32;
     }
+    // *INDENT-ON*
+    // clang-format on
 
-    NCNN_LOGE("find_layer_index_by_name %s failed", name);
-    return -1;
-}
-
-int Net::custom_layer_to_index(const char* type)
-{
-    const size_t custom_layer_registry_entry_count = d->custom_layer_registry.size();
-    for (size_t i = 0; i < custom_layer_registry_entry_count; i++)
+    if (opt.use_local_pool_allocator && feat.allocator == netd->get_local_blob_allocator(numa_node))
     {
-        if (strcmp(type, d->custom_layer_registry[i].name) == 0)
-            return static_cast<int>(i);
+        // detach the returned mat from local pool allocator
+        // so we could destroy net instance much earlier
+        feat = feat.clone();
     }
 
-    return -1;
+    if (memory_plan_allocator && feat.allocator == memory_plan_allocator)
+    {
+        // detach the returned mat from memory plan arena
+        // the arena is reused for other blobs and released with extractor
+        feat = feat.clone();
+    }
 }
 
-Layer* Net::create_custom_layer(const char* type)
+void ExtractorPrivate::set_profiling(bool enable)
 {
-    int index = custom_layer_to_index(type);
-    if (index == -1)
-        return 0;
-
-    return create_custom_layer(index);
+    if (enable && !profiler)
+    {
+        profiler = new LayerProfiler;
+    }
+    if (!enable && profiler)
+    {
+        delete profiler;
+        profiler = 0;
+    }
 }
-#endif // NCNN_STRING
 
-Layer* Net::create_custom_layer(int index)
+void ExtractorPrivate::detach_memory_plan(const Allocator* allocator)
 {
-    const size_t custom_layer_registry_entry_count = d->custom_layer_registry.size();
-    if (index < 0 || static_cast<unsigned int>(index) >= custom_layer_registry_entry_count)
-        return 0;
-
-    layer_creator_func layer_creator = d->custom_layer_registry[index].creator;
-    if (!layer_creator)
-        return 0;
-
-    Layer* layer = layer_creator(d->custom_layer_registry[index].userdata);
-    layer->typeindex = ncnn::LayerType::CustomBit | index;
-    return layer;
-}
+    if (!allocator)
+        return;
 
-class ExtractorPrivate
-{
-public:
-    ExtractorPrivate(const Net* _net)
-        : net(_net)
+    for (size_t i = 0; i < blob_mats.size(); i++)
     {
+        if (blob_mats[i].allocator == allocator)
+        {
+            blob_mats[i] = blob_mats[i].clone();
+        }
     }
-    const Net* net;
-    std::vector<Mat> blob_mats;
-    Option opt;
-
-#if NCNN_VULKAN
-    VkAllocator* local_blob_vkallocator;
-    VkAllocator* local_staging_vkallocator;
 
-    std::vector<VkMat> blob_mats_gpu;
-    std::vector<VkImageMat> blob_mats_gpu_image;
-#endif // NCNN_VULKAN
-};
+    if (opt.blob_allocator == allocator)
+    {
+        opt.blob_allocator = 0;
+    }
+}
 
 Extractor::Extractor(const Net* _net, size_t blob_count)
     : d(new ExtractorPrivate(_net))
@@ -2303,6 +3999,10 @@ Extractor::~Extractor()
 {
     clear();
 
+    delete d->profiler;
+
+    delete d->local_workspace_allocator;
+
     delete d;
 }
 
@@ -2311,7 +4011,11 @@ Extractor::Extractor(const Extractor& rhs)
 {
     d->net = rhs.d->net;
     d->blob_mats = rhs.d->blob_mats;
+    d->batch_blob_mats = rhs.d->batch_blob_mats;
     d->opt = rhs.d->opt;
+    d->detach_memory_plan(rhs.d->memory_plan_allocator);
+    d->set_profiling(rhs.d->profiler != 0);
+    d->assign_thread_affinity(rhs.d);
 
 #if NCNN_VULKAN
     d->local_blob_vkallocator = 0;
@@ -2329,7 +4033,11 @@ Extractor& Extractor::operator=(const Extractor& rhs)
 
     d->net = rhs.d->net;
     d->blob_mats = rhs.d->blob_mats;
+    d->batch_blob_mats = rhs.d->batch_blob_mats;
     d->opt = rhs.d->opt;
+    d->detach_memory_plan(rhs.d->memory_plan_allocator);
+    d->set_profiling(rhs.d->profiler != 0);
+    d->assign_thread_affinity(rhs.d);
 
 #if NCNN_VULKAN
     d->local_blob_vkallocator = 0;
@@ -2345,6 +4053,18 @@ Extractor& Extractor::operator=(const Extractor& rhs)
 void Extractor::clear()
 {
     d->blob_mats.clear();
+    d->batch_blob_mats.clear();
+
+    if (d->memory_plan_allocator)
+    {
+        if (d->opt.blob_allocator == d->memory_plan_allocator)
+        {
+            d->opt.blob_allocator = 0;
+        }
+
+        delete d->memory_plan_allocator;
+        d->memory_plan_allocator = 0;
+    }
 
 #if NCNN_VULKAN
     if (d->opt.use_vulkan_compute)
@@ -2384,6 +4104,99 @@ void Extractor::set_workspace_allocator(Allocator* allocator)
     d->opt.workspace_allocator = allocator;
 }
 
+void Extractor::set_numa_node(int node)
+{
+    if (node >= get_numa_node_count())
+    {
+        NCNN_LOGE("numa node %d not exists", node);
+        return;
+    }
+
+    d->numa_node = node < 0 ? -1 : node;
+
+    CpuSet mask;
+    mask.disable_all();
+    d->update_thread_affinity(node < 0 ? mask : get_numa_node_cpuset(node));
+}
+
+void Extractor::set_thread_affinity(const CpuSet& thread_affinity_mask)
+{
+    d->update_thread_affinity(thread_affinity_mask);
+
+    if (d->thread_affinity_id == 0)
+        return;
+
+    // one openmp thread per core of the set
+    const int num_enabled = thread_affinity_mask.num_enabled();
+    if (d->opt.num_threads > num_enabled)
+    {
+        d->opt.num_threads = num_enabled;
+    }
+
+    d->create_local_workspace_allocator();
+}
+
+void Extractor::set_profiling(bool enable)
+{
+    d->set_profiling(enable);
+}
+
+const std::vector<LayerProfile>& Extractor::profile_records() const
+{
+    static const std::vector<LayerProfile> empty_records;
+    return d->profiler ? d->profiler->records : empty_records;
+}
+
+void Extractor::clear_profile_records()
+{
+    if (d->profiler)
+    {
+        d->profiler->records.clear();
+    }
+}
+
+#if NCNN_STDIO
+void print_layer_profiles(const std::vector<LayerProfile>& records, FILE* fp)
+{
+    double total_time = 0;
+    uint64_t total_macs = 0;
+    uint64_t total_bytes = 0;
+
+    fprintf(fp, "%-24s %-30s %10s %10s %10s %10s %8s\n", "type", "name", "time(ms)", "MMACs", "GFLOPS", "GB/s", "flop/B");
+    for (size_t i = 0; i < records.size(); i++)
+    {
+        const LayerProfile& r = records[i];
+        const double time = r.end - r.start;
+        const uint64_t bytes = r.bytes_read + r.bytes_written;
+
+        total_time += time;
+        total_macs += r.macs;
+        total_bytes += bytes;
+
+        // sub-timer-resolution layers report zero throughput
+        const double seconds = time / 1000.0;
+        const double gflops = seconds > 0 ? r.macs * 2 / seconds / 1e9 : 0.0;
+        const double gbps = seconds > 0 ? bytes / seconds / 1e9 : 0.0;
+        const double intensity = bytes ? r.macs * 2.0 / bytes : 0.0;
+
+#if NCNN_STRING
+        fprintf(fp, "%-24s %-30s", r.type, r.name);
+#else
+        fprintf(fp, "%-24d %-30d", r.typeindex, r.layer_index);
+#endif
+        fprintf(fp, " %10.3f %10.2f %10.2f %10.2f %8.2f\n", time, r.macs / 1e6, gflops, gbps, intensity);
+    }
+
+    const double total_seconds = total_time / 1000.0;
+    fprintf(fp, "%-24s %-30s %10.3f %10.2f %10.2f %10.2f %8.2f\n", "total", "",
+            total_time,
+            total_macs / 1e6,
+            total_seconds > 0 ? total_macs * 2 / total_seconds / 1e9 : 0.0,
+            total_seconds > 0 ? total_bytes / total_seconds / 1e9 : 0.0,
+            total_bytes ? total_macs * 2.0 / total_bytes : 0.0);
+}
+#endif // NCNN_STDIO
+
 #if NCNN_VULKAN
 void Extractor::set_vulkan_compute(bool enable)
 {
@@ -2476,18 +4289,23 @@ int Extractor::extract(int blob_index, Mat& feat, int type)
 
     if (d->blob_mats[blob_index].dims == 0)
     {
-        int layer_index = d->net->blobs()[blob_index].producer;
+        // use memory plan allocator
+        if (d->opt.use_memory_plan && !d->opt.blob_allocator)
+        {
+            d->memory_plan_allocator = new MemoryPlanAllocator(&d->net->d->memory_plan);
+            d->opt.blob_allocator = d->memory_plan_allocator;
+        }
 
         // use local allocator
         if (d->opt.use_local_pool_allocator)
         {
             if (!d->opt.blob_allocator)
             {
-                d->opt.blob_allocator = d->net->d->local_blob_allocator;
+                d->opt.blob_allocator = d->net->d->get_local_blob_allocator(d->numa_node);
             }
             if (!d->opt.workspace_allocator)
             {
-                d->opt.workspace_allocator = d->net->d->local_workspace_allocator;
+                d->opt.workspace_allocator = d->local_workspace_allocator ? d->local_workspace_allocator : d->net->d->get_local_workspace_allocator(d->numa_node);
             }
         }
 
@@ -2573,62 +4391,153 @@ int Extractor::extract(int blob_index, Mat& feat, int type)
         }
         else
         {
-            ret = d->net->d->forward_layer(layer_index, d->blob_mats, d->opt);
+            ret = d->forward(d->net->d, blob_index);
         }
 #else
-        ret = d->net->d->forward_layer(layer_index, d->blob_mats, d->opt);
+        ret = d->forward(d->net->d, blob_index);
 #endif // NCNN_VULKAN
     }
 
     feat = d->blob_mats[blob_index];
 
-    if (d->opt.use_packing_layout && (type == 0) && feat.elempack != 1)
+    d->convert_output(d->net->d, feat, type);
+
+    set_kmp_blocktime(old_blocktime);
+    set_flush_denormals(old_flush_denormals);
+
+    return ret;
+}
+
+#if NCNN_STRING
+int Extractor::input(const char* blob_name, const std::vector<Mat>& in)
+{
+    int blob_index = d->net->find_blob_index_by_name(blob_name);
+    if (blob_index == -1)
     {
-        Mat bottom_blob_unpacked;
-        convert_packing(feat, bottom_blob_unpacked, 1, d->opt);
-        feat = bottom_blob_unpacked;
+        NCNN_LOGE("Try");
+        const std::vector<const char*>& input_names = d->net->input_names();
+        for (size_t i = 0; i < input_names.size(); i++)
+        {
+            NCNN_LOGE("    ex.input(\"%s\", in%d);", input_names[i], (int)i);
+        }
+
+        return -1;
     }
 
-    // clang-format off
-    // *INDENT-OFF*
-#if NCNN_ARM82
-    if (d->opt.use_fp16_storage && cpu_support_arm_asimdhp() && (type == 0))
+    return input(blob_index, in);
+}
+
+int Extractor::extract(const char* blob_name, std::vector<Mat>& feats, int type)
+{
+    int blob_index = d->net->find_blob_index_by_name(blob_name);
+    if (blob_index == -1)
     {
-        if (feat.elembits() == 16)
+        NCNN_LOGE("Try");
+        const std::vector<const char*>& output_names = d->net->output_names();
+        for (size_t i = 0; i < output_names.size(); i++)
         {
-            Mat feat_fp32;
-            cast_float16_to_float32(feat, feat_fp32, d->opt);
-            feat = feat_fp32;
+            NCNN_LOGE("    ex.extract(\"%s\", out%d);", output_names[i], (int)i);
         }
+
+        return -1;
     }
-    else
-#endif // NCNN_ARM82
-#if NCNN_BF16
-    if (d->opt.use_bf16_storage && (type == 0))
+
+    return extract(blob_index, feats, type);
+}
+#endif // NCNN_STRING
+
+int Extractor::input(int blob_index, const std::vector<Mat>& in)
+{
+    if (blob_index < 0 || blob_index >= (int)d->blob_mats.size())
+        return -1;
+
+    if (in.empty())
+        return -1;
+
+    if (d->batch_blob_mats.empty())
     {
-        if (feat.elembits() == 16)
+        d->batch_blob_mats.resize(in.size());
+        for (size_t b = 0; b < in.size(); b++)
         {
-            Mat feat_fp32;
-            cast_bfloat16_to_float32(feat, feat_fp32, d->opt);
-            feat = feat_fp32;
+            d->batch_blob_mats[b].resize(d->blob_mats.size());
         }
     }
-    else
-#endif // NCNN_BF16
-    if (feat.elembits() == 8 && (type == 0))
+    else if (d->batch_blob_mats.size() != in.size())
     {
-        Mat feat_fp32;
-        cast_int8_to_float32(feat, feat_fp32, d->opt);
-        feat = feat_fp32;
+        NCNN_LOGE("input batch size %d mismatch, previous batch size is %d", (int)in.size(), (int)d->batch_blob_mats.size());
+        return -1;
     }
-    // *INDENT-ON*
-    // clang-format on
 
-    if (d->opt.use_local_pool_allocator && feat.allocator == d->net->d->local_blob_allocator)
+    for (size_t b = 0; b < in.size(); b++)
     {
-        // detach the returned mat from local pool allocator
-        // so we could destroy net instance much earlier
-        feat = feat.clone();
+        d->batch_blob_mats[b][blob_index] = in[b];
+    }
+
+    return 0;
+}
+
+int Extractor::extract(int blob_index, std::vector<Mat>& feats, int type)
+{
+    if (blob_index < 0 || blob_index >= (int)d->blob_mats.size())
+        return -1;
+
+    if (d->batch_blob_mats.empty())
+    {
+        NCNN_LOGE("batched extract requires batched input");
+        return -1;
+    }
+
+    const int batch = (int)d->batch_blob_mats.size();
+
+    feats.resize(batch);
+
+#if NCNN_VULKAN
+    if (d->opt.use_vulkan_compute)
+    {
+        // gpu runs the samples one after another
+        int ret = 0;
+        for (int b = 0; b < batch && ret == 0; b++)
+        {
+            std::swap(d->blob_mats, d->batch_blob_mats[b]);
+            ret = extract(blob_index, feats[b], type);
+            std::swap(d->blob_mats, d->batch_blob_mats[b]);
+        }
+
+        return ret;
+    }
+#endif // NCNN_VULKAN
+
+    int old_blocktime = get_kmp_blocktime();
+    set_kmp_blocktime(d->opt.openmp_blocktime);
+
+    int old_flush_denormals = get_flush_denormals();
+    set_flush_denormals(d->opt.flush_denormals);
+
+    int ret = 0;
+
+    if (d->batch_blob_mats[0][blob_index].dims == 0)
+    {
+        // use local allocator
+        if (d->opt.use_local_pool_allocator)
+        {
+            if (!d->opt.blob_allocator)
+            {
+                d->opt.blob_allocator = d->net->d->get_local_blob_allocator(d->numa_node);
+            }
+            if (!d->opt.workspace_allocator)
+            {
+                d->opt.workspace_allocator = d->local_workspace_allocator ? d->local_workspace_allocator : d->net->d->get_local_workspace_allocator(d->numa_node);
+            }
+        }
+
+        ret = d->forward_batch(d->net->d, blob_index);
+    }
+
+    for (int b = 0; b < batch; b++)
+    {
+        feats[b] = d->batch_blob_mats[b][blob_index];
+
+        d->convert_output(d->net->d, feats[b], type);
     }
 
     set_kmp_blocktime(old_blocktime);
@@ -2749,8 +4658,11 @@ int Extractor::extract(int blob_index, VkMat& feat, VkCompute& cmd)
         }
         else
         {
-            int layer_index = d->net->blobs()[blob_index].producer;
-            ret = d->net->d->forward_layer(layer_index, d->blob_mats, d->blob_mats_gpu, cmd, d->opt);
+            ret = d->resolve_execution_plan(d->net->d, blob_index, execution_plan_blob_available_gpu(d->blob_mats, d->blob_mats_gpu));
+            for (int i = (int)d->layer_queue.size() - 1; i >= 0 && ret == 0; i--)
+            {
+                ret = d->net->d->forward_layer(d->layer_queue[i], d->blob_mats, d->blob_mats_gpu, cmd, d->opt);
+            }
         }
     }
 
@@ -2799,8 +4711,11 @@ int Extractor::extract(int blob_index, VkImageMat& feat, VkCompute& cmd)
         }
         else
         {
-            int layer_index = d->net->blobs()[blob_index].producer;
-            ret = d->net->d->forward_layer(layer_index, d->blob_mats, d->blob_mats_gpu, d->blob_mats_gpu_image, cmd, d->opt);
+            ret = d->resolve_execution_plan(d->net->d, blob_index, execution_plan_blob_available_gpu_image(d->blob_mats, d->blob_mats_gpu, d->blob_mats_gpu_image));
+            for (int i = (int)d->layer_queue.size() - 1; i >= 0 && ret == 0; i--)
+            {
+                ret = d->net->d->forward_layer(d->layer_queue[i], d->blob_mats, d->blob_mats_gpu, d->blob_mats_gpu_image, cmd, d->opt);
+            }
         }
     }
 
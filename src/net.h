@@ -21,6 +21,8 @@
 #include "option.h"
 #include "platform.h"
 
+#include <stdint.h>
+
 #if NCNN_PLATFORM_API
 #if __ANDROID_API__ >= 9
 #include <android/asset_manager.h>
@@ -32,6 +34,7 @@ namespace ncnn {
 #if NCNN_VULKAN
 class VkCompute;
 #endif // NCNN_VULKAN
+class CpuSet;
 class DataReader;
 class Extractor;
 class NetPrivate;
@@ -92,6 +95,24 @@ public:
     // return 0 if success
     int load_model(FILE* fp);
     int load_model(const char* modelpath);
+
+    // map network weight data from model file
+    // weight data is referenced from the mapping instead of copied
+    // so processes loading the same model share its memory
+    // the mapping is retained until clear
+    // return 0 if success
+    int load_model_mmap(const char* modelpath);
+
+    // persistent cache of the weights transformed while loading model
+    // set before load_model, layers found in the cache skip their weight transform
+    // the cache is rewritten when model, cpu isa or options no longer match
+    // return 0 if success
+    int set_pipeline_weight_cache(const char* cachepath);
+
+    // kernel choices measured by opt.use_autotune, keyed by cpu model
+    // set before load_model, layers found in the file skip tuning
+    // return 0 if success
+    int set_autotune_cache(const char* cachepath);
 #endif // NCNN_STDIO
 
     // load network structure from external memory
@@ -129,6 +150,16 @@ public:
     // construct an Extractor from network
     Extractor create_extractor() const;
 
+    // arena size in bytes of the static blob memory plan
+    // the plan is recorded by the first extractor with opt.use_memory_plan enabled
+    // each concurrently alive extractor holds one arena of this size, freed by clear()
+    // return 0 if no plan is available yet
+    size_t memory_plan_size() const;
+
+    // count of blobs extractors served from the heap instead of the memory plan arena
+    // grows when replay misses the plan, as after an input shape change
+    size_t memory_plan_miss_count() const;
+
     // get input/output indexes/names
     const std::vector<int>& input_indexes() const;
     const std::vector<int>& output_indexes() const;
@@ -160,6 +191,41 @@ private:
     NetPrivate* const d;
 };
 
+// one layer run recorded by Extractor profiling
+struct NCNN_EXPORT LayerProfile
+{
+    int layer_index;
+    int typeindex;
+#if NCNN_STRING
+    // point into the layer, valid while the net is alive
+    const char* type;
+    const char* name;
+#endif // NCNN_STRING
+
+    // milliseconds from get_current_time
+    double start;
+    double end;
+
+    int num_threads;
+
+    // storage shape, elempack and elemsize of bottom and top blobs, data is null
+    std::vector<Mat> bottom_shapes;
+    std::vector<Mat> top_shapes;
+
+    // bytes of the top blobs allocated by the layer, zero if computed inplace
+    size_t allocated_bytes;
+
+    // theoretical cost from estimate_layer_workload
+    uint64_t macs;
+    uint64_t bytes_read;
+    uint64_t bytes_written;
+};
+
+#if NCNN_STDIO
+// print time, macs, achieved GFLOPS and GB/s and arithmetic intensity of every record, then the totals
+NCNN_EXPORT void print_layer_profiles(const std::vector<LayerProfile>& records, FILE* fp);
+#endif // NCNN_STDIO
+
 class ExtractorPrivate;
 class NCNN_EXPORT Extractor
 {
@@ -191,6 +257,31 @@ public:
     // set workspace memory allocator
     void set_workspace_allocator(Allocator* allocator);
 
+    // run on the cores of numa node and on its weight replica from opt.use_numa_replica
+    // the calling thread and its openmp threads get bound to the node on the next extract
+    // only the calling thread with the simpleomp runtime
+    // the binding stays after extract, an extractor without binding later on the same thread restores the default cores
+    // without explicit allocators the node local pools of the net are used
+    // -1 = no binding(default)
+    void set_numa_node(int node);
+
+    // run on the given cores, e.g. one get_cpu_partition() per stream for multi-stream inference
+    // the calling thread and its openmp threads get bound to the cores on the next extract
+    // the binding stays after extract, an extractor without binding later on the same thread restores the default cores
+    // caps the thread count to the core count and uses a private workspace pool
+    // overrides the cores picked by set_numa_node, an empty set removes the binding
+    // with the simpleomp runtime the openmp threads are shared by all streams, only the calling thread is bound
+    void set_thread_affinity(const CpuSet& thread_affinity_mask);
+
+    // record a LayerProfile for every layer run on cpu by following extract calls
+    // costs one branch per layer when disabled, which is the default
+    void set_profiling(bool enable);
+
+    // records collected since profiling was enabled or cleared, in run order
+    const std::vector<LayerProfile>& profile_records() const;
+
+    void clear_profile_records();
+
 #if NCNN_VULKAN
     void set_vulkan_compute(bool enable);
 
@@ -223,6 +314,26 @@ public:
     // type = 1, do not convert fp16/bf16 or / and packing
     int extract(int blob_index, Mat& feat, int type = 0);
 
+#if NCNN_STRING
+    // set batched input by blob name, one mat per sample
+    // every batched input must have the same batch size
+    // return 0 if success
+    int input(const char* blob_name, const std::vector<Mat>& in);
+
+    // get batched result by blob name, one mat per sample
+    // layers run once per batch, innerproduct folds the batch into one gemm
+    // return 0 if success
+    int extract(const char* blob_name, std::vector<Mat>& feats, int type = 0);
+#endif // NCNN_STRING
+
+    // set batched input by blob index, one mat per sample
+    // return 0 if success
+    int input(int blob_index, const std::vector<Mat>& in);
+
+    // get batched result by blob index, one mat per sample
+    // return 0 if success
+    int extract(int blob_index, std::vector<Mat>& feats, int type = 0);
+
 #if NCNN_VULKAN
 #if NCNN_STRING
     // set input by blob name
@@ -267,6 +378,64 @@ private:
     ExtractorPrivate* const d;
 };
 
+// completion callback of an AsyncExtractor request, invoked on a worker thread
+// ret is 0 if success, outputs follow the order of the requested output blobs
+typedef void (*async_extract_callback_func)(int ret, std::vector<Mat>& outputs, void* userdata);
+
+class AsyncExtractorPrivate;
+class NCNN_EXPORT AsyncExtractor
+{
+public:
+    // serve requests on net with worker_count threads
+    // each worker reuses its own blob and workspace pool allocator across requests
+    // at most max_inflight requests are queued or running, 0 for twice the worker count
+    AsyncExtractor(const Net* net, int worker_count = 1, int max_inflight = 0);
+
+    // wait for all requests and stop the workers
+    virtual ~AsyncExtractor();
+
+    // set thread count for every request
+    // default is the net thread count divided among workers
+    void set_num_threads(int num_threads);
+
+    // coalesce concurrent requests into one batched forward
+    // a worker waits up to max_delay_us for up to max_batch requests with the same input and output blobs
+    // max_batch = 1 disables batching, which is the default
+    void set_dynamic_batching(int max_batch, int max_delay_us);
+
+    // pin worker i and its openmp threads to get_cpu_partition(i, worker_count)
+    // each worker then runs as an isolated stream on its own cores with its own pools
+    // the thread count of a request is capped to the partition size
+    // takes effect from the next request of each worker, disabled by default
+    // with the simpleomp runtime only the worker threads are pinned, the openmp threads are shared
+    void set_cpu_partitioning(bool enable);
+
+    // histogram[n] is the number of forwards that served n requests at once
+    void get_batch_histogram(std::vector<int>& histogram) const;
+
+    // queue a request, blocks while max_inflight requests are in flight
+    // outputs are passed to callback, or kept for wait() if callback is null
+    // return request id, -1 if failed
+    int submit(const std::vector<int>& input_indexes, const std::vector<Mat>& inputs, const std::vector<int>& output_indexes, async_extract_callback_func callback = 0, void* userdata = 0);
+
+    // queue a request with single input and output
+    int submit(int input_index, const Mat& in, int output_index, async_extract_callback_func callback = 0, void* userdata = 0);
+
+    // wait for a request submitted without callback and take its outputs
+    // return extract status, -1 if request id is unknown
+    int wait(int request_id, std::vector<Mat>& outputs);
+
+    // wait until every submitted request finished
+    void wait_all();
+
+private:
+    AsyncExtractor(const AsyncExtractor&);
+    AsyncExtractor& operator=(const AsyncExtractor&);
+
+private:
+    AsyncExtractorPrivate* const d;
+};
+
 } // namespace ncnn
 
 #endif // NCNN_NET_H
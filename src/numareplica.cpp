@@ -0,0 +1,135 @@
+// Tencent is pleased to support the open source community by making ncnn available.
+//
+// Copyright (C) 2024 THL A29 Limited, a Tencent company. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this file except
+// in compliance with the License. You may obtain a copy of the License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software distributed
+// under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+// CONDITIONS OF ANY KIND, either express or implied. See the License for the
+// specific language governing permissions and limitations under the License.
+
+#include "numareplica.h"
+
+#include "cpu.h"
+#include "kerneltuning.h"
+
+namespace ncnn {
+
+// loads and transforms the layer replicas of one numa node
+struct numa_replica_context
+{
+    const std::vector<Layer*>* layers;
+    std::vector<Layer*>* replicas;
+    const std::vector<ParamDict>* layer_params;
+    const std::vector<std::vector<Mat> >* layer_weights;
+    const std::vector<int>* layer_kernel_choices;
+    Option opt;
+    int node;
+    int ret;
+};
+
+static void* numa_replica_worker(void* args)
+{
+    numa_replica_context* ctx = (numa_replica_context*)args;
+
+    // pages are placed on the node of the thread touching them first
+#if NCNN_SIMPLEOMP
+    // the loaders run concurrently, pinning the shared simpleomp pool threads would race between nodes
+    set_cpu_current_thread_affinity(get_numa_node_cpuset(ctx->node));
+#else
+    set_cpu_thread_affinity(get_numa_node_cpuset(ctx->node));
+#endif
+    set_thread_hugepage_allocation(ctx->opt.use_hugepage);
+
+    Option opt = ctx->opt;
+    opt.blob_allocator = 0;
+    opt.workspace_allocator = 0;
+
+    const std::vector<Layer*>& replicas = *ctx->replicas;
+    for (size_t i = 0; i < replicas.size(); i++)
+    {
+        const Layer* origin = (*ctx->layers)[i];
+        Layer* layer = replicas[i];
+
+        layer->type = origin->type;
+        layer->name = origin->name;
+        layer->bottoms = origin->bottoms;
+        layer->tops = origin->tops;
+        layer->bottom_shapes = origin->bottom_shapes;
+        layer->top_shapes = origin->top_shapes;
+
+        const std::vector<Mat>& weights = (*ctx->layer_weights)[i];
+        std::vector<Mat> local_weights(weights.size());
+        for (size_t j = 0; j < weights.size(); j++)
+        {
+            local_weights[j] = weights[j].clone();
+        }
+
+        ModelBinFromMatArray mb(local_weights.empty() ? 0 : &local_weights[0]);
+
+        Option opt1 = opt;
+        const int kernel_choice = i < ctx->layer_kernel_choices->size() ? (*ctx->layer_kernel_choices)[i] : 0;
+        if (kernel_choice)
+            apply_kernel_choice(opt1, kernel_choice);
+
+        if (layer->load_param((*ctx->layer_params)[i]) != 0 || layer->load_model(mb) != 0 || layer->create_pipeline(opt1) != 0)
+        {
+#if NCNN_STRING
+            NCNN_LOGE("numa node %d replica of layer %d %s failed", ctx->node, (int)i, layer->name.c_str());
+#else
+            NCNN_LOGE("numa node %d replica of layer %d failed", ctx->node, (int)i);
+#endif
+            ctx->ret = -1;
+            break;
+        }
+    }
+
+    set_thread_hugepage_allocation(false);
+
+    return 0;
+}
+
+int load_numa_replicas(const std::vector<Layer*>& layers, std::vector<std::vector<Layer*> >& replicas, const std::vector<ParamDict>& layer_params, const std::vector<std::vector<Mat> >& layer_weights, const std::vector<int>& layer_kernel_choices, const Option& opt)
+{
+    const int node_count = (int)replicas.size();
+
+    std::vector<numa_replica_context> contexts(node_count);
+    std::vector<Thread*> workers(node_count, (Thread*)0);
+
+    for (int node = 0; node < node_count; node++)
+    {
+        if (replicas[node].empty())
+            continue;
+
+        contexts[node].layers = &layers;
+        contexts[node].replicas = &replicas[node];
+        contexts[node].layer_params = &layer_params;
+        contexts[node].layer_weights = &layer_weights;
+        contexts[node].layer_kernel_choices = &layer_kernel_choices;
+        contexts[node].opt = opt;
+        contexts[node].node = node;
+        contexts[node].ret = 0;
+        workers[node] = new Thread(numa_replica_worker, (void*)&contexts[node]);
+    }
+
+    int ret = 0;
+    for (int node = 0; node < node_count; node++)
+    {
+        if (!workers[node])
+            continue;
+
+        workers[node]->join();
+        delete workers[node];
+
+        if (contexts[node].ret != 0)
+            ret = -1;
+    }
+
+    return ret;
+}
+
+} // namespace ncnn
@@ -0,0 +1,56 @@
+// Tencent is pleased to support the open source community by making ncnn available.
+//
+// Copyright (C) 2024 THL A29 Limited, a Tencent company. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this file except
+// in compliance with the License. You may obtain a copy of the License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software distributed
+// under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+// CONDITIONS OF ANY KIND, either express or implied. See the License for the
+// specific language governing permissions and limitations under the License.
+
+#ifndef NCNN_NUMAREPLICA_H
+#define NCNN_NUMAREPLICA_H
+
+#include "layer.h"
+#include "mat.h"
+#include "modelbin.h"
+#include "option.h"
+#include "paramdict.h"
+
+namespace ncnn {
+
+// hands out the weights of mb and keeps a copy of each for the numa replicas
+// the copy is taken before create_pipeline may alter the weights in place
+class ModelBinRecorder : public ModelBin
+{
+public:
+    ModelBinRecorder(const ModelBin& _mb, std::vector<Mat>& _weights)
+        : mb(_mb), weights(_weights)
+    {
+    }
+
+    virtual Mat load(int w, int type) const
+    {
+        Mat m = mb.load(w, type);
+        weights.push_back(m.clone());
+        return m;
+    }
+
+private:
+    const ModelBin& mb;
+    std::vector<Mat>& weights;
+};
+
+// load and transform the layer replicas of every node with a non-empty replicas[node]
+// replicas are created by the caller and get the params and recorded weights of layers
+// each node is loaded on a thread bound to it, pages land on the node touching them first
+// return 0 if all replicas are ready
+int load_numa_replicas(const std::vector<Layer*>& layers, std::vector<std::vector<Layer*> >& replicas, const std::vector<ParamDict>& layer_params, const std::vector<std::vector<Mat> >& layer_weights, const std::vector<int>& layer_kernel_choices, const Option& opt);
+
+} // namespace ncnn
+
+#endif // NCNN_NUMAREPLICA_H
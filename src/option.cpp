@@ -60,7 +60,7 @@ Option::Option()
     use_image_storage = false;
     use_tensor_storage = false;
 
-    use_reserved_0 = false;
+    use_adaptive_threads = false;
 
     flush_denormals = 3;
 
@@ -72,6 +72,13 @@ Option::Option()
     use_winograd23_convolution = true;
     use_winograd43_convolution = true;
     use_winograd63_convolution = true;
+
+    use_memory_plan = false;
+    use_branch_parallel = false;
+    use_parallel_load = false;
+    use_autotune = false;
+    use_hugepage = false;
+    use_numa_replica = false;
 }
 
 } // namespace ncnn
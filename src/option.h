@@ -117,7 +117,12 @@ public:
     bool use_image_storage;
     bool use_tensor_storage;
 
-    bool use_reserved_0;
+    // run each layer on fewer threads when its estimated work does not pay off the parallel overhead
+    // the fork and join cost of this host is measured once per thread count, the first time at load_model
+    // a layer keeps full threads on the first run with new bottom shapes, which decides its thread count
+    // set before load_model, cpu inference only
+    // disabled by default
+    bool use_adaptive_threads;
 
     // enable DAZ(Denormals-Are-Zero) and FTZ(Flush-To-Zero)
     // default value is 3
@@ -140,12 +145,45 @@ public:
     bool use_winograd43_convolution;
     bool use_winograd63_convolution;
 
-    bool use_reserved_6;
-    bool use_reserved_7;
-    bool use_reserved_8;
-    bool use_reserved_9;
-    bool use_reserved_10;
-    bool use_reserved_11;
+    // plan intermediate blob memory statically
+    // the first extractor records blob sizes and lifetimes
+    // later extractors serve every blob from one preallocated arena
+    // the net keeps one arena per concurrently alive extractor and reuses them
+    // blobs are keyed by the layer allocating them, the plan also replays with use_branch_parallel
+    // workspace allocations are not planned and still go to workspace_allocator
+    // takes effect only when blob_allocator is not set
+    // disabled by default
+    bool use_memory_plan;
+
+    // run independent graph branches concurrently
+    // num_threads is split among the concurrently running layers
+    // blob_allocator and workspace_allocator from the user are serialized while branches run
+    // disabled by default
+    bool use_branch_parallel;
+
+    // create layer pipelines on num_threads threads while the model is being read
+    // custom layers must tolerate concurrent create_pipeline
+    // disabled by default
+    bool use_parallel_load;
+
+    // time the convolution kernel candidates of every layer with shape hints while loading
+    // the fastest is remembered in the autotune cache set by Net::set_autotune_cache
+    // use_parallel_load is ignored while tuning
+    // disabled by default
+    bool use_autotune;
+
+    // back large weights and the net local blob and workspace pools with huge pages on linux
+    // applies to weights created by load_model and to pools created afterwards
+    // see get_hugepage_usage for how much ended up huge page backed
+    // disabled by default
+    bool use_hugepage;
+
+    // replicate the layers with their packed weights on every other numa node while loading
+    // each replica is transformed by threads bound to its node so the memory stays node local
+    // extractors bound by Extractor::set_numa_node run on the replica of their node
+    // set before load_param, cpu inference only
+    // disabled by default
+    bool use_numa_replica;
 };
 
 } // namespace ncnn
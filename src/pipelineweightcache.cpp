@@ -0,0 +1,432 @@
+// Tencent is pleased to support the open source community by making ncnn available.
+//
+// Copyright (C) 2024 THL A29 Limited, a Tencent company. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this file except
+// in compliance with the License. You may obtain a copy of the License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software distributed
+// under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+// CONDITIONS OF ANY KIND, either express or implied. See the License for the
+// specific language governing permissions and limitations under the License.
+
+#include "pipelineweightcache.h"
+
+#if NCNN_STDIO
+
+#include "cpu.h"
+
+#include <string.h>
+
+#if defined __unix__ || defined __APPLE__
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace ncnn {
+
+uint64_t hash_bytes(uint64_t hash, const void* data, size_t size)
+{
+    const unsigned char* p = (const unsigned char*)data;
+
+    for (; size >= 8; size -= 8, p += 8)
+    {
+        uint64_t v;
+        memcpy(&v, p, 8);
+        hash = (hash ^ v) * 0x100000001b3ULL;
+        hash ^= hash >> 32;
+    }
+    for (; size > 0; size--, p++)
+    {
+        hash = (hash ^ *p) * 0x100000001b3ULL;
+    }
+
+    return hash;
+}
+
+uint64_t hash_param_dict(uint64_t hash, const ParamDict& pd)
+{
+    for (int id = 0; id < NCNN_MAX_PARAM_COUNT; id++)
+    {
+        int type = pd.type(id);
+        if (type == 0)
+            continue;
+
+        hash = hash_bytes(hash, &id, sizeof(int));
+        hash = hash_bytes(hash, &type, sizeof(int));
+
+        if (type == 1 || type == 2 || type == 3)
+        {
+            // int and float share the storage
+            int v = pd.get(id, 0);
+            hash = hash_bytes(hash, &v, sizeof(int));
+        }
+        else
+        {
+            Mat v = pd.get(id, Mat());
+            hash = hash_bytes(hash, &v.w, sizeof(int));
+            hash = hash_bytes(hash, v.data, v.total() * v.elemsize);
+        }
+    }
+
+    return hash;
+}
+
+struct pipeline_weight_cache_header
+{
+    uint32_t magic;
+    uint32_t version;
+    uint64_t key;
+    int32_t entry_count;
+    int32_t reserved;
+};
+
+struct pipeline_weight_cache_entry_header
+{
+    int32_t layer_index;
+    int32_t typeindex;
+    uint64_t weight_hash;
+    int32_t mat_count;
+    int32_t reserved;
+};
+
+struct pipeline_weight_cache_mat_header
+{
+    int32_t dims;
+    int32_t w;
+    int32_t h;
+    int32_t d;
+    int32_t c;
+    int32_t elempack;
+    int64_t elemsize;
+    int64_t offset;
+    int64_t nbytes;
+};
+
+static const uint32_t PIPELINE_WEIGHT_CACHE_MAGIC = 0x4357434e; // NCWC
+static const uint32_t PIPELINE_WEIGHT_CACHE_VERSION = 1;
+
+PipelineWeightCache::PipelineWeightCache()
+{
+    data = 0;
+    size = 0;
+    mapped = false;
+}
+
+PipelineWeightCache::~PipelineWeightCache()
+{
+    entries.clear();
+
+#if defined __unix__ || defined __APPLE__
+    if (mapped)
+    {
+        munmap(data, size);
+        data = 0;
+    }
+#endif
+    if (data)
+    {
+        fastFree(data);
+    }
+}
+
+uint64_t PipelineWeightCache::make_key(const Option& opt)
+{
+    uint64_t key = 0xcbf29ce484222325ULL;
+
+#ifdef NCNN_VERSION_STRING
+    key = hash_bytes(key, NCNN_VERSION_STRING, strlen(NCNN_VERSION_STRING));
+#endif
+    int sizeof_pointer = (int)sizeof(void*);
+    key = hash_bytes(key, &sizeof_pointer, sizeof(int));
+
+    // layer implementations are dispatched by isa at runtime
+    int isa[] = {
+        cpu_support_arm_neon(),
+        cpu_support_arm_vfpv4(),
+        cpu_support_arm_asimdhp(),
+        cpu_support_arm_asimddp(),
+        cpu_support_arm_asimdfhm(),
+        cpu_support_arm_bf16(),
+        cpu_support_arm_i8mm(),
+        cpu_support_arm_sve(),
+        cpu_support_x86_avx(),
+        cpu_support_x86_fma(),
+        cpu_support_x86_xop(),
+        cpu_support_x86_f16c(),
+        cpu_support_x86_avx2(),
+        cpu_support_x86_avx_vnni(),
+        cpu_support_x86_avx512(),
+        cpu_support_x86_avx512_vnni(),
+        cpu_support_x86_avx512_bf16(),
+        cpu_support_x86_avx512_fp16(),
+        cpu_support_mips_msa(),
+        cpu_support_loongson_mmi(),
+        cpu_support_riscv_v(),
+        cpu_support_riscv_zfh(),
+    };
+    key = hash_bytes(key, isa, sizeof(isa));
+
+    // options picking the weight transform
+    int options[] = {
+        opt.use_winograd_convolution,
+        opt.use_sgemm_convolution,
+        opt.use_int8_inference,
+        opt.use_bf16_storage,
+        opt.use_fp16_packed,
+        opt.use_fp16_storage,
+        opt.use_fp16_arithmetic,
+        opt.use_int8_packed,
+        opt.use_int8_storage,
+        opt.use_int8_arithmetic,
+        opt.use_packing_layout,
+        opt.use_winograd23_convolution,
+        opt.use_winograd43_convolution,
+        opt.use_winograd63_convolution,
+    };
+    key = hash_bytes(key, options, sizeof(options));
+
+    return key;
+}
+
+int PipelineWeightCache::load(const char* path, uint64_t key)
+{
+#if defined __unix__ || defined __APPLE__
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return -1;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(pipeline_weight_cache_header))
+    {
+        close(fd);
+        return -1;
+    }
+
+    size = (size_t)st.st_size;
+
+    // private writable mapping, the file is never modified
+    void* ptr = mmap(0, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (ptr == MAP_FAILED)
+        return -1;
+
+    data = (unsigned char*)ptr;
+    mapped = true;
+#else
+    FILE* fp = fopen(path, "rb");
+    if (!fp)
+        return -1;
+
+    fseek(fp, 0, SEEK_END);
+    long len = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    if (len < (long)sizeof(pipeline_weight_cache_header))
+    {
+        fclose(fp);
+        return -1;
+    }
+
+    size = (size_t)len;
+    data = (unsigned char*)fastMalloc(size);
+    size_t nread = fread(data, 1, size, fp);
+    fclose(fp);
+    if (nread != size)
+        return -1;
+#endif
+
+    const pipeline_weight_cache_header* header = (const pipeline_weight_cache_header*)data;
+    if (header->magic != PIPELINE_WEIGHT_CACHE_MAGIC || header->version != PIPELINE_WEIGHT_CACHE_VERSION || header->key != key)
+        return -1;
+
+    size_t pos = sizeof(pipeline_weight_cache_header);
+
+    entries.resize(header->entry_count);
+    for (int i = 0; i < header->entry_count; i++)
+    {
+        if (pos + sizeof(pipeline_weight_cache_entry_header) > size)
+        {
+            entries.clear();
+            return -1;
+        }
+
+        const pipeline_weight_cache_entry_header* eh = (const pipeline_weight_cache_entry_header*)(data + pos);
+        pos += sizeof(pipeline_weight_cache_entry_header);
+
+        cache_entry& entry = entries[i];
+        entry.layer_index = eh->layer_index;
+        entry.typeindex = eh->typeindex;
+        entry.weight_hash = eh->weight_hash;
+        entry.weights.resize(eh->mat_count);
+
+        for (int j = 0; j < eh->mat_count; j++)
+        {
+            if (pos + sizeof(pipeline_weight_cache_mat_header) > size)
+            {
+                entries.clear();
+                return -1;
+            }
+
+            const pipeline_weight_cache_mat_header* mh = (const pipeline_weight_cache_mat_header*)(data + pos);
+            pos += sizeof(pipeline_weight_cache_mat_header);
+
+            if (mh->dims == 0)
+                continue;
+
+            if (mh->offset < 0 || mh->nbytes < 0 || (uint64_t)mh->offset + (uint64_t)mh->nbytes > size)
+            {
+                entries.clear();
+                return -1;
+            }
+
+            void* ptr = data + mh->offset;
+            Mat& m = entry.weights[j];
+            if (mh->dims == 1) m = Mat(mh->w, ptr, (size_t)mh->elemsize, mh->elempack);
+            if (mh->dims == 2) m = Mat(mh->w, mh->h, ptr, (size_t)mh->elemsize, mh->elempack);
+            if (mh->dims == 3) m = Mat(mh->w, mh->h, mh->c, ptr, (size_t)mh->elemsize, mh->elempack);
+            if (mh->dims == 4) m = Mat(mh->w, mh->h, mh->d, mh->c, ptr, (size_t)mh->elemsize, mh->elempack);
+
+            if ((int64_t)(m.total() * m.elemsize) != mh->nbytes)
+            {
+                entries.clear();
+                return -1;
+            }
+        }
+    }
+
+    return 0;
+}
+
+int PipelineWeightCache::find(int layer_index, int typeindex, uint64_t weight_hash, std::vector<Mat>& weights) const
+{
+    for (size_t i = 0; i < entries.size(); i++)
+    {
+        const cache_entry& entry = entries[i];
+        if (entry.layer_index == layer_index && entry.typeindex == typeindex && entry.weight_hash == weight_hash)
+        {
+            weights = entry.weights;
+            return 0;
+        }
+    }
+
+    return -1;
+}
+
+int PipelineWeightCache::save(const char* path, uint64_t key, const std::vector<int>& typeindexes, const std::vector<uint64_t>& weight_hashes, const std::vector<std::vector<Mat> >& weights)
+{
+    // write aside and rename, the old file may still be mapped
+    std::string tmppath = std::string(path) + std::string(".tmp");
+
+    FILE* fp = fopen(tmppath.c_str(), "wb");
+    if (!fp)
+    {
+        NCNN_LOGE("fopen %s failed", tmppath.c_str());
+        return -1;
+    }
+
+    pipeline_weight_cache_header header;
+    header.magic = PIPELINE_WEIGHT_CACHE_MAGIC;
+    header.version = PIPELINE_WEIGHT_CACHE_VERSION;
+    header.key = key;
+    header.entry_count = 0;
+    header.reserved = 0;
+
+    size_t headers_size = sizeof(pipeline_weight_cache_header);
+    for (size_t i = 0; i < weights.size(); i++)
+    {
+        if (weights[i].empty())
+            continue;
+
+        header.entry_count++;
+        headers_size += sizeof(pipeline_weight_cache_entry_header) + weights[i].size() * sizeof(pipeline_weight_cache_mat_header);
+    }
+
+    // mat data follows all headers, 64 byte aligned
+    size_t offset = alignSize(headers_size, 64);
+
+    bool ok = fwrite(&header, sizeof(header), 1, fp) == 1;
+
+    for (size_t i = 0; i < weights.size() && ok; i++)
+    {
+        if (weights[i].empty())
+            continue;
+
+        pipeline_weight_cache_entry_header eh;
+        eh.layer_index = (int32_t)i;
+        eh.typeindex = typeindexes[i];
+        eh.weight_hash = weight_hashes[i];
+        eh.mat_count = (int32_t)weights[i].size();
+        eh.reserved = 0;
+        ok = ok && fwrite(&eh, sizeof(eh), 1, fp) == 1;
+
+        for (size_t j = 0; j < weights[i].size(); j++)
+        {
+            const Mat& m = weights[i][j];
+
+            pipeline_weight_cache_mat_header mh;
+            memset(&mh, 0, sizeof(mh));
+            if (!m.empty())
+            {
+                mh.dims = m.dims;
+                mh.w = m.w;
+                mh.h = m.h;
+                mh.d = m.d;
+                mh.c = m.c;
+                mh.elempack = m.elempack;
+                mh.elemsize = (int64_t)m.elemsize;
+                mh.offset = (int64_t)offset;
+                mh.nbytes = (int64_t)(m.total() * m.elemsize);
+
+                offset = alignSize(offset + (size_t)mh.nbytes, 64);
+            }
+            ok = ok && fwrite(&mh, sizeof(mh), 1, fp) == 1;
+        }
+    }
+
+    static const unsigned char zeros[64] = {0};
+
+    size_t pos = headers_size;
+    for (size_t i = 0; i < weights.size() && ok; i++)
+    {
+        for (size_t j = 0; j < weights[i].size() && ok; j++)
+        {
+            const Mat& m = weights[i][j];
+            if (m.empty())
+                continue;
+
+            size_t pad = alignSize(pos, 64) - pos;
+            ok = ok && fwrite(zeros, 1, pad, fp) == pad;
+
+            size_t nbytes = m.total() * m.elemsize;
+            ok = ok && fwrite(m.data, 1, nbytes, fp) == nbytes;
+
+            pos += pad + nbytes;
+        }
+    }
+
+    fclose(fp);
+
+#ifdef _WIN32
+    if (ok)
+    {
+        remove(path);
+    }
+#endif
+
+    if (!ok || rename(tmppath.c_str(), path) != 0)
+    {
+        NCNN_LOGE("write pipeline weight cache %s failed", path);
+        remove(tmppath.c_str());
+        return -1;
+    }
+
+    return 0;
+}
+
+} // namespace ncnn
+
+#endif // NCNN_STDIO
@@ -0,0 +1,111 @@
+// Tencent is pleased to support the open source community by making ncnn available.
+//
+// Copyright (C) 2024 THL A29 Limited, a Tencent company. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this file except
+// in compliance with the License. You may obtain a copy of the License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software distributed
+// under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+// CONDITIONS OF ANY KIND, either express or implied. See the License for the
+// specific language governing permissions and limitations under the License.
+
+#ifndef NCNN_PIPELINEWEIGHTCACHE_H
+#define NCNN_PIPELINEWEIGHTCACHE_H
+
+#include "datareader.h"
+#include "mat.h"
+#include "option.h"
+#include "paramdict.h"
+#include "platform.h"
+
+#include <stdint.h>
+
+namespace ncnn {
+
+#if NCNN_STDIO
+// fnv style hash over 8 byte words
+uint64_t hash_bytes(uint64_t hash, const void* data, size_t size);
+
+// hash every param a layer was loaded with
+uint64_t hash_param_dict(uint64_t hash, const ParamDict& pd);
+
+// hash everything a layer reads in load_model
+class DataReaderHashing : public DataReader
+{
+public:
+    DataReaderHashing(const DataReader& _dr)
+        : dr(_dr), hash(0xcbf29ce484222325ULL)
+    {
+    }
+
+#if NCNN_STRING
+    virtual int scan(const char* format, void* p) const
+    {
+        return dr.scan(format, p);
+    }
+#endif // NCNN_STRING
+
+    virtual size_t read(void* buf, size_t size) const
+    {
+        size_t nread = dr.read(buf, size);
+        hash = hash_bytes(hash, buf, nread);
+        return nread;
+    }
+
+    virtual size_t reference(size_t size, const void** buf) const
+    {
+        size_t nref = dr.reference(size, buf);
+        if (nref)
+        {
+            hash = hash_bytes(hash, *buf, nref);
+        }
+        return nref;
+    }
+
+    const DataReader& dr;
+    mutable uint64_t hash;
+};
+
+// weights transformed by create_pipeline, persisted across runs
+// the whole file is mapped and the cached mats point into it
+class PipelineWeightCache
+{
+public:
+    PipelineWeightCache();
+    ~PipelineWeightCache();
+
+    // identify library version, cpu isa and transform related options
+    static uint64_t make_key(const Option& opt);
+
+    // map cache file, return 0 if it exists and matches key
+    int load(const char* path, uint64_t key);
+
+    // cached weights for one layer, return 0 if found
+    int find(int layer_index, int typeindex, uint64_t weight_hash, std::vector<Mat>& weights) const;
+
+    // write all entries, layers with empty weights are skipped
+    static int save(const char* path, uint64_t key, const std::vector<int>& typeindexes, const std::vector<uint64_t>& weight_hashes, const std::vector<std::vector<Mat> >& weights);
+
+private:
+    struct cache_entry
+    {
+        int layer_index;
+        int typeindex;
+        uint64_t weight_hash;
+        std::vector<Mat> weights;
+    };
+
+    std::vector<cache_entry> entries;
+
+    unsigned char* data;
+    size_t size;
+    bool mapped;
+};
+#endif // NCNN_STDIO
+
+} // namespace ncnn
+
+#endif // NCNN_PIPELINEWEIGHTCACHE_H
@@ -17,13 +17,24 @@
 #if NCNN_SIMPLEOMP
 
 #include "simpleomp.h"
-#include "cpu.h" // ncnn::get_cpu_count()
+#include "benchmark.h" // ncnn::trace_event()
+#include "cpu.h"       // ncnn::get_cpu_count()
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
 #include <stdarg.h>
+#include <sched.h>
+
+#if NCNN_SIMPLEOMP_WORKSTEALING && defined(__linux__)
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#define NCNN_SIMPLEOMP_FUTEX 1
+#else
+#define NCNN_SIMPLEOMP_FUTEX 0
+#endif
 
 #if __clang__
 extern "C" typedef void (*kmpc_micro)(int32_t* gtid, int32_t* tid, ...);
@@ -74,6 +85,26 @@ static void* kmp_threadfunc(void* args);
 
 namespace ncnn {
 
+class KMPTeam;
+
+class KMPLoop
+{
+public:
+    // worksharing loop shared by the team
+    // iterations are numbered 0 ~ count and handed out in chunks
+    int loop_seq;
+    int guided;
+    int num_threads;
+    long start;
+    long incr;
+    long count;
+    long chunk;
+    long next;
+    // iterations finished, GOMP_loop_end waits for it to reach count
+    long done;
+    KMPLoop* link;
+};
+
 class KMPTask
 {
 public:
@@ -93,12 +124,283 @@ public:
     // per-task
     int thread_num;
 
+    // worksharing loop status
+    int loop_seq;
+    KMPLoop* loop;
+    // the loop ended last and the iterations of the chunk in hand
+    KMPLoop* last_loop;
+    long pending;
+
     // finish status
-    int* num_threads_to_wait;
-    Mutex* finish_lock;
-    ConditionVariable* finish_condition;
+    KMPTeam* team;
+};
+
+class KMPTeam
+{
+public:
+    KMPTeam(int _num_threads)
+    {
+        num_threads = _num_threads;
+        num_threads_to_wait = _num_threads - 1;
+        loops = 0;
+    }
+
+    ~KMPTeam()
+    {
+        while (loops)
+        {
+            KMPLoop* link = loops->link;
+            delete loops;
+            loops = link;
+        }
+    }
+
+    // the first task reaching its loop_seq-th loop sets it up for the others
+    KMPLoop* get_loop(int loop_seq, int guided, long start, long incr, long count, long chunk)
+    {
+        loops_lock.lock();
+
+        KMPLoop* loop = loops;
+        while (loop && loop->loop_seq != loop_seq)
+        {
+            loop = loop->link;
+        }
+
+        if (!loop)
+        {
+            loop = new KMPLoop;
+            loop->loop_seq = loop_seq;
+            loop->guided = guided;
+            loop->num_threads = num_threads;
+            loop->start = start;
+            loop->incr = incr;
+            loop->count = count;
+            loop->chunk = chunk;
+            loop->next = 0;
+            loop->done = 0;
+            loop->link = loops;
+            loops = loop;
+        }
+
+        loops_lock.unlock();
+
+        return loop;
+    }
+
+public:
+    int num_threads;
+    int num_threads_to_wait;
+#if !NCNN_SIMPLEOMP_FUTEX
+    Mutex finish_lock;
+    ConditionVariable finish_condition;
+#endif
+
+    Mutex loops_lock;
+    KMPLoop* loops;
+};
+
+static inline void kmp_cpu_relax()
+{
+#if defined(__i386__) || defined(__x86_64__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    __asm__ __volatile__("yield" ::: "memory");
+#endif
+}
+
+#if NCNN_SIMPLEOMP_WORKSTEALING
+
+#if NCNN_SIMPLEOMP_FUTEX
+static void kmp_futex_wait(int* addr, int val)
+{
+    syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, val, NULL, NULL, 0);
+}
+
+static void kmp_futex_wake(int* addr, int n)
+{
+    syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, n, NULL, NULL, 0);
+}
+#endif // NCNN_SIMPLEOMP_FUTEX
+
+class KMPTaskDeque
+{
+public:
+    KMPTaskDeque()
+    {
+        capacity = 16;
+        tasks = new KMPTask*[capacity];
+        front = 0;
+        size = 0;
+    }
+
+    ~KMPTaskDeque()
+    {
+        delete[] tasks;
+    }
+
+    bool empty() const
+    {
+        // unlocked peek, only a hint for the thieves
+        return __atomic_load_n(&size, __ATOMIC_RELAXED) == 0;
+    }
+
+    // the owner pushes and pops at the back
+    void push_back(KMPTask* v, int n)
+    {
+        lock.lock();
+
+        if (size + n > capacity)
+        {
+            grow(size + n);
+        }
+
+        for (int i = 0; i < n; i++)
+        {
+            tasks[(front + size + i) % capacity] = &v[i];
+        }
+
+        __atomic_store_n(&size, size + n, __ATOMIC_RELAXED);
+
+        lock.unlock();
+    }
+
+    // take the newest task, only if it belongs to team when team is given
+    KMPTask* pop_back(const KMPTeam* team)
+    {
+        if (empty())
+            return 0;
+
+        KMPTask* v = 0;
+
+        lock.lock();
+        if (size > 0)
+        {
+            KMPTask* t = tasks[(front + size - 1) % capacity];
+            if (!team || t->team == team)
+            {
+                v = t;
+                __atomic_store_n(&size, size - 1, __ATOMIC_RELAXED);
+            }
+        }
+        lock.unlock();
+
+        return v;
+    }
+
+    // the thieves steal the oldest task at the front
+    KMPTask* steal_front()
+    {
+        if (empty())
+            return 0;
+
+        KMPTask* v = 0;
+
+        lock.lock();
+        if (size > 0)
+        {
+            v = tasks[front];
+            front = (front + 1) % capacity;
+            __atomic_store_n(&size, size - 1, __ATOMIC_RELAXED);
+        }
+        lock.unlock();
+
+        return v;
+    }
+
+private:
+    void grow(int n)
+    {
+        int new_capacity = capacity * 2;
+        while (new_capacity < n)
+        {
+            new_capacity *= 2;
+        }
+
+        KMPTask** new_tasks = new KMPTask*[new_capacity];
+        for (int i = 0; i < size; i++)
+        {
+            new_tasks[i] = tasks[(front + i) % capacity];
+        }
+
+        delete[] tasks;
+        tasks = new_tasks;
+        capacity = new_capacity;
+        front = 0;
+    }
+
+private:
+    Mutex lock;
+
+    // ring buffer deque
+    KMPTask** tasks;
+    int capacity;
+    int front;
+    int size;
 };
 
+class KMPParker
+{
+public:
+    KMPParker()
+    {
+        epoch = 0;
+        sleepers = 0;
+    }
+
+    // announce the sleep, the caller must look for tasks again before park()
+    int prepare()
+    {
+        __atomic_fetch_add(&sleepers, 1, __ATOMIC_SEQ_CST);
+        return __atomic_load_n(&epoch, __ATOMIC_SEQ_CST);
+    }
+
+    void cancel()
+    {
+        __atomic_fetch_sub(&sleepers, 1, __ATOMIC_SEQ_CST);
+    }
+
+    void park(int e)
+    {
+#if NCNN_SIMPLEOMP_FUTEX
+        kmp_futex_wait(&epoch, e);
+#else
+        lock.lock();
+        while (__atomic_load_n(&epoch, __ATOMIC_SEQ_CST) == e)
+        {
+            condition.wait(lock);
+        }
+        lock.unlock();
+#endif
+
+        cancel();
+    }
+
+    void unpark(int n)
+    {
+        __atomic_fetch_add(&epoch, 1, __ATOMIC_SEQ_CST);
+
+        if (__atomic_load_n(&sleepers, __ATOMIC_SEQ_CST) == 0)
+            return;
+
+#if NCNN_SIMPLEOMP_FUTEX
+        kmp_futex_wake(&epoch, n);
+#else
+        (void)n;
+        lock.lock();
+        lock.unlock();
+        condition.broadcast();
+#endif
+    }
+
+private:
+    int epoch;
+    int sleepers;
+#if !NCNN_SIMPLEOMP_FUTEX
+    Mutex lock;
+    ConditionVariable condition;
+#endif
+};
+#else  // NCNN_SIMPLEOMP_WORKSTEALING
 class KMPTaskQueue
 {
 public:
@@ -191,6 +493,7 @@ private:
     int front;
     int back;
 };
+#endif // NCNN_SIMPLEOMP_WORKSTEALING
 
 class KMPGlobal
 {
@@ -200,7 +503,12 @@ public:
         kmp_max_threads = 0;
         kmp_threads = 0;
         kmp_threads_tid = 0;
+#if NCNN_SIMPLEOMP_WORKSTEALING
+        kmp_deques = 0;
+        kmp_quit = 0;
+#else
         kmp_task_queue = 0;
+#endif
     }
 
     ~KMPGlobal()
@@ -221,7 +529,12 @@ public:
         // NCNN_LOGE("KMPGlobal init");
         kmp_max_threads = ncnn::get_cpu_count();
 
+#if NCNN_SIMPLEOMP_WORKSTEALING
+        // deque 0 collects the tasks from threads outside the pool
+        kmp_deques = new ncnn::KMPTaskDeque[kmp_max_threads];
+#else
         kmp_task_queue = new ncnn::KMPTaskQueue(std::max(kmp_max_threads * 4, 16));
+#endif
 
         if (kmp_max_threads > 1)
         {
@@ -240,6 +553,10 @@ public:
         // NCNN_LOGE("KMPGlobal deinit");
         if (kmp_max_threads > 1)
         {
+#if NCNN_SIMPLEOMP_WORKSTEALING
+            __atomic_store_n(&kmp_quit, 1, __ATOMIC_SEQ_CST);
+            kmp_parker.unpark(kmp_max_threads - 1);
+#else
             // TODO portable stack allocation
             ncnn::KMPTask* tasks = (ncnn::KMPTask*)alloca((kmp_max_threads - 1) * sizeof(ncnn::KMPTask));
             for (int i = 0; i < kmp_max_threads - 1; i++)
@@ -254,13 +571,14 @@ public:
 #endif
                 tasks[i].num_threads = kmp_max_threads;
                 tasks[i].thread_num = i + 1;
-                tasks[i].num_threads_to_wait = 0;
-                tasks[i].finish_lock = 0;
-                tasks[i].finish_condition = 0;
+                tasks[i].loop_seq = 0;
+                tasks[i].loop = 0;
+                tasks[i].team = 0;
             }
 
             // dispatch 1 ~ kmp_max_threads
             kmp_task_queue->dispatch(tasks, kmp_max_threads - 1);
+#endif
 
             for (int i = 0; i < kmp_max_threads - 1; i++)
             {
@@ -276,14 +594,24 @@ public:
             delete[] kmp_threads_tid;
         }
 
+#if NCNN_SIMPLEOMP_WORKSTEALING
+        delete[] kmp_deques;
+#else
         delete kmp_task_queue;
+#endif
     }
 
 public:
     int kmp_max_threads;
     ncnn::Thread** kmp_threads;
     int* kmp_threads_tid;
+#if NCNN_SIMPLEOMP_WORKSTEALING
+    ncnn::KMPTaskDeque* kmp_deques;
+    ncnn::KMPParker kmp_parker;
+    int kmp_quit;
+#else
     ncnn::KMPTaskQueue* kmp_task_queue;
+#endif
 };
 
 } // namespace ncnn
@@ -294,12 +622,44 @@ static ncnn::KMPGlobal g_kmp_global;
 
 static ncnn::ThreadLocalStorage tls_num_threads;
 static ncnn::ThreadLocalStorage tls_thread_num;
+static ncnn::ThreadLocalStorage tls_task;
+static ncnn::ThreadLocalStorage tls_orphan_loop;
+#if NCNN_SIMPLEOMP_WORKSTEALING
+static ncnn::ThreadLocalStorage tls_worker_id;
+
+// idle workers and waiting masters spin this many rounds before parking
+#define KMP_SPIN_COUNT 4096
+#endif
 
 static void init_g_kmp_global()
 {
     g_kmp_global.init();
 }
 
+static double trace_begin()
+{
+    return ncnn::trace_enabled() ? ncnn::get_current_time() : 0;
+}
+
+static void trace_parallel_task(double start, int thread_num, int num_threads)
+{
+    if (start == 0)
+        return;
+
+    char detail[32];
+    sprintf(detail, "%d/%d", thread_num, num_threads);
+    ncnn::trace_event("omp", "parallel_task", detail, start, ncnn::get_current_time());
+}
+
+static void trace_barrier(double start)
+{
+    if (start == 0)
+        return;
+
+    // the master thread waiting for the team
+    ncnn::trace_event("omp", "barrier", 0, start, ncnn::get_current_time());
+}
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -456,129 +816,421 @@ static int kmp_invoke_microtask(kmpc_micro fn, int gtid, int tid, int argc, void
 }
 #endif // __clang__
 
-static void* kmp_threadfunc(void* args)
+
+struct kmp_task_context
 {
-#if __clang__
-    int tid = *(int*)args;
-#else
-    (void)args;
-#endif
+    void* num_threads;
+    void* thread_num;
+    void* task;
+};
 
-    for (;;)
-    {
-        ncnn::KMPTask* task;
-        g_kmp_global.kmp_task_queue->get(task);
+static void kmp_enter_task(ncnn::KMPTask* task, kmp_task_context* saved)
+{
+    // a thread may run tasks of another team while waiting, keep its own context
+    saved->num_threads = tls_num_threads.get();
+    saved->thread_num = tls_thread_num.get();
+    saved->task = tls_task.get();
+
+    tls_num_threads.set(reinterpret_cast<void*>((size_t)task->num_threads));
+    tls_thread_num.set(reinterpret_cast<void*>((size_t)task->thread_num));
+    tls_task.set(task);
+}
 
-        // fprintf(stderr, "get %d\n", tid);
+static void kmp_leave_task(const kmp_task_context* saved)
+{
+    tls_num_threads.set(saved->num_threads);
+    tls_thread_num.set(saved->thread_num);
+    tls_task.set(saved->task);
+}
 
-        if (!task->fn)
-            break;
+static void kmp_run_task(ncnn::KMPTask* task, int tid)
+{
+    kmp_task_context saved;
+    kmp_enter_task(task, &saved);
 
-        tls_num_threads.set(reinterpret_cast<void*>((size_t)task->num_threads));
-        tls_thread_num.set(reinterpret_cast<void*>((size_t)task->thread_num));
+    const double trace_start = trace_begin();
 
 #if __clang__
-        kmp_invoke_microtask(task->fn, task->thread_num, tid, task->argc, task->argv);
+    kmp_invoke_microtask(task->fn, task->thread_num, tid, task->argc, task->argv);
 #else
-        task->fn(task->data);
+    (void)tid;
+    task->fn(task->data);
 #endif
 
-        // update finished
-        {
-            task->finish_lock->lock();
-            *task->num_threads_to_wait = *task->num_threads_to_wait - 1;
-            if (*task->num_threads_to_wait == 0)
-            {
-                task->finish_condition->signal();
-            }
-            task->finish_lock->unlock();
-        }
-    }
+    trace_parallel_task(trace_start, task->thread_num, task->num_threads);
 
-    // fprintf(stderr, "exit\n");
-    return 0;
+    kmp_leave_task(&saved);
 }
 
-#if __clang__
-int32_t __kmpc_global_thread_num(void* /*loc*/)
+static void kmp_finish_task(ncnn::KMPTeam* team)
 {
-    // NCNN_LOGE("__kmpc_global_thread_num");
-    return 0;
+#if NCNN_SIMPLEOMP_FUTEX
+    if (__atomic_sub_fetch(&team->num_threads_to_wait, 1, __ATOMIC_ACQ_REL) == 0)
+    {
+        ncnn::kmp_futex_wake(&team->num_threads_to_wait, 1);
+    }
+#else
+    team->finish_lock.lock();
+    if (__atomic_sub_fetch(&team->num_threads_to_wait, 1, __ATOMIC_ACQ_REL) == 0)
+    {
+        team->finish_condition.signal();
+    }
+    team->finish_lock.unlock();
+#endif
 }
 
-void __kmpc_push_num_threads(void* /*loc*/, int32_t /*gtid*/, int32_t num_threads)
+static void kmp_execute_task(ncnn::KMPTask* task, int tid)
 {
-    // NCNN_LOGE("__kmpc_push_num_threads %d", num_threads);
-    omp_set_num_threads(num_threads);
+    kmp_run_task(task, tid);
+
+    kmp_finish_task(task->team);
 }
 
-void __kmpc_fork_call(void* /*loc*/, int32_t argc, kmpc_micro fn, ...)
+#if NCNN_SIMPLEOMP_WORKSTEALING
+static int kmp_worker_id()
 {
-    g_kmp_global.try_init();
-
-    // NCNN_LOGE("__kmpc_fork_call %d", argc);
-    int num_threads = omp_get_num_threads();
+    return (int)reinterpret_cast<size_t>(tls_worker_id.get());
+}
 
-    // build argv
-    void* argv[32];
+static ncnn::KMPTask* kmp_steal_task(int tid)
+{
+    const int n = g_kmp_global.kmp_max_threads;
+    for (int i = 1; i < n; i++)
     {
-        va_list ap;
-        va_start(ap, fn);
-        for (int i = 0; i < argc; i++)
-            argv[i] = va_arg(ap, void*);
-        va_end(ap);
+        ncnn::KMPTask* task = g_kmp_global.kmp_deques[(tid + i) % n].steal_front();
+        if (task)
+            return task;
     }
 
-    if (g_kmp_global.kmp_max_threads == 1 || num_threads == 1)
-    {
-        for (int i = 0; i < num_threads; i++)
-        {
-            tls_thread_num.set(reinterpret_cast<void*>((size_t)i));
+    return 0;
+}
 
-            kmp_invoke_microtask(fn, 0, 0, argc, argv);
-        }
+static void kmp_dispatch(ncnn::KMPTask* tasks, int n)
+{
+    // push to the deque of the calling thread, idle workers steal from the front
+    g_kmp_global.kmp_deques[kmp_worker_id()].push_back(tasks, n);
+    g_kmp_global.kmp_parker.unpark(n);
+}
+#else  // NCNN_SIMPLEOMP_WORKSTEALING
+static void kmp_dispatch(ncnn::KMPTask* tasks, int n)
+{
+    g_kmp_global.kmp_task_queue->dispatch(tasks, n);
+}
+#endif // NCNN_SIMPLEOMP_WORKSTEALING
 
-        return;
+static void kmp_wait_team(ncnn::KMPTeam* team)
+{
+#if NCNN_SIMPLEOMP_WORKSTEALING
+    // run the tasks nobody has stolen yet in place
+    // so that a worker waiting on its nested region always makes progress
+    const int tid = kmp_worker_id();
+    for (;;)
+    {
+        ncnn::KMPTask* task = g_kmp_global.kmp_deques[tid].pop_back(team);
+        if (!task)
+            break;
+
+        kmp_execute_task(task, tid);
     }
+#endif
 
-    int num_threads_to_wait = num_threads - 1;
-    ncnn::Mutex finish_lock;
-    ncnn::ConditionVariable finish_condition;
+    const double trace_start = trace_begin();
 
-    // TODO portable stack allocation
-    ncnn::KMPTask* tasks = (ncnn::KMPTask*)alloca((num_threads - 1) * sizeof(ncnn::KMPTask));
-    for (int i = 0; i < num_threads - 1; i++)
+#if NCNN_SIMPLEOMP_WORKSTEALING
+    for (int i = 0; i < KMP_SPIN_COUNT; i++)
     {
-        tasks[i].fn = fn;
-        tasks[i].argc = argc;
-        tasks[i].argv = (void**)argv;
-        tasks[i].num_threads = num_threads;
-        tasks[i].thread_num = i + 1;
-        tasks[i].num_threads_to_wait = &num_threads_to_wait;
-        tasks[i].finish_lock = &finish_lock;
-        tasks[i].finish_condition = &finish_condition;
+        if (__atomic_load_n(&team->num_threads_to_wait, __ATOMIC_ACQUIRE) == 0)
+            break;
+
+        ncnn::kmp_cpu_relax();
     }
+#endif
 
-    // dispatch 1 ~ num_threads
-    g_kmp_global.kmp_task_queue->dispatch(tasks, num_threads - 1);
+#if NCNN_SIMPLEOMP_FUTEX
+    for (;;)
+    {
+        int num_threads_to_wait = __atomic_load_n(&team->num_threads_to_wait, __ATOMIC_ACQUIRE);
+        if (num_threads_to_wait == 0)
+            break;
 
-    // dispatch 0
+        ncnn::kmp_futex_wait(&team->num_threads_to_wait, num_threads_to_wait);
+    }
+#else
+    team->finish_lock.lock();
+    while (__atomic_load_n(&team->num_threads_to_wait, __ATOMIC_ACQUIRE) != 0)
+    {
+        team->finish_condition.wait(team->finish_lock);
+    }
+    team->finish_lock.unlock();
+#endif
+
+    trace_barrier(trace_start);
+}
+
+static void kmp_init_task(ncnn::KMPTask* task, ncnn::KMPTeam* team, int thread_num)
+{
+    task->num_threads = team->num_threads;
+    task->thread_num = thread_num;
+    task->loop_seq = 0;
+    task->loop = 0;
+    task->last_loop = 0;
+    task->pending = 0;
+    task->team = team;
+}
+
+static ncnn::KMPLoop* kmp_loop_begin(int guided, long start, long incr, long count, long chunk)
+{
+    if (chunk < 1)
+        chunk = 1;
+
+    ncnn::KMPTask* task = (ncnn::KMPTask*)tls_task.get();
+    if (task)
     {
-        tls_num_threads.set(reinterpret_cast<void*>((size_t)num_threads));
-        tls_thread_num.set(reinterpret_cast<void*>((size_t)0));
+        task->loop = task->team->get_loop(task->loop_seq, guided, start, incr, count, chunk);
+        task->loop_seq++;
+        return task->loop;
+    }
+
+    // orphaned loop outside any parallel region
+    ncnn::KMPLoop* loop = new ncnn::KMPLoop;
+    loop->loop_seq = 0;
+    loop->guided = guided;
+    loop->num_threads = 1;
+    loop->start = start;
+    loop->incr = incr;
+    loop->count = count;
+    loop->chunk = chunk;
+    loop->next = 0;
+    loop->done = 0;
+    loop->link = 0;
+
+    delete (ncnn::KMPLoop*)tls_orphan_loop.get();
+    tls_orphan_loop.set(loop);
+    return loop;
+}
 
-        kmp_invoke_microtask(fn, 0, 0, argc, argv);
+static ncnn::KMPLoop* kmp_loop_current()
+{
+    ncnn::KMPTask* task = (ncnn::KMPTask*)tls_task.get();
+    if (task)
+        return task->loop;
+
+    return (ncnn::KMPLoop*)tls_orphan_loop.get();
+}
+
+static void kmp_loop_end()
+{
+    ncnn::KMPTask* task = (ncnn::KMPTask*)tls_task.get();
+    if (task)
+    {
+        if (task->loop)
+            task->last_loop = task->loop;
+        task->loop = 0;
+        return;
     }
 
-    // wait for finished
+    delete (ncnn::KMPLoop*)tls_orphan_loop.get();
+    tls_orphan_loop.set(0);
+}
+
+// grab the next chunk [first, last) of the current loop
+static bool kmp_loop_next(ncnn::KMPLoop** loop, long* first, long* last)
+{
+    *loop = kmp_loop_current();
+    if (!*loop)
+        return false;
+
+    ncnn::KMPLoop* l = *loop;
+
+    // the previous chunk of this task has finished
+    ncnn::KMPTask* task = (ncnn::KMPTask*)tls_task.get();
+    if (task && task->pending)
+    {
+        __atomic_add_fetch(&l->done, task->pending, __ATOMIC_RELEASE);
+        task->pending = 0;
+    }
+
+    if (l->guided)
+    {
+        // chunk shrinks with the remaining iterations
+        long i = __atomic_load_n(&l->next, __ATOMIC_RELAXED);
+        for (;;)
+        {
+            long remain = l->count - i;
+            if (remain <= 0)
+            {
+                kmp_loop_end();
+                return false;
+            }
+
+            long n = std::max(remain / (2 * l->num_threads), l->chunk);
+            n = std::min(n, remain);
+
+            if (__atomic_compare_exchange_n(&l->next, &i, i + n, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+            {
+                *first = i;
+                *last = i + n;
+                if (task)
+                    task->pending = n;
+                return true;
+            }
+        }
+    }
+
+    long i = __atomic_fetch_add(&l->next, l->chunk, __ATOMIC_RELAXED);
+    if (i >= l->count)
+    {
+        kmp_loop_end();
+        return false;
+    }
+
+    *first = i;
+    *last = std::min(i + l->chunk, l->count);
+    if (task)
+        task->pending = *last - *first;
+    return true;
+}
+
+// wait for the chunks the other threads of the team still run
+static void kmp_loop_wait(ncnn::KMPLoop* loop)
+{
+    for (int i = 0; __atomic_load_n(&loop->done, __ATOMIC_ACQUIRE) < loop->count; i++)
+    {
+        if (i < 1024)
+            ncnn::kmp_cpu_relax();
+        else
+            sched_yield();
+    }
+}
+
+static void* kmp_threadfunc(void* args)
+{
+    int tid = *(int*)args;
+
+#if NCNN_SIMPLEOMP_WORKSTEALING
+    tls_worker_id.set(reinterpret_cast<void*>((size_t)tid));
+
+    ncnn::KMPTaskDeque& deque = g_kmp_global.kmp_deques[tid];
+    ncnn::KMPParker& parker = g_kmp_global.kmp_parker;
+
+    for (;;)
+    {
+        ncnn::KMPTask* task = deque.pop_back(0);
+        if (!task)
+        {
+            task = kmp_steal_task(tid);
+        }
+
+        // spin a while, the next parallel region usually follows shortly
+        for (int i = 0; !task && i < KMP_SPIN_COUNT; i++)
+        {
+            ncnn::kmp_cpu_relax();
+            task = kmp_steal_task(tid);
+        }
+
+        if (!task)
+        {
+            int epoch = parker.prepare();
+
+            task = kmp_steal_task(tid);
+            if (task)
+            {
+                parker.cancel();
+            }
+            else if (__atomic_load_n(&g_kmp_global.kmp_quit, __ATOMIC_SEQ_CST))
+            {
+                parker.cancel();
+                break;
+            }
+            else
+            {
+                parker.park(epoch);
+                continue;
+            }
+        }
+
+        kmp_execute_task(task, tid);
+    }
+#else  // NCNN_SIMPLEOMP_WORKSTEALING
+    for (;;)
     {
-        finish_lock.lock();
-        if (num_threads_to_wait != 0)
+        ncnn::KMPTask* task;
+        g_kmp_global.kmp_task_queue->get(task);
+
+        // fprintf(stderr, "get %d\n", tid);
+
+        if (!task->fn)
+            break;
+
+        kmp_execute_task(task, tid);
+    }
+#endif // NCNN_SIMPLEOMP_WORKSTEALING
+
+    // fprintf(stderr, "exit\n");
+    return 0;
+}
+
+#if __clang__
+int32_t __kmpc_global_thread_num(void* /*loc*/)
+{
+    // NCNN_LOGE("__kmpc_global_thread_num");
+    return 0;
+}
+
+void __kmpc_push_num_threads(void* /*loc*/, int32_t /*gtid*/, int32_t num_threads)
+{
+    // NCNN_LOGE("__kmpc_push_num_threads %d", num_threads);
+    omp_set_num_threads(num_threads);
+}
+
+
+void __kmpc_fork_call(void* /*loc*/, int32_t argc, kmpc_micro fn, ...)
+{
+    g_kmp_global.try_init();
+
+    // NCNN_LOGE("__kmpc_fork_call %d", argc);
+    int num_threads = omp_get_num_threads();
+
+    // build argv
+    void* argv[32];
+    {
+        va_list ap;
+        va_start(ap, fn);
+        for (int i = 0; i < argc; i++)
+            argv[i] = va_arg(ap, void*);
+        va_end(ap);
+    }
+
+    ncnn::KMPTeam team(num_threads);
+
+    // TODO portable stack allocation
+    ncnn::KMPTask* tasks = (ncnn::KMPTask*)alloca(num_threads * sizeof(ncnn::KMPTask));
+    for (int i = 0; i < num_threads; i++)
+    {
+        tasks[i].fn = fn;
+        tasks[i].argc = argc;
+        tasks[i].argv = (void**)argv;
+        kmp_init_task(&tasks[i], &team, i);
+    }
+
+    if (g_kmp_global.kmp_max_threads == 1 || num_threads == 1)
+    {
+        for (int i = 0; i < num_threads; i++)
         {
-            finish_condition.wait(finish_lock);
+            kmp_run_task(&tasks[i], 0);
         }
-        finish_lock.unlock();
+
+        return;
     }
+
+    // dispatch 1 ~ num_threads
+    kmp_dispatch(tasks + 1, num_threads - 1);
+
+    // dispatch 0
+    kmp_run_task(&tasks[0], 0);
+
+    // wait for finished
+    kmp_wait_team(&team);
 }
 
 void __kmpc_for_static_init_4(void* /*loc*/, int32_t gtid, int32_t /*sched*/, int32_t* last, int32_t* lower, int32_t* upper, int32_t* /*stride*/, int32_t /*incr*/, int32_t /*chunk*/)
@@ -650,16 +1302,123 @@ void __kmpc_for_static_fini(void* /*loc*/, int32_t gtid)
     // NCNN_LOGE("__kmpc_for_static_fini");
     (void)gtid;
 }
+
+static void kmp_dispatch_init(int32_t schedule, int64_t lb, int64_t ub, int64_t st, int64_t chunk)
+{
+    long count = 0;
+    if (st > 0 && ub >= lb)
+        count = (long)((ub - lb) / st + 1);
+    if (st < 0 && lb >= ub)
+        count = (long)((lb - ub) / -st + 1);
+
+    // strip the monotonic / nonmonotonic modifiers
+    schedule &= ~((1 << 29) | (1 << 30));
+
+    if (schedule == 34)
+    {
+        // kmp_sch_static, one even chunk per thread
+        int num_threads = omp_get_num_threads();
+        chunk = (count + num_threads - 1) / num_threads;
+    }
+
+    // kmp_sch_guided_chunked is 36, the others are served as dynamic
+    kmp_loop_begin(schedule == 36, (long)lb, (long)st, count, (long)chunk);
+}
+
+static int kmp_dispatch_next(int32_t* p_last, int64_t* p_lb, int64_t* p_ub, int64_t* p_st)
+{
+    ncnn::KMPLoop* loop;
+    long first;
+    long last;
+    if (!kmp_loop_next(&loop, &first, &last))
+        return 0;
+
+    if (p_last)
+        *p_last = last == loop->count;
+    *p_lb = loop->start + first * loop->incr;
+    *p_ub = loop->start + (last - 1) * loop->incr;
+    if (p_st)
+        *p_st = loop->incr;
+    return 1;
+}
+
+void __kmpc_dispatch_init_4(void* /*loc*/, int32_t /*gtid*/, int32_t schedule, int32_t lb, int32_t ub, int32_t st, int32_t chunk)
+{
+    kmp_dispatch_init(schedule, lb, ub, st, chunk);
+}
+
+void __kmpc_dispatch_init_4u(void* /*loc*/, int32_t /*gtid*/, int32_t schedule, uint32_t lb, uint32_t ub, int32_t st, int32_t chunk)
+{
+    kmp_dispatch_init(schedule, lb, ub, st, chunk);
+}
+
+void __kmpc_dispatch_init_8(void* /*loc*/, int32_t /*gtid*/, int32_t schedule, int64_t lb, int64_t ub, int64_t st, int64_t chunk)
+{
+    kmp_dispatch_init(schedule, lb, ub, st, chunk);
+}
+
+void __kmpc_dispatch_init_8u(void* /*loc*/, int32_t /*gtid*/, int32_t schedule, uint64_t lb, uint64_t ub, int64_t st, int64_t chunk)
+{
+    kmp_dispatch_init(schedule, (int64_t)lb, (int64_t)ub, st, chunk);
+}
+
+int __kmpc_dispatch_next_4(void* /*loc*/, int32_t /*gtid*/, int32_t* p_last, int32_t* p_lb, int32_t* p_ub, int32_t* p_st)
+{
+    int64_t lb;
+    int64_t ub;
+    int64_t st;
+    if (!kmp_dispatch_next(p_last, &lb, &ub, &st))
+        return 0;
+
+    *p_lb = (int32_t)lb;
+    *p_ub = (int32_t)ub;
+    if (p_st)
+        *p_st = (int32_t)st;
+    return 1;
+}
+
+int __kmpc_dispatch_next_4u(void* /*loc*/, int32_t /*gtid*/, int32_t* p_last, uint32_t* p_lb, uint32_t* p_ub, int32_t* p_st)
+{
+    int64_t lb;
+    int64_t ub;
+    int64_t st;
+    if (!kmp_dispatch_next(p_last, &lb, &ub, &st))
+        return 0;
+
+    *p_lb = (uint32_t)lb;
+    *p_ub = (uint32_t)ub;
+    if (p_st)
+        *p_st = (int32_t)st;
+    return 1;
+}
+
+int __kmpc_dispatch_next_8(void* /*loc*/, int32_t /*gtid*/, int32_t* p_last, int64_t* p_lb, int64_t* p_ub, int64_t* p_st)
+{
+    return kmp_dispatch_next(p_last, p_lb, p_ub, p_st);
+}
+
+int __kmpc_dispatch_next_8u(void* /*loc*/, int32_t /*gtid*/, int32_t* p_last, uint64_t* p_lb, uint64_t* p_ub, int64_t* p_st)
+{
+    int64_t lb;
+    int64_t ub;
+    if (!kmp_dispatch_next(p_last, &lb, &ub, p_st))
+        return 0;
+
+    *p_lb = (uint64_t)lb;
+    *p_ub = (uint64_t)ub;
+    return 1;
+}
 #else  // __clang__
 
 static ncnn::ThreadLocalStorage tls_parallel_context;
 
 struct parallel_context
 {
-    int num_threads_to_wait;
-    ncnn::Mutex finish_lock;
-    ncnn::ConditionVariable finish_condition;
+    ncnn::KMPTeam* team;
     ncnn::KMPTask* tasks;
+    double trace_start;
+    kmp_task_context saved;
+    parallel_context* prev;
 };
 
 void GOMP_parallel_start(void (*fn)(void*), void* data, unsigned num_threads)
@@ -672,44 +1431,41 @@ void GOMP_parallel_start(void (*fn)(void*), void* data, unsigned num_threads)
         num_threads = omp_get_max_threads();
     }
 
-    if (g_kmp_global.kmp_max_threads == 1 || num_threads == 1)
-    {
-        for (unsigned i = 0; i < num_threads; i++)
-        {
-            tls_num_threads.set(reinterpret_cast<void*>((size_t)num_threads));
-            tls_thread_num.set(reinterpret_cast<void*>((size_t)i));
-
-            fn(data);
-        }
-
-        return;
-    }
-
     parallel_context* pc = new parallel_context;
 
+    // nested regions stack up
+    pc->prev = (parallel_context*)tls_parallel_context.get();
     tls_parallel_context.set(pc);
 
-    pc->num_threads_to_wait = num_threads - 1;
+    pc->team = new ncnn::KMPTeam(num_threads);
 
-    pc->tasks = new ncnn::KMPTask[num_threads - 1];
-    for (unsigned i = 0; i < num_threads - 1; i++)
+    pc->tasks = new ncnn::KMPTask[num_threads];
+    for (unsigned i = 0; i < num_threads; i++)
     {
         pc->tasks[i].fn = fn;
         pc->tasks[i].data = data;
-        pc->tasks[i].num_threads = num_threads;
-        pc->tasks[i].thread_num = i + 1;
-        pc->tasks[i].num_threads_to_wait = &pc->num_threads_to_wait;
-        pc->tasks[i].finish_lock = &pc->finish_lock;
-        pc->tasks[i].finish_condition = &pc->finish_condition;
+        kmp_init_task(&pc->tasks[i], pc->team, i);
     }
 
-    // dispatch 1 ~ num_threads
-    g_kmp_global.kmp_task_queue->dispatch(pc->tasks, num_threads - 1);
+    if (g_kmp_global.kmp_max_threads == 1 || num_threads == 1)
+    {
+        for (unsigned i = 1; i < num_threads; i++)
+        {
+            kmp_execute_task(&pc->tasks[i], 0);
+        }
+    }
+    else
+    {
+        // dispatch 1 ~ num_threads
+        kmp_dispatch(pc->tasks + 1, num_threads - 1);
+    }
 
     // dispatch 0
     {
-        tls_num_threads.set(reinterpret_cast<void*>((size_t)num_threads));
-        tls_thread_num.set(reinterpret_cast<void*>((size_t)0));
+        // the master task runs in the caller until GOMP_parallel_end
+        kmp_enter_task(&pc->tasks[0], &pc->saved);
+
+        pc->trace_start = trace_begin();
     }
 }
 
@@ -717,85 +1473,202 @@ void GOMP_parallel_end()
 {
     // NCNN_LOGE("GOMP_parallel_end");
     parallel_context* pc = (parallel_context*)tls_parallel_context.get();
-    tls_parallel_context.set(0);
+    tls_parallel_context.set(pc->prev);
+
+    trace_parallel_task(pc->trace_start, 0, pc->team->num_threads);
+
+    kmp_leave_task(&pc->saved);
 
     // wait for finished
-    {
-        pc->finish_lock.lock();
-        if (pc->num_threads_to_wait != 0)
-        {
-            pc->finish_condition.wait(pc->finish_lock);
-        }
-        pc->finish_lock.unlock();
-    }
+    kmp_wait_team(pc->team);
 
+    delete pc->team;
     delete[] pc->tasks;
     delete pc;
 }
 
-void GOMP_parallel(void (*fn)(void*), void* data, unsigned num_threads, unsigned int /*flags*/)
+static long gomp_loop_count(long start, long end, long incr)
+{
+    if (incr > 0)
+        return end > start ? (end - start + incr - 1) / incr : 0;
+
+    return start > end ? (start - end - incr - 1) / -incr : 0;
+}
+
+// guided -1 for a plain parallel region, 0 / 1 for the combined dynamic / guided parallel loop
+static void gomp_parallel(void (*fn)(void*), void* data, unsigned num_threads, int guided, long start, long end, long incr, long chunk_size)
 {
     g_kmp_global.try_init();
 
-    // NCNN_LOGE("GOMP_parallel %p %p %u", fn, data, num_threads);
     if (num_threads == 0)
     {
         num_threads = omp_get_max_threads();
     }
 
-    if (g_kmp_global.kmp_max_threads == 1 || num_threads == 1)
-    {
-        for (unsigned i = 0; i < num_threads; i++)
-        {
-            tls_num_threads.set(reinterpret_cast<void*>((size_t)num_threads));
-            tls_thread_num.set(reinterpret_cast<void*>((size_t)i));
+    ncnn::KMPTeam team(num_threads);
 
-            fn(data);
-        }
-
-        return;
+    // the combined parallel loop is set up before the team starts
+    ncnn::KMPLoop* loop = 0;
+    if (guided != -1)
+    {
+        loop = team.get_loop(0, guided, start, incr, gomp_loop_count(start, end, incr), chunk_size < 1 ? 1 : chunk_size);
     }
 
-    int num_threads_to_wait = num_threads - 1;
-    ncnn::Mutex finish_lock;
-    ncnn::ConditionVariable finish_condition;
-
     // TODO portable stack allocation
-    ncnn::KMPTask* tasks = (ncnn::KMPTask*)alloca((num_threads - 1) * sizeof(ncnn::KMPTask));
-    for (unsigned i = 0; i < num_threads - 1; i++)
+    ncnn::KMPTask* tasks = (ncnn::KMPTask*)alloca(num_threads * sizeof(ncnn::KMPTask));
+    for (unsigned i = 0; i < num_threads; i++)
     {
         tasks[i].fn = fn;
         tasks[i].data = data;
-        tasks[i].num_threads = num_threads;
-        tasks[i].thread_num = i + 1;
-        tasks[i].num_threads_to_wait = &num_threads_to_wait;
-        tasks[i].finish_lock = &finish_lock;
-        tasks[i].finish_condition = &finish_condition;
-    }
+        kmp_init_task(&tasks[i], &team, i);
 
-    // dispatch 1 ~ num_threads
-    g_kmp_global.kmp_task_queue->dispatch(tasks, num_threads - 1);
+        if (loop)
+        {
+            tasks[i].loop_seq = 1;
+            tasks[i].loop = loop;
+        }
+    }
 
-    // dispatch 0
+    if (g_kmp_global.kmp_max_threads == 1 || num_threads == 1)
     {
-        tls_num_threads.set(reinterpret_cast<void*>((size_t)num_threads));
-        tls_thread_num.set(reinterpret_cast<void*>((size_t)0));
+        for (unsigned i = 0; i < num_threads; i++)
+        {
+            kmp_run_task(&tasks[i], 0);
+        }
 
-        fn(data);
+        return;
     }
 
+    // dispatch 1 ~ num_threads
+    kmp_dispatch(tasks + 1, num_threads - 1);
+
+    // dispatch 0
+    kmp_run_task(&tasks[0], 0);
+
     // wait for finished
+    kmp_wait_team(&team);
+}
+
+void GOMP_parallel(void (*fn)(void*), void* data, unsigned num_threads, unsigned int /*flags*/)
+{
+    // NCNN_LOGE("GOMP_parallel %p %p %u", fn, data, num_threads);
+    gomp_parallel(fn, data, num_threads, -1, 0, 0, 0, 0);
+}
+
+void GOMP_parallel_loop_dynamic(void (*fn)(void*), void* data, unsigned num_threads, long start, long end, long incr, long chunk_size, unsigned /*flags*/)
+{
+    gomp_parallel(fn, data, num_threads, 0, start, end, incr, chunk_size);
+}
+
+void GOMP_parallel_loop_nonmonotonic_dynamic(void (*fn)(void*), void* data, unsigned num_threads, long start, long end, long incr, long chunk_size, unsigned /*flags*/)
+{
+    gomp_parallel(fn, data, num_threads, 0, start, end, incr, chunk_size);
+}
+
+void GOMP_parallel_loop_guided(void (*fn)(void*), void* data, unsigned num_threads, long start, long end, long incr, long chunk_size, unsigned /*flags*/)
+{
+    gomp_parallel(fn, data, num_threads, 1, start, end, incr, chunk_size);
+}
+
+void GOMP_parallel_loop_nonmonotonic_guided(void (*fn)(void*), void* data, unsigned num_threads, long start, long end, long incr, long chunk_size, unsigned /*flags*/)
+{
+    gomp_parallel(fn, data, num_threads, 1, start, end, incr, chunk_size);
+}
+
+void GOMP_parallel_loop_runtime(void (*fn)(void*), void* data, unsigned num_threads, long start, long end, long incr, unsigned /*flags*/)
+{
+    gomp_parallel(fn, data, num_threads, 0, start, end, incr, 1);
+}
+
+static bool gomp_loop_next(long* istart, long* iend)
+{
+    ncnn::KMPLoop* loop;
+    long first;
+    long last;
+    if (!kmp_loop_next(&loop, &first, &last))
+        return false;
+
+    *istart = loop->start + first * loop->incr;
+    *iend = loop->start + last * loop->incr;
+    return true;
+}
+
+static bool gomp_loop_start(int guided, long start, long end, long incr, long chunk_size, long* istart, long* iend)
+{
+    kmp_loop_begin(guided, start, incr, gomp_loop_count(start, end, incr), chunk_size);
+
+    return gomp_loop_next(istart, iend);
+}
+
+bool GOMP_loop_dynamic_start(long start, long end, long incr, long chunk_size, long* istart, long* iend)
+{
+    return gomp_loop_start(0, start, end, incr, chunk_size, istart, iend);
+}
+
+bool GOMP_loop_dynamic_next(long* istart, long* iend)
+{
+    return gomp_loop_next(istart, iend);
+}
+
+bool GOMP_loop_nonmonotonic_dynamic_start(long start, long end, long incr, long chunk_size, long* istart, long* iend)
+{
+    return gomp_loop_start(0, start, end, incr, chunk_size, istart, iend);
+}
+
+bool GOMP_loop_nonmonotonic_dynamic_next(long* istart, long* iend)
+{
+    return gomp_loop_next(istart, iend);
+}
+
+bool GOMP_loop_guided_start(long start, long end, long incr, long chunk_size, long* istart, long* iend)
+{
+    return gomp_loop_start(1, start, end, incr, chunk_size, istart, iend);
+}
+
+bool GOMP_loop_guided_next(long* istart, long* iend)
+{
+    return gomp_loop_next(istart, iend);
+}
+
+bool GOMP_loop_nonmonotonic_guided_start(long start, long end, long incr, long chunk_size, long* istart, long* iend)
+{
+    return gomp_loop_start(1, start, end, incr, chunk_size, istart, iend);
+}
+
+bool GOMP_loop_nonmonotonic_guided_next(long* istart, long* iend)
+{
+    return gomp_loop_next(istart, iend);
+}
+
+bool GOMP_loop_runtime_start(long start, long end, long incr, long* istart, long* iend)
+{
+    return gomp_loop_start(0, start, end, incr, 1, istart, iend);
+}
+
+bool GOMP_loop_runtime_next(long* istart, long* iend)
+{
+    return gomp_loop_next(istart, iend);
+}
+
+void GOMP_loop_end()
+{
+    // all iterations of the loop have finished on return, the rest of the team is not waited for
+    ncnn::KMPTask* task = (ncnn::KMPTask*)tls_task.get();
+    if (task && task->last_loop)
     {
-        finish_lock.lock();
-        if (num_threads_to_wait != 0)
-        {
-            finish_condition.wait(finish_lock);
-        }
-        finish_lock.unlock();
+        kmp_loop_wait(task->last_loop);
     }
+
+    kmp_loop_end();
+}
+
+void GOMP_loop_end_nowait()
+{
+    kmp_loop_end();
 }
 #endif // __clang__
 
+
 #ifdef __cplusplus
 } // extern "C"
 #endif
@@ -23,6 +23,12 @@
 
 // This minimal openmp runtime implementation only supports the llvm openmp abi
 // and only supports #pragma omp parallel for num_threads(X)
+// worksharing loops with schedule(dynamic / guided) are supported
+// with gcc the end of such a loop without nowait waits for the iterations of that loop only
+// barriers are not, #pragma omp barrier, #pragma omp for schedule(static) without nowait
+// and any #pragma omp for without nowait built by clang fail to link
+// build with NCNN_SIMPLEOMP_WORKSTEALING for the work-stealing scheduler
+// which also runs nested parallel regions without blocking the pool
 
 #ifdef __cplusplus
 extern "C" {
@@ -0,0 +1,198 @@
+// Tencent is pleased to support the open source community by making ncnn available.
+//
+// Copyright (C) 2024 THL A29 Limited, a Tencent company. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this file except
+// in compliance with the License. You may obtain a copy of the License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software distributed
+// under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+// CONDITIONS OF ANY KIND, either express or implied. See the License for the
+// specific language governing permissions and limitations under the License.
+
+#include "threadplanner.h"
+
+#include "layerprofiler.h"
+
+namespace ncnn {
+
+static Mutex g_parallel_cost_lock;
+static std::vector<ParallelCost> g_parallel_costs;
+
+static ParallelCost measure_parallel_cost(int num_threads)
+{
+    ParallelCost cost;
+
+    // multiply-add over a cache resident buffer, like the elementwise kernels
+    const int size = 16384;
+    std::vector<float> buf(size, 1.f);
+    float* ptr = &buf[0];
+
+    double start = get_current_time();
+    for (int r = 0; r < 32; r++)
+    {
+        for (int i = 0; i < size; i++)
+        {
+            ptr[i] = ptr[i] * 0.999f + 0.001f;
+        }
+    }
+    double end = get_current_time();
+
+    volatile float sink = ptr[0] + ptr[size - 1];
+    (void)sink;
+
+    cost.elements_per_ms = size * 32 / std::max(end - start, 0.001);
+
+#ifdef _OPENMP
+    // the first regions spin up the thread pool
+    std::vector<int> hits(num_threads, 0);
+    for (int r = 0; r < 40; r++)
+    {
+        if (r == 8)
+            start = get_current_time();
+
+        #pragma omp parallel for num_threads(num_threads)
+        for (int i = 0; i < num_threads; i++)
+        {
+            hits[i]++;
+        }
+    }
+    end = get_current_time();
+
+    cost.region_ms = (end - start) / 32;
+#else
+    (void)num_threads;
+    cost.region_ms = 0;
+#endif
+
+    return cost;
+}
+
+ParallelCost get_parallel_cost(int num_threads)
+{
+    {
+        MutexLockGuard guard(g_parallel_cost_lock);
+
+        if (num_threads < (int)g_parallel_costs.size() && g_parallel_costs[num_threads].region_ms >= 0)
+            return g_parallel_costs[num_threads];
+    }
+
+    // measure without the lock, layers reading the known costs must not wait for the calibration
+    ParallelCost cost = measure_parallel_cost(num_threads);
+
+    MutexLockGuard guard(g_parallel_cost_lock);
+
+    if ((int)g_parallel_costs.size() <= num_threads)
+    {
+        ParallelCost unknown;
+        unknown.region_ms = -1;
+        unknown.elements_per_ms = 0;
+        g_parallel_costs.resize(num_threads + 1, unknown);
+    }
+
+    // keep the cost published first when another thread measured concurrently
+    if (g_parallel_costs[num_threads].region_ms < 0)
+    {
+        g_parallel_costs[num_threads] = cost;
+    }
+
+    return g_parallel_costs[num_threads];
+}
+
+LayerThreadPlanner::LayerThreadPlanner(int layer_count)
+{
+    choices.resize(layer_count);
+}
+
+int LayerThreadPlanner::get(const Layer* layer, int layer_index, const std::vector<Mat>& blob_mats, int num_threads, std::vector<Mat>& bottom_shapes)
+{
+    {
+        MutexLockGuard guard(lock);
+
+        const std::vector<Choice>& layer_choices = choices[layer_index];
+        for (size_t j = 0; j < layer_choices.size(); j++)
+        {
+            const Choice& choice = layer_choices[j];
+            if (choice.num_threads_full != num_threads)
+                continue;
+
+            bool hit = choice.bottom_shapes.size() == layer->bottoms.size();
+            for (size_t i = 0; hit && i < layer->bottoms.size(); i++)
+            {
+                const Mat& m = blob_mats[layer->bottoms[i]];
+                const Mat& shape = choice.bottom_shapes[i];
+                hit = m.dims == shape.dims && m.w == shape.w && m.h == shape.h && m.d == shape.d && m.c == shape.c && m.elemsize == shape.elemsize && m.elempack == shape.elempack;
+            }
+
+            if (hit)
+                return choice.num_threads;
+
+            break;
+        }
+    }
+
+    bottom_shapes.resize(layer->bottoms.size());
+    for (size_t i = 0; i < layer->bottoms.size(); i++)
+    {
+        bottom_shapes[i] = blob_storage_shape(blob_mats[layer->bottoms[i]]);
+    }
+
+    return 0;
+}
+
+void LayerThreadPlanner::set(const Layer* layer, int layer_index, const std::vector<Mat>& bottom_shapes, const std::vector<Mat>& blob_mats, int num_threads)
+{
+    std::vector<Mat> top_shapes(layer->tops.size());
+    for (size_t i = 0; i < layer->tops.size(); i++)
+    {
+        top_shapes[i] = blob_storage_shape(blob_mats[layer->tops[i]]);
+    }
+
+    Choice choice;
+    choice.num_threads_full = num_threads;
+    choice.num_threads = choose(estimate_layer_workload(layer, bottom_shapes, top_shapes), num_threads);
+    choice.bottom_shapes = bottom_shapes;
+
+    MutexLockGuard guard(lock);
+
+    // one choice per thread count, extractors with other counts keep theirs
+    std::vector<Choice>& layer_choices = choices[layer_index];
+    for (size_t j = 0; j < layer_choices.size(); j++)
+    {
+        if (layer_choices[j].num_threads_full == num_threads)
+        {
+            layer_choices[j] = choice;
+            return;
+        }
+    }
+
+    layer_choices.push_back(choice);
+}
+
+int LayerThreadPlanner::choose(const LayerWorkload& workload, int num_threads)
+{
+    const ParallelCost cost = get_parallel_cost(num_threads);
+    if (cost.region_ms <= 0 || num_threads <= 1)
+        return num_threads;
+
+    const double elements = (double)workload.macs + (double)(workload.bytes_read + workload.bytes_written) / 4;
+    const double work_ms = elements / cost.elements_per_ms;
+
+    int best = 1;
+    double best_ms = work_ms;
+    for (int n = 2; n <= num_threads; n++)
+    {
+        const double ms = work_ms / n + cost.region_ms * (n - 1) / (num_threads - 1);
+        if (ms < best_ms)
+        {
+            best = n;
+            best_ms = ms;
+        }
+    }
+
+    return best;
+}
+
+} // namespace ncnn
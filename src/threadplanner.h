@@ -0,0 +1,70 @@
+// Tencent is pleased to support the open source community by making ncnn available.
+//
+// Copyright (C) 2024 THL A29 Limited, a Tencent company. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this file except
+// in compliance with the License. You may obtain a copy of the License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software distributed
+// under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+// CONDITIONS OF ANY KIND, either express or implied. See the License for the
+// specific language governing permissions and limitations under the License.
+
+#ifndef NCNN_THREADPLANNER_H
+#define NCNN_THREADPLANNER_H
+
+#include "benchmark.h"
+#include "layer.h"
+#include "mat.h"
+#include "platform.h"
+
+namespace ncnn {
+
+// fork and join cost of one parallel region on a given thread count
+// and the single thread rate of a streaming elementwise loop
+struct ParallelCost
+{
+    double region_ms;
+    double elements_per_ms;
+};
+
+// measured once per thread count and process
+ParallelCost get_parallel_cost(int num_threads);
+
+// picks the thread count of every layer for Option::use_adaptive_threads
+// the choice is made from the workload of a run with full threads
+// and kept per full thread count until the bottom shapes change
+class LayerThreadPlanner
+{
+public:
+    LayerThreadPlanner(int layer_count);
+
+    // thread count for running the layer on blob_mats
+    // return 0 and capture the bottom shapes if the choice is still open
+    int get(const Layer* layer, int layer_index, const std::vector<Mat>& blob_mats, int num_threads, std::vector<Mat>& bottom_shapes);
+
+    // decide from the captured bottom shapes and the tops of the finished run
+    void set(const Layer* layer, int layer_index, const std::vector<Mat>& bottom_shapes, const std::vector<Mat>& blob_mats, int num_threads);
+
+    // minimize work / n plus a region cost growing linearly up to num_threads
+    // macs weigh like streamed elements, which errs towards more threads for simd gemm
+    static int choose(const LayerWorkload& workload, int num_threads);
+
+    struct Choice
+    {
+        // thread count the choice was made for
+        int num_threads_full;
+        int num_threads;
+        std::vector<Mat> bottom_shapes;
+    };
+
+    Mutex lock;
+    // per layer, one choice for every full thread count seen
+    std::vector<std::vector<Choice> > choices;
+};
+
+} // namespace ncnn
+
+#endif // NCNN_THREADPLANNER_H
@@ -0,0 +1,400 @@
+// Tencent is pleased to support the open source community by making ncnn available.
+//
+// Copyright (C) 2024 THL A29 Limited, a Tencent company. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this file except
+// in compliance with the License. You may obtain a copy of the License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software distributed
+// under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+// CONDITIONS OF ANY KIND, either express or implied. See the License for the
+// specific language governing permissions and limitations under the License.
+
+#include <stdio.h>
+#include <string.h>
+
+#include "allocator.h"
+#include "mat.h"
+#include "platform.h"
+
+template<typename T>
+static int test_pool_allocator_reuse(float scr)
+{
+    T allocator;
+    allocator.set_size_compare_ratio(scr);
+
+    void* p0 = allocator.fastMalloc(1000);
+    memset(p0, 0, 1000);
+    allocator.fastFree(p0);
+
+    // budget is reusable for size in [1000 * scr, 1000]
+    const size_t limit = scr == 0.f ? 1 : (size_t)(1000 * scr);
+    void* p1 = allocator.fastMalloc(limit);
+    const bool reused = p1 == p0;
+    allocator.fastFree(p1);
+
+    if (!reused)
+    {
+        fprintf(stderr, "test_pool_allocator_reuse %f budget not reused for %d\n", scr, (int)limit);
+        return -1;
+    }
+
+    // too small for the budget
+    void* p2 = allocator.fastMalloc(limit > 2 ? limit / 2 : 1);
+    if (scr != 0.f && p2 == p0)
+    {
+        fprintf(stderr, "test_pool_allocator_reuse %f budget reused for %d\n", scr, (int)(limit / 2));
+        allocator.fastFree(p2);
+        return -1;
+    }
+    allocator.fastFree(p2);
+
+    // too large for the budget
+    void* p3 = allocator.fastMalloc(1001);
+    if (p3 == p0)
+    {
+        fprintf(stderr, "test_pool_allocator_reuse %f budget reused for 1001\n", scr);
+        allocator.fastFree(p3);
+        return -1;
+    }
+    allocator.fastFree(p3);
+
+    return 0;
+}
+
+template<typename T>
+static int test_pool_allocator_statistics()
+{
+    T allocator;
+
+    void* ptrs[8];
+    for (int i = 0; i < 8; i++)
+    {
+        ptrs[i] = allocator.fastMalloc(4096 * (i + 1));
+    }
+
+    ncnn::PoolAllocatorStatistics stat;
+    allocator.get_statistics(stat);
+    if (stat.hit_count != 0 || stat.miss_count != 8 || stat.payout_count != 8 || stat.budget_count != 0)
+    {
+        fprintf(stderr, "test_pool_allocator_statistics malloc hit=%d miss=%d payout=%d budget=%d\n", stat.hit_count, stat.miss_count, stat.payout_count, stat.budget_count);
+        return -1;
+    }
+
+    for (int i = 0; i < 8; i++)
+    {
+        allocator.fastFree(ptrs[i]);
+    }
+
+    for (int i = 0; i < 8; i++)
+    {
+        ptrs[i] = allocator.fastMalloc(4096 * (i + 1));
+    }
+
+    for (int i = 0; i < 8; i++)
+    {
+        allocator.fastFree(ptrs[i]);
+    }
+
+    allocator.get_statistics(stat);
+    if (stat.hit_count != 8 || stat.miss_count != 8 || stat.payout_count != 0 || stat.budget_count != 8 || stat.budget_size != 4096 * 36)
+    {
+        fprintf(stderr, "test_pool_allocator_statistics reuse hit=%d miss=%d payout=%d budget=%d %d\n", stat.hit_count, stat.miss_count, stat.payout_count, stat.budget_count, (int)stat.budget_size);
+        return -1;
+    }
+
+    allocator.clear();
+
+    allocator.get_statistics(stat);
+    if (stat.budget_count != 0 || stat.budget_size != 0)
+    {
+        fprintf(stderr, "test_pool_allocator_statistics clear budget=%d %d\n", stat.budget_count, (int)stat.budget_size);
+        return -1;
+    }
+
+    return 0;
+}
+
+struct pool_allocator_thread_context
+{
+    ncnn::Allocator* allocator;
+    int seed;
+    int ret;
+};
+
+static void* pool_allocator_thread_worker(void* args)
+{
+    pool_allocator_thread_context* ctx = (pool_allocator_thread_context*)args;
+
+    unsigned int r = ctx->seed;
+
+    void* ptrs[16] = {0};
+    size_t sizes[16] = {0};
+    for (int i = 0; i < 2000; i++)
+    {
+        r = r * 1103515245 + 12345;
+        const int j = (r >> 16) % 16;
+
+        if (ptrs[j])
+        {
+            // nobody else should have touched our block
+            if (((unsigned char*)ptrs[j])[sizes[j] - 1] != (unsigned char)ctx->seed)
+            {
+                ctx->ret = -1;
+            }
+
+            ctx->allocator->fastFree(ptrs[j]);
+            ptrs[j] = 0;
+            continue;
+        }
+
+        sizes[j] = 64 + (r >> 8) % 65536;
+        ptrs[j] = ctx->allocator->fastMalloc(sizes[j]);
+        memset(ptrs[j], ctx->seed, sizes[j]);
+    }
+
+    for (int j = 0; j < 16; j++)
+    {
+        if (ptrs[j])
+            ctx->allocator->fastFree(ptrs[j]);
+    }
+
+    return 0;
+}
+
+template<typename T>
+static int test_pool_allocator_threads()
+{
+#if NCNN_THREADS
+    T allocator;
+
+    const int thread_count = 4;
+
+    pool_allocator_thread_context contexts[thread_count];
+    ncnn::Thread* threads[thread_count];
+    for (int i = 0; i < thread_count; i++)
+    {
+        contexts[i].allocator = &allocator;
+        contexts[i].seed = i + 1;
+        contexts[i].ret = 0;
+        threads[i] = new ncnn::Thread(pool_allocator_thread_worker, &contexts[i]);
+    }
+
+    int ret = 0;
+    for (int i = 0; i < thread_count; i++)
+    {
+        threads[i]->join();
+        delete threads[i];
+
+        if (contexts[i].ret != 0)
+            ret = -1;
+    }
+
+    ncnn::PoolAllocatorStatistics stat;
+    allocator.get_statistics(stat);
+    if (stat.payout_count != 0 || stat.hit_count + stat.miss_count == 0)
+    {
+        fprintf(stderr, "test_pool_allocator_threads hit=%d miss=%d payout=%d\n", stat.hit_count, stat.miss_count, stat.payout_count);
+        return -1;
+    }
+
+    if (ret != 0)
+    {
+        fprintf(stderr, "test_pool_allocator_threads block corrupted\n");
+    }
+
+    return ret;
+#else
+    return 0;
+#endif
+}
+
+static void* threadlocal_pool_allocator_free_worker(void* args)
+{
+    void** allocator_and_ptr = (void**)args;
+
+    ncnn::Allocator* allocator = (ncnn::Allocator*)allocator_and_ptr[0];
+    allocator->fastFree(allocator_and_ptr[1]);
+
+    return 0;
+}
+
+static void* threadlocal_pool_allocator_malloc_worker(void* args)
+{
+    void** allocator_and_ptr = (void**)args;
+
+    // the size comes in place of the pointer
+    ncnn::Allocator* allocator = (ncnn::Allocator*)allocator_and_ptr[0];
+    void* ptr = allocator->fastMalloc((size_t)allocator_and_ptr[1]);
+    allocator->fastFree(ptr);
+    allocator_and_ptr[1] = ptr;
+
+    return 0;
+}
+
+static int test_threadlocal_pool_allocator_cross_thread()
+{
+#if NCNN_THREADS
+    ncnn::ThreadLocalPoolAllocator allocator;
+
+    void* ptr = allocator.fastMalloc(1000);
+    void* allocator_and_ptr[2] = {&allocator, ptr};
+
+    // free on another thread
+    {
+        ncnn::Thread t(threadlocal_pool_allocator_free_worker, allocator_and_ptr);
+        t.join();
+    }
+
+    ncnn::PoolAllocatorStatistics stat;
+    allocator.get_statistics(stat);
+    if (stat.payout_count != 0 || stat.budget_count != 1)
+    {
+        fprintf(stderr, "test_threadlocal_pool_allocator_cross_thread payout=%d budget=%d\n", stat.payout_count, stat.budget_count);
+        return -1;
+    }
+
+#if !(defined _WIN32 && !(defined __MINGW32__))
+    // the exited thread handed its cache back to the shared pool
+    void* ptr2 = allocator.fastMalloc(1000);
+    allocator.fastFree(ptr2);
+    if (ptr2 != ptr)
+    {
+        fprintf(stderr, "test_threadlocal_pool_allocator_cross_thread block stranded in exited thread\n");
+        return -1;
+    }
+#endif
+
+    // blocks beyond the thread cache budget go to the shared pool at once
+    const size_t large_size = 16 * 1024 * 1024;
+    void* large = allocator.fastMalloc(large_size);
+    allocator.fastFree(large);
+
+    allocator_and_ptr[1] = (void*)large_size;
+    {
+        ncnn::Thread t(threadlocal_pool_allocator_malloc_worker, allocator_and_ptr);
+        t.join();
+    }
+
+    if (allocator_and_ptr[1] != large)
+    {
+        fprintf(stderr, "test_threadlocal_pool_allocator_cross_thread large block kept in thread cache\n");
+        return -1;
+    }
+
+    allocator.clear();
+
+    allocator.get_statistics(stat);
+    if (stat.budget_count != 0)
+    {
+        fprintf(stderr, "test_threadlocal_pool_allocator_cross_thread clear budget=%d\n", stat.budget_count);
+        return -1;
+    }
+#endif
+
+    return 0;
+}
+
+template<typename T>
+static int test_pool_allocator_hugepage()
+{
+    T allocator;
+    allocator.set_use_hugepage(true);
+
+    // huge page backing is best effort, the memory must work either way
+    const size_t size = 5 * NCNN_HUGEPAGE_SIZE + 1000;
+    unsigned char* p0 = (unsigned char*)allocator.fastMalloc(size);
+    memset(p0, 1, size);
+
+    unsigned char* p1 = (unsigned char*)allocator.fastMalloc(1000);
+    memset(p1, 2, 1000);
+
+    ncnn::PoolAllocatorStatistics stat;
+    allocator.get_statistics(stat);
+
+#if defined __linux__
+    if (stat.hugepage_size < 5 * NCNN_HUGEPAGE_SIZE || stat.hugepage_size > 6 * NCNN_HUGEPAGE_SIZE)
+    {
+        fprintf(stderr, "test_pool_allocator_hugepage hugepage_size %d\n", (int)stat.hugepage_size);
+        allocator.fastFree(p0);
+        allocator.fastFree(p1);
+        return -1;
+    }
+#endif
+
+    if (p0[size - 1] != 1 || p1[999] != 2)
+    {
+        fprintf(stderr, "test_pool_allocator_hugepage memory corrupted\n");
+        allocator.fastFree(p0);
+        allocator.fastFree(p1);
+        return -1;
+    }
+
+    allocator.fastFree(p0);
+    allocator.fastFree(p1);
+
+    allocator.clear();
+
+    allocator.get_statistics(stat);
+    if (stat.hugepage_size != 0)
+    {
+        fprintf(stderr, "test_pool_allocator_hugepage clear hugepage_size %d\n", (int)stat.hugepage_size);
+        return -1;
+    }
+
+    return 0;
+}
+
+static int test_fastmalloc_hugepage()
+{
+    const size_t size = 3 * NCNN_HUGEPAGE_SIZE;
+    unsigned char* p = (unsigned char*)ncnn::fastMalloc_hugepage(size);
+    if (!p || (size_t)p % NCNN_MALLOC_ALIGN != 0)
+    {
+        fprintf(stderr, "test_fastmalloc_hugepage bad pointer %p\n", p);
+        ncnn::fastFree(p);
+        return -1;
+    }
+
+    memset(p, 3, size);
+    ncnn::fastFree(p);
+
+    ncnn::set_thread_hugepage_allocation(true);
+    if (!ncnn::get_thread_hugepage_allocation())
+    {
+        fprintf(stderr, "test_fastmalloc_hugepage thread hugepage allocation not enabled\n");
+        return -1;
+    }
+
+    ncnn::Mat m(1024, 1024, 4);
+    m.fill(1.f);
+
+    ncnn::set_thread_hugepage_allocation(false);
+
+    return 0;
+}
+
+int main()
+{
+    return 0
+           || test_pool_allocator_reuse<ncnn::PoolAllocator>(0.f)
+           || test_pool_allocator_reuse<ncnn::PoolAllocator>(0.5f)
+           || test_pool_allocator_reuse<ncnn::PoolAllocator>(0.75f)
+           || test_pool_allocator_reuse<ncnn::PoolAllocator>(1.f)
+           || test_pool_allocator_reuse<ncnn::UnlockedPoolAllocator>(0.f)
+           || test_pool_allocator_reuse<ncnn::UnlockedPoolAllocator>(0.75f)
+           || test_pool_allocator_statistics<ncnn::PoolAllocator>()
+           || test_pool_allocator_statistics<ncnn::UnlockedPoolAllocator>()
+           || test_pool_allocator_reuse<ncnn::ThreadLocalPoolAllocator>(0.f)
+           || test_pool_allocator_reuse<ncnn::ThreadLocalPoolAllocator>(0.5f)
+           || test_pool_allocator_statistics<ncnn::ThreadLocalPoolAllocator>()
+           || test_pool_allocator_threads<ncnn::PoolAllocator>()
+           || test_pool_allocator_threads<ncnn::ThreadLocalPoolAllocator>()
+           || test_threadlocal_pool_allocator_cross_thread()
+           || test_pool_allocator_hugepage<ncnn::PoolAllocator>()
+           || test_pool_allocator_hugepage<ncnn::UnlockedPoolAllocator>()
+           || test_pool_allocator_hugepage<ncnn::ThreadLocalPoolAllocator>()
+           || test_fastmalloc_hugepage();
+}
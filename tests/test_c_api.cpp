@@ -277,13 +277,24 @@ static int test_c_api_2()
     ncnn_mat_t b = ncnn_mat_reshape_3d(a, 4, 2, 3, NULL);
     ncnn_mat_t c = 0;
 
+    // profile records of mylayer
+    int profile_record_count = 0;
+    ncnn_layer_profile_t record = {0};
+    ncnn_blob_profile_t top_blob = {0};
+
     {
         ncnn_extractor_t ex = ncnn_extractor_create(net);
 
+        ncnn_extractor_set_profiling(ex, 1);
+
         ncnn_extractor_input(ex, "data", b);
 
         ncnn_extractor_extract(ex, "output", &c);
 
+        profile_record_count = ncnn_extractor_get_profile_record_count(ex);
+        ncnn_extractor_get_profile_record(ex, 0, &record);
+        ncnn_extractor_get_profile_blob(ex, 0, 1, 0, &top_blob);
+
         ncnn_extractor_destroy(ex);
     }
 
@@ -315,6 +326,16 @@ static int test_c_api_2()
         ncnn_mat_destroy(c2);
     }
 
+    // inplace mylayer clones the input still referenced by b, custom layers have no cost model
+    if (profile_record_count != 1 || record.layer_index != 1 || record.end < record.start || record.bottom_count != 1 || record.top_count != 1 || record.allocated_bytes != 24 * sizeof(float) || record.macs != 0 || record.bytes_read != 24 * sizeof(float) || record.bytes_written != 24 * sizeof(float))
+    {
+        success = false;
+    }
+    if (top_blob.dims != 3 || top_blob.w != 4 || top_blob.h != 2 || top_blob.c != 3 || top_blob.elempack != 1 || top_blob.elemsize != 4)
+    {
+        success = false;
+    }
+
     ncnn_mat_destroy(a);
     ncnn_mat_destroy(b);
     ncnn_mat_destroy(c);
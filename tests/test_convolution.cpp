@@ -12,7 +12,9 @@
 // CONDITIONS OF ANY KIND, either express or implied. See the License for the
 // specific language governing permissions and limitations under the License.
 
+#include "datareader.h"
 #include "layer/convolution.h"
+#include "net.h"
 #include "testutil.h"
 
 static int test_convolution(int w, int h, int c, int outch, int kernel, int dilation, int stride, int pad, int bias)
@@ -418,6 +420,211 @@ static int test_convolution_1()
 }
 #endif // NCNN_INT8
 
+static int test_convolution_kernel_info(int kernel, int use_winograd_convolution)
+{
+    ncnn::ParamDict pd;
+    pd.set(0, 16);                        // num_output
+    pd.set(1, kernel);                    // kernel_w
+    pd.set(6, 16 * 16 * kernel * kernel); // weight_data_size
+
+    std::vector<ncnn::Mat> weights(2);
+    weights[0] = RandomMat(16 * 16 * kernel * kernel);
+    weights[1] = RandomMat(16);
+
+    ncnn::Option opt;
+    opt.num_threads = 1;
+    opt.use_winograd_convolution = use_winograd_convolution;
+
+    ncnn::Layer* op = ncnn::create_layer("Convolution");
+    op->load_param(pd);
+    op->load_model(ncnn::ModelBinFromMatArray(weights.data()));
+    op->create_pipeline(opt);
+
+    // a report must be complete and follow the option
+    ncnn::LayerKernelInfo info;
+    int ret = 0;
+    if (op->get_kernel_info(info) == 0)
+    {
+        if (!info.algorithm || !info.isa || !info.precision || info.elempack < 1 || info.out_elempack < 1)
+            ret = -1;
+        else if (!use_winograd_convolution && strncmp(info.algorithm, "winograd", 8) == 0)
+            ret = -1;
+#if defined(__i386__) || defined(__x86_64__) || defined(_M_IX86) || defined(_M_X64)
+        // 16 to 16 channels 3x3s1 always goes winograd on x86
+        else if (use_winograd_convolution && kernel == 3 && strncmp(info.algorithm, "winograd", 8) != 0)
+            ret = -1;
+#endif
+    }
+    else
+    {
+#if defined(__i386__) || defined(__x86_64__) || defined(_M_IX86) || defined(_M_X64)
+        // convolution_x86 reports every pipeline it creates
+        ret = -1;
+#endif
+    }
+
+    op->destroy_pipeline(opt);
+    delete op;
+
+    if (ret != 0)
+    {
+        fprintf(stderr, "test_convolution_kernel_info failed kernel=%d use_winograd_convolution=%d\n", kernel, use_winograd_convolution);
+    }
+
+    return ret;
+}
+
+#if NCNN_STDIO && NCNN_STRING
+static int run_convolution_net(const char* param, const ncnn::Option& opt, const char* autotune_cache, const char* weight_cache, const std::vector<unsigned char>& model, const ncnn::Mat& in, ncnn::Mat& out)
+{
+    ncnn::Net net;
+    net.opt = opt;
+    if (autotune_cache)
+        net.set_autotune_cache(autotune_cache);
+    if (weight_cache)
+        net.set_pipeline_weight_cache(weight_cache);
+
+    if (net.load_param_mem(param) != 0)
+        return -1;
+
+    const unsigned char* mem = model.data();
+    ncnn::DataReaderFromMemory dr(mem);
+    if (net.load_model(dr) != 0)
+        return -1;
+
+    ncnn::Extractor ex = net.create_extractor();
+    ex.input("data", in);
+    return ex.extract("out", out);
+}
+
+static int test_convolution_autotune()
+{
+    // autotune needs the -23330 shape hints
+    static const char* param = "7767517\n"
+                               "2 2\n"
+                               "Input data 0 1 data 0=20 1=20 2=24 -23330=4,3,20,20,24\n"
+                               "Convolution conv 1 1 data out 0=32 1=3 4=1 5=1 6=6912 -23330=4,3,20,20,32\n";
+
+    std::vector<unsigned char> model;
+    AppendModelWeights(model, 6912, 32);
+
+    ncnn::Mat in = RandomMat(20, 20, 24);
+
+    std::string cachepath = TempFilePath("test_convolution_autotune.txt");
+    remove(cachepath.c_str());
+
+    ncnn::Option opt;
+    opt.num_threads = 1;
+
+    ncnn::Mat out;
+    int ret = run_convolution_net(param, opt, 0, 0, model, in, out);
+
+    opt.use_autotune = true;
+
+    ncnn::Mat out_tuned;
+    if (ret == 0)
+        ret = run_convolution_net(param, opt, cachepath.c_str(), 0, model, in, out_tuned);
+
+    // every candidate kernel agrees with the default one
+    if (ret == 0)
+        ret = CompareMat(out, out_tuned, 0.01);
+
+    // the second load takes the choice from the cache file
+    FILE* fp = fopen(cachepath.c_str(), "rb");
+    if (ret == 0 && !fp)
+        ret = -1;
+    if (fp)
+        fclose(fp);
+
+    ncnn::Mat out_cached;
+    if (ret == 0)
+        ret = run_convolution_net(param, opt, cachepath.c_str(), 0, model, in, out_cached);
+
+    if (ret == 0)
+        ret = CompareMat(out_tuned, out_cached, 0.0001);
+
+    remove(cachepath.c_str());
+
+    if (ret != 0)
+    {
+        fprintf(stderr, "test_convolution_autotune failed\n");
+    }
+
+    return ret;
+}
+
+static int test_convolution_weight_cache()
+{
+    // 16 to 16 channels 3x3s1 keeps winograd weights
+    static const char* param = "7767517\n"
+                               "2 2\n"
+                               "Input data 0 1 data 0=20 1=20 2=16\n"
+                               "Convolution conv 1 1 data out 0=16 1=3 4=1 5=1 6=2304\n";
+
+    // same weights read with another stride
+    static const char* param_strided = "7767517\n"
+                                       "2 2\n"
+                                       "Input data 0 1 data 0=20 1=20 2=16\n"
+                                       "Convolution conv 1 1 data out 0=16 1=3 3=2 4=1 5=1 6=2304\n";
+
+    std::vector<unsigned char> model;
+    AppendModelWeights(model, 2304, 16);
+
+    ncnn::Mat in = RandomMat(20, 20, 16);
+
+    std::string cachepath = TempFilePath("test_convolution_weight_cache.bin");
+    remove(cachepath.c_str());
+
+    ncnn::Option opt;
+    opt.num_threads = 1;
+
+    ncnn::Mat out;
+    ncnn::Mat out_strided;
+    int ret = run_convolution_net(param, opt, 0, 0, model, in, out);
+    if (ret == 0)
+        ret = run_convolution_net(param_strided, opt, 0, 0, model, in, out_strided);
+
+    // the first load writes the cache, the second one restores from it
+    for (int i = 0; i < 2 && ret == 0; i++)
+    {
+        ncnn::Mat out_cached;
+        ret = run_convolution_net(param, opt, 0, cachepath.c_str(), model, in, out_cached);
+        if (ret == 0)
+            ret = CompareMat(out, out_cached, 0.001);
+    }
+
+    // edited params over the same weights miss the cache
+    ncnn::Mat out_strided_cached;
+    if (ret == 0)
+        ret = run_convolution_net(param_strided, opt, 0, cachepath.c_str(), model, in, out_strided_cached);
+    if (ret == 0)
+        ret = CompareMat(out_strided, out_strided_cached, 0.001);
+
+    remove(cachepath.c_str());
+
+    if (ret != 0)
+    {
+        fprintf(stderr, "test_convolution_weight_cache failed\n");
+    }
+
+    return ret;
+}
+#endif // NCNN_STDIO && NCNN_STRING
+
+static int test_convolution_4()
+{
+    return 0
+           || test_convolution_kernel_info(1, 1)
+           || test_convolution_kernel_info(3, 1)
+           || test_convolution_kernel_info(3, 0)
+           || test_convolution_kernel_info(5, 1)
+#if NCNN_STDIO && NCNN_STRING
+           || test_convolution_autotune()
+           || test_convolution_weight_cache()
+#endif
+           ;
+}
+
 int main()
 {
     SRAND(7767517);
@@ -427,11 +634,13 @@ int main()
            || test_convolution_0()
            || test_convolution_1()
            || test_convolution_2()
-           || test_convolution_3();
+           || test_convolution_3()
+           || test_convolution_4();
 #else
     return 0
            || test_convolution_0()
            || test_convolution_2()
-           || test_convolution_3();
+           || test_convolution_3()
+           || test_convolution_4();
 #endif
 }
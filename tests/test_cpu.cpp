@@ -2,6 +2,10 @@
 
 #include "cpu.h"
 
+#if defined __ANDROID__ || defined __linux__
+#include <sched.h>
+#endif
+
 #if defined __ANDROID__ || defined __linux__ || defined __APPLE__
 
 static int test_cpu_set()
@@ -101,6 +105,224 @@ static int test_cpu_powersave()
     }
 }
 
+static int test_cpu_numa()
+{
+    const int node_count = ncnn::get_numa_node_count();
+    if (node_count < 1)
+    {
+        fprintf(stderr, "There must be at least one numa node\n");
+        return 1;
+    }
+
+    int cpu_count = 0;
+    for (int i = 0; i < node_count; i++)
+    {
+        cpu_count += ncnn::get_numa_node_cpuset(i).num_enabled();
+    }
+
+    if (cpu_count < 1)
+    {
+        fprintf(stderr, "The numa nodes have no cpu\n");
+        return 1;
+    }
+
+    const int node = ncnn::get_current_numa_node();
+    if (node < 0 || node >= node_count)
+    {
+        fprintf(stderr, "The current numa node %d is out of range\n", node);
+        return 1;
+    }
+
+    return 0;
+}
+
+static int test_cpu_cache()
+{
+    const int l1 = ncnn::get_cpu_level1_cache_size();
+    const int l2 = ncnn::get_cpu_level2_cache_size();
+    const int l3 = ncnn::get_cpu_level3_cache_size();
+    if (l1 <= 0 || l2 <= 0 || l3 < 0)
+    {
+        fprintf(stderr, "cpu cache size l1 %d l2 %d l3 %d\n", l1, l2, l3);
+        return 1;
+    }
+
+    for (int i = 0; i < ncnn::get_cpu_count(); i++)
+    {
+        for (int level = 1; level <= 3; level++)
+        {
+            const int size = ncnn::get_cpu_cache_size(i, level);
+            const int shared_cpu_count = ncnn::get_cpu_cache_shared_cpu_count(i, level);
+            if (size < 0 || shared_cpu_count < 0 || shared_cpu_count > ncnn::get_cpu_count())
+            {
+                fprintf(stderr, "cpu %d level %d cache size %d shared by %d cpus\n", i, level, size, shared_cpu_count);
+                return 1;
+            }
+        }
+    }
+
+    if (ncnn::get_cpu_cache_size(-1, 1) != 0 || ncnn::get_cpu_cache_size(0, 4) != 0)
+    {
+        fprintf(stderr, "cpu cache size out of range should be 0\n");
+        return 1;
+    }
+
+    return 0;
+}
+
+static int test_cpu_partition()
+{
+    // a single partition spans all cores
+    const ncnn::CpuSet mask = ncnn::get_cpu_partition(0, 1);
+    const int cpu_count = mask.num_enabled();
+    if (cpu_count != ncnn::get_cpu_count())
+    {
+        fprintf(stderr, "cpu partition 0 of 1 has %d cpus out of %d\n", cpu_count, ncnn::get_cpu_count());
+        return 1;
+    }
+
+    for (int partition_count = 1; partition_count <= cpu_count; partition_count++)
+    {
+        ncnn::CpuSet visited;
+        visited.disable_all();
+
+        int total = 0;
+        for (int i = 0; i < partition_count; i++)
+        {
+            ncnn::CpuSet partition = ncnn::get_cpu_partition(i, partition_count);
+
+            const int n = partition.num_enabled();
+            if (n < cpu_count / partition_count || n > (cpu_count + partition_count - 1) / partition_count)
+            {
+                fprintf(stderr, "cpu partition %d of %d has %d cpus out of %d\n", i, partition_count, n, cpu_count);
+                return 1;
+            }
+
+            for (int j = 0; j < 1024; j++)
+            {
+                if (!partition.is_enabled(j))
+                    continue;
+
+                if (visited.is_enabled(j) || !mask.is_enabled(j))
+                {
+                    fprintf(stderr, "cpu partition %d of %d has unexpected cpu %d\n", i, partition_count, j);
+                    return 1;
+                }
+
+                visited.enable(j);
+            }
+
+            total += n;
+        }
+
+        if (total != cpu_count)
+        {
+            fprintf(stderr, "cpu partitions of %d cover %d cpus out of %d\n", partition_count, total, cpu_count);
+            return 1;
+        }
+    }
+
+    // more partitions than cpus share them
+    ncnn::CpuSet partition = ncnn::get_cpu_partition(cpu_count, cpu_count + 1);
+    if (partition.num_enabled() != 1)
+    {
+        fprintf(stderr, "cpu partition beyond cpu count has %d cpus\n", partition.num_enabled());
+        return 1;
+    }
+
+    return 0;
+}
+
+#if NCNN_THREADS
+struct current_thread_affinity_context
+{
+    ncnn::Mutex lock;
+    ncnn::ConditionVariable condition;
+    bool bound;
+    int cpu_count;
+};
+
+static void* current_thread_affinity_other(void* args)
+{
+    current_thread_affinity_context* ctx = (current_thread_affinity_context*)args;
+
+    // look at the own cores once the other thread got bound
+    ctx->lock.lock();
+    while (!ctx->bound)
+    {
+        ctx->condition.wait(ctx->lock);
+    }
+    ctx->lock.unlock();
+
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    if (sched_getaffinity(0, sizeof(cpu_set_t), &cpu_set) == 0)
+        ctx->cpu_count = CPU_COUNT(&cpu_set);
+
+    return 0;
+}
+
+static int test_cpu_current_thread_affinity()
+{
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    if (sched_getaffinity(0, sizeof(cpu_set_t), &cpu_set) != 0)
+        return 0;
+
+    ncnn::CpuSet mask;
+    ncnn::CpuSet single;
+    for (int i = 0; i < CPU_SETSIZE; i++)
+    {
+        if (!CPU_ISSET(i, &cpu_set))
+            continue;
+
+        if (mask.num_enabled() == 0)
+            single.enable(i);
+        mask.enable(i);
+    }
+
+    current_thread_affinity_context ctx;
+    ctx.bound = false;
+    ctx.cpu_count = 0;
+
+    ncnn::Thread other(current_thread_affinity_other, &ctx);
+
+    int ret = ncnn::set_cpu_current_thread_affinity(single);
+
+    ctx.lock.lock();
+    ctx.bound = true;
+    ctx.condition.signal();
+    ctx.lock.unlock();
+
+    other.join();
+
+    cpu_set_t bound_cpu_set;
+    CPU_ZERO(&bound_cpu_set);
+    sched_getaffinity(0, sizeof(cpu_set_t), &bound_cpu_set);
+
+    ncnn::set_cpu_current_thread_affinity(mask);
+
+    if (ret != 0 || CPU_COUNT(&bound_cpu_set) != 1)
+    {
+        fprintf(stderr, "The calling thread is bound to %d cpus instead of 1\n", CPU_COUNT(&bound_cpu_set));
+        return 1;
+    }
+
+    if (ctx.cpu_count != mask.num_enabled())
+    {
+        fprintf(stderr, "Another thread is bound to %d cpus instead of %d\n", ctx.cpu_count, mask.num_enabled());
+        return 1;
+    }
+
+    return 0;
+}
+#else
+static int test_cpu_current_thread_affinity()
+{
+    return 0;
+}
+#endif // NCNN_THREADS
+
 #else
 
 static int test_cpu_info()
@@ -108,6 +330,26 @@ static int test_cpu_info()
     return 0;
 }
 
+static int test_cpu_numa()
+{
+    return 0;
+}
+
+static int test_cpu_cache()
+{
+    return 0;
+}
+
+static int test_cpu_partition()
+{
+    return 0;
+}
+
+static int test_cpu_current_thread_affinity()
+{
+    return 0;
+}
+
 static int test_cpu_omp()
 {
     return 0;
@@ -125,6 +367,10 @@ int main()
     return 0
            || test_cpu_set()
            || test_cpu_info()
+           || test_cpu_numa()
+           || test_cpu_cache()
+           || test_cpu_partition()
+           || test_cpu_current_thread_affinity()
            || test_cpu_omp()
            || test_cpu_powersave();
 }
@@ -12,6 +12,7 @@
 // CONDITIONS OF ANY KIND, either express or implied. See the License for the
 // specific language governing permissions and limitations under the License.
 
+#include "benchmark.h"
 #include "layer/gemm.h"
 #include "testutil.h"
 
@@ -159,11 +160,45 @@ static int test_gemm_6()
            || test_gemm_bias(16, 24, 15, RandomMat(14), 1.7f, 1.3f, 1, 1);
 }
 
+static int test_gemm_workload(int M, int N, int K, int transA, int transB)
+{
+    ncnn::ParamDict pd;
+    pd.set(2, transA);
+    pd.set(3, transB);
+
+    ncnn::Layer* op = ncnn::create_layer("Gemm");
+    op->load_param(pd);
+
+    std::vector<ncnn::Mat> bottom_shapes(2);
+    bottom_shapes[0] = transA ? ncnn::Mat(M, K, (void*)0) : ncnn::Mat(K, M, (void*)0);
+    bottom_shapes[1] = transB ? ncnn::Mat(K, N, (void*)0) : ncnn::Mat(N, K, (void*)0);
+    std::vector<ncnn::Mat> top_shapes(1, ncnn::Mat(N, M, (void*)0));
+    ncnn::LayerWorkload workload = ncnn::estimate_layer_workload(op, bottom_shapes, top_shapes);
+
+    // A whose shape is unknown yet, K comes from B
+    bottom_shapes[0] = ncnn::Mat();
+    ncnn::LayerWorkload workload_b = ncnn::estimate_layer_workload(op, bottom_shapes, top_shapes);
+
+    delete op;
+
+    if (workload.macs != (uint64_t)M * N * K || workload_b.macs != (uint64_t)M * N * K)
+    {
+        fprintf(stderr, "test_gemm_workload failed M=%d N=%d K=%d transA=%d transB=%d macs=%d %d\n", M, N, K, transA, transB, (int)workload.macs, (int)workload_b.macs);
+        return -1;
+    }
+
+    return 0;
+}
+
 int main()
 {
     SRAND(7767517);
 
     return 0
+           || test_gemm_workload(13, 14, 15, 0, 0)
+           || test_gemm_workload(13, 14, 15, 1, 0)
+           || test_gemm_workload(13, 14, 15, 0, 1)
+           || test_gemm_workload(13, 14, 15, 1, 1)
            || test_gemm_0()
            || test_gemm_1()
            || test_gemm_2()
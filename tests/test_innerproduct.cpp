@@ -12,7 +12,11 @@
 // CONDITIONS OF ANY KIND, either express or implied. See the License for the
 // specific language governing permissions and limitations under the License.
 
+#include "benchmark.h"
+#include "datareader.h"
 #include "layer/innerproduct.h"
+#include "layer_type.h"
+#include "net.h"
 #include "testutil.h"
 
 static int test_innerproduct(const ncnn::Mat& a, int outch, int bias)
@@ -201,7 +205,8 @@ static int test_innerproduct_4()
            || test_innerproduct_gemm(RandomMat(15, 32), 32, 1)
            || test_innerproduct_gemm(RandomMat(16, 24), 32, 1)
            || test_innerproduct_gemm(RandomMat(17, 20), 32, 1)
-           || test_innerproduct_gemm(RandomMat(18, 14), 32, 1);
+           || test_innerproduct_gemm(RandomMat(18, 14), 32, 1)
+           || test_innerproduct_gemm(RandomMat(1024, 8), 1024, 1);
 }
 
 #if NCNN_INT8
@@ -256,12 +261,125 @@ static int test_innerproduct_5()
 }
 #endif // NCNN_INT8
 
+static int test_innerproduct_workload()
+{
+    ncnn::ParamDict pd;
+    pd.set(0, 16);         // num_output
+    pd.set(2, 16 * 9 * 4); // weight_data_size
+
+    ncnn::Layer* op = ncnn::create_layer("InnerProduct");
+    op->load_param(pd);
+
+    // gemm path with 5 rows of 36 inputs
+    std::vector<ncnn::Mat> bottom_shapes(1, ncnn::Mat(36, 5, (void*)0));
+    std::vector<ncnn::Mat> top_shapes(1, ncnn::Mat(16, 5, (void*)0));
+    ncnn::LayerWorkload workload = ncnn::estimate_layer_workload(op, bottom_shapes, top_shapes);
+
+    delete op;
+
+    if (workload.macs != 5 * 16 * 36 || workload.bytes_read != (5 * 36 + 16 * 36) * 4 || workload.bytes_written != 5 * 16 * 4)
+    {
+        fprintf(stderr, "test_innerproduct_workload failed macs=%d bytes_read=%d bytes_written=%d\n", (int)workload.macs, (int)workload.bytes_read, (int)workload.bytes_written);
+        return -1;
+    }
+
+    return 0;
+}
+
+#if NCNN_STRING
+static int test_innerproduct_batch()
+{
+    static const char* param = "7767517\n"
+                               "3 3\n"
+                               "Input data 0 1 data 0=8 1=8 2=3\n"
+                               "InnerProduct fc 1 1 data fc 0=16 1=1 2=3072\n"
+                               "ReLU relu 1 1 fc out\n";
+
+    std::vector<unsigned char> model;
+    AppendModelWeights(model, 3072, 16);
+
+    ncnn::Net net;
+    net.opt.num_threads = 1;
+    if (net.load_param_mem(param) != 0)
+        return -1;
+
+    const unsigned char* mem = &model[0];
+    ncnn::DataReaderFromMemory dr(mem);
+    if (net.load_model(dr) != 0)
+        return -1;
+
+    const int batch = 3;
+    std::vector<ncnn::Mat> ins(batch);
+    std::vector<ncnn::Mat> outs_single(batch);
+    for (int b = 0; b < batch; b++)
+    {
+        ins[b] = RandomMat(8, 8, 3);
+
+        ncnn::Extractor ex = net.create_extractor();
+        if (ex.input("data", ins[b]) != 0 || ex.extract("out", outs_single[b]) != 0)
+        {
+            fprintf(stderr, "test_innerproduct_batch single extract %d failed\n", b);
+            return -1;
+        }
+    }
+
+    ncnn::Extractor ex = net.create_extractor();
+    ex.set_profiling(true);
+
+    std::vector<ncnn::Mat> outs;
+    if (ex.input("data", ins) != 0 || ex.extract("out", outs) != 0 || (int)outs.size() != batch)
+    {
+        fprintf(stderr, "test_innerproduct_batch batched extract failed\n");
+        return -1;
+    }
+
+    for (int b = 0; b < batch; b++)
+    {
+        if (CompareMat(outs[b], outs_single[b], 0.001) != 0)
+        {
+            fprintf(stderr, "test_innerproduct_batch sample %d mismatch\n", b);
+            return -1;
+        }
+    }
+
+    // the whole batch went through innerproduct as one gemm with a row per sample
+    int fc_records = 0;
+    const std::vector<ncnn::LayerProfile>& records = ex.profile_records();
+    for (size_t i = 0; i < records.size(); i++)
+    {
+        if (records[i].typeindex != ncnn::LayerType::InnerProduct)
+            continue;
+
+        const ncnn::Mat& shape = records[i].bottom_shapes[0];
+        if (shape.dims != 2 || shape.h * shape.elempack != batch)
+        {
+            fprintf(stderr, "test_innerproduct_batch innerproduct not folded\n");
+            return -1;
+        }
+
+        fc_records++;
+    }
+
+    if (fc_records != 1)
+    {
+        fprintf(stderr, "test_innerproduct_batch innerproduct ran %d times\n", fc_records);
+        return -1;
+    }
+
+    return 0;
+}
+#endif // NCNN_STRING
+
 int main()
 {
     SRAND(7767517);
 
 #if NCNN_INT8
     return 0
+           || test_innerproduct_workload()
+#if NCNN_STRING
+           || test_innerproduct_batch()
+#endif
            || test_innerproduct_0()
            || test_innerproduct_1()
            || test_innerproduct_2()
@@ -270,6 +388,10 @@ int main()
            || test_innerproduct_5();
 #else
     return 0
+           || test_innerproduct_workload()
+#if NCNN_STRING
+           || test_innerproduct_batch()
+#endif
            || test_innerproduct_0()
            || test_innerproduct_1()
            || test_innerproduct_2()
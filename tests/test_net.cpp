@@ -0,0 +1,533 @@
+// Tencent is pleased to support the open source community by making ncnn available.
+//
+// Copyright (C) 2024 THL A29 Limited, a Tencent company. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this file except
+// in compliance with the License. You may obtain a copy of the License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software distributed
+// under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+// CONDITIONS OF ANY KIND, either express or implied. See the License for the
+// specific language governing permissions and limitations under the License.
+
+#include "benchmark.h"
+#include "datareader.h"
+#include "net.h"
+#include "testutil.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#if NCNN_STRING
+// fire module like graph, conv0 feeds two branches joined by concat
+static const char* net_param = "7767517\n"
+                               "8 9\n"
+                               "Input data 0 1 data 0=12 1=12 2=8\n"
+                               "Convolution conv0 1 1 data conv0 0=16 1=1 5=1 6=128 9=1\n"
+                               "Split split 1 2 conv0 conv0_0 conv0_1\n"
+                               "Convolution conv1 1 1 conv0_0 conv1 0=16 1=1 5=1 6=256 9=1\n"
+                               "Convolution conv2 1 1 conv0_1 conv2 0=16 1=3 4=1 5=1 6=2304 9=1\n"
+                               "Concat concat 2 1 conv1 conv2 cat\n"
+                               "Pooling pool 1 1 cat pool 0=1 4=1\n"
+                               "InnerProduct fc 1 1 pool out 0=10 1=1 2=320\n";
+
+static std::vector<unsigned char> make_net_model()
+{
+    std::vector<unsigned char> model;
+    AppendModelWeights(model, 128, 16);
+    AppendModelWeights(model, 256, 16);
+    AppendModelWeights(model, 2304, 16);
+    AppendModelWeights(model, 320, 10);
+    return model;
+}
+
+static int load_net(ncnn::Net& net, const std::vector<unsigned char>& model)
+{
+    if (net.load_param_mem(net_param) != 0)
+        return -1;
+
+    const unsigned char* mem = &model[0];
+    ncnn::DataReaderFromMemory dr(mem);
+    return net.load_model(dr);
+}
+
+static int extract_net(const ncnn::Net& net, const ncnn::Mat& in, ncnn::Mat& out)
+{
+    ncnn::Extractor ex = net.create_extractor();
+    if (ex.input("data", in) != 0)
+        return -1;
+
+    return ex.extract("out", out);
+}
+
+// output of the same model on a net with default options
+static int extract_reference(const std::vector<unsigned char>& model, const ncnn::Mat& in, ncnn::Mat& out)
+{
+    ncnn::Net net;
+    net.opt.num_threads = 1;
+    if (load_net(net, model) != 0)
+        return -1;
+
+    return extract_net(net, in, out);
+}
+
+static int test_net_memory_plan()
+{
+    std::vector<unsigned char> model = make_net_model();
+    ncnn::Mat in = RandomMat(12, 12, 8);
+
+    ncnn::Mat out_ref;
+    if (extract_reference(model, in, out_ref) != 0)
+        return -1;
+
+    ncnn::Net net;
+    net.opt.num_threads = 1;
+    net.opt.use_memory_plan = true;
+    if (load_net(net, model) != 0)
+        return -1;
+
+    // the first extractor records the plan, later ones replay it from the arena
+    size_t plan_size = 0;
+    for (int i = 0; i < 3; i++)
+    {
+        ncnn::Mat out;
+        if (extract_net(net, in, out) != 0 || CompareMat(out, out_ref, 0.001) != 0)
+        {
+            fprintf(stderr, "test_net_memory_plan extract %d mismatch\n", i);
+            return -1;
+        }
+
+        if (i == 0)
+            plan_size = net.memory_plan_size();
+
+        // a replay falling back to the heap or dropping the plan shows up here
+        if (plan_size == 0 || net.memory_plan_size() != plan_size || net.memory_plan_miss_count() != 0)
+        {
+            fprintf(stderr, "test_net_memory_plan replay %d missed the plan size=%d misses=%d\n", i, (int)net.memory_plan_size(), (int)net.memory_plan_miss_count());
+            return -1;
+        }
+    }
+
+    // another input shape misses the plan and records it again
+    ncnn::Mat in_large = RandomMat(16, 16, 8);
+    ncnn::Mat out_large;
+    if (extract_net(net, in_large, out_large) != 0 || net.memory_plan_miss_count() == 0)
+    {
+        fprintf(stderr, "test_net_memory_plan shape change not detected\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+static int test_net_branch_parallel()
+{
+    std::vector<unsigned char> model = make_net_model();
+    ncnn::Mat in = RandomMat(12, 12, 8);
+
+    ncnn::Mat out_ref;
+    if (extract_reference(model, in, out_ref) != 0)
+        return -1;
+
+    // the unlocked pools are serialized by the net while branches run
+    ncnn::UnlockedPoolAllocator blob_allocator;
+    ncnn::UnlockedPoolAllocator workspace_allocator;
+
+    ncnn::Net net;
+    net.opt.num_threads = 4;
+    net.opt.use_branch_parallel = true;
+    net.opt.blob_allocator = &blob_allocator;
+    net.opt.workspace_allocator = &workspace_allocator;
+    if (load_net(net, model) != 0)
+        return -1;
+
+    // the second extract reuses the pool threads
+    for (int i = 0; i < 2; i++)
+    {
+        ncnn::Mat out;
+        if (extract_net(net, in, out) != 0 || CompareMat(out, out_ref, 0.001) != 0)
+        {
+            fprintf(stderr, "test_net_branch_parallel extract %d mismatch\n", i);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+static int test_net_memory_plan_branch_parallel()
+{
+    std::vector<unsigned char> model = make_net_model();
+    ncnn::Mat in = RandomMat(12, 12, 8);
+
+    ncnn::Mat out_ref;
+    if (extract_reference(model, in, out_ref) != 0)
+        return -1;
+
+    ncnn::Net net;
+    net.opt.num_threads = 4;
+    net.opt.use_memory_plan = true;
+    net.opt.use_branch_parallel = true;
+    if (load_net(net, model) != 0)
+        return -1;
+
+    // branches finish in any order, the plan recorded first must survive the later extracts
+    size_t plan_size = 0;
+    for (int i = 0; i < 4; i++)
+    {
+        ncnn::Mat out;
+        if (extract_net(net, in, out) != 0 || CompareMat(out, out_ref, 0.001) != 0)
+        {
+            fprintf(stderr, "test_net_memory_plan_branch_parallel extract %d mismatch\n", i);
+            return -1;
+        }
+
+        if (i == 0)
+            plan_size = net.memory_plan_size();
+
+        if (plan_size == 0 || net.memory_plan_size() != plan_size)
+        {
+            fprintf(stderr, "test_net_memory_plan_branch_parallel plan lost after extract %d\n", i);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+static int test_net_batch()
+{
+    std::vector<unsigned char> model = make_net_model();
+
+    ncnn::Net net;
+    net.opt.num_threads = 1;
+    if (load_net(net, model) != 0)
+        return -1;
+
+    // batched extract should match the single sample result of every sample
+    const int batch = 3;
+    std::vector<ncnn::Mat> ins(batch);
+    std::vector<ncnn::Mat> outs_single(batch);
+    for (int b = 0; b < batch; b++)
+    {
+        ins[b] = RandomMat(12, 12, 8);
+
+        if (extract_net(net, ins[b], outs_single[b]) != 0)
+        {
+            fprintf(stderr, "test_net_batch single extract %d failed\n", b);
+            return -1;
+        }
+    }
+
+    ncnn::Extractor ex = net.create_extractor();
+
+    std::vector<ncnn::Mat> outs;
+    if (ex.input("data", ins) != 0 || ex.extract("out", outs) != 0 || (int)outs.size() != batch)
+    {
+        fprintf(stderr, "test_net_batch batched extract failed\n");
+        return -1;
+    }
+
+    for (int b = 0; b < batch; b++)
+    {
+        if (CompareMat(outs[b], outs_single[b], 0.001) != 0)
+        {
+            fprintf(stderr, "test_net_batch sample %d mismatch\n", b);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+static int test_net_async()
+{
+    std::vector<unsigned char> model = make_net_model();
+
+    ncnn::Net net;
+    net.opt.num_threads = 1;
+    if (load_net(net, model) != 0)
+        return -1;
+
+    std::vector<ncnn::Mat> ins(4);
+    std::vector<ncnn::Mat> outs_ref(4);
+    for (int i = 0; i < 4; i++)
+    {
+        ins[i] = RandomMat(12, 12, 8);
+
+        if (extract_net(net, ins[i], outs_ref[i]) != 0)
+            return -1;
+    }
+
+    // async requests on two workers should match the extractor result
+    ncnn::AsyncExtractor aex(&net, 2);
+
+    int ids[4];
+    for (int i = 0; i < 4; i++)
+    {
+        ids[i] = aex.submit(net.input_indexes()[0], ins[i], net.output_indexes()[0]);
+    }
+
+    int ret = 0;
+    for (int i = 0; i < 4; i++)
+    {
+        std::vector<ncnn::Mat> outs;
+        if (ids[i] < 0 || aex.wait(ids[i], outs) != 0 || outs.size() != 1 || CompareMat(outs[0], outs_ref[i], 0.001) != 0)
+        {
+            fprintf(stderr, "test_net_async request %d mismatch\n", i);
+            ret = -1;
+        }
+    }
+
+    return ret;
+}
+
+static int test_net_async_batching()
+{
+    std::vector<unsigned char> model = make_net_model();
+
+    ncnn::Net net;
+    net.opt.num_threads = 1;
+    if (load_net(net, model) != 0)
+        return -1;
+
+    std::vector<ncnn::Mat> ins(4);
+    std::vector<ncnn::Mat> outs_ref(4);
+    for (int i = 0; i < 4; i++)
+    {
+        ins[i] = RandomMat(12, 12, 8);
+
+        if (extract_net(net, ins[i], outs_ref[i]) != 0)
+            return -1;
+    }
+
+    // one worker waiting long enough pairs the four requests into two batches of 2
+    ncnn::AsyncExtractor aex(&net, 1, 4);
+    aex.set_dynamic_batching(2, 1000000);
+
+    int ids[4];
+    for (int i = 0; i < 4; i++)
+    {
+        ids[i] = aex.submit(net.input_indexes()[0], ins[i], net.output_indexes()[0]);
+    }
+
+    int ret = 0;
+    for (int i = 0; i < 4; i++)
+    {
+        std::vector<ncnn::Mat> outs;
+        if (ids[i] < 0 || aex.wait(ids[i], outs) != 0 || outs.size() != 1 || CompareMat(outs[0], outs_ref[i], 0.001) != 0)
+        {
+            fprintf(stderr, "test_net_async_batching request %d mismatch\n", i);
+            ret = -1;
+        }
+    }
+
+    std::vector<int> histogram;
+    aex.get_batch_histogram(histogram);
+    if (ret == 0 && (histogram.size() < 3 || histogram[2] != 2))
+    {
+        fprintf(stderr, "test_net_async_batching requests not batched in pairs\n");
+        ret = -1;
+    }
+
+    return ret;
+}
+
+static int test_net_parallel_load()
+{
+    std::vector<unsigned char> model = make_net_model();
+    ncnn::Mat in = RandomMat(12, 12, 8);
+
+    ncnn::Mat out_ref;
+    if (extract_reference(model, in, out_ref) != 0)
+        return -1;
+
+    // create pipelines on two threads while loading
+    ncnn::Net net;
+    net.opt.num_threads = 2;
+    net.opt.use_parallel_load = true;
+    if (load_net(net, model) != 0)
+    {
+        fprintf(stderr, "test_net_parallel_load load failed\n");
+        return -1;
+    }
+
+    ncnn::Mat out;
+    if (extract_net(net, in, out) != 0 || CompareMat(out, out_ref, 0.001) != 0)
+    {
+        fprintf(stderr, "test_net_parallel_load mismatch\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+static int test_net_adaptive_threads()
+{
+    std::vector<unsigned char> model = make_net_model();
+    ncnn::Mat in = RandomMat(12, 12, 8);
+
+    ncnn::Mat out_ref;
+    if (extract_reference(model, in, out_ref) != 0)
+        return -1;
+
+    ncnn::Net net;
+    net.opt.num_threads = 2;
+    net.opt.use_adaptive_threads = true;
+    if (load_net(net, model) != 0)
+        return -1;
+
+    // the first run picks the thread count of each layer, the second one uses it
+    for (int i = 0; i < 2; i++)
+    {
+        ncnn::Mat out;
+        if (extract_net(net, in, out) != 0 || CompareMat(out, out_ref, 0.001) != 0)
+        {
+            fprintf(stderr, "test_net_adaptive_threads extract %d mismatch\n", i);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+#if NCNN_STDIO
+static int test_net_mmap()
+{
+    std::vector<unsigned char> model = make_net_model();
+    ncnn::Mat in = RandomMat(12, 12, 8);
+
+    ncnn::Mat out_ref;
+    if (extract_reference(model, in, out_ref) != 0)
+        return -1;
+
+    std::string modelpath = TempFilePath("test_net_mmap.bin");
+
+    FILE* fp = fopen(modelpath.c_str(), "wb");
+    if (!fp)
+    {
+        fprintf(stderr, "test_net_mmap fopen %s failed\n", modelpath.c_str());
+        return -1;
+    }
+
+    int ret = fwrite(&model[0], 1, model.size(), fp) == model.size() ? 0 : -1;
+    fclose(fp);
+
+    // weights referenced from the mapped model file
+    {
+        ncnn::Net net;
+        net.opt.num_threads = 1;
+        if (ret == 0)
+            ret = net.load_param_mem(net_param);
+        if (ret == 0)
+            ret = net.load_model_mmap(modelpath.c_str());
+
+        ncnn::Mat out;
+        if (ret == 0)
+            ret = extract_net(net, in, out);
+        if (ret == 0)
+            ret = CompareMat(out, out_ref, 0.001);
+    }
+
+    remove(modelpath.c_str());
+
+    if (ret != 0)
+    {
+        fprintf(stderr, "test_net_mmap failed\n");
+    }
+
+    return ret;
+}
+
+static std::string read_file_string(const char* filepath)
+{
+    std::string s;
+
+    FILE* fp = fopen(filepath, "rb");
+    if (!fp)
+        return s;
+
+    char buf[4096];
+    size_t nread;
+    while ((nread = fread(buf, 1, sizeof(buf), fp)) > 0)
+    {
+        s.append(buf, nread);
+    }
+
+    fclose(fp);
+
+    return s;
+}
+
+static int test_net_trace()
+{
+    std::vector<unsigned char> model = make_net_model();
+    ncnn::Mat in = RandomMat(12, 12, 8);
+
+    ncnn::Net net;
+    net.opt.num_threads = 1;
+    if (load_net(net, model) != 0)
+        return -1;
+
+    std::string tracepath = TempFilePath("test_net_trace.json");
+
+    // every layer type shows up in the trace
+    ncnn::start_trace();
+
+    ncnn::Mat out;
+    int ret = extract_net(net, in, out);
+
+    if (ncnn::stop_trace(tracepath.c_str()) != 0)
+        ret = -1;
+
+    std::string trace = read_file_string(tracepath.c_str());
+    remove(tracepath.c_str());
+
+    static const char* types[] = {"Convolution", "Split", "Concat", "Pooling", "InnerProduct"};
+    if (ret == 0 && strncmp(trace.c_str(), "{\"displayTimeUnit\"", 18) != 0)
+        ret = -1;
+    for (int i = 0; i < 5 && ret == 0; i++)
+    {
+        std::string event = std::string("\"name\":\"") + types[i] + "\"";
+        if (!strstr(trace.c_str(), event.c_str()))
+        {
+            fprintf(stderr, "test_net_trace no %s event\n", types[i]);
+            ret = -1;
+        }
+    }
+
+    if (ret != 0)
+    {
+        fprintf(stderr, "test_net_trace failed\n");
+    }
+
+    return ret;
+}
+#endif // NCNN_STDIO
+#endif // NCNN_STRING
+
+int main()
+{
+    SRAND(7767517);
+
+#if NCNN_STRING
+    return 0
+           || test_net_memory_plan()
+           || test_net_branch_parallel()
+           || test_net_memory_plan_branch_parallel()
+           || test_net_batch()
+           || test_net_async()
+           || test_net_async_batching()
+           || test_net_parallel_load()
+           || test_net_adaptive_threads()
+#if NCNN_STDIO
+           || test_net_mmap()
+           || test_net_trace()
+#endif
+           ;
+#else
+    return 0;
+#endif
+}
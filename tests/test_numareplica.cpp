@@ -0,0 +1,272 @@
+// Tencent is pleased to support the open source community by making ncnn available.
+//
+// Copyright (C) 2024 THL A29 Limited, a Tencent company. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this file except
+// in compliance with the License. You may obtain a copy of the License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software distributed
+// under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+// CONDITIONS OF ANY KIND, either express or implied. See the License for the
+// specific language governing permissions and limitations under the License.
+
+#include "cpu.h"
+#include "datareader.h"
+#include "net.h"
+#include "testutil.h"
+
+#if (defined __ANDROID__ || defined __linux__) && NCNN_STRING
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static int write_sysfs_file(const char* path, const char* content)
+{
+    FILE* fp = fopen(path, "wb");
+    if (!fp)
+        return -1;
+
+    fputs(content, fp);
+    fclose(fp);
+
+    return 0;
+}
+
+// a sysfs tree with two numa nodes of the given cpus
+static int create_fake_sysfs(const char* root, const char* cpulist0, const char* cpulist1)
+{
+    char path[256];
+    sprintf(path, "%s/devices", root);
+    mkdir(path, 0755);
+    sprintf(path, "%s/devices/system", root);
+    mkdir(path, 0755);
+    sprintf(path, "%s/devices/system/node", root);
+    mkdir(path, 0755);
+    sprintf(path, "%s/devices/system/node/online", root);
+    if (write_sysfs_file(path, "0-1\n") != 0)
+        return -1;
+
+    for (int i = 0; i < 2; i++)
+    {
+        sprintf(path, "%s/devices/system/node/node%d", root, i);
+        mkdir(path, 0755);
+        sprintf(path, "%s/devices/system/node/node%d/cpulist", root, i);
+        if (write_sysfs_file(path, i == 0 ? cpulist0 : cpulist1) != 0)
+            return -1;
+    }
+
+    return 0;
+}
+
+static void remove_fake_sysfs(const char* root)
+{
+    char path[256];
+    for (int i = 0; i < 2; i++)
+    {
+        sprintf(path, "%s/devices/system/node/node%d/cpulist", root, i);
+        remove(path);
+        sprintf(path, "%s/devices/system/node/node%d", root, i);
+        rmdir(path);
+    }
+    sprintf(path, "%s/devices/system/node/online", root);
+    remove(path);
+    sprintf(path, "%s/devices/system/node", root);
+    rmdir(path);
+    sprintf(path, "%s/devices/system", root);
+    rmdir(path);
+    sprintf(path, "%s/devices", root);
+    rmdir(path);
+    rmdir(root);
+}
+
+static int test_numareplica_extract()
+{
+    static const char* param = "7767517\n"
+                               "4 4\n"
+                               "Input data 0 1 data 0=8 1=8 2=3\n"
+                               "Convolution conv 1 1 data conv 0=8 1=3 4=1 5=1 6=216\n"
+                               "ReLU relu 1 1 conv relu\n"
+                               "InnerProduct fc 1 1 relu out 0=10 1=1 2=5120\n";
+
+    std::vector<unsigned char> model;
+    AppendModelWeights(model, 216, 8);
+    AppendModelWeights(model, 5120, 10);
+
+    ncnn::Net net;
+    net.opt.num_threads = 1;
+    net.opt.use_numa_replica = true;
+    if (net.load_param_mem(param) != 0)
+        return -1;
+
+    const unsigned char* mem = &model[0];
+    ncnn::DataReaderFromMemory dr(mem);
+    if (net.load_model(dr) != 0)
+        return -1;
+
+    ncnn::Mat in = RandomMat(8, 8, 3);
+
+    // the loaded layers, the home node and the replica on the other node
+    ncnn::Mat outs[3];
+    for (int i = 0; i < 3; i++)
+    {
+        ncnn::Extractor ex = net.create_extractor();
+        ex.set_numa_node(i - 1);
+        if (ex.input("data", in) != 0 || ex.extract("out", outs[i]) != 0)
+        {
+            fprintf(stderr, "test_numareplica_extract numa node %d extract failed\n", i - 1);
+            return -1;
+        }
+    }
+
+    for (int i = 1; i < 3; i++)
+    {
+        if (CompareMat(outs[i], outs[0], 0.001) != 0)
+        {
+            fprintf(stderr, "test_numareplica_extract numa node %d mismatch\n", i - 1);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+// load and extract on a fake topology of two nodes
+static int test_numareplica_topology(const char* cpulist0, const char* cpulist1)
+{
+    char root[] = "/tmp/ncnn_numa_XXXXXX";
+    if (!mkdtemp(root))
+    {
+        fprintf(stderr, "test_numareplica mkdtemp failed\n");
+        return -1;
+    }
+
+    int ret = create_fake_sysfs(root, cpulist0, cpulist1);
+    if (ret == 0)
+        ret = ncnn::reload_numa_topology(root);
+
+    if (ret == 0 && ncnn::get_numa_node_count() != 2)
+    {
+        fprintf(stderr, "test_numareplica fake topology has %d nodes\n", ncnn::get_numa_node_count());
+        ret = -1;
+    }
+
+    if (ret == 0)
+        ret = test_numareplica_extract();
+
+    ncnn::reload_numa_topology("/sys");
+    remove_fake_sysfs(root);
+
+    return ret;
+}
+
+static int test_numareplica()
+{
+    // two nodes sharing cpu 0
+    return test_numareplica_topology("0\n", "0\n");
+}
+
+#if NCNN_SIMPLEOMP && defined(_OPENMP)
+static int current_thread_cpu_count()
+{
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    if (sched_getaffinity(0, sizeof(cpu_set_t), &cpu_set) != 0)
+        return -1;
+
+    return CPU_COUNT(&cpu_set);
+}
+
+static int test_numareplica_simpleomp()
+{
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    if (sched_getaffinity(0, sizeof(cpu_set_t), &cpu_set) != 0)
+        return 0;
+
+    // the first cpu on node 0, the others on node 1
+    char cpulist0[32] = "";
+    char cpulist1[1024] = "";
+    for (int i = 0; i < CPU_SETSIZE; i++)
+    {
+        if (!CPU_ISSET(i, &cpu_set))
+            continue;
+
+        if (cpulist0[0] == '\0')
+        {
+            sprintf(cpulist0, "%d", i);
+            continue;
+        }
+
+        if (strlen(cpulist1) + 8 < sizeof(cpulist1))
+            sprintf(cpulist1 + strlen(cpulist1), "%s%d", cpulist1[0] ? "," : "", i);
+    }
+
+    // a single cpu host puts both nodes on it
+    if (cpulist1[0] == '\0')
+        strcpy(cpulist1, cpulist0);
+
+    const int cpu_count = CPU_COUNT(&cpu_set);
+    const int num_threads = ncnn::get_omp_num_threads();
+
+    // start the pool threads before the replicas are loaded
+    std::vector<int> cpu_counts(num_threads, 0);
+    #pragma omp parallel num_threads(num_threads)
+    {
+        cpu_counts[ncnn::get_omp_thread_num()] = current_thread_cpu_count();
+    }
+
+    // the loaders pin themselves, with or without work stealing the shared pool threads keep their cores
+    int ret = test_numareplica_topology(cpulist0, cpulist1);
+
+    #pragma omp parallel num_threads(num_threads)
+    {
+        cpu_counts[ncnn::get_omp_thread_num()] = current_thread_cpu_count();
+    }
+
+    for (int i = 0; i < num_threads && ret == 0; i++)
+    {
+        if (cpu_counts[i] != cpu_count)
+        {
+            fprintf(stderr, "test_numareplica_simpleomp pool thread %d bound to %d cpus instead of %d\n", i, cpu_counts[i], cpu_count);
+            ret = -1;
+        }
+    }
+
+    if (ret == 0 && ncnn::get_omp_num_threads() != num_threads)
+    {
+        fprintf(stderr, "test_numareplica_simpleomp omp thread count changed to %d\n", ncnn::get_omp_num_threads());
+        ret = -1;
+    }
+
+    return ret;
+}
+#else
+static int test_numareplica_simpleomp()
+{
+    return 0;
+}
+#endif // NCNN_SIMPLEOMP && defined(_OPENMP)
+#else
+static int test_numareplica()
+{
+    return 0;
+}
+
+static int test_numareplica_simpleomp()
+{
+    return 0;
+}
+#endif
+
+int main()
+{
+    SRAND(7767517);
+
+    return 0
+           || test_numareplica()
+           || test_numareplica_simpleomp();
+}
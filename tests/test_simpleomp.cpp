@@ -0,0 +1,277 @@
+// Tencent is pleased to support the open source community by making ncnn available.
+//
+// Copyright (C) 2024 THL A29 Limited, a Tencent company. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this file except
+// in compliance with the License. You may obtain a copy of the License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software distributed
+// under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+// CONDITIONS OF ANY KIND, either express or implied. See the License for the
+// specific language governing permissions and limitations under the License.
+
+#include <stdio.h>
+#include <string.h>
+
+#include "cpu.h"
+#include "platform.h"
+
+#if NCNN_SIMPLEOMP
+#include "simpleomp.h"
+#endif
+
+// every iteration must run exactly once
+static int check_hits(const int* hits, int count, const char* name)
+{
+    for (int i = 0; i < count; i++)
+    {
+        if (hits[i] != 1)
+        {
+            fprintf(stderr, "%s iteration %d ran %d times\n", name, i, hits[i]);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+static int test_simpleomp_nested()
+{
+    int hits[16][32];
+    memset(hits, 0, sizeof(hits));
+
+    #pragma omp parallel for num_threads(4)
+    for (int i = 0; i < 16; i++)
+    {
+        #pragma omp parallel for num_threads(4)
+        for (int j = 0; j < 32; j++)
+        {
+            hits[i][j]++;
+        }
+    }
+
+    return check_hits(&hits[0][0], 16 * 32, "test_simpleomp_nested");
+}
+
+static int test_simpleomp_schedule()
+{
+    const int count = 1000;
+
+    int hits_dynamic[count];
+    int hits_guided[count];
+    int hits_reverse[count];
+    memset(hits_dynamic, 0, sizeof(hits_dynamic));
+    memset(hits_guided, 0, sizeof(hits_guided));
+    memset(hits_reverse, 0, sizeof(hits_reverse));
+
+    #pragma omp parallel num_threads(4)
+    {
+        #pragma omp for schedule(dynamic, 3) nowait
+        for (int i = 0; i < count; i++)
+        {
+            hits_dynamic[i]++;
+        }
+
+        #pragma omp for schedule(guided) nowait
+        for (int i = 0; i < count; i++)
+        {
+            hits_guided[i]++;
+        }
+
+        #pragma omp for schedule(dynamic) nowait
+        for (int i = count - 1; i >= 0; i -= 1)
+        {
+            hits_reverse[i]++;
+        }
+    }
+
+    int hits_combined[count];
+    memset(hits_combined, 0, sizeof(hits_combined));
+
+    #pragma omp parallel for num_threads(4) schedule(dynamic, 7)
+    for (int i = 0; i < count; i++)
+    {
+        hits_combined[i]++;
+    }
+
+    return 0
+           || check_hits(hits_dynamic, count, "test_simpleomp_schedule dynamic")
+           || check_hits(hits_guided, count, "test_simpleomp_schedule guided")
+           || check_hits(hits_reverse, count, "test_simpleomp_schedule reverse")
+           || check_hits(hits_combined, count, "test_simpleomp_schedule combined");
+}
+
+static int test_simpleomp_loop_end()
+{
+    // clang emits __kmpc_barrier for the implicit barrier, which simpleomp does not provide
+#if !(__clang__ && NCNN_SIMPLEOMP)
+    const int count = 256;
+
+    int values[count];
+    memset(values, 0, sizeof(values));
+
+    int missing[4] = {0, 0, 0, 0};
+
+    #pragma omp parallel num_threads(4)
+    {
+        #pragma omp for schedule(dynamic, 5)
+        for (int i = 0; i < count; i++)
+        {
+            values[i] = i + 1;
+        }
+
+        // every iteration has finished once past the loop
+        const int thread_num = ncnn::get_omp_thread_num();
+        for (int i = 0; i < count; i++)
+        {
+            if (values[i] != i + 1)
+                missing[thread_num]++;
+        }
+    }
+
+    for (int i = 0; i < 4; i++)
+    {
+        if (missing[i] != 0)
+        {
+            fprintf(stderr, "test_simpleomp_loop_end thread %d passed the loop with %d iterations pending\n", i, missing[i]);
+            return -1;
+        }
+    }
+#endif
+
+    return 0;
+}
+
+static int test_simpleomp_empty()
+{
+    int ran = 0;
+
+    #pragma omp parallel for num_threads(4)
+    for (int i = 0; i < 0; i++)
+    {
+        ran++;
+    }
+
+    #pragma omp parallel for num_threads(4) schedule(dynamic)
+    for (int i = 0; i < 0; i++)
+    {
+        ran++;
+    }
+
+    #pragma omp parallel for num_threads(4) schedule(guided)
+    for (int i = 5; i < 5; i++)
+    {
+        ran++;
+    }
+
+    if (ran != 0)
+    {
+        fprintf(stderr, "test_simpleomp_empty empty loops ran %d iterations\n", ran);
+        return -1;
+    }
+
+    // fewer iterations than threads
+    int hits[2] = {0, 0};
+
+    #pragma omp parallel for num_threads(8)
+    for (int i = 0; i < 2; i++)
+    {
+        hits[i]++;
+    }
+
+    int hits_dynamic[2] = {0, 0};
+
+    #pragma omp parallel for num_threads(8) schedule(dynamic)
+    for (int i = 0; i < 2; i++)
+    {
+        hits_dynamic[i]++;
+    }
+
+    return 0
+           || check_hits(hits, 2, "test_simpleomp_empty static")
+           || check_hits(hits_dynamic, 2, "test_simpleomp_empty dynamic");
+}
+
+#if NCNN_THREADS
+struct fork_context
+{
+    int index;
+    int sums[64];
+    int ret;
+};
+
+static void* fork_worker(void* args)
+{
+    fork_context* ctx = (fork_context*)args;
+
+    ctx->ret = 0;
+    for (int r = 0; r < 50; r++)
+    {
+        memset(ctx->sums, 0, sizeof(ctx->sums));
+
+        #pragma omp parallel for num_threads(4) schedule(dynamic, 2)
+        for (int i = 0; i < 64; i++)
+        {
+            int sum = 0;
+            for (int j = 0; j <= i; j++)
+            {
+                sum += j + ctx->index;
+            }
+            ctx->sums[i] = sum;
+        }
+
+        for (int i = 0; i < 64; i++)
+        {
+            if (ctx->sums[i] != i * (i + 1) / 2 + (i + 1) * ctx->index)
+                ctx->ret = -1;
+        }
+    }
+
+    return 0;
+}
+#endif // NCNN_THREADS
+
+static int test_simpleomp_concurrent_forks()
+{
+#if NCNN_THREADS
+    // parallel regions forked from several external threads at once share the pool
+    const int thread_count = 4;
+
+    fork_context ctxs[thread_count];
+    ncnn::Thread* threads[thread_count];
+    for (int i = 0; i < thread_count; i++)
+    {
+        ctxs[i].index = i;
+        threads[i] = new ncnn::Thread(fork_worker, (void*)&ctxs[i]);
+    }
+
+    int ret = 0;
+    for (int i = 0; i < thread_count; i++)
+    {
+        threads[i]->join();
+        delete threads[i];
+
+        if (ctxs[i].ret != 0)
+        {
+            fprintf(stderr, "test_simpleomp_concurrent_forks thread %d got wrong sums\n", i);
+            ret = -1;
+        }
+    }
+
+    return ret;
+#else
+    return 0;
+#endif
+}
+
+int main()
+{
+    return 0
+           || test_simpleomp_nested()
+           || test_simpleomp_schedule()
+           || test_simpleomp_loop_end()
+           || test_simpleomp_empty()
+           || test_simpleomp_concurrent_forks();
+}
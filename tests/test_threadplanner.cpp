@@ -0,0 +1,134 @@
+// Tencent is pleased to support the open source community by making ncnn available.
+//
+// Copyright (C) 2024 THL A29 Limited, a Tencent company. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this file except
+// in compliance with the License. You may obtain a copy of the License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software distributed
+// under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+// CONDITIONS OF ANY KIND, either express or implied. See the License for the
+// specific language governing permissions and limitations under the License.
+
+#include <stdio.h>
+
+#include "layer.h"
+#include "layer_type.h"
+#include "threadplanner.h"
+
+static int test_threadplanner_choose()
+{
+    const int num_threads = 4;
+
+    ncnn::LayerWorkload tiny;
+    tiny.macs = 0;
+    tiny.bytes_read = 64;
+    tiny.bytes_written = 64;
+
+    ncnn::LayerWorkload large;
+    large.macs = 10000000000ULL;
+    large.bytes_read = 1024 * 1024 * 1024;
+    large.bytes_written = 1024 * 1024 * 1024;
+
+    const int large_threads = ncnn::LayerThreadPlanner::choose(large, num_threads);
+    if (large_threads != num_threads)
+    {
+        fprintf(stderr, "test_threadplanner_choose large workload picks %d threads, expect %d\n", large_threads, num_threads);
+        return -1;
+    }
+
+    // without openmp there is no region cost and every layer keeps the full count
+    if (ncnn::get_parallel_cost(num_threads).region_ms > 0)
+    {
+        const int tiny_threads = ncnn::LayerThreadPlanner::choose(tiny, num_threads);
+        if (tiny_threads != 1)
+        {
+            fprintf(stderr, "test_threadplanner_choose tiny workload picks %d threads, expect 1\n", tiny_threads);
+            return -1;
+        }
+    }
+
+    const int single_threads = ncnn::LayerThreadPlanner::choose(large, 1);
+    if (single_threads != 1)
+    {
+        fprintf(stderr, "test_threadplanner_choose single thread picks %d threads\n", single_threads);
+        return -1;
+    }
+
+    return 0;
+}
+
+static int test_threadplanner_thread_counts()
+{
+    ncnn::Layer* relu = ncnn::create_layer(ncnn::LayerType::ReLU);
+    relu->bottoms.resize(1, 0);
+    relu->tops.resize(1, 1);
+
+    std::vector<ncnn::Mat> blob_mats(2);
+    blob_mats[0].create(8, 8, 4);
+    blob_mats[1].create(8, 8, 4);
+
+    ncnn::LayerThreadPlanner planner(1);
+
+    std::vector<ncnn::Mat> bottom_shapes;
+
+    int ret = 0;
+
+    // nothing chosen yet
+    if (planner.get(relu, 0, blob_mats, 4, bottom_shapes) != 0)
+    {
+        fprintf(stderr, "test_threadplanner_thread_counts unexpected choice before set\n");
+        ret = -1;
+    }
+    planner.set(relu, 0, bottom_shapes, blob_mats, 4);
+
+    const int threads4 = planner.get(relu, 0, blob_mats, 4, bottom_shapes);
+    if (ret == 0 && (threads4 < 1 || threads4 > 4))
+    {
+        fprintf(stderr, "test_threadplanner_thread_counts 4 threads choice %d out of range\n", threads4);
+        ret = -1;
+    }
+
+    // an extractor with another thread count makes its own choice
+    if (ret == 0 && planner.get(relu, 0, blob_mats, 2, bottom_shapes) != 0)
+    {
+        fprintf(stderr, "test_threadplanner_thread_counts 2 threads reuses the 4 threads choice\n");
+        ret = -1;
+    }
+    planner.set(relu, 0, bottom_shapes, blob_mats, 2);
+
+    const int threads2 = planner.get(relu, 0, blob_mats, 2, bottom_shapes);
+    if (ret == 0 && (threads2 < 1 || threads2 > 2))
+    {
+        fprintf(stderr, "test_threadplanner_thread_counts 2 threads choice %d out of range\n", threads2);
+        ret = -1;
+    }
+
+    // and leaves the others alone
+    if (ret == 0 && planner.get(relu, 0, blob_mats, 4, bottom_shapes) != threads4)
+    {
+        fprintf(stderr, "test_threadplanner_thread_counts 4 threads choice overwritten\n");
+        ret = -1;
+    }
+
+    // a new bottom shape opens the choice again
+    blob_mats[0].create(16, 16, 4);
+    if (ret == 0 && planner.get(relu, 0, blob_mats, 4, bottom_shapes) != 0)
+    {
+        fprintf(stderr, "test_threadplanner_thread_counts choice kept for another shape\n");
+        ret = -1;
+    }
+
+    delete relu;
+
+    return ret;
+}
+
+int main()
+{
+    return 0
+           || test_threadplanner_choose()
+           || test_threadplanner_thread_counts();
+}
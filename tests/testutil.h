@@ -23,6 +23,7 @@
 #include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #if NCNN_VULKAN
 #include "command.h"
@@ -342,6 +343,37 @@ static int CompareMat(const std::vector<ncnn::Mat>& a, const std::vector<ncnn::M
     return 0;
 }
 
+// a file under the temp directory, each test passes its own name
+static std::string TempFilePath(const char* name)
+{
+#ifdef _WIN32
+    const char* dir = getenv("TEMP");
+    if (!dir)
+        dir = ".";
+#else
+    const char* dir = getenv("TMPDIR");
+    if (!dir)
+        dir = "/tmp";
+#endif
+
+    std::string path = dir;
+    path += "/";
+    path += name;
+    return path;
+}
+
+// append the model bytes of one layer, fp32 weight tag and random weights, then random bias without tag
+static void AppendModelWeights(std::vector<unsigned char>& model, int weight_size, int bias_size)
+{
+    ncnn::Mat weight = RandomMat(weight_size);
+    ncnn::Mat bias = RandomMat(bias_size);
+
+    size_t offset = model.size();
+    model.resize(offset + 4 + (weight_size + bias_size) * sizeof(float), 0);
+    memcpy(&model[offset + 4], weight.data, weight_size * sizeof(float));
+    memcpy(&model[offset + 4 + weight_size * sizeof(float)], bias.data, bias_size * sizeof(float));
+}
+
 template<typename T>
 int test_layer_naive(int typeindex, const ncnn::ParamDict& pd, const std::vector<ncnn::Mat>& weights, const std::vector<ncnn::Mat>& a, int top_blob_count, std::vector<ncnn::Mat>& b, void (*func)(T*), int flag)
 {
@@ -0,0 +1,132 @@
+// Tencent is pleased to support the open source community by making ncnn available.
+//
+// Copyright (C) 2023 THL A29 Limited, a Tencent company. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this file except
+// in compliance with the License. You may obtain a copy of the License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software distributed
+// under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+// CONDITIONS OF ANY KIND, either express or implied. See the License for the
+// specific language governing permissions and limitations under the License.
+
+// print the kernel every layer picked in create_pipeline
+
+#include "datareader.h"
+#include "layer.h"
+#include "net.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+class DataReaderFromEmpty : public ncnn::DataReader
+{
+public:
+    virtual int scan(const char* /*format*/, void* /*p*/) const
+    {
+        return 0;
+    }
+    virtual size_t read(void* buf, size_t size) const
+    {
+        memset(buf, 0, size);
+        return size;
+    }
+};
+
+static int set_option(ncnn::Option& opt, const char* key, int value)
+{
+    if (strcmp(key, "num_threads") == 0)
+        opt.num_threads = value;
+    else if (strcmp(key, "use_packing_layout") == 0)
+        opt.use_packing_layout = value;
+    else if (strcmp(key, "use_fp16_storage") == 0)
+        opt.use_fp16_storage = value;
+    else if (strcmp(key, "use_bf16_storage") == 0)
+        opt.use_bf16_storage = value;
+    else if (strcmp(key, "use_int8_inference") == 0)
+        opt.use_int8_inference = value;
+    else if (strcmp(key, "use_sgemm_convolution") == 0)
+        opt.use_sgemm_convolution = value;
+    else if (strcmp(key, "use_winograd_convolution") == 0)
+        opt.use_winograd_convolution = value;
+    else if (strcmp(key, "use_winograd23_convolution") == 0)
+        opt.use_winograd23_convolution = value;
+    else if (strcmp(key, "use_winograd43_convolution") == 0)
+        opt.use_winograd43_convolution = value;
+    else if (strcmp(key, "use_winograd63_convolution") == 0)
+        opt.use_winograd63_convolution = value;
+    else
+        return -1;
+
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: %s [ncnnparam] [ncnnbin] [option=value]...\n", argv[0]);
+        fprintf(stderr, "  ncnnbin - loads zero weights, int8 kernels need the real bin\n");
+        fprintf(stderr, "  option  - num_threads use_packing_layout use_fp16_storage use_bf16_storage use_int8_inference\n");
+        fprintf(stderr, "            use_sgemm_convolution use_winograd_convolution use_winograd23/43/63_convolution\n");
+        fprintf(stderr, "  layers  - only x86 Convolution ConvolutionDepthWise InnerProduct and arm Convolution InnerProduct report\n");
+        fprintf(stderr, "            their kernel, other layers and architectures are counted but not listed\n");
+        return -1;
+    }
+
+    const char* parampath = argv[1];
+    const char* binpath = argc > 2 ? argv[2] : "-";
+
+    ncnn::Net net;
+    net.opt.use_vulkan_compute = false;
+
+    for (int i = 3; i < argc; i++)
+    {
+        char key[64];
+        int value = 0;
+        if (sscanf(argv[i], "%63[^=]=%d", key, &value) != 2 || set_option(net.opt, key, value) != 0)
+        {
+            fprintf(stderr, "unknown option %s\n", argv[i]);
+            return -1;
+        }
+    }
+
+    if (net.load_param(parampath) != 0)
+        return -1;
+
+    int ret = 0;
+    if (strcmp(binpath, "-") == 0)
+    {
+        DataReaderFromEmpty dr;
+        ret = net.load_model(dr);
+    }
+    else
+    {
+        ret = net.load_model(binpath);
+    }
+    if (ret != 0)
+        return -1;
+
+    fprintf(stdout, "%-5s %-24s %-30s %-18s %-12s %-10s %s\n", "index", "type", "name", "algorithm", "isa", "precision", "packing");
+
+    int reported_count = 0;
+    const std::vector<ncnn::Layer*>& layers = net.layers();
+    for (size_t i = 0; i < layers.size(); i++)
+    {
+        const ncnn::Layer* layer = layers[i];
+
+        ncnn::LayerKernelInfo info;
+        if (layer->get_kernel_info(info) != 0)
+            continue;
+
+        fprintf(stdout, "%-5d %-24s %-30s %-18s %-12s %-10s %d->%d\n", (int)i, layer->type.c_str(), layer->name.c_str(), info.algorithm, info.isa, info.precision, info.elempack, info.out_elempack);
+        reported_count++;
+    }
+
+    fprintf(stdout, "%d of %d layers report their kernel\n", reported_count, (int)layers.size());
+
+    return 0;
+}